@@ -0,0 +1,52 @@
+#include "alloc.h"
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/* smaller blocks fit in a few pages and are left to calloc */
+#define FIRST_TOUCH_MIN ((size_t)1 << 20)
+
+/* transparent huge page size with 4 KiB base pages */
+#define HUGE_PAGE ((size_t)2 << 20)
+
+/* alignment of the other blocks, one cache line */
+#define LINE_ALIGN 64
+
+static int alloc_mode = SIMUTIL_ALLOC_DEFAULT;
+
+void simutil_set_alloc_mode(int mode) {
+    __atomic_store_n(&alloc_mode, mode, __ATOMIC_RELAXED);
+}
+
+int simutil_get_alloc_mode(void) {
+    return __atomic_load_n(&alloc_mode, __ATOMIC_RELAXED);
+}
+
+void* __simutil_alloc(size_t size, size_t head, size_t nlines,
+                      size_t line_bytes) {
+    const int mode = simutil_get_alloc_mode();
+    if (mode == SIMUTIL_ALLOC_DEFAULT || size < FIRST_TOUCH_MIN)
+        return calloc(1, size);
+    const int huge = (mode & SIMUTIL_ALLOC_HUGEPAGES) && size >= HUGE_PAGE;
+    void* out = NULL;
+    if (posix_memalign(&out, huge ? HUGE_PAGE : LINE_ALIGN, size))
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    /* before the first touch, so the faults can map huge pages directly */
+    if (huge)
+        madvise(out, size, MADV_HUGEPAGE);
+#endif
+    char* bytes = (char*)out;
+    if (!(mode & SIMUTIL_ALLOC_FIRST_TOUCH)) {
+        memset(bytes, 0, size);
+        return out;
+    }
+    const size_t body = nlines * line_bytes;
+    memset(bytes, 0, head);
+#pragma omp parallel for schedule(static)
+    for (size_t l = 0; l < nlines; l++)
+        memset(bytes + head + l * line_bytes, 0, line_bytes);
+    memset(bytes + head + body, 0, size - head - body);
+    return out;
+}
@@ -0,0 +1,48 @@
+#ifndef SIMUTIL_ALLOC_H
+#define SIMUTIL_ALLOC_H
+
+#include "simutil_includes.h"
+
+/*
+ * How 'new_matrix' and 'new_matrix3' obtain their element storage. The modes
+ * are flags and can be combined.
+ *
+ * SIMUTIL_ALLOC_FIRST_TOUCH zeroes the storage lines from an OpenMP
+ * 'schedule(static)' loop, the split used by the parallel loops of the
+ * library, so that under the usual first-touch policy every page is placed
+ * on the NUMA node of the thread that will work on it.
+ *
+ * SIMUTIL_ALLOC_HUGEPAGES aligns large blocks to 2 MiB and asks for
+ * transparent huge pages with madvise, cutting TLB misses on large sweeps.
+ * It is a hint: with THP disabled the block uses normal pages.
+ */
+typedef enum {
+    SIMUTIL_ALLOC_DEFAULT = 0,
+    SIMUTIL_ALLOC_FIRST_TOUCH = 1,
+    SIMUTIL_ALLOC_HUGEPAGES = 2
+} simutil_alloc_mode_t;
+
+/**
+ * @brief Function to choose how matrices and matrix3s created from now on are
+ * allocated. Containers allocated before keep their pages.
+ *
+ * @param mode SIMUTIL_ALLOC_DEFAULT or a combination of the other flags
+ */
+SIMUTIL_API void simutil_set_alloc_mode(int mode);
+
+SIMUTIL_API int simutil_get_alloc_mode(void);
+
+/**
+ * @brief Function to allocate 'size' zeroed bytes that can be released with
+ * free(). The bytes from 'head' on hold 'nlines' storage lines of
+ * 'line_bytes' each, which are zeroed by the threads that own them.
+ *
+ * @param size Total size of the block
+ * @param head Offset of the first line
+ * @param nlines Number of lines
+ * @param line_bytes Size of a line
+ */
+SIMUTIL_API void* __simutil_alloc(size_t size, size_t head, size_t nlines,
+                                  size_t line_bytes);
+
+#endif
@@ -0,0 +1,501 @@
+#include "compress.h"
+#include "error.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/* edge of a block and values per block */
+#define EDGE 4
+#define BLOCK_LEN (EDGE * EDGE * EDGE)
+
+/*
+ * Header byte of a block: the low bits hold the residual width (0 to 64) or
+ * PALETTE + the index width; the high bit flags raw-bit (lossless) keys.
+ */
+#define CODE_MASK 0x7f
+#define LOSSLESS 0x80
+#define PALETTE 64
+
+/* most distinct keys of a palette block, indexed with up to 4 bits */
+#define PALETTE_MAX 16
+
+/* largest encoded block: header, first key, 63 residuals of 64 bits */
+#define BLOCK_MAX (1 + 8 + (BLOCK_LEN - 1) * 8)
+
+/* bytes after the stream that the bit reader may touch */
+#define STREAM_PAD 16
+
+/* decoded blocks kept per thread; a line of up to 4 * CACHE_SETS values
+ * along EXT3 stays cached while its neighbours along EXT2 are read */
+#define CACHE_SETS 128
+
+/* quantized values must stay exact in a double and far from overflow */
+#define QUANT_MAX 4503599627370496.0 /* 2^52 */
+
+struct cmatrix3 {
+    uint64_t id;
+    size_t ext[3];
+    size_t nb[3];
+    size_t nblocks;
+    double step;
+    size_t* off;
+    unsigned char* data;
+};
+
+typedef struct {
+    uint64_t owner;
+    size_t block;
+    double v[BLOCK_LEN];
+} cache_line;
+
+static _Thread_local cache_line cache[CACHE_SETS];
+
+/* identifies a compressed matrix3 in the caches, never reused */
+static uint64_t next_id = 0;
+
+static inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store64(unsigned char* p, uint64_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                   Keys                                   */
+/*                                                                          */
+/****************************************************************************/
+
+/* order-preserving integer of the bits of a double, and back */
+static inline uint64_t key_of(double x) {
+    uint64_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u >> 63) ? ~u : u | (UINT64_C(1) << 63);
+}
+
+static inline double value_of_key(uint64_t k) {
+    const uint64_t u = (k >> 63) ? k & ~(UINT64_C(1) << 63) : ~k;
+    double x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+static inline uint64_t zigzag(uint64_t r) {
+    return (r << 1) ^ (uint64_t)((int64_t)r >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t z) {
+    return (z >> 1) ^ (UINT64_C(0) - (z & 1));
+}
+
+/*
+ * Lorenzo prediction of key t of a block from its already known neighbours
+ * at lower indices; neighbours outside the block count as zero. Exact in
+ * wrapping arithmetic, so decoding reproduces the keys bit for bit.
+ */
+static inline uint64_t predict(const uint64_t* a, int t) {
+    const int x = t / (EDGE * EDGE), y = t / EDGE % EDGE, z = t % EDGE;
+    const int dx = EDGE * EDGE, dy = EDGE;
+#define A(cx, cy, cz, d) ((cx) && (cy) && (cz) ? a[t - (d)] : 0)
+    return A(x, 1, 1, dx) + A(1, y, 1, dy) + A(1, 1, z, 1) -
+           A(x, y, 1, dx + dy) - A(x, 1, z, dx + 1) - A(1, y, z, dy + 1) +
+           A(x, y, z, dx + dy + 1);
+#undef A
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Blocks                                  */
+/*                                                                          */
+/****************************************************************************/
+
+static inline void block_coords(const cmatrix3* cm, size_t b, size_t* c) {
+    c[2] = b % cm->nb[2] * EDGE;
+    c[1] = b / cm->nb[2] % cm->nb[1] * EDGE;
+    c[0] = b / (cm->nb[2] * cm->nb[1]) * EDGE;
+}
+
+/* values of a block, the parts beyond the matrix repeating its last plane */
+static void gather(const cmatrix3* cm, double*** src, size_t b, double* v) {
+    size_t c[3];
+    block_coords(cm, b, c);
+    for (int x = 0; x < EDGE; x++) {
+        const size_t i = c[0] + x < cm->ext[0] ? c[0] + x : cm->ext[0] - 1;
+        for (int y = 0; y < EDGE; y++) {
+            const size_t j = c[1] + y < cm->ext[1] ? c[1] + y : cm->ext[1] - 1;
+            const double* line = src[i + 1][j + 1] + 1;
+            for (int z = 0; z < EDGE; z++) {
+                const size_t k =
+                    c[2] + z < cm->ext[2] ? c[2] + z : cm->ext[2] - 1;
+                v[(x * EDGE + y) * EDGE + z] = line[k];
+            }
+        }
+    }
+}
+
+/* writes the values of a block that lie inside the matrix */
+static void scatter(const cmatrix3* cm, double*** dst, size_t b,
+                    const double* v) {
+    size_t c[3];
+    block_coords(cm, b, c);
+    for (size_t x = 0; x < EDGE && c[0] + x < cm->ext[0]; x++)
+        for (size_t y = 0; y < EDGE && c[1] + y < cm->ext[1]; y++) {
+            double* line = dst[c[0] + x + 1][c[1] + y + 1] + 1 + c[2];
+            for (size_t z = 0; z < EDGE && c[2] + z < cm->ext[2]; z++)
+                line[z] = v[(x * EDGE + y) * EDGE + z];
+        }
+}
+
+/*
+ * Keys of a block: values quantized to multiples of 'step' when every one
+ * of them comes back within 'tol', raw bits otherwise. Returns the flags
+ * of the header byte.
+ */
+static int block_keys(const double* v, double step, double tol, uint64_t* a) {
+    if (step > 0.0) {
+        int ok = 1;
+        for (int t = 0; t < BLOCK_LEN && ok; t++) {
+            const double q = nearbyint(v[t] / step);
+            /* rounded as 'decode' rounds it, not fused into the check */
+            volatile double back = q * step;
+            ok = fabs(q) < QUANT_MAX && fabs(back - v[t]) <= tol;
+            a[t] = (uint64_t)(int64_t)q;
+        }
+        if (ok)
+            return 0;
+    }
+    for (int t = 0; t < BLOCK_LEN; t++)
+        a[t] = key_of(v[t]);
+    return LOSSLESS;
+}
+
+/* packs 'n' values of 'w' bits (1 to 64) into 'p', returns the bytes used */
+static size_t pack(const uint64_t* z, int n, unsigned w, unsigned char* p) {
+    unsigned char* const start = p;
+    uint64_t acc = 0;
+    unsigned used = 0;
+    for (int t = 0; t < n; t++) {
+        acc |= z[t] << used;
+        if (used + w >= 64) {
+            store64(p, acc);
+            p += 8;
+            acc = used ? z[t] >> (64 - used) : 0;
+            used = used + w - 64;
+        } else
+            used += w;
+    }
+    store64(p, acc);
+    return (size_t)(p - start) + (used + 7) / 8;
+}
+
+/* reads back 'n' values packed by 'pack'; may read STREAM_PAD bytes past */
+static void unpack(const unsigned char* p, int n, unsigned w, uint64_t* z) {
+    const uint64_t mask = w < 64 ? (UINT64_C(1) << w) - 1 : ~UINT64_C(0);
+    size_t pos = 0;
+    for (int t = 0; t < n; t++, pos += w) {
+        const unsigned char* q = p + (pos >> 3);
+        const unsigned s = pos & 7;
+        uint64_t v = load64(q) >> s;
+        if (s + w > 64)
+            v |= (uint64_t)q[8] << (64 - s);
+        z[t] = v & mask;
+    }
+}
+
+/*
+ * Distinct keys of a block and the index of every key among them, or 0 when
+ * there are more than PALETTE_MAX.
+ */
+static int palette_of(const uint64_t* a, uint64_t* pal, uint64_t* idx) {
+    int m = 0;
+    for (int t = 0; t < BLOCK_LEN; t++) {
+        int p = 0;
+        while (p < m && pal[p] != a[t])
+            p++;
+        if (p == m) {
+            if (m == PALETTE_MAX)
+                return 0;
+            pal[m++] = a[t];
+        }
+        idx[t] = (uint64_t)p;
+    }
+    return m;
+}
+
+/*
+ * Encodes a block into 'out' and returns its size in bytes: either the
+ * first key and the bit-packed residuals of the others, or, when smaller,
+ * a palette of the distinct keys and bit-packed indices into it.
+ */
+static size_t encode(const double* v, double step, double tol,
+                     unsigned char* out) {
+    uint64_t a[BLOCK_LEN], z[BLOCK_LEN], idx[BLOCK_LEN], pal[PALETTE_MAX];
+    const int flags = block_keys(v, step, tol, a);
+    uint64_t any = 0;
+    for (int t = 1; t < BLOCK_LEN; t++) {
+        z[t] = zigzag(a[t] - predict(a, t));
+        any |= z[t];
+    }
+    const unsigned w = any ? 64 - (unsigned)__builtin_clzll(any) : 0;
+    const size_t size = 9 + ((BLOCK_LEN - 1) * w + 7) / 8;
+    const int m = w ? palette_of(a, pal, idx) : 0;
+    const unsigned k = m > 1 ? 32 - (unsigned)__builtin_clz(m - 1) : 1;
+    if (m && 2 + 8 * (size_t)m + (BLOCK_LEN * k + 7) / 8 < size) {
+        out[0] = (unsigned char)(flags | (PALETTE + k));
+        out[1] = (unsigned char)m;
+        for (int p = 0; p < m; p++)
+            store64(out + 2 + 8 * p, pal[p]);
+        return 2 + 8 * (size_t)m + pack(idx, BLOCK_LEN, k, out + 2 + 8 * m);
+    }
+    out[0] = (unsigned char)(flags | w);
+    store64(out + 1, a[0]);
+    return w ? 9 + pack(z + 1, BLOCK_LEN - 1, w, out + 9) : 9;
+}
+
+static void decode(const cmatrix3* cm, size_t b, double* v) {
+    const unsigned char* in = cm->data + cm->off[b];
+    const unsigned code = in[0] & CODE_MASK;
+    uint64_t a[BLOCK_LEN];
+    if (code > PALETTE) {
+        const int m = in[1];
+        uint64_t idx[BLOCK_LEN];
+        unpack(in + 2 + 8 * m, BLOCK_LEN, code - PALETTE, idx);
+        for (int t = 0; t < BLOCK_LEN; t++)
+            a[t] = load64(in + 2 + 8 * idx[t]);
+    } else {
+        uint64_t z[BLOCK_LEN] = {0};
+        a[0] = load64(in + 1);
+        if (code)
+            unpack(in + 9, BLOCK_LEN - 1, code, z + 1);
+        for (int t = 1; t < BLOCK_LEN; t++)
+            a[t] = predict(a, t) + unzigzag(z[t]);
+    }
+    if (in[0] & LOSSLESS)
+        for (int t = 0; t < BLOCK_LEN; t++)
+            v[t] = value_of_key(a[t]);
+    else
+        for (int t = 0; t < BLOCK_LEN; t++)
+            v[t] = (double)(int64_t)a[t] * cm->step;
+}
+
+/* decoded values of a block through the calling thread's cache */
+static const double* cached(const cmatrix3* cm, size_t b) {
+    cache_line* line = &cache[b % CACHE_SETS];
+    if (line->owner != cm->id || line->block != b) {
+        decode(cm, b, line->v);
+        line->owner = cm->id;
+        line->block = b;
+    }
+    return line->v;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                        Compression and Decoding                          */
+/*                                                                          */
+/****************************************************************************/
+
+cmatrix3* __compress_lines3(double*** src, const size_t* ext,
+                            size_t elem_size, double tol) {
+    if (elem_size != sizeof(double)) {
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Expected double elements @ compress_matrix3!\n");
+        return NULL;
+    }
+    if (!(tol >= 0.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Negative error bound @ compress_matrix3!\n");
+        return NULL;
+    }
+    cmatrix3* cm = calloc(1, sizeof(cmatrix3));
+    if (!cm)
+        goto fail;
+    cm->id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    cm->nblocks = 1;
+    for (int a = 0; a < 3; a++) {
+        cm->ext[a] = ext[a];
+        cm->nb[a] = (ext[a] + EDGE - 1) / EDGE;
+        cm->nblocks *= cm->nb[a];
+    }
+    /* rounding to multiples of twice the bound keeps it, up to the check */
+    cm->step = 2.0 * tol;
+    cm->off = malloc((cm->nblocks + 1) * sizeof(size_t));
+    if (!cm->off)
+        goto fail;
+    const size_t nb = cm->nblocks;
+    const int par = nb * BLOCK_LEN >= SIMUTIL_PAR_MIN;
+
+    /* sizes first, so every block can then be written at its final place */
+    cm->off[0] = 0;
+#pragma omp parallel for schedule(static) if (par)
+    for (size_t b = 0; b < nb; b++) {
+        double v[BLOCK_LEN];
+        unsigned char buf[BLOCK_MAX + 8];
+        gather(cm, src, b, v);
+        cm->off[b + 1] = encode(v, cm->step, tol, buf);
+    }
+    for (size_t b = 0; b < nb; b++)
+        cm->off[b + 1] += cm->off[b];
+    cm->data = malloc(cm->off[nb] + STREAM_PAD);
+    if (!cm->data)
+        goto fail;
+    memset(cm->data + cm->off[nb], 0, STREAM_PAD);
+#pragma omp parallel for schedule(static) if (par)
+    for (size_t b = 0; b < nb; b++) {
+        double v[BLOCK_LEN];
+        unsigned char buf[BLOCK_MAX + 8];
+        gather(cm, src, b, v);
+        memcpy(cm->data + cm->off[b], buf, encode(v, cm->step, tol, buf));
+    }
+    return cm;
+
+fail:
+    raise_error(SIMUTIL_ALLOCATE_ERROR,
+                "Failed to allocate compressed data @ compress_matrix3!\n");
+    free_cmatrix3(cm);
+    return NULL;
+}
+
+void free_cmatrix3(cmatrix3* cm) {
+    if (!cm)
+        return;
+    free(cm->off);
+    free(cm->data);
+    free(cm);
+}
+
+void __decompress_lines3(double*** dst, const size_t* ext,
+                         const cmatrix3* cm) {
+    if (ext[0] != cm->ext[0] || ext[1] != cm->ext[1] || ext[2] != cm->ext[2]) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching matrix3 shape @ decompress_matrix3!\n");
+        return;
+    }
+    const size_t nb = cm->nblocks;
+#pragma omp parallel for schedule(static) if (nb * BLOCK_LEN >= SIMUTIL_PAR_MIN)
+    for (size_t b = 0; b < nb; b++) {
+        double v[BLOCK_LEN];
+        decode(cm, b, v);
+        scatter(cm, dst, b, v);
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Access                                  */
+/*                                                                          */
+/****************************************************************************/
+
+double cmatrix3_get(const cmatrix3* cm, size_t i, size_t j, size_t k) {
+    i--;
+    j--;
+    k--;
+    const size_t b =
+        ((i / EDGE) * cm->nb[1] + j / EDGE) * cm->nb[2] + k / EDGE;
+    return cached(cm, b)[((i % EDGE) * EDGE + j % EDGE) * EDGE + k % EDGE];
+}
+
+void __cmatrix3_line(double* out, size_t n, const cmatrix3* cm, size_t i,
+                     size_t j) {
+    if (n != cm->ext[2] || i < 1 || i > cm->ext[0] || j < 1 ||
+        j > cm->ext[1]) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Line out of range @ cmatrix3_line!\n");
+        return;
+    }
+    i--;
+    j--;
+    const size_t row = ((i / EDGE) * cm->nb[1] + j / EDGE) * cm->nb[2];
+    const size_t t0 = ((i % EDGE) * EDGE + j % EDGE) * EDGE;
+    for (size_t b3 = 0; b3 < cm->nb[2]; b3++) {
+        const double* v = cached(cm, row + b3);
+        for (size_t z = 0; z < EDGE && b3 * EDGE + z < n; z++)
+            out[b3 * EDGE + z] = v[t0 + z];
+    }
+}
+
+size_t cmatrix3_ext(const cmatrix3* cm, int axis) {
+    if (axis < 1 || axis > 3) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Invalid axis @ cmatrix3_ext!\n");
+        return 0;
+    }
+    return cm->ext[axis - 1];
+}
+
+size_t cmatrix3_bytes(const cmatrix3* cm) {
+    return sizeof(cmatrix3) + (cm->nblocks + 1) * sizeof(size_t) +
+           cm->off[cm->nblocks] + STREAM_PAD;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Statistics                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Statistics of one row of blocks along EXT3, decoded into 'buf': the sum
+ * and extrema, then the squared deviations from the row mean.
+ */
+static stats_running row_stats(const cmatrix3* cm, size_t row, double* buf) {
+    size_t n = 0;
+    for (size_t b3 = 0; b3 < cm->nb[2]; b3++) {
+        const size_t b = row * cm->nb[2] + b3;
+        size_t c[3];
+        double v[BLOCK_LEN];
+        block_coords(cm, b, c);
+        decode(cm, b, v);
+        for (size_t x = 0; x < EDGE && c[0] + x < cm->ext[0]; x++)
+            for (size_t y = 0; y < EDGE && c[1] + y < cm->ext[1]; y++)
+                for (size_t z = 0; z < EDGE && c[2] + z < cm->ext[2]; z++)
+                    buf[n++] = v[(x * EDGE + y) * EDGE + z];
+    }
+    stats_running s = {n, 0.0, 0.0, INFINITY, -INFINITY};
+    double sum = 0.0;
+    for (size_t t = 0; t < n; t++) {
+        sum += buf[t];
+        s.min = buf[t] < s.min ? buf[t] : s.min;
+        s.max = buf[t] > s.max ? buf[t] : s.max;
+    }
+    s.mean = sum / (double)n;
+    for (size_t t = 0; t < n; t++)
+        s.m2 += (buf[t] - s.mean) * (buf[t] - s.mean);
+    return s;
+}
+
+/* per-row results are merged in row order, for any number of threads */
+void stats_update_cmatrix3(stats_running* s, const cmatrix3* cm) {
+    const size_t nrow = cm->nb[0] * cm->nb[1];
+    if (cm->nblocks == 0)
+        return;
+    stats_running* part = malloc(nrow * sizeof(stats_running));
+    if (!part) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate results @ stats_update_cmatrix3!\n");
+        return;
+    }
+    int failed = 0;
+#pragma omp parallel if (cm->nblocks * BLOCK_LEN >= SIMUTIL_PAR_MIN)
+    {
+        double* buf = malloc(cm->nb[2] * BLOCK_LEN * sizeof(double));
+        if (!buf) {
+#pragma omp atomic write
+            failed = 1;
+        }
+#pragma omp for schedule(static)
+        for (size_t row = 0; row < nrow; row++)
+            if (buf)
+                part[row] = row_stats(cm, row, buf);
+        free(buf);
+    }
+    if (failed)
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate buffers @ stats_update_cmatrix3!\n");
+    else
+        for (size_t row = 0; row < nrow; row++)
+            stats_merge(s, &part[row]);
+    free(part);
+}
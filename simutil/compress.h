@@ -0,0 +1,145 @@
+#ifndef SIMUTIL_COMPRESS_H
+#define SIMUTIL_COMPRESS_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+#ifndef SIMUTIL_STATS_H
+#include "stats.h"
+#endif
+
+/**
+ * @brief Opaque read-only copy of a 'matrix3(double)' encoded in 4 x 4 x 4
+ * blocks. Every block is predicted from its own earlier values and the
+ * residuals are bit-packed at the width the block needs, so constant and
+ * smooth regions shrink most. Values are decoded on access through a small
+ * per-thread cache of blocks; all read functions are thread-safe.
+ *
+ */
+typedef struct cmatrix3 cmatrix3;
+
+SIMUTIL_API cmatrix3* __compress_lines3(double*** src, const size_t* ext,
+                                        size_t elem_size, double tol);
+
+SIMUTIL_API void __decompress_lines3(double*** dst, const size_t* ext,
+                                     const cmatrix3* cm);
+
+SIMUTIL_API void __cmatrix3_line(double* out, size_t n, const cmatrix3* cm,
+                                 size_t i, size_t j);
+
+/**
+ * @brief Function to release a compressed matrix3.
+ *
+ * @param cm Compressed matrix3
+ */
+SIMUTIL_API void free_cmatrix3(cmatrix3* cm);
+
+/**
+ * @brief Function to read one element of a compressed matrix3, indexed like
+ * 'mat3[i][j][k]' of the matrix it was made from.
+ *
+ * @param cm Compressed matrix3
+ * @param i Index along MATRIX3_EXT1, from 1
+ * @param j Index along MATRIX3_EXT2, from 1
+ * @param k Index along MATRIX3_EXT3, from 1
+ */
+SIMUTIL_API double cmatrix3_get(const cmatrix3* cm, size_t i, size_t j,
+                                size_t k);
+
+/**
+ * @brief Function to get a storage extent of a compressed matrix3, as
+ * MATRIX3_EXT1/2/3 of the matrix it was made from.
+ *
+ * @param cm Compressed matrix3
+ * @param axis 1, 2 or 3
+ */
+SIMUTIL_API size_t cmatrix3_ext(const cmatrix3* cm, int axis);
+
+/**
+ * @brief Function to get the memory held by a compressed matrix3 in bytes,
+ * block index included.
+ *
+ * @param cm Compressed matrix3
+ */
+SIMUTIL_API size_t cmatrix3_bytes(const cmatrix3* cm);
+
+/**
+ * @brief Function to add every element of a compressed matrix3 to a running
+ * state, decoding blocks in parallel. The result does not depend on the
+ * number of threads.
+ *
+ * @param s Pointer to the running state
+ * @param cm Compressed matrix3
+ */
+SIMUTIL_API void stats_update_cmatrix3(stats_running* s, const cmatrix3* cm);
+
+#define __COMPRESS_CHECK_DOUBLE(x, name)                                       \
+    do {                                                                       \
+        if (sizeof(x) != sizeof(double)) {                                     \
+            raise_error(SIMUTIL_TYPE_ERROR,                                    \
+                        "Expected double elements @ " name "!\n");             \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+    } while (0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                        Compression and Decoding                          */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to compress a 'matrix3(double)'. With 'tol' 0 the encoding is
+ * lossless, bit for bit, NaNs and signed zeros included. With 'tol' > 0 every
+ * value is stored within 'tol' of the original, which compresses smooth
+ * fields much further; blocks holding values the bound cannot represent
+ * (infinities, NaNs, huge magnitudes) are kept lossless. Returns NULL on
+ * failure.
+ *
+ * @param mat3 'matrix3(double)' to compress, left unchanged
+ * @param tol Absolute error bound, or 0
+ */
+#define compress_matrix3(mat3, tol)                                            \
+    __compress_lines3(                                                         \
+        (double***)(mat3),                                                     \
+        (const size_t[3]){MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),              \
+                          MATRIX3_EXT3(mat3)},                                 \
+        sizeof(***(mat3)), (tol))
+
+/**
+ * @brief Macro to decode a compressed matrix3 into a 'matrix3(double)' of
+ * the same shape and layout as the one it was made from.
+ *
+ * @param dst Target 'matrix3(double)'
+ * @param cm Compressed matrix3
+ */
+#define decompress_matrix3(dst, cm)                                            \
+    do {                                                                       \
+        __COMPRESS_CHECK_DOUBLE(***(dst), "decompress_matrix3");               \
+        __decompress_lines3((double***)(dst),                                  \
+                            (const size_t[3]){MATRIX3_EXT1(dst),               \
+                                              MATRIX3_EXT2(dst),               \
+                                              MATRIX3_EXT3(dst)},              \
+                            (cm));                                             \
+    } while (0)
+
+/**
+ * @brief Macro to decode the line 'mat3[i][j][1..EXT3]' of a compressed
+ * matrix3 into a vector of its length.
+ *
+ * @param vec 'vector(double)' of length cmatrix3_ext(cm, 3)
+ * @param cm Compressed matrix3
+ * @param i Index along MATRIX3_EXT1, from 1
+ * @param j Index along MATRIX3_EXT2, from 1
+ */
+#define cmatrix3_line(vec, cm, i, j)                                           \
+    do {                                                                       \
+        __COMPRESS_CHECK_DOUBLE(*(vec), "cmatrix3_line");                      \
+        __cmatrix3_line((double*)(vec) + 1, (size_t)LENGTH(vec), (cm), (i),    \
+                        (j));                                                  \
+    } while (0)
+
+#endif
@@ -0,0 +1,602 @@
+#include "domain.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* polls before a waiting rank gives its core to another process */
+#define SPIN_TRIES 64
+
+/* polls between checks that an attached segment still carries its name */
+#define RECHECK_TRIES 1024
+
+/* milliseconds a rank waits for rank 0 to create the shared memory */
+#define ATTACH_TIMEOUT_MS 30000
+
+/* every subdomain block starts on its own page, so its owner places it */
+#define PAGE 4096
+
+/* longest shared memory name, with the field suffix */
+#define NAME_LEN 256
+
+/*
+ * Per-rank exchange counters and attach handshake, one cache line each: a
+ * rank posts 'token' and rank 0 echoes it in 'ack'
+ */
+typedef struct {
+    uint64_t ready;
+    uint64_t pulled;
+    uint64_t token;
+    uint64_t ack;
+    char pad[32];
+} slot;
+
+typedef struct {
+    uint64_t nranks;
+    uint64_t bar_count;
+    uint64_t bar_gen;
+    char pad[40];
+    slot slots[];
+} control;
+
+typedef struct {
+    void* view;
+    char* base;
+    size_t bytes;
+    size_t elem_size;
+    int id;
+} field;
+
+typedef struct {
+    int rank;
+    int dir[3];
+} neighbor;
+
+struct domain {
+    domain_geometry geo;
+    char name[NAME_LEN];
+    int depth;
+    int lines_are_cols;
+    /* user axis of every storage axis, outermost first; -1 if unused */
+    int smap[3];
+    control* ctl;
+    size_t ctl_bytes;
+    uint64_t seq;
+    int nnbr;
+    neighbor nbr[26];
+    field* fields;
+    int nfields;
+    int next_id;
+};
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Shared Memory                               */
+/*                                                                          */
+/****************************************************************************/
+
+static void relax(int* spins) {
+    if (++*spins >= SPIN_TRIES) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void wait_at_least(uint64_t* p, uint64_t v) {
+    int spins = 0;
+    while (__atomic_load_n(p, __ATOMIC_ACQUIRE) < v)
+        relax(&spins);
+}
+
+static void sleep_ms(void) {
+    const struct timespec ts = {0, 1000000};
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * Rank 0 replaces any leftover segment by a new one of 'bytes'; the others
+ * wait for one to appear with that size and, if 'id' is given, store its
+ * identity there. Returns the mapping, or NULL.
+ */
+static void* map_segment(const char* name, size_t bytes, int create,
+                         struct stat* id) {
+    int fd = -1;
+    if (create) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd >= 0 && ftruncate(fd, (off_t)bytes) != 0) {
+            close(fd);
+            shm_unlink(name);
+            fd = -1;
+        }
+    } else {
+        for (int t = 0; t < ATTACH_TIMEOUT_MS; t++) {
+            struct stat st;
+            if (fd < 0)
+                fd = shm_open(name, O_RDWR, 0600);
+            if (fd >= 0 && fstat(fd, &st) == 0 &&
+                (size_t)st.st_size == bytes) {
+                if (id)
+                    *id = st;
+                break;
+            }
+            if (fd < 0 && errno != ENOENT)
+                break;
+            sleep_ms();
+        }
+    }
+    if (fd < 0)
+        return NULL;
+    void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* whether 'name' still refers to the segment identified by 'id' */
+static int same_segment(const char* name, const struct stat* id) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    const int same = fstat(fd, &st) == 0 && st.st_dev == id->st_dev &&
+                     st.st_ino == id->st_ino;
+    close(fd);
+    return same;
+}
+
+/* a token that no other attach, of this or an earlier run, has used */
+static uint64_t new_token(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t ns =
+        (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    return ((uint64_t)getpid() << 40 ^ ns) | 1;
+}
+
+/*
+ * A segment left by a crashed run may still carry the name when a rank
+ * attaches, looking complete. Every rank therefore posts a new token in its
+ * slot and waits until rank 0 echoes it, which only happens in the segment
+ * rank 0 created. A rank that sees the name move to another segment while it
+ * waits attaches again.
+ */
+static control* attach_control(const char* name, size_t bytes, int rank) {
+    const uint64_t token = new_token();
+    for (;;) {
+        struct stat id;
+        control* ctl = map_segment(name, bytes, 0, &id);
+        if (!ctl)
+            return NULL;
+        slot* me = &ctl->slots[rank];
+        __atomic_store_n(&me->token, token, __ATOMIC_RELEASE);
+        int spins = 0;
+        for (size_t polls = 1;; polls++) {
+            if (__atomic_load_n(&me->ack, __ATOMIC_ACQUIRE) == token)
+                return ctl;
+            if (polls % RECHECK_TRIES == 0 && !same_segment(name, &id))
+                break;
+            relax(&spins);
+        }
+        munmap(ctl, bytes);
+    }
+}
+
+/* rank 0: echo the token of every other rank once it has attached */
+static void accept_ranks(control* ctl, int nranks) {
+    for (int r = 1; r < nranks; r++) {
+        slot* s = &ctl->slots[r];
+        uint64_t token;
+        int spins = 0;
+        while (!(token = __atomic_load_n(&s->token, __ATOMIC_ACQUIRE)))
+            relax(&spins);
+        __atomic_store_n(&s->ack, token, __ATOMIC_RELEASE);
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Geometry                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static int rank_of(const domain* dom, const int* c) {
+    const int* p = dom->geo.procs;
+    return c[0] + p[0] * (c[1] + p[1] * c[2]);
+}
+
+static void coords_of(const domain* dom, int rank, int* c) {
+    const int* p = dom->geo.procs;
+    c[0] = rank % p[0];
+    c[1] = rank / p[0] % p[1];
+    c[2] = rank / (p[0] * p[1]);
+}
+
+/* interior cells of coordinate c along user axis a, and the first one */
+static size_t split(const domain* dom, int a, int c, size_t* lo) {
+    const size_t q = dom->geo.global[a] / (size_t)dom->geo.procs[a];
+    const size_t r = dom->geo.global[a] % (size_t)dom->geo.procs[a];
+    if (lo)
+        *lo = (size_t)c * q + ((size_t)c < r ? (size_t)c : r) + 1;
+    return q + ((size_t)c < r);
+}
+
+/* ghost width along user axis a */
+static size_t ghost_of(const domain* dom, int a) {
+    return a == DOMAIN_DEPS && dom->depth == 2 ? 0 : (size_t)dom->geo.ghost;
+}
+
+/* extents of a rank's block, ghosts included, along user axes */
+static void extents(const domain* dom, int rank, size_t* e) {
+    int c[3];
+    coords_of(dom, rank, c);
+    for (int a = 0; a < 3; a++)
+        e[a] = split(dom, a, c[a], NULL) + 2 * ghost_of(dom, a);
+}
+
+static size_t block_bytes(const domain* dom, int rank, size_t elem_size) {
+    size_t e[3];
+    extents(dom, rank, e);
+    const size_t bytes = (e[0] * e[1] * e[2] + 1) * elem_size;
+    return (bytes + PAGE - 1) / PAGE * PAGE;
+}
+
+static size_t block_offset(const domain* dom, int rank, size_t elem_size) {
+    size_t off = 0;
+    for (int r = 0; r < rank; r++)
+        off += block_bytes(dom, r, elem_size);
+    return off;
+}
+
+/* the 26 (or 8) surrounding subdomains that exist */
+static void find_neighbors(domain* dom) {
+    const domain_geometry* g = &dom->geo;
+    dom->nnbr = 0;
+    for (int d2 = -1; d2 <= 1; d2++)
+        for (int d1 = -1; d1 <= 1; d1++)
+            for (int d0 = -1; d0 <= 1; d0++) {
+                const int d[3] = {d0, d1, d2};
+                if ((!d0 && !d1 && !d2) || (dom->depth == 2 && d2))
+                    continue;
+                int c[3], ok = 1;
+                for (int a = 0; a < 3; a++) {
+                    c[a] = g->coords[a] + d[a];
+                    if (c[a] >= 0 && c[a] < g->procs[a])
+                        continue;
+                    if (!(g->periodic >> a & 1))
+                        ok = 0;
+                    c[a] = (c[a] + g->procs[a]) % g->procs[a];
+                }
+                if (!ok)
+                    continue;
+                neighbor* nb = &dom->nbr[dom->nnbr++];
+                nb->rank = rank_of(dom, c);
+                memcpy(nb->dir, d, sizeof(d));
+            }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Domain                                  */
+/*                                                                          */
+/****************************************************************************/
+
+domain* __new_domain(const char* name, int nranks, int rank,
+                     const size_t* global, const int* procs, int depth,
+                     int ghost, int periodic, int lines_are_cols) {
+    if (!name || strchr(name, '/') || strlen(name) + 16 > NAME_LEN) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Expected a short name without slashes @ new_domain!\n");
+        return NULL;
+    }
+    if (nranks < 1 || rank < 0 || rank >= nranks || ghost < 0 ||
+        procs[0] < 1 || procs[1] < 1 || procs[2] < 1 ||
+        procs[0] * procs[1] * procs[2] != nranks) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Process grid does not match the ranks @ new_domain!\n");
+        return NULL;
+    }
+    domain* dom = calloc(1, sizeof(domain));
+    if (!dom) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for domain @ new_domain!\n");
+        return NULL;
+    }
+    dom->name[0] = '/';
+    strcpy(dom->name + 1, name);
+    dom->depth = depth;
+    dom->lines_are_cols = lines_are_cols;
+    domain_geometry* g = &dom->geo;
+    g->rank = rank;
+    g->nranks = nranks;
+    g->ghost = ghost;
+    g->periodic = periodic;
+    memcpy(g->procs, procs, 3 * sizeof(int));
+    memcpy(g->global, global, 3 * sizeof(size_t));
+    coords_of(dom, rank, g->coords);
+    for (int a = 0; a < 3; a++) {
+        g->n[a] = split(dom, a, g->coords[a], &g->lo[a]);
+        /* a ghost layer may not reach past the neighbouring subdomain */
+        const int linked = procs[a] > 1 || (periodic >> a & 1);
+        const size_t need = linked && ghost_of(dom, a) > 1 ? ghost_of(dom, a)
+                                                           : 1;
+        if (global[a] / (size_t)procs[a] < need) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Subdomains thinner than the ghost layer @ "
+                        "new_domain!\n");
+            free(dom);
+            return NULL;
+        }
+    }
+    /* storage lines are (rows, cols) or (cols, rows), then the depth */
+    const int row_major[2][3] = {{-1, DOMAIN_ROWS, DOMAIN_COLS},
+                                 {DOMAIN_ROWS, DOMAIN_COLS, DOMAIN_DEPS}};
+    const int col_major[2][3] = {{-1, DOMAIN_COLS, DOMAIN_ROWS},
+                                 {DOMAIN_COLS, DOMAIN_ROWS, DOMAIN_DEPS}};
+    memcpy(dom->smap, (lines_are_cols ? col_major : row_major)[depth == 3],
+           sizeof(dom->smap));
+    find_neighbors(dom);
+
+    dom->ctl_bytes = sizeof(control) + (size_t)nranks * sizeof(slot);
+    dom->ctl = rank == 0 ? map_segment(dom->name, dom->ctl_bytes, 1, NULL)
+                         : attach_control(dom->name, dom->ctl_bytes, rank);
+    if (!dom->ctl) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Cannot map shared memory '%s' @ new_domain!\n", name);
+        free(dom);
+        return NULL;
+    }
+    if (rank == 0) {
+        dom->ctl->nranks = (uint64_t)nranks;
+        accept_ranks(dom->ctl, nranks);
+    }
+    domain_barrier(dom);
+    return dom;
+}
+
+void free_domain(domain* dom) {
+    if (!dom)
+        return;
+    while (dom->nfields > 0)
+        __free_domain_field(dom, dom->fields[dom->nfields - 1].view);
+    domain_barrier(dom);
+    if (dom->geo.rank == 0)
+        shm_unlink(dom->name);
+    munmap(dom->ctl, dom->ctl_bytes);
+    free(dom->fields);
+    free(dom);
+}
+
+const domain_geometry* domain_geometry_of(const domain* dom) {
+    return &dom->geo;
+}
+
+/* centralized barrier: the last rank to arrive starts a new generation */
+void domain_barrier(domain* dom) {
+    control* ctl = dom->ctl;
+    const uint64_t gen = __atomic_load_n(&ctl->bar_gen, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&ctl->bar_count, 1, __ATOMIC_ACQ_REL) ==
+        ctl->nranks) {
+        __atomic_store_n(&ctl->bar_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&ctl->bar_gen, gen + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    int spins = 0;
+    while (__atomic_load_n(&ctl->bar_gen, __ATOMIC_ACQUIRE) == gen)
+        relax(&spins);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Fields                                  */
+/*                                                                          */
+/****************************************************************************/
+
+static field* find_field(domain* dom, void* view, const char* name) {
+    for (int i = 0; i < dom->nfields; i++)
+        if (dom->fields[i].view == view)
+            return &dom->fields[i];
+    raise_error(SIMUTIL_DEFAULT_ERROR, "Not a field of this domain @ %s!\n",
+                name);
+    return NULL;
+}
+
+/*
+ * Private matrix or matrix3 head over a rank's shared block: the header and
+ * pointer tables live in one malloc'd block, the elements in the segment.
+ * Both kinds reserve a matrix header, so views are freed the same way; a
+ * matrix3 uses its last words. Zero capacities mark matrices as views.
+ */
+static void* make_view(const domain* dom, char* block, int rank,
+                       size_t elem_size) {
+    size_t e[3], s[3];
+    extents(dom, rank, e);
+    for (int k = 0; k < 3; k++)
+        s[k] = dom->smap[k] < 0 ? 1 : e[dom->smap[k]];
+    const size_t head = MATRIX_SIZE_BYTE;
+    if (dom->depth == 2) {
+        char* start = malloc(head + (s[1] + 1) * sizeof(char*));
+        if (!start)
+            return NULL;
+        size_t* h = (size_t*)start;
+        h[0] = e[DOMAIN_COLS];
+        h[1] = e[DOMAIN_ROWS];
+        h[2] = 1;
+        h[3] = h[4] = 0;
+        char** out = (char**)(start + head);
+        for (size_t l = 1; l <= s[1]; l++)
+            out[l] = block + (l - 1) * s[2] * elem_size;
+        return out;
+    }
+    char* start =
+        malloc(head + (s[0] + 1) * sizeof(char**) +
+               (s[0] * s[1] + 1) * sizeof(char*));
+    if (!start)
+        return NULL;
+    size_t* h = (size_t*)(start + head - MATRIX3_SIZE_BYTE);
+    h[0] = e[DOMAIN_COLS];
+    h[1] = e[DOMAIN_ROWS];
+    h[2] = e[DOMAIN_DEPS];
+    char*** out = (char***)(start + head);
+    char** lines = (char**)(out + s[0] + 1);
+    for (size_t i = 1; i <= s[0]; i++) {
+        out[i] = lines + (i - 1) * s[1];
+        for (size_t j = 1; j <= s[1]; j++)
+            out[i][j] = block + ((i - 1) * s[1] + (j - 1)) * s[2] * elem_size;
+    }
+    return out;
+}
+
+void* __domain_field(domain* dom, size_t elem_size, int depth) {
+    if (depth != dom->depth) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Field and domain dimensions differ @ domain_matrix!\n");
+        return NULL;
+    }
+    field f = {NULL, NULL, 0, elem_size, dom->next_id++};
+    for (int r = 0; r < dom->geo.nranks; r++)
+        f.bytes += block_bytes(dom, r, elem_size);
+    char name[NAME_LEN + 16];
+    snprintf(name, sizeof(name), "%s.%d", dom->name, f.id);
+
+    /* rank 0 creates the segment before anyone opens it */
+    if (dom->geo.rank == 0)
+        f.base = map_segment(name, f.bytes, 1, NULL);
+    domain_barrier(dom);
+    if (dom->geo.rank != 0)
+        f.base = map_segment(name, f.bytes, 0, NULL);
+    field* grown = realloc(dom->fields, (size_t)(dom->nfields + 1) *
+                                            sizeof(field));
+    if (!f.base || !grown) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Cannot map shared memory @ domain_matrix!\n");
+        if (f.base)
+            munmap(f.base, f.bytes);
+        if (grown)
+            dom->fields = grown;
+        return NULL;
+    }
+    dom->fields = grown;
+    const int rank = dom->geo.rank;
+    char* block = f.base + block_offset(dom, rank, elem_size);
+    /* first touch by the owner puts the pages on its NUMA node */
+    memset(block, 0, block_bytes(dom, rank, elem_size));
+    f.view = make_view(dom, block, rank, elem_size);
+    if (!f.view) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for view @ domain_matrix!\n");
+        munmap(f.base, f.bytes);
+        return NULL;
+    }
+    dom->fields[dom->nfields++] = f;
+    return f.view;
+}
+
+void* __domain_peer(domain* dom, void* view, int rank) {
+    field* f = find_field(dom, view, "domain_peer");
+    if (!f)
+        return NULL;
+    if (rank < 0 || rank >= dom->geo.nranks) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "No such rank @ domain_peer!\n");
+        return NULL;
+    }
+    void* out = make_view(dom, f->base + block_offset(dom, rank, f->elem_size),
+                          rank, f->elem_size);
+    if (!out)
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for view @ domain_peer!\n");
+    return out;
+}
+
+void __free_domain_view(void* view) {
+    if (view)
+        free((char*)view - MATRIX_SIZE_BYTE);
+}
+
+void __free_domain_field(domain* dom, void* view) {
+    field* f = find_field(dom, view, "free_domain_field");
+    if (!f)
+        return;
+    char name[NAME_LEN + 16];
+    snprintf(name, sizeof(name), "%s.%d", dom->name, f->id);
+    domain_barrier(dom);
+    if (dom->geo.rank == 0)
+        shm_unlink(name);
+    munmap(f->base, f->bytes);
+    __free_domain_view(f->view);
+    *f = dom->fields[--dom->nfields];
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Halo Exchange                               */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Copies the part of neighbour 'nb' that lies in this rank's ghost layer in
+ * direction 'nb->dir'. Along every axis the source is the neighbour's last
+ * ghost-wide slab of interior (dir -1), its whole interior (dir 0) or its
+ * first slab (dir +1); the target is the matching ghost or interior range.
+ */
+static void pull(const domain* dom, const field* f, const neighbor* nb) {
+    size_t dlo[3], slo[3], len[3], de[3], se[3];
+    int c[3];
+    coords_of(dom, nb->rank, c);
+    extents(dom, dom->geo.rank, de);
+    extents(dom, nb->rank, se);
+    for (int a = 0; a < 3; a++) {
+        const size_t g = ghost_of(dom, a);
+        const size_t n = dom->geo.n[a];
+        const size_t nn = split(dom, a, c[a], NULL);
+        len[a] = nb->dir[a] ? g : n;
+        dlo[a] = nb->dir[a] < 0 ? 0 : nb->dir[a] > 0 ? g + n : g;
+        slo[a] = nb->dir[a] < 0 ? nn : g;
+    }
+    /* storage axes: lines (s0, s1) of s2 contiguous elements */
+    size_t dext[3], sext[3], cnt[3], doff[3], soff[3];
+    for (int k = 0; k < 3; k++) {
+        const int a = dom->smap[k];
+        dext[k] = a < 0 ? 1 : de[a];
+        sext[k] = a < 0 ? 1 : se[a];
+        cnt[k] = a < 0 ? 1 : len[a];
+        doff[k] = a < 0 ? 0 : dlo[a];
+        soff[k] = a < 0 ? 0 : slo[a];
+    }
+    const size_t es = f->elem_size;
+    /* element 0 of every block is the 1-indexing pad */
+    char* dst = f->base + block_offset(dom, dom->geo.rank, es) + es;
+    const char* src = f->base + block_offset(dom, nb->rank, es) + es;
+    const size_t bytes = cnt[2] * es;
+#pragma omp parallel for collapse(2) schedule(static)                          \
+    if (cnt[0] * cnt[1] * cnt[2] >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < cnt[0]; i++)
+        for (size_t j = 0; j < cnt[1]; j++) {
+            const size_t dl = (doff[0] + i) * dext[1] + doff[1] + j;
+            const size_t sl = (soff[0] + i) * sext[1] + soff[1] + j;
+            memcpy(dst + (dl * dext[2] + doff[2]) * es,
+                   src + (sl * sext[2] + soff[2]) * es, bytes);
+        }
+}
+
+void __domain_exchange(domain* dom, void* view) {
+    field* f = find_field(dom, view, "domain_exchange");
+    if (!f)
+        return;
+    slot* slots = dom->ctl->slots;
+    const uint64_t seq = ++dom->seq;
+    __atomic_store_n(&slots[dom->geo.rank].ready, seq, __ATOMIC_RELEASE);
+    for (int k = 0; k < dom->nnbr; k++) {
+        wait_at_least(&slots[dom->nbr[k].rank].ready, seq);
+        pull(dom, f, &dom->nbr[k]);
+    }
+    /* neighbours may only overwrite their interior once it has been read */
+    __atomic_store_n(&slots[dom->geo.rank].pulled, seq, __ATOMIC_RELEASE);
+    for (int k = 0; k < dom->nnbr; k++)
+        wait_at_least(&slots[dom->nbr[k].rank].pulled, seq);
+}
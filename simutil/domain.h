@@ -0,0 +1,201 @@
+#ifndef SIMUTIL_DOMAIN_H
+#define SIMUTIL_DOMAIN_H
+
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/* user axes of a domain, in the order of the matrix constructors */
+typedef enum { DOMAIN_COLS, DOMAIN_ROWS, DOMAIN_DEPS } domain_axis_t;
+
+/* flags of the axes whose opposite faces are neighbours */
+#define DOMAIN_PERIODIC_COLS 1
+#define DOMAIN_PERIODIC_ROWS 2
+#define DOMAIN_PERIODIC_DEPS 4
+
+/**
+ * @brief Opaque decomposition of a global grid over the processes of one
+ * machine, with every subdomain stored in POSIX shared memory.
+ *
+ */
+typedef struct domain domain;
+
+/**
+ * @brief Placement of the calling rank's subdomain. Arrays are indexed by
+ * 'domain_axis_t'; for a 2-D domain the DOMAIN_DEPS entries are 1.
+ *
+ */
+typedef struct {
+    int rank;
+    int nranks;
+    int procs[3];
+    int coords[3];
+    size_t global[3];
+    size_t lo[3];
+    size_t n[3];
+    int ghost;
+    int periodic;
+} domain_geometry;
+
+SIMUTIL_API domain* __new_domain(const char* name, int nranks, int rank,
+                                 const size_t* global, const int* procs,
+                                 int depth, int ghost, int periodic,
+                                 int lines_are_cols);
+
+/**
+ * @brief Function to release a domain and the shared memory of its control
+ * block. Collective: every rank must call it, after releasing its fields.
+ *
+ * @param dom Domain to release
+ */
+SIMUTIL_API void free_domain(domain* dom);
+
+/**
+ * @brief Function to get the placement of the calling rank's subdomain.
+ *
+ * @param dom Domain
+ */
+SIMUTIL_API const domain_geometry* domain_geometry_of(const domain* dom);
+
+/**
+ * @brief Function to wait until every rank of the domain has reached the
+ * barrier.
+ *
+ * @param dom Domain
+ */
+SIMUTIL_API void domain_barrier(domain* dom);
+
+SIMUTIL_API void* __domain_field(domain* dom, size_t elem_size, int depth);
+
+SIMUTIL_API void* __domain_peer(domain* dom, void* field, int rank);
+
+SIMUTIL_API void __domain_exchange(domain* dom, void* field);
+
+SIMUTIL_API void __free_domain_field(domain* dom, void* field);
+
+SIMUTIL_API void __free_domain_view(void* view);
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Decomposition                               */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to split a global ncols x nrows x ndeps grid into
+ * pcols x prows x pdeps subdomains, one per process. Collective: all 'nranks'
+ * processes call it with the same arguments and their own 'rank'; rank 0
+ * creates the shared memory named after 'name' ('/dev/shm/name*' on Linux),
+ * which must not be in use by another run. Ranks are numbered with the
+ * column coordinate fastest. Returns NULL on failure.
+ *
+ * @param name Name of the shared memory, without slashes
+ * @param nranks Number of processes, pcols * prows * pdeps
+ * @param rank Rank of the calling process, from 0
+ * @param ncols Global columns
+ * @param nrows Global rows
+ * @param ndeps Global depth
+ * @param pcols Subdomains along the columns
+ * @param prows Subdomains along the rows
+ * @param pdeps Subdomains along the depth
+ * @param ghost Width of the ghost layer on every side
+ * @param periodic DOMAIN_PERIODIC_* flags, or 0
+ */
+#define new_domain3(name, nranks, rank, ncols, nrows, ndeps, pcols, prows,     \
+                    pdeps, ghost, periodic)                                    \
+    __new_domain((name), (nranks), (rank),                                     \
+                 (const size_t[3]){(ncols), (nrows), (ndeps)},                 \
+                 (const int[3]){(pcols), (prows), (pdeps)}, 3, (ghost),        \
+                 (periodic), __SIMUTIL_LINES_ARE_COLS)
+
+/**
+ * @brief Macro to split a global ncols x nrows grid into pcols x prows
+ * subdomains, one per process. See 'new_domain3'.
+ *
+ * @param name Name of the shared memory, without slashes
+ * @param nranks Number of processes, pcols * prows
+ * @param rank Rank of the calling process, from 0
+ * @param ncols Global columns
+ * @param nrows Global rows
+ * @param pcols Subdomains along the columns
+ * @param prows Subdomains along the rows
+ * @param ghost Width of the ghost layer on every side
+ * @param periodic DOMAIN_PERIODIC_COLS/ROWS flags, or 0
+ */
+#define new_domain2(name, nranks, rank, ncols, nrows, pcols, prows, ghost,     \
+                    periodic)                                                  \
+    __new_domain((name), (nranks), (rank),                                     \
+                 (const size_t[3]){(ncols), (nrows), 1},                       \
+                 (const int[3]){(pcols), (prows), 1}, 2, (ghost), (periodic),  \
+                 __SIMUTIL_LINES_ARE_COLS)
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Fields                                  */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to allocate a field over a 3-D domain. Collective: every rank
+ * allocates the domain's fields in the same order. Returns the calling
+ * rank's subdomain as a zeroed 'matrix3(T)' of (n + 2 * ghost) cells along
+ * every axis, whose interior starts at index ghost + 1. The memory is shared
+ * and first touched by its owner; release it with 'free_domain_field', never
+ * with 'free_matrix3'.
+ *
+ * @param dom Domain made by 'new_domain3'
+ * @param T Type of element
+ */
+#define domain_matrix3(dom, T) ((matrix3(T))__domain_field((dom), sizeof(T), 3))
+
+/**
+ * @brief Macro to allocate a field over a 2-D domain. See 'domain_matrix3'.
+ *
+ * @param dom Domain made by 'new_domain2'
+ * @param T Type of element
+ */
+#define domain_matrix(dom, T) ((matrix(T))__domain_field((dom), sizeof(T), 2))
+
+/**
+ * @brief Macro to view another rank's subdomain of a field, ghost layers
+ * included, without copying. Release the view with 'free_domain_view'.
+ *
+ * @param dom Domain
+ * @param field Field returned by 'domain_matrix' or 'domain_matrix3'
+ * @param rank Rank whose subdomain is viewed
+ */
+#define domain_peer(dom, field, rank)                                          \
+    ((__typeof__(field))__domain_peer((dom), (void*)(field), (rank)))
+
+/**
+ * @brief Macro to fill the ghost layers of a field, edges and corners
+ * included, from the interiors of the neighbouring subdomains. Collective
+ * over neighbours only: it returns once this rank's ghosts are filled and
+ * the neighbours have read this rank's interior, so the interior may be
+ * written again. Ghosts on non-periodic global boundaries are left alone.
+ *
+ * @param dom Domain
+ * @param field Field returned by 'domain_matrix' or 'domain_matrix3'
+ */
+#define domain_exchange(dom, field) __domain_exchange((dom), (void*)(field))
+
+/**
+ * @brief Macro to release a field. Collective.
+ *
+ * @param dom Domain
+ * @param field Field returned by 'domain_matrix' or 'domain_matrix3'
+ */
+#define free_domain_field(dom, field)                                          \
+    __free_domain_field((dom), (void*)(field))
+
+/**
+ * @brief Macro to release a view made by 'domain_peer'.
+ *
+ * @param view View to release
+ */
+#define free_domain_view(view) __free_domain_view((void*)(view))
+
+#endif
@@ -0,0 +1,85 @@
+#include "dual.h"
+#include "error.h"
+#include <string.h>
+
+static inline void set_elem(double** jac, int lines_are_cols, size_t i,
+                            size_t j, double v) {
+    if (lines_are_cols)
+        jac[j + 1][i + 1] = v;
+    else
+        jac[i + 1][j + 1] = v;
+}
+
+/*
+ * Seeds every unknown whose color falls in [c0, c0 + DUAL_N) along direction
+ * color - c0; unknown j has color j for dense Jacobians and j mod ncolors for
+ * banded ones.
+ */
+static void seed(vector(dual) in, const double* x, size_t n, size_t ncolors,
+                 size_t c0) {
+    for (size_t j = 0; j < n; j++) {
+        const size_t c = j % ncolors;
+        in[j + 1] = dual_const(x[j]);
+        if (c >= c0 && c < c0 + DUAL_N)
+            in[j + 1].d[c - c0] = 1.0;
+    }
+}
+
+void __dual_jacobian(double** jac, size_t nlines, size_t linelen,
+                     int lines_are_cols, double* fx, size_t nfx,
+                     dual_residual_t f, void* ctx, const double* x, size_t n,
+                     size_t lower, size_t upper, int banded) {
+    const char* name = banded ? "dual_jacobian_banded" : "dual_jacobian";
+    const size_t m = lines_are_cols ? linelen : nlines;
+    const size_t ncols = lines_are_cols ? nlines : linelen;
+    if (ncols != n || (fx && nfx != m) || (banded && m != n)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching Jacobian dimensions @ %s!\n", name);
+        return;
+    }
+    if (n == 0 || m == 0)
+        return;
+    const size_t ncolors =
+        banded && lower + upper + 1 < n ? lower + upper + 1 : n;
+    vector(dual) in = new_vector(dual, n);
+    vector(dual) out = new_vector(dual, m);
+    if (!in || !out) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate dual vectors @ %s!\n", name);
+        goto cleanup;
+    }
+    if (banded)
+        for (size_t i = 0; i < m; i++)
+            for (size_t j = 0; j < n; j++)
+                set_elem(jac, lines_are_cols, i, j, 0.0);
+    for (size_t c0 = 0; c0 < ncolors; c0 += DUAL_N) {
+        seed(in, x, n, ncolors, c0);
+        memset(out + 1, 0, m * sizeof(dual));
+        f(out, in, ctx);
+        if (fx && c0 == 0)
+            for (size_t i = 0; i < m; i++)
+                fx[i] = out[i + 1].v;
+        const size_t c1 = c0 + DUAL_N < ncolors ? c0 + DUAL_N : ncolors;
+        for (size_t i = 0; i < m; i++) {
+            if (!banded) {
+                for (size_t j = c0; j < c1; j++)
+                    set_elem(jac, lines_are_cols, i, j, out[i + 1].d[j - c0]);
+                continue;
+            }
+            /* the band of row i holds one unknown of every color */
+            const size_t lo = i > lower ? i - lower : 0;
+            const size_t hi = i + upper < n - 1 ? i + upper : n - 1;
+            for (size_t j = lo; j <= hi; j++) {
+                const size_t c = j % ncolors;
+                if (c >= c0 && c < c1)
+                    set_elem(jac, lines_are_cols, i, j, out[i + 1].d[c - c0]);
+            }
+        }
+    }
+
+cleanup:
+    if (in)
+        free_vector(in);
+    if (out)
+        free_vector(out);
+}
@@ -0,0 +1,203 @@
+#ifndef SIMUTIL_DUAL_H
+#define SIMUTIL_DUAL_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_DUAL_BASE_H
+#include "dual_base.h"
+#endif
+#include <math.h>
+
+/**
+ * @brief Residual callback evaluated on dual numbers. Must set every element
+ * of 'out' from 'in' using the dual arithmetic below, so that out[i].d[k]
+ * is the derivative of out[i].v along the direction seeded in in[..].d[k].
+ *
+ */
+typedef void (*dual_residual_t)(vector(dual) out, vector(dual) in, void* ctx);
+
+SIMUTIL_API void __dual_jacobian(double** jac, size_t nlines, size_t linelen,
+                                 int lines_are_cols, double* fx, size_t nfx,
+                                 dual_residual_t f, void* ctx,
+                                 const double* x, size_t n, size_t lower,
+                                 size_t upper, int banded);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Arithmetic                                */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Function to make a constant: the value 'x' with zero derivatives.
+ *
+ * @param x Value
+ */
+static inline dual dual_const(double x) {
+    dual r = {x, {0.0}};
+    return r;
+}
+
+/**
+ * @brief Function to make an independent variable: the value 'x' with a unit
+ * derivative along direction 'k' (0 to DUAL_N - 1) and zero along the others.
+ *
+ * @param x Value
+ * @param k Direction
+ */
+static inline dual dual_var(double x, int k) {
+    dual r = {x, {0.0}};
+    r.d[k] = 1.0;
+    return r;
+}
+
+/* sum, difference, product and quotient rules */
+static inline dual dual_add(dual a, dual b) {
+    dual r;
+    r.v = a.v + b.v;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = a.d[k] + b.d[k];
+    return r;
+}
+
+static inline dual dual_sub(dual a, dual b) {
+    dual r;
+    r.v = a.v - b.v;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = a.d[k] - b.d[k];
+    return r;
+}
+
+static inline dual dual_mul(dual a, dual b) {
+    dual r;
+    r.v = a.v * b.v;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = a.d[k] * b.v + a.v * b.d[k];
+    return r;
+}
+
+static inline dual dual_div(dual a, dual b) {
+    dual r;
+    const double inv = 1.0 / b.v;
+    r.v = a.v * inv;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = (a.d[k] - r.v * b.d[k]) * inv;
+    return r;
+}
+
+/* a * s + t for constants s and t */
+static inline dual dual_affine(dual a, double s, double t) {
+    dual r;
+    r.v = a.v * s + t;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = a.d[k] * s;
+    return r;
+}
+
+static inline dual dual_scale(dual a, double s) {
+    return dual_affine(a, s, 0.0);
+}
+
+static inline dual dual_shift(dual a, double t) {
+    return dual_affine(a, 1.0, t);
+}
+
+static inline dual dual_neg(dual a) { return dual_affine(a, -1.0, 0.0); }
+
+/* f(a) from f(a.v) and f'(a.v) */
+static inline dual __dual_chain(dual a, double f, double df) {
+    dual r;
+    r.v = f;
+    for (int k = 0; k < DUAL_N; k++)
+        r.d[k] = df * a.d[k];
+    return r;
+}
+
+static inline dual dual_sqrt(dual a) {
+    const double s = sqrt(a.v);
+    return __dual_chain(a, s, 0.5 / s);
+}
+
+static inline dual dual_exp(dual a) {
+    const double e = exp(a.v);
+    return __dual_chain(a, e, e);
+}
+
+static inline dual dual_log(dual a) {
+    return __dual_chain(a, log(a.v), 1.0 / a.v);
+}
+
+static inline dual dual_sin(dual a) {
+    return __dual_chain(a, sin(a.v), cos(a.v));
+}
+
+static inline dual dual_cos(dual a) {
+    return __dual_chain(a, cos(a.v), -sin(a.v));
+}
+
+static inline dual dual_tanh(dual a) {
+    const double t = tanh(a.v);
+    return __dual_chain(a, t, 1.0 - t * t);
+}
+
+/* a^p for a constant exponent */
+static inline dual dual_pow(dual a, double p) {
+    const double f = pow(a.v, p);
+    return __dual_chain(a, f, p == 0.0 ? 0.0 : p * pow(a.v, p - 1.0));
+}
+
+/* |a|, with the derivative of a at zero */
+static inline dual dual_abs(dual a) { return a.v < 0.0 ? dual_neg(a) : a; }
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Jacobians                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to compute the Jacobian of a residual at 'x'. The unknowns
+ * are seeded DUAL_N at a time, so 'f' is called ceil(n / DUAL_N) times
+ * instead of the n + 1 times of finite differences, and the derivatives are
+ * exact.
+ *
+ * @param jac 'matrix(double)' of LENGTH(fx) rows and LENGTH(x) columns, set
+ * to J[i][j] = d f_i / d x_j
+ * @param fx 'vector(double)' set to f(x), or NULL
+ * @param f Residual callback
+ * @param ctx User data passed to 'f'
+ * @param x 'vector(double)' point of evaluation
+ */
+#define dual_jacobian(jac, fx, f, ctx, x)                                      \
+    __dual_jacobian((double**)(jac), MATRIX_NLINES(jac), MATRIX_LINELEN(jac),  \
+                    __SIMUTIL_LINES_ARE_COLS, (fx) ? (double*)(fx) + 1 : NULL, \
+                    (fx) ? (size_t)LENGTH(fx) : 0, (f), (ctx),                 \
+                    (const double*)(x) + 1, (size_t)LENGTH(x), 0, 0, 0)
+
+/**
+ * @brief Macro to compute a banded Jacobian, in which f_i only depends on
+ * x_(i - lower) to x_(i + upper). Unknowns that share no residual are seeded
+ * in the same direction, so 'f' is called ceil((lower + upper + 1) / DUAL_N)
+ * times whatever the size of the system: once for a tridiagonal one. Entries
+ * outside the band are set to zero.
+ *
+ * @param jac Square 'matrix(double)' of size LENGTH(x)
+ * @param fx 'vector(double)' set to f(x), or NULL
+ * @param f Residual callback
+ * @param ctx User data passed to 'f'
+ * @param x 'vector(double)' point of evaluation
+ * @param lower Number of subdiagonals
+ * @param upper Number of superdiagonals
+ */
+#define dual_jacobian_banded(jac, fx, f, ctx, x, lower, upper)                 \
+    __dual_jacobian((double**)(jac), MATRIX_NLINES(jac), MATRIX_LINELEN(jac),  \
+                    __SIMUTIL_LINES_ARE_COLS, (fx) ? (double*)(fx) + 1 : NULL, \
+                    (fx) ? (size_t)LENGTH(fx) : 0, (f), (ctx),                 \
+                    (const double*)(x) + 1, (size_t)LENGTH(x), (lower),        \
+                    (upper), 1)
+
+#endif
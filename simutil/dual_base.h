@@ -0,0 +1,22 @@
+#ifndef SIMUTIL_DUAL_BASE_H
+#define SIMUTIL_DUAL_BASE_H
+
+/* derivative components carried by every dual number */
+#define DUAL_N 8
+
+/**
+ * @brief Forward-mode dual number: a value and its derivatives along DUAL_N
+ * independent directions, propagated together so that one evaluation gives
+ * DUAL_N columns of a Jacobian. The components are updated in fixed-length
+ * loops that compile to a few SIMD instructions.
+ *
+ */
+typedef struct {
+    double v;
+    double d[DUAL_N];
+} dual;
+
+/* argument expander printing the value of a dual number */
+#define __SIMUTIL_DARG(x) (x).v
+
+#endif
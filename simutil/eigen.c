@@ -0,0 +1,820 @@
+#include "eigen.h"
+#include "error.h"
+#include "rng.h"
+#include "transpose.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/* independent partial sums, so the reductions vectorize without reordering */
+#define LANES 8
+
+/* vector entries per task when applying a QL sweep */
+#define ROT_BLOCK 32
+
+/* vectors per task in the Householder back-transformation */
+#define BACK_BLOCK 16
+
+/* vector entries per task in the Lanczos projections */
+#define PROJ_BLOCK 512
+
+#define MAX_QL_ITER 60
+#define MAX_SWEEPS 60
+/* smallest p for which the Jacobi sweeps are preconditioned */
+#define PRECOND_MIN 64
+/* rows per tile in the Gram product */
+#define GRAM_BLOCK 32
+
+/* Lanczos steps between two convergence checks */
+#define LANCZOS_CHECK 8
+#define LANCZOS_SEED 0x1A2C05ull
+
+static double dot(const double* a, const double* b, size_t n) {
+    double acc[LANES] = {0.0};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (int j = 0; j < LANES; j++)
+            acc[j] += a[i + j] * b[i + j];
+    double s = 0.0;
+    for (; i < n; i++)
+        s += a[i] * b[i];
+    for (int j = 0; j < LANES; j++)
+        s += acc[j];
+    return s;
+}
+
+/* row and column counts of a matrix from its storage extents */
+static size_t rows_of(size_t nlines, size_t linelen, int lines_are_cols) {
+    return lines_are_cols ? linelen : nlines;
+}
+
+static size_t cols_of(size_t nlines, size_t linelen, int lines_are_cols) {
+    return lines_are_cols ? nlines : linelen;
+}
+
+/*
+ * Copies the columns (or, with 'want_cols' zero, the rows) of a matrix into
+ * consecutive arrays of 'dst'.
+ */
+static void read_lines(double* dst, double** mat, size_t nlines,
+                       size_t linelen, int lines_are_cols, int want_cols,
+                       char** table) {
+    if (want_cols == lines_are_cols) {
+        for (size_t l = 0; l < nlines; l++)
+            memcpy(dst + l * linelen, mat[l + 1] + 1,
+                   linelen * sizeof(double));
+        return;
+    }
+    for (size_t j = 0; j < linelen; j++)
+        table[j] = (char*)(dst + j * nlines);
+    for (size_t l = 0; l < nlines; l++)
+        table[linelen + l] = (char*)(mat[l + 1] + 1);
+    __transpose_tables(table, table + linelen, nlines, linelen,
+                       sizeof(double));
+}
+
+/*
+ * Sets column j of a matrix with 'nrows' rows to 'cols[j]', j < 'ncols'.
+ * 'table' holds at least 'nrows' pointers.
+ */
+static void write_columns(double** out, int lines_are_cols, double** cols,
+                          size_t ncols, size_t nrows, char** table) {
+    if (lines_are_cols) {
+        for (size_t j = 0; j < ncols; j++)
+            memcpy(out[j + 1] + 1, cols[j], nrows * sizeof(double));
+        return;
+    }
+    for (size_t i = 0; i < nrows; i++)
+        table[i] = (char*)(out[i + 1] + 1);
+    __transpose_tables(table, (char* const*)cols, ncols, nrows,
+                       sizeof(double));
+}
+
+/* sorts 'perm' so that 'key[perm[i]]' increases, or decreases with 'desc' */
+static void sort_perm(size_t* perm, const double* key, size_t n, int desc) {
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i;
+        for (; j > 0 && (desc ? key[perm[j - 1]] < key[i]
+                              : key[perm[j - 1]] > key[i]);
+             j--)
+            perm[j] = perm[j - 1];
+        perm[j] = i;
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                           Tridiagonal Reduction                          */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Householder reflector H = I - tau v v^T with H x = (alpha, 0, ..., 0).
+ * 'x' is overwritten by v, whose first entry is 1. Returns alpha.
+ */
+static double make_reflector(double* x, size_t m, double* tau) {
+    const double x0 = x[0];
+    const double tail = dot(x + 1, x + 1, m - 1);
+    x[0] = 1.0;
+    if (tail == 0.0) {
+        *tau = 0.0;
+        return x0;
+    }
+    const double norm = sqrt(x0 * x0 + tail);
+    const double alpha = x0 > 0.0 ? -norm : norm;
+    const double scale = 1.0 / (x0 - alpha);
+    for (size_t i = 1; i < m; i++)
+        x[i] *= scale;
+    *tau = (alpha - x0) / alpha;
+    return alpha;
+}
+
+/*
+ * Reduces the full symmetric n x n array 'a' to tridiagonal form T = Q^T A Q
+ * with diagonal 'd' and off-diagonal 'e' (e[i] couples i and i + 1). Q is
+ * H_0 ... H_{n-3}; the vector of H_k is left in row k of 'a' from column
+ * k + 1 on. Each step makes a single pass over the trailing block: a row
+ * gets the rank-2 update of this step and then, while it is in cache, its
+ * product with the next reflector.
+ */
+static void tridiagonalize(double* a, size_t n, double* d, double* e,
+                           double* tau, double* p, double* q) {
+    e[n - 1] = 0.0;
+    if (n == 1) {
+        d[0] = a[0];
+        return;
+    }
+    if (n >= 3) {
+        e[0] = make_reflector(a + 1, n - 1, &tau[0]);
+#pragma omp parallel for schedule(static) if (n * n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 1; i < n; i++)
+            p[i] = tau[0] * dot(a + i * n + 1, a + 1, n - 1);
+    }
+    for (size_t k = 0; k + 2 < n; k++) {
+        const size_t m = n - k - 1;
+        const double* v = a + k * n + k + 1;
+        const double* pk = p + k + 1;
+        double* w = q + k + 1;
+        /* trailing block B -= v w^T + w v^T, w = p - (tau / 2)(p . v) v */
+        const double K = 0.5 * tau[k] * dot(pk, v, m);
+        for (size_t t = 0; t < m; t++)
+            w[t] = pk[t] - K * v[t];
+        d[k] = a[k * n + k];
+        double* r = a + (k + 1) * n + k + 1;
+        for (size_t t = 0; t < m; t++)
+            r[t] -= v[0] * w[t] + w[0] * v[t];
+        const int more = k + 3 < n;
+        const double* v1 = r + 1;
+        if (more)
+            e[k + 1] = make_reflector(r + 1, m - 1, &tau[k + 1]);
+        const double tau1 = more ? tau[k + 1] : 0.0;
+#pragma omp parallel for schedule(static) if (m * m >= SIMUTIL_PAR_MIN)
+        for (size_t i = k + 2; i < n; i++) {
+            double* ri = a + i * n + k + 1;
+            const double vi = v[i - k - 1];
+            const double wi = w[i - k - 1];
+            for (size_t t = 0; t < m; t++)
+                ri[t] -= vi * w[t] + wi * v[t];
+            if (more)
+                p[i] = tau1 * dot(ri + 1, v1, m - 1);
+        }
+    }
+    d[n - 2] = a[(n - 2) * n + n - 2];
+    d[n - 1] = a[(n - 1) * n + n - 1];
+    e[n - 2] = a[(n - 2) * n + n - 1];
+}
+
+/*
+ * Turns the 'n' rows of 'zt', vectors in the basis of T, into vectors in the
+ * basis of A: z <- H_0 (H_1 (... H_{n-3} z)). Rows are taken in blocks, so
+ * that every reflector is read once per block.
+ */
+static void back_transform(double* zt, const double* a, const double* tau,
+                           size_t n) {
+    const size_t nblocks = (n + BACK_BLOCK - 1) / BACK_BLOCK;
+#pragma omp parallel for schedule(static) if (n * n >= SIMUTIL_PAR_MIN)
+    for (size_t b = 0; b < nblocks; b++) {
+        const size_t r0 = b * BACK_BLOCK;
+        const size_t r1 = r0 + BACK_BLOCK < n ? r0 + BACK_BLOCK : n;
+        for (size_t k = n > 2 ? n - 2 : 0; k-- > 0;) {
+            const double* v = a + k * n + k + 1;
+            const size_t m = n - k - 1;
+            for (size_t r = r0; r < r1; r++) {
+                double* z = zt + r * n + k + 1;
+                const double f = tau[k] * dot(v, z, m);
+                for (size_t t = 0; t < m; t++)
+                    z[t] -= f * v[t];
+            }
+        }
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Tridiagonal QL                              */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Applies the rotations of a QL sweep, i = hi - 1 down to lo, each mixing
+ * rows i and i + 1 of 'zt'. The rotations only depend on T, so the sweep is
+ * applied to one block of entries at a time, in parallel.
+ */
+static void apply_rotations(double* zt, size_t ncomp, const double* rc,
+                            const double* rs, size_t lo, size_t hi) {
+    const size_t nblocks = (ncomp + ROT_BLOCK - 1) / ROT_BLOCK;
+#pragma omp parallel for schedule(static)                                      \
+    if ((hi - lo) * ncomp >= SIMUTIL_PAR_MIN)
+    for (size_t b = 0; b < nblocks; b++) {
+        const size_t k0 = b * ROT_BLOCK;
+        const size_t len = ncomp - k0 < ROT_BLOCK ? ncomp - k0 : ROT_BLOCK;
+        for (size_t i = hi; i-- > lo;) {
+            double* z0 = zt + i * ncomp + k0;
+            double* z1 = z0 + ncomp;
+            const double c = rc[i];
+            const double s = rs[i];
+            for (size_t t = 0; t < len; t++) {
+                const double f = z1[t];
+                z1[t] = s * z0[t] + c * f;
+                z0[t] = c * z0[t] - s * f;
+            }
+        }
+    }
+}
+
+/*
+ * Implicit QL with Wilkinson shifts on the tridiagonal (d, e). 'd' becomes
+ * the eigenvalues, unsorted. With 'zt', row i ends up as the eigenvector of
+ * d[i] in the basis that 'zt' started in. Returns zero if an eigenvalue
+ * needs more than MAX_QL_ITER sweeps.
+ */
+static int tridiag_ql(double* d, double* e, size_t n, double* zt,
+                      size_t ncomp, double* rc, double* rs, size_t* sweeps) {
+    for (size_t l = 0; l < n; l++) {
+        int iter = 0;
+        for (;;) {
+            size_t m = l;
+            for (; m + 1 < n; m++)
+                if (fabs(e[m]) <= DBL_EPSILON * (fabs(d[m]) + fabs(d[m + 1])))
+                    break;
+            if (m == l)
+                break;
+            if (iter++ == MAX_QL_ITER)
+                return 0;
+            (*sweeps)++;
+            double g = (d[l + 1] - d[l]) / (2.0 * e[l]);
+            double r = hypot(g, 1.0);
+            g = d[m] - d[l] + e[l] / (g + (g >= 0.0 ? r : -r));
+            double s = 1.0, c = 1.0, p = 0.0;
+            size_t i = m;
+            int underflow = 0;
+            while (i-- > l) {
+                const double f = s * e[i];
+                const double b = c * e[i];
+                r = hypot(f, g);
+                e[i + 1] = r;
+                if (r == 0.0) {
+                    /* the matrix split: restart on the shorter block */
+                    d[i + 1] -= p;
+                    e[m] = 0.0;
+                    underflow = 1;
+                    break;
+                }
+                s = f / r;
+                c = g / r;
+                g = d[i + 1] - p;
+                r = (d[i] - g) * s + 2.0 * c * b;
+                p = s * r;
+                d[i + 1] = g + p;
+                g = c * r - b;
+                rc[i] = c;
+                rs[i] = s;
+            }
+            if (zt)
+                apply_rotations(zt, ncomp, rc, rs, underflow ? i + 1 : l, m);
+            if (underflow)
+                continue;
+            d[l] -= p;
+            e[l] = g;
+            e[m] = 0.0;
+        }
+    }
+    return 1;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                           Symmetric Eigenvalues                          */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Eigenvalues 'd' (unsorted) of the full symmetric n x n array 'a', which is
+ * overwritten. With 'zt', a zeroed n x n array, row i is set to the
+ * eigenvector of d[i]. 'work' holds 6n doubles.
+ */
+static int dense_eigen(double* a, size_t n, double* d, double* zt,
+                       double* work, size_t* sweeps) {
+    double* e = work;
+    double* tau = work + n;
+    double* p = work + 2 * n;
+    double* q = work + 3 * n;
+    double* rc = work + 4 * n;
+    double* rs = work + 5 * n;
+    tridiagonalize(a, n, d, e, tau, p, q);
+    if (zt)
+        for (size_t i = 0; i < n; i++)
+            zt[i * n + i] = 1.0;
+    if (!tridiag_ql(d, e, n, zt, n, rc, rs, sweeps))
+        return 0;
+    if (zt)
+        back_transform(zt, a, tau, n);
+    return 1;
+}
+
+eigen_result __eigen_symmetric(double** mat, size_t nlines, size_t linelen,
+                               double* w, size_t nw, double** vecs,
+                               size_t vec_nlines, size_t vec_linelen,
+                               int lines_are_cols) {
+    eigen_result res = {0, 0};
+    const size_t n = nlines;
+    if (linelen != n || nw != n ||
+        (vecs && (vec_nlines != n || vec_linelen != n))) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ eigen_symmetric!\n");
+        return res;
+    }
+    if (n == 0) {
+        res.converged = 1;
+        return res;
+    }
+    double* a = malloc(n * n * sizeof(double));
+    double* work = malloc(7 * n * sizeof(double));
+    size_t* perm = malloc(n * sizeof(size_t));
+    double** cols = malloc(n * sizeof(double*));
+    char** table = malloc(n * sizeof(char*));
+    double* zt = vecs ? calloc(n * n, sizeof(double)) : NULL;
+    if (!a || !work || !perm || !cols || !table || (vecs && !zt)) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ eigen_symmetric!\n");
+        goto done;
+    }
+    double* d = work + 6 * n;
+
+    /* storage line l is row l or column l; mirror its lower-triangle half */
+    for (size_t l = 0; l < n; l++)
+        memcpy(a + l * n, mat[l + 1] + 1, n * sizeof(double));
+    for (size_t l = 0; l < n; l++) {
+        const size_t t0 = lines_are_cols ? l + 1 : 0;
+        const size_t t1 = lines_are_cols ? n : l;
+        for (size_t t = t0; t < t1; t++)
+            a[t * n + l] = a[l * n + t];
+    }
+
+    res.converged = dense_eigen(a, n, d, zt, work, &res.iterations);
+    if (!res.converged)
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "QL iterations did not converge @ eigen_symmetric!\n");
+
+    sort_perm(perm, d, n, 0);
+    for (size_t j = 0; j < n; j++)
+        w[j] = d[perm[j]];
+    if (zt) {
+        for (size_t j = 0; j < n; j++)
+            cols[j] = zt + perm[j] * n;
+        write_columns(vecs, lines_are_cols, cols, n, n, table);
+    }
+done:
+    free(a);
+    free(work);
+    free(perm);
+    free(cols);
+    free(table);
+    free(zt);
+    return res;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Lanczos                                  */
+/*                                                                          */
+/****************************************************************************/
+
+/* r -= Q^T (Q r) over the 'nq' rows of 'Q'; 'h' is set to Q r */
+static void project_out(double* r, const double* Q, size_t nq, size_t n,
+                        double* h) {
+#pragma omp parallel for schedule(static) if (nq * n >= SIMUTIL_PAR_MIN)
+    for (size_t t = 0; t < nq; t++)
+        h[t] = dot(Q + t * n, r, n);
+    const size_t nblocks = (n + PROJ_BLOCK - 1) / PROJ_BLOCK;
+#pragma omp parallel for schedule(static) if (nq * n >= SIMUTIL_PAR_MIN)
+    for (size_t b = 0; b < nblocks; b++) {
+        const size_t c0 = b * PROJ_BLOCK;
+        const size_t len = n - c0 < PROJ_BLOCK ? n - c0 : PROJ_BLOCK;
+        for (size_t t = 0; t < nq; t++) {
+            const double* qt = Q + t * n + c0;
+            const double ht = h[t];
+            for (size_t i = 0; i < len; i++)
+                r[c0 + i] -= ht * qt[i];
+        }
+    }
+}
+
+/* random unit vector orthogonal to the 'nq' rows of 'Q' */
+static void fresh_direction(double* r, const double* Q, size_t nq, size_t n,
+                            double* h, rng_state* rng) {
+    __rng_fill(rng, RNG_UNIFORM, -1.0, 1.0, r, n);
+    project_out(r, Q, nq, n, h);
+    project_out(r, Q, nq, n, h);
+    const double scale = 1.0 / sqrt(dot(r, r, n));
+    for (size_t i = 0; i < n; i++)
+        r[i] *= scale;
+}
+
+eigen_result __eigen_lanczos(krylov_op_t op, void* ctx, size_t n, double* w,
+                             size_t k, double** vecs, size_t vec_nlines,
+                             size_t vec_linelen, int lines_are_cols,
+                             double tol, size_t maxdim) {
+    eigen_result res = {0, 0};
+    if (k == 0 || k > n ||
+        (vecs && (rows_of(vec_nlines, vec_linelen, lines_are_cols) != n ||
+                  cols_of(vec_nlines, vec_linelen, lines_are_cols) != k))) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ eigen_lanczos!\n");
+        return res;
+    }
+    size_t mmax = maxdim ? maxdim : (4 * k > k + 64 ? 4 * k : k + 64);
+    mmax = mmax < n ? mmax : n;
+    if (mmax < k) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Basis smaller than the number of eigenvalues @ "
+                    "eigen_lanczos!\n");
+        return res;
+    }
+    double* Q = malloc(mmax * n * sizeof(double));
+    double* work = malloc(8 * mmax * sizeof(double));
+    double* st = malloc(mmax * mmax * sizeof(double));
+    size_t* perm = malloc(mmax * sizeof(size_t));
+    double* ritz = vecs ? malloc(k * n * sizeof(double)) : NULL;
+    double** cols = malloc(k * sizeof(double*));
+    char** table = malloc(n * sizeof(char*));
+    vector(double) x = new_vector(double, n);
+    vector(double) y = new_vector(double, n);
+    if (!Q || !work || !st || !perm || (vecs && !ritz) || !cols || !table ||
+        !x || !y) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ eigen_lanczos!\n");
+        goto done;
+    }
+    double* alpha = work;
+    double* beta = work + mmax;
+    double* h = work + 2 * mmax;
+    double* d = work + 3 * mmax;
+    double* e = work + 4 * mmax;
+    double* rc = work + 5 * mmax;
+    double* rs = work + 6 * mmax;
+    double* res_est = work + 7 * mmax;
+
+    rng_state rng = rng_init(LANCZOS_SEED, 0);
+    fresh_direction(Q, Q, 0, n, h, &rng);
+    double anorm = 0.0;
+    size_t j = 0;
+    for (;;) {
+        /* r = A q_j, orthogonalized twice against the whole basis */
+        memcpy(x + 1, Q + j * n, n * sizeof(double));
+        op(y, x, ctx);
+        double* r = y + 1;
+        project_out(r, Q, j + 1, n, h);
+        alpha[j] = h[j];
+        project_out(r, Q, j + 1, n, h);
+        alpha[j] += h[j];
+        beta[j] = sqrt(dot(r, r, n));
+        anorm = fmax(anorm, fabs(alpha[j]) + beta[j]);
+        const int breakdown = beta[j] <= DBL_EPSILON * anorm;
+        j++;
+        res.iterations = j;
+
+        if (j >= k &&
+            ((j - k) % LANCZOS_CHECK == 0 || j == mmax || breakdown)) {
+            memcpy(d, alpha, j * sizeof(double));
+            memcpy(e, beta, (j - 1) * sizeof(double));
+            e[j - 1] = 0.0;
+            memset(st, 0, j * j * sizeof(double));
+            for (size_t i = 0; i < j; i++)
+                st[i * j + i] = 1.0;
+            size_t sweeps = 0;
+            if (!tridiag_ql(d, e, j, st, j, rc, rs, &sweeps)) {
+                raise_error(SIMUTIL_DEFAULT_ERROR,
+                            "QL iterations did not converge @ "
+                            "eigen_lanczos!\n");
+                goto done;
+            }
+            sort_perm(perm, d, j, 1);
+            double top = 0.0;
+            for (size_t i = 0; i < j; i++)
+                top = fmax(top, fabs(d[i]));
+            /* the residual of a Ritz pair is beta_j times its last entry */
+            size_t nconv = 0;
+            for (size_t i = 0; i < k; i++) {
+                res_est[i] = beta[j - 1] * fabs(st[perm[i] * j + j - 1]);
+                nconv += res_est[i] <= tol * top;
+            }
+            if (nconv == k || j == mmax) {
+                res.converged = nconv == k;
+                break;
+            }
+        }
+        if (breakdown) {
+            /* invariant subspace: T decouples, continue in a new direction */
+            beta[j - 1] = 0.0;
+            fresh_direction(Q + j * n, Q, j, n, h, &rng);
+        } else {
+            const double scale = 1.0 / beta[j - 1];
+            for (size_t i = 0; i < n; i++)
+                Q[j * n + i] = r[i] * scale;
+        }
+    }
+    if (!res.converged)
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Ritz pairs did not converge @ eigen_lanczos!\n");
+
+    for (size_t i = 0; i < k; i++)
+        w[i] = d[perm[i]];
+    if (vecs) {
+        /* Ritz vectors Q^T s, a block of entries at a time */
+        const size_t nblocks = (n + PROJ_BLOCK - 1) / PROJ_BLOCK;
+#pragma omp parallel for schedule(static) if (j * n >= SIMUTIL_PAR_MIN)
+        for (size_t b = 0; b < nblocks; b++) {
+            const size_t c0 = b * PROJ_BLOCK;
+            const size_t len = n - c0 < PROJ_BLOCK ? n - c0 : PROJ_BLOCK;
+            for (size_t i = 0; i < k; i++) {
+                double* out = ritz + i * n + c0;
+                const double* s = st + perm[i] * j;
+                memset(out, 0, len * sizeof(double));
+                for (size_t t = 0; t < j; t++) {
+                    const double* qt = Q + t * n + c0;
+                    for (size_t c = 0; c < len; c++)
+                        out[c] += s[t] * qt[c];
+                }
+            }
+        }
+        for (size_t i = 0; i < k; i++)
+            cols[i] = ritz + i * n;
+        write_columns(vecs, lines_are_cols, cols, k, n, table);
+    }
+done:
+    free(Q);
+    free(work);
+    free(st);
+    free(perm);
+    free(ritz);
+    free(cols);
+    free(table);
+    if (x)
+        free_vector(x);
+    if (y)
+        free_vector(y);
+    return res;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                        Singular Value Decomposition                      */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Rotates columns x and y (and the matching rows of V^T, if any) so that they
+ * become orthogonal. Returns zero when they already were to working
+ * precision.
+ */
+static int rotate_pair(double* x, double* y, size_t m, double* vx, double* vy,
+                       size_t n, double tol) {
+    double xx[LANES] = {0.0}, yy[LANES] = {0.0}, xy[LANES] = {0.0};
+    size_t i = 0;
+    for (; i + LANES <= m; i += LANES)
+        for (int j = 0; j < LANES; j++) {
+            xx[j] += x[i + j] * x[i + j];
+            yy[j] += y[i + j] * y[i + j];
+            xy[j] += x[i + j] * y[i + j];
+        }
+    double a = 0.0, b = 0.0, g = 0.0;
+    for (; i < m; i++) {
+        a += x[i] * x[i];
+        b += y[i] * y[i];
+        g += x[i] * y[i];
+    }
+    for (int j = 0; j < LANES; j++) {
+        a += xx[j];
+        b += yy[j];
+        g += xy[j];
+    }
+    if (!(fabs(g) > tol * sqrt(a * b)))
+        return 0;
+    const double zeta = (b - a) / (2.0 * g);
+    const double t =
+        (zeta >= 0.0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+    const double c = 1.0 / sqrt(1.0 + t * t);
+    const double s = c * t;
+    for (i = 0; i < m; i++) {
+        const double xi = x[i];
+        x[i] = c * xi - s * y[i];
+        y[i] = s * xi + c * y[i];
+    }
+    if (vx)
+        for (i = 0; i < n; i++) {
+            const double xi = vx[i];
+            vx[i] = c * xi - s * vy[i];
+            vy[i] = s * xi + c * vy[i];
+        }
+    return 1;
+}
+
+/*
+ * One-sided Jacobi on the 'n' columns (rows of 'wt', each 'm' long), until
+ * they are mutually orthogonal. The pairs of a sweep are taken in
+ * round-robin order: every round holds n / 2 disjoint pairs, rotated in
+ * parallel.
+ */
+static int jacobi(double* wt, size_t n, size_t m, double* vt,
+                  size_t* sweeps) {
+    const size_t np = n + (n & 1);
+    const double tol = (double)m * DBL_EPSILON;
+    for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+        int rotated = 0;
+        for (size_t round = 0; round + 1 < np; round++) {
+#pragma omp parallel for schedule(static) reduction(| : rotated)              \
+    if (n * m >= SIMUTIL_PAR_MIN)
+            for (size_t i = 0; i < np / 2; i++) {
+                const size_t p = i == 0 ? 0 : (i - 1 + round) % (np - 1) + 1;
+                const size_t q = (np - 2 - i + round) % (np - 1) + 1;
+                if (p >= n || q >= n)
+                    continue;
+                rotated |=
+                    rotate_pair(wt + p * m, wt + q * m, m,
+                                vt ? vt + p * n : NULL,
+                                vt ? vt + q * n : NULL, n, tol);
+            }
+        }
+        (*sweeps)++;
+        if (!rotated)
+            return 1;
+    }
+    return 0;
+}
+
+/* lower triangle of the p x p Gram matrix G = W W^T, rows of 'wt' 'm' long */
+static void gram(double* g, const double* wt, size_t p, size_t m) {
+    const size_t nb = (p + GRAM_BLOCK - 1) / GRAM_BLOCK;
+#pragma omp parallel for schedule(static, 1) if (p * m >= SIMUTIL_PAR_MIN)
+    for (size_t bi = 0; bi < nb; bi++) {
+        const size_t i1 = (bi + 1) * GRAM_BLOCK < p ? (bi + 1) * GRAM_BLOCK : p;
+        for (size_t j0 = 0; j0 <= bi * GRAM_BLOCK; j0 += GRAM_BLOCK)
+            for (size_t i = bi * GRAM_BLOCK; i < i1; i++) {
+                const size_t j1 = j0 + GRAM_BLOCK < i + 1 ? j0 + GRAM_BLOCK
+                                                          : i + 1;
+                for (size_t j = j0; j < j1; j++)
+                    g[i * p + j] = dot(wt + i * m, wt + j * m, m);
+            }
+    }
+}
+
+/* out = zt * wt, with 'zt' p x p and 'wt' p x m, all row-major */
+static void multiply(double* out, const double* zt, const double* wt,
+                     size_t p, size_t m) {
+    const size_t nblocks = (m + PROJ_BLOCK - 1) / PROJ_BLOCK;
+#pragma omp parallel for collapse(2) schedule(static)                          \
+    if (p * m >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < p; i++)
+        for (size_t b = 0; b < nblocks; b++) {
+            const size_t c0 = b * PROJ_BLOCK;
+            const size_t len = m - c0 < PROJ_BLOCK ? m - c0 : PROJ_BLOCK;
+            double* o = out + i * m + c0;
+            for (size_t c = 0; c < len; c++)
+                o[c] = 0.0;
+            for (size_t k = 0; k < p; k++) {
+                const double z = zt[i * p + k];
+                const double* w = wt + k * m + c0;
+                for (size_t c = 0; c < len; c++)
+                    o[c] += z * w[c];
+            }
+        }
+}
+
+/*
+ * Rotates the columns of W onto the eigenvectors of W^T W, which leaves them
+ * nearly orthogonal, so that Jacobi only has to polish. 'zt' and 'tmp' are
+ * p x p and p x m scratch; V^T becomes the eigenvector rows. Returns zero if
+ * the eigensolver failed, leaving W and V^T as they were.
+ */
+static int precondition(double* wt, double* tmp, size_t p, size_t m,
+                        double* vt, double* zt, size_t* sweeps) {
+    double* g = malloc(p * p * sizeof(double));
+    double* work = malloc(7 * p * sizeof(double));
+    int ok = g && work;
+    if (ok) {
+        gram(g, wt, p, m);
+        for (size_t i = 0; i < p; i++)
+            for (size_t j = i + 1; j < p; j++)
+                g[i * p + j] = g[j * p + i];
+        memset(zt, 0, p * p * sizeof(double));
+        ok = dense_eigen(g, p, work + 6 * p, zt, work, sweeps);
+    }
+    if (ok) {
+        multiply(tmp, zt, wt, p, m);
+        memcpy(wt, tmp, p * m * sizeof(double));
+        if (vt)
+            memcpy(vt, zt, p * p * sizeof(double));
+    }
+    free(g);
+    free(work);
+    return ok;
+}
+
+eigen_result __svd(double** mat, size_t nlines, size_t linelen, double* s,
+                   size_t ns, double** u, size_t u_nlines, size_t u_linelen,
+                   double** v, size_t v_nlines, size_t v_linelen,
+                   int lines_are_cols) {
+    eigen_result res = {0, 0};
+    const size_t m = rows_of(nlines, linelen, lines_are_cols);
+    const size_t n = cols_of(nlines, linelen, lines_are_cols);
+    const size_t p = m < n ? m : n;
+    if (ns != p ||
+        (u && (rows_of(u_nlines, u_linelen, lines_are_cols) != m ||
+               cols_of(u_nlines, u_linelen, lines_are_cols) != p)) ||
+        (v && (rows_of(v_nlines, v_linelen, lines_are_cols) != n ||
+               cols_of(v_nlines, v_linelen, lines_are_cols) != p))) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ svd_matrix!\n");
+        return res;
+    }
+    if (p == 0) {
+        res.converged = 1;
+        return res;
+    }
+    /* work on B = A, or B = A^T when A is wide: B is mb x p, mb >= p */
+    const int wide = m < n;
+    const size_t mb = wide ? n : m;
+    double** left = wide ? v : u;
+    double** right = wide ? u : v;
+    double* wt = malloc(p * mb * sizeof(double));
+    double* vt = right ? calloc(p * p, sizeof(double)) : NULL;
+    double* sigma = malloc(p * sizeof(double));
+    size_t* perm = malloc(p * sizeof(size_t));
+    double** cols = malloc(p * sizeof(double*));
+    char** table = malloc((nlines + linelen) * sizeof(char*));
+    if (!wt || (right && !vt) || !sigma || !perm || !cols || !table) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ svd_matrix!\n");
+        goto done;
+    }
+    /* the columns of B are the columns of A, or the rows of a wide A */
+    read_lines(wt, mat, nlines, linelen, lines_are_cols, !wide, table);
+    if (vt)
+        for (size_t i = 0; i < p; i++)
+            vt[i * p + i] = 1.0;
+    if (p >= PRECOND_MIN) {
+        size_t ql_sweeps = 0;
+        double* tmp = malloc(p * mb * sizeof(double));
+        double* zt = malloc(p * p * sizeof(double));
+        if (tmp && zt)
+            precondition(wt, tmp, p, mb, vt, zt, &ql_sweeps);
+        free(tmp);
+        free(zt);
+    }
+    res.converged = jacobi(wt, p, mb, vt, &res.iterations);
+    if (!res.converged)
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Jacobi sweeps did not converge @ svd_matrix!\n");
+
+    for (size_t j = 0; j < p; j++)
+        sigma[j] = sqrt(dot(wt + j * mb, wt + j * mb, mb));
+    sort_perm(perm, sigma, p, 1);
+    for (size_t j = 0; j < p; j++)
+        s[j] = sigma[perm[j]];
+    if (left) {
+        /* a zero singular value leaves its column of U zero */
+        for (size_t j = 0; j < p; j++) {
+            double* col = wt + j * mb;
+            const double scale = sigma[j] > 0.0 ? 1.0 / sigma[j] : 0.0;
+            for (size_t i = 0; i < mb; i++)
+                col[i] *= scale;
+        }
+        for (size_t j = 0; j < p; j++)
+            cols[j] = wt + perm[j] * mb;
+        write_columns(left, lines_are_cols, cols, p, mb, table);
+    }
+    if (right) {
+        for (size_t j = 0; j < p; j++)
+            cols[j] = vt + perm[j] * p;
+        write_columns(right, lines_are_cols, cols, p, p, table);
+    }
+done:
+    free(wt);
+    free(vt);
+    free(sigma);
+    free(perm);
+    free(cols);
+    free(table);
+    return res;
+}
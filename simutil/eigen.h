@@ -0,0 +1,114 @@
+#ifndef SIMUTIL_EIGEN_H
+#define SIMUTIL_EIGEN_H
+
+#ifndef SIMUTIL_KRYLOV_H
+#include "krylov.h"
+#endif
+
+/**
+ * @brief Outcome of a decomposition. 'iterations' counts QL sweeps, Lanczos
+ * steps or Jacobi sweeps; 'converged' is zero if the iteration limit was hit
+ * or the arguments were rejected.
+ *
+ */
+typedef struct {
+    size_t iterations;
+    int converged;
+} eigen_result;
+
+SIMUTIL_API eigen_result __eigen_symmetric(double** mat, size_t nlines,
+                                           size_t linelen, double* w,
+                                           size_t nw, double** vecs,
+                                           size_t vec_nlines,
+                                           size_t vec_linelen,
+                                           int lines_are_cols);
+
+SIMUTIL_API eigen_result __eigen_lanczos(krylov_op_t op, void* ctx, size_t n,
+                                         double* w, size_t k, double** vecs,
+                                         size_t vec_nlines,
+                                         size_t vec_linelen,
+                                         int lines_are_cols, double tol,
+                                         size_t maxdim);
+
+SIMUTIL_API eigen_result __svd(double** mat, size_t nlines, size_t linelen,
+                               double* s, size_t ns, double** u,
+                               size_t u_nlines, size_t u_linelen, double** v,
+                               size_t v_nlines, size_t v_linelen,
+                               int lines_are_cols);
+
+/* extents of an optional matrix argument, zero for NULL */
+#define __EIGEN_NLINES(mat) ((mat) ? (size_t)MATRIX_NLINES(mat) : 0)
+#define __EIGEN_LINELEN(mat) ((mat) ? (size_t)MATRIX_LINELEN(mat) : 0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                           Symmetric Eigenvalues                          */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to compute every eigenvalue, and optionally every eigenvector,
+ * of a dense symmetric 'matrix(double)': Householder reduction to
+ * tridiagonal form, then implicit QL iterations. Only the lower triangle of
+ * 'mat' is read, and 'mat' is left unchanged.
+ *
+ * @param mat Symmetric n x n matrix
+ * @param w 'vector(double)' of length n, set to the eigenvalues in increasing
+ * order
+ * @param vecs n x n 'matrix(double)' whose column j is set to the unit
+ * eigenvector of w[j], or NULL
+ */
+#define eigen_symmetric(mat, w, vecs)                                          \
+    __eigen_symmetric((double**)(mat), MATRIX_NLINES(mat),                     \
+                      MATRIX_LINELEN(mat), (w) + 1, (size_t)LENGTH(w),         \
+                      (double**)(vecs), __EIGEN_NLINES(vecs),                  \
+                      __EIGEN_LINELEN(vecs), __SIMUTIL_LINES_ARE_COLS)
+
+/**
+ * @brief Macro to compute the k largest eigenvalues, and optionally their
+ * eigenvectors, of a symmetric operator with k = LENGTH(w). Runs Lanczos
+ * with full reorthogonalization until the residual of every wanted Ritz pair
+ * is below 'tol' times the largest Ritz value, or the basis reaches 'maxdim'
+ * vectors. The start vector is fixed, so runs are repeatable.
+ *
+ * @param op Callback computing A * x, e.g. 'krylov_dense_matvec'
+ * @param ctx User data passed to 'op'
+ * @param n Size of the operator
+ * @param w 'vector(double)' set to the eigenvalues in decreasing order
+ * @param vecs n x k 'matrix(double)' whose column j is set to the unit
+ * eigenvector of w[j], or NULL
+ * @param tol Relative residual tolerance
+ * @param maxdim Largest basis size, or 0 for a default of max(4k, k + 64)
+ */
+#define eigen_lanczos(op, ctx, n, w, vecs, tol, maxdim)                        \
+    __eigen_lanczos((op), (ctx), (n), (w) + 1, (size_t)LENGTH(w),              \
+                    (double**)(vecs), __EIGEN_NLINES(vecs),                    \
+                    __EIGEN_LINELEN(vecs), __SIMUTIL_LINES_ARE_COLS, (tol),    \
+                    (maxdim))
+
+/****************************************************************************/
+/*                                                                          */
+/*                        Singular Value Decomposition                      */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to compute the thin singular value decomposition
+ * A = U diag(s) V^T of an m x n 'matrix(double)' (m rows, n columns) by
+ * one-sided Jacobi rotations. From p = 64 on, the columns are first rotated
+ * onto the eigenvectors of A^T A, so Jacobi converges in a sweep or two.
+ * With p = min(m, n), 'u' is m x p and 'v' is n x p. 'mat' is left unchanged.
+ *
+ * @param mat Matrix to decompose
+ * @param s 'vector(double)' of length p, set to the singular values in
+ * decreasing order
+ * @param u Matrix set to the left singular vectors (columns), or NULL
+ * @param v Matrix set to the right singular vectors (columns), or NULL
+ */
+#define svd_matrix(mat, s, u, v)                                               \
+    __svd((double**)(mat), MATRIX_NLINES(mat), MATRIX_LINELEN(mat), (s) + 1,   \
+          (size_t)LENGTH(s), (double**)(u), __EIGEN_NLINES(u),                 \
+          __EIGEN_LINELEN(u), (double**)(v), __EIGEN_NLINES(v),                \
+          __EIGEN_LINELEN(v), __SIMUTIL_LINES_ARE_COLS)
+
+#endif
@@ -1,7 +1,7 @@
 #ifndef SIMUTIL_ERROR_H
 #define SIMUTIL_ERROR_H
 
-#include <stdlib.h>
+#include "simutil_includes.h"
 
 typedef enum {
     SIMUTIL_DIMENSION_ERROR,
@@ -11,7 +11,7 @@ typedef enum {
     SIMUTIL_DEFAULT_ERROR
 } error_t;
 
-void raise_error(error_t err, const char* format, ...)
+SIMUTIL_API void raise_error(error_t err, const char* format, ...)
     __attribute__((format(printf, 2, 3)));
 
 #define SIMUTIL_NULLPTR_CHECK(p)                                               \
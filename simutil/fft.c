@@ -0,0 +1,816 @@
+#include "fft.h"
+#include "error.h"
+#include "transpose.h"
+#include <math.h>
+#include <string.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_STAGES 64
+
+/* columns gathered per task when transforming across lines */
+#define ACROSS_BLOCK 16
+
+typedef struct {
+    int radix;
+    size_t m;      /* butterflies per group, n_s / radix */
+    size_t stride; /* distance between the inputs of one butterfly */
+    double* tw;    /* (radix - 1) * m complex twiddles */
+} fft_stage;
+
+struct fft_plan {
+    size_t n;
+    int dir;
+    int real;
+    /* mixed-radix Stockham passes */
+    size_t nstages;
+    fft_stage stages[MAX_STAGES];
+    double* twiddles;
+    /* Bluestein: convolution of length 'bn' through power-of-two plans */
+    size_t bn;
+    fft_plan* bfwd;
+    fft_plan* bbwd;
+    double* chirp;
+    double* bhat;
+    /* real data: complex plan of half (or, for odd n, full) length */
+    fft_plan* half;
+    double* rtw;
+    /* scratch for fft_execute, 'nwork' doubles */
+    size_t nwork;
+    double* work;
+};
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Butterflies                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Every pass maps x -> y with the autosorting Stockham scheme. For group q
+ * and offset k < s the inputs are x[k + s * (q + r * m)], r < radix, and the
+ * outputs, multiplied by the twiddle w_q^r, go to y[k + s * (radix * q + r)].
+ * The inner loop over k is contiguous and is done two complex values at a
+ * time with AVX.
+ */
+
+#define CMUL_RE(ar, ai, br, bi) ((ar) * (br) - (ai) * (bi))
+#define CMUL_IM(ar, ai, br, bi) ((ar) * (bi) + (ai) * (br))
+
+#ifdef __AVX__
+/* (v0, v1) * (wr + i wi) for two interleaved complex values */
+static inline __m256d cmul_avx(__m256d v, __m256d wr, __m256d wi) {
+    return _mm256_addsub_pd(_mm256_mul_pd(v, wr),
+                            _mm256_mul_pd(_mm256_permute_pd(v, 0x5), wi));
+}
+
+/* v * (dir * i) */
+static inline __m256d mul_diri_avx(__m256d v, int dir) {
+    const __m256d sw = _mm256_permute_pd(v, 0x5);
+    const __m256d sign = (dir < 0) ? _mm256_set_pd(-0.0, 0.0, -0.0, 0.0)
+                                   : _mm256_set_pd(0.0, -0.0, 0.0, -0.0);
+    return _mm256_xor_pd(sw, sign);
+}
+#endif
+
+static void pass2(const fft_stage* st, const double* x, double* y) {
+    const size_t m = st->m;
+    const size_t s = st->stride;
+    for (size_t q = 0; q < m; q++) {
+        const double wr = st->tw[2 * q];
+        const double wi = st->tw[2 * q + 1];
+        const double* a = x + 2 * s * q;
+        const double* b = x + 2 * s * (q + m);
+        double* y0 = y + 2 * s * (2 * q);
+        double* y1 = y0 + 2 * s;
+        size_t k = 0;
+#ifdef __AVX__
+        const __m256d vwr = _mm256_set1_pd(wr);
+        const __m256d vwi = _mm256_set1_pd(wi);
+        for (; k + 2 <= s; k += 2) {
+            const __m256d va = _mm256_loadu_pd(a + 2 * k);
+            const __m256d vb = _mm256_loadu_pd(b + 2 * k);
+            _mm256_storeu_pd(y0 + 2 * k, _mm256_add_pd(va, vb));
+            _mm256_storeu_pd(y1 + 2 * k,
+                             cmul_avx(_mm256_sub_pd(va, vb), vwr, vwi));
+        }
+#endif
+        for (; k < s; k++) {
+            const double ar = a[2 * k], ai = a[2 * k + 1];
+            const double br = b[2 * k], bi = b[2 * k + 1];
+            const double dr = ar - br, di = ai - bi;
+            y0[2 * k] = ar + br;
+            y0[2 * k + 1] = ai + bi;
+            y1[2 * k] = CMUL_RE(dr, di, wr, wi);
+            y1[2 * k + 1] = CMUL_IM(dr, di, wr, wi);
+        }
+    }
+}
+
+static void pass4(const fft_stage* st, const double* x, double* y, int dir) {
+    const size_t m = st->m;
+    const size_t s = st->stride;
+    const double d = (double)dir;
+    for (size_t q = 0; q < m; q++) {
+        const double w1r = st->tw[2 * q], w1i = st->tw[2 * q + 1];
+        const double w2r = st->tw[2 * (m + q)], w2i = st->tw[2 * (m + q) + 1];
+        const double w3r = st->tw[2 * (2 * m + q)];
+        const double w3i = st->tw[2 * (2 * m + q) + 1];
+        const double* a0 = x + 2 * s * q;
+        const double* a1 = x + 2 * s * (q + m);
+        const double* a2 = x + 2 * s * (q + 2 * m);
+        const double* a3 = x + 2 * s * (q + 3 * m);
+        double* y0 = y + 2 * s * (4 * q);
+        double* y1 = y0 + 2 * s;
+        double* y2 = y1 + 2 * s;
+        double* y3 = y2 + 2 * s;
+        size_t k = 0;
+#ifdef __AVX__
+        const __m256d v1r = _mm256_set1_pd(w1r), v1i = _mm256_set1_pd(w1i);
+        const __m256d v2r = _mm256_set1_pd(w2r), v2i = _mm256_set1_pd(w2i);
+        const __m256d v3r = _mm256_set1_pd(w3r), v3i = _mm256_set1_pd(w3i);
+        for (; k + 2 <= s; k += 2) {
+            const __m256d b0 = _mm256_loadu_pd(a0 + 2 * k);
+            const __m256d b1 = _mm256_loadu_pd(a1 + 2 * k);
+            const __m256d b2 = _mm256_loadu_pd(a2 + 2 * k);
+            const __m256d b3 = _mm256_loadu_pd(a3 + 2 * k);
+            const __m256d t0 = _mm256_add_pd(b0, b2);
+            const __m256d t1 = _mm256_sub_pd(b0, b2);
+            const __m256d t2 = _mm256_add_pd(b1, b3);
+            const __m256d t3 = mul_diri_avx(_mm256_sub_pd(b1, b3), dir);
+            _mm256_storeu_pd(y0 + 2 * k, _mm256_add_pd(t0, t2));
+            _mm256_storeu_pd(y1 + 2 * k,
+                             cmul_avx(_mm256_add_pd(t1, t3), v1r, v1i));
+            _mm256_storeu_pd(y2 + 2 * k,
+                             cmul_avx(_mm256_sub_pd(t0, t2), v2r, v2i));
+            _mm256_storeu_pd(y3 + 2 * k,
+                             cmul_avx(_mm256_sub_pd(t1, t3), v3r, v3i));
+        }
+#endif
+        for (; k < s; k++) {
+            const double t0r = a0[2 * k] + a2[2 * k];
+            const double t0i = a0[2 * k + 1] + a2[2 * k + 1];
+            const double t1r = a0[2 * k] - a2[2 * k];
+            const double t1i = a0[2 * k + 1] - a2[2 * k + 1];
+            const double t2r = a1[2 * k] + a3[2 * k];
+            const double t2i = a1[2 * k + 1] + a3[2 * k + 1];
+            /* (a1 - a3) * (dir * i) */
+            const double t3r = -d * (a1[2 * k + 1] - a3[2 * k + 1]);
+            const double t3i = d * (a1[2 * k] - a3[2 * k]);
+            double ur, ui;
+            y0[2 * k] = t0r + t2r;
+            y0[2 * k + 1] = t0i + t2i;
+            ur = t1r + t3r;
+            ui = t1i + t3i;
+            y1[2 * k] = CMUL_RE(ur, ui, w1r, w1i);
+            y1[2 * k + 1] = CMUL_IM(ur, ui, w1r, w1i);
+            ur = t0r - t2r;
+            ui = t0i - t2i;
+            y2[2 * k] = CMUL_RE(ur, ui, w2r, w2i);
+            y2[2 * k + 1] = CMUL_IM(ur, ui, w2r, w2i);
+            ur = t1r - t3r;
+            ui = t1i - t3i;
+            y3[2 * k] = CMUL_RE(ur, ui, w3r, w3i);
+            y3[2 * k + 1] = CMUL_IM(ur, ui, w3r, w3i);
+        }
+    }
+}
+
+static void pass3(const fft_stage* st, const double* x, double* y, int dir) {
+    const size_t m = st->m;
+    const size_t s = st->stride;
+    const double s3 = (double)dir * 0.86602540378443864676;
+    for (size_t q = 0; q < m; q++) {
+        const double w1r = st->tw[2 * q], w1i = st->tw[2 * q + 1];
+        const double w2r = st->tw[2 * (m + q)], w2i = st->tw[2 * (m + q) + 1];
+        const double* a0 = x + 2 * s * q;
+        const double* a1 = x + 2 * s * (q + m);
+        const double* a2 = x + 2 * s * (q + 2 * m);
+        double* y0 = y + 2 * s * (3 * q);
+        double* y1 = y0 + 2 * s;
+        double* y2 = y1 + 2 * s;
+        for (size_t k = 0; k < s; k++) {
+            const double tr = a1[2 * k] + a2[2 * k];
+            const double ti = a1[2 * k + 1] + a2[2 * k + 1];
+            const double mr = a0[2 * k] - 0.5 * tr;
+            const double mi = a0[2 * k + 1] - 0.5 * ti;
+            /* i * s3 * (a1 - a2) */
+            const double jr = -s3 * (a1[2 * k + 1] - a2[2 * k + 1]);
+            const double ji = s3 * (a1[2 * k] - a2[2 * k]);
+            double ur, ui;
+            y0[2 * k] = a0[2 * k] + tr;
+            y0[2 * k + 1] = a0[2 * k + 1] + ti;
+            ur = mr + jr;
+            ui = mi + ji;
+            y1[2 * k] = CMUL_RE(ur, ui, w1r, w1i);
+            y1[2 * k + 1] = CMUL_IM(ur, ui, w1r, w1i);
+            ur = mr - jr;
+            ui = mi - ji;
+            y2[2 * k] = CMUL_RE(ur, ui, w2r, w2i);
+            y2[2 * k + 1] = CMUL_IM(ur, ui, w2r, w2i);
+        }
+    }
+}
+
+static void pass5(const fft_stage* st, const double* x, double* y, int dir) {
+    const size_t m = st->m;
+    const size_t s = st->stride;
+    const double c1 = 0.30901699437494742410;  /* cos(2 pi / 5) */
+    const double c2 = -0.80901699437494742410; /* cos(4 pi / 5) */
+    const double s1 = (double)dir * 0.95105651629515357212;
+    const double s2 = (double)dir * 0.58778525229247312917;
+    for (size_t q = 0; q < m; q++) {
+        const double* w = st->tw;
+        const double* a0 = x + 2 * s * q;
+        const double* a1 = x + 2 * s * (q + m);
+        const double* a2 = x + 2 * s * (q + 2 * m);
+        const double* a3 = x + 2 * s * (q + 3 * m);
+        const double* a4 = x + 2 * s * (q + 4 * m);
+        double* yr[5];
+        yr[0] = y + 2 * s * (5 * q);
+        for (int r = 1; r < 5; r++)
+            yr[r] = yr[r - 1] + 2 * s;
+        for (size_t k = 0; k < s; k++) {
+            const double b1r = a1[2 * k] + a4[2 * k];
+            const double b1i = a1[2 * k + 1] + a4[2 * k + 1];
+            const double b2r = a2[2 * k] + a3[2 * k];
+            const double b2i = a2[2 * k + 1] + a3[2 * k + 1];
+            const double d1r = a1[2 * k] - a4[2 * k];
+            const double d1i = a1[2 * k + 1] - a4[2 * k + 1];
+            const double d2r = a2[2 * k] - a3[2 * k];
+            const double d2i = a2[2 * k + 1] - a3[2 * k + 1];
+            const double p1r = a0[2 * k] + c1 * b1r + c2 * b2r;
+            const double p1i = a0[2 * k + 1] + c1 * b1i + c2 * b2i;
+            const double p2r = a0[2 * k] + c2 * b1r + c1 * b2r;
+            const double p2i = a0[2 * k + 1] + c2 * b1i + c1 * b2i;
+            /* i * (s1 d1 + s2 d2) and i * (s2 d1 - s1 d2) */
+            const double j1r = -(s1 * d1i + s2 * d2i);
+            const double j1i = s1 * d1r + s2 * d2r;
+            const double j2r = -(s2 * d1i - s1 * d2i);
+            const double j2i = s2 * d1r - s1 * d2r;
+            const double vr[5] = {a0[2 * k] + b1r + b2r, p1r + j1r, p2r + j2r,
+                                  p2r - j2r, p1r - j1r};
+            const double vi[5] = {a0[2 * k + 1] + b1i + b2i, p1i + j1i,
+                                  p2i + j2i, p2i - j2i, p1i - j1i};
+            yr[0][2 * k] = vr[0];
+            yr[0][2 * k + 1] = vi[0];
+            for (int r = 1; r < 5; r++) {
+                const double wr = w[2 * ((r - 1) * m + q)];
+                const double wi = w[2 * ((r - 1) * m + q) + 1];
+                yr[r][2 * k] = CMUL_RE(vr[r], vi[r], wr, wi);
+                yr[r][2 * k + 1] = CMUL_IM(vr[r], vi[r], wr, wi);
+            }
+        }
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Execution                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static void exec_complex(const fft_plan* p, double* x, double* work);
+
+static void exec_stockham(const fft_plan* p, double* x, double* work) {
+    double* src = x;
+    double* dst = work;
+    for (size_t i = 0; i < p->nstages; i++) {
+        const fft_stage* st = &p->stages[i];
+        switch (st->radix) {
+        case 2:
+            pass2(st, src, dst);
+            break;
+        case 3:
+            pass3(st, src, dst, p->dir);
+            break;
+        case 4:
+            pass4(st, src, dst, p->dir);
+            break;
+        default:
+            pass5(st, src, dst, p->dir);
+            break;
+        }
+        double* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != x)
+        memcpy(x, src, 2 * p->n * sizeof(double));
+}
+
+static void exec_bluestein(const fft_plan* p, double* x, double* work) {
+    const size_t n = p->n;
+    const size_t bn = p->bn;
+    double* a = work;
+    double* sub = work + 2 * bn;
+    for (size_t k = 0; k < n; k++) {
+        const double cr = p->chirp[2 * k], ci = p->chirp[2 * k + 1];
+        a[2 * k] = CMUL_RE(x[2 * k], x[2 * k + 1], cr, ci);
+        a[2 * k + 1] = CMUL_IM(x[2 * k], x[2 * k + 1], cr, ci);
+    }
+    memset(a + 2 * n, 0, 2 * (bn - n) * sizeof(double));
+    exec_complex(p->bfwd, a, sub);
+    for (size_t k = 0; k < bn; k++) {
+        const double ar = a[2 * k], ai = a[2 * k + 1];
+        const double br = p->bhat[2 * k], bi = p->bhat[2 * k + 1];
+        a[2 * k] = CMUL_RE(ar, ai, br, bi);
+        a[2 * k + 1] = CMUL_IM(ar, ai, br, bi);
+    }
+    exec_complex(p->bbwd, a, sub);
+    for (size_t k = 0; k < n; k++) {
+        const double cr = p->chirp[2 * k], ci = p->chirp[2 * k + 1];
+        x[2 * k] = CMUL_RE(a[2 * k], a[2 * k + 1], cr, ci);
+        x[2 * k + 1] = CMUL_IM(a[2 * k], a[2 * k + 1], cr, ci);
+    }
+}
+
+/* in-place complex transform of 'x' using 'p->nwork' doubles of 'work' */
+static void exec_complex(const fft_plan* p, double* x, double* work) {
+    if (p->bn)
+        exec_bluestein(p, x, work);
+    else
+        exec_stockham(p, x, work);
+}
+
+/* real-to-complex (forward) or complex-to-real (backward), out of place */
+static void exec_real(const fft_plan* p, double* out, const double* in,
+                      double* work) {
+    const size_t n = p->n;
+    const size_t h = n / 2;
+    if (n % 2) {
+        /* odd length: go through a full complex transform */
+        double* z = work + p->half->nwork;
+        if (p->dir == FFT_FORWARD) {
+            for (size_t k = 0; k < n; k++) {
+                z[2 * k] = in[k];
+                z[2 * k + 1] = 0.0;
+            }
+            exec_complex(p->half, z, work);
+            memcpy(out, z, 2 * (h + 1) * sizeof(double));
+        } else {
+            memcpy(z, in, 2 * (h + 1) * sizeof(double));
+            for (size_t k = 1; k <= h; k++) {
+                z[2 * (n - k)] = in[2 * k];
+                z[2 * (n - k) + 1] = -in[2 * k + 1];
+            }
+            exec_complex(p->half, z, work);
+            for (size_t k = 0; k < n; k++)
+                out[k] = z[2 * k];
+        }
+        return;
+    }
+    if (p->dir == FFT_FORWARD) {
+        /* pack even/odd samples as one complex signal of length n / 2 */
+        if ((const double*)out != in)
+            memmove(out, in, n * sizeof(double));
+        exec_complex(p->half, out, work);
+        const double z0r = out[0], z0i = out[1];
+        out[0] = z0r + z0i;
+        out[1] = 0.0;
+        out[2 * h] = z0r - z0i;
+        out[2 * h + 1] = 0.0;
+        for (size_t k = 1; 2 * k <= h; k++) {
+            const size_t j = h - k;
+            const double zkr = out[2 * k], zki = out[2 * k + 1];
+            const double zjr = out[2 * j], zji = out[2 * j + 1];
+            /* A = Zk + conj(Zj), B = Zk - conj(Zj) */
+            const double Ar = zkr + zjr, Ai = zki - zji;
+            const double Br = zkr - zjr, Bi = zki + zji;
+            const double wkr = p->rtw[2 * k], wki = p->rtw[2 * k + 1];
+            const double wjr = p->rtw[2 * j], wji = p->rtw[2 * j + 1];
+            /* Xk = A / 2 - i / 2 * W^k * B */
+            const double ckr = CMUL_RE(wkr, wki, Br, Bi);
+            const double cki = CMUL_IM(wkr, wki, Br, Bi);
+            /* Xj = conj(A) / 2 + i / 2 * W^j * conj(B) */
+            const double cjr = CMUL_RE(wjr, wji, Br, -Bi);
+            const double cji = CMUL_IM(wjr, wji, Br, -Bi);
+            out[2 * k] = 0.5 * (Ar + cki);
+            out[2 * k + 1] = 0.5 * (Ai - ckr);
+            out[2 * j] = 0.5 * (Ar - cji);
+            out[2 * j + 1] = 0.5 * (-Ai + cjr);
+        }
+    } else {
+        /* rebuild the packed half-length spectrum, then transform back */
+        for (size_t k = 0; k < h; k++) {
+            const size_t j = h - k;
+            const double xkr = in[2 * k], xki = in[2 * k + 1];
+            const double xjr = in[2 * j], xji = in[2 * j + 1];
+            const double Ar = xkr + xjr, Ai = xki - xji;
+            const double Br = xkr - xjr, Bi = xki + xji;
+            /* Zk = A + i * conj(W^k) * B */
+            const double wr = p->rtw[2 * k], wi = -p->rtw[2 * k + 1];
+            const double cr = CMUL_RE(wr, wi, Br, Bi);
+            const double ci = CMUL_IM(wr, wi, Br, Bi);
+            out[2 * k] = Ar - ci;
+            out[2 * k + 1] = Ai + cr;
+        }
+        exec_complex(p->half, out, work);
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Planning                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static inline void unit_root(double* w, size_t num, size_t den, int dir) {
+    const double angle = (double)dir * 2.0 * M_PI * (double)(num % den) /
+                         (double)den;
+    w[0] = cos(angle);
+    w[1] = sin(angle);
+}
+
+static size_t smooth_remainder(size_t n) {
+    while (n % 2 == 0)
+        n /= 2;
+    while (n % 3 == 0)
+        n /= 3;
+    while (n % 5 == 0)
+        n /= 5;
+    return n;
+}
+
+static fft_plan* alloc_plan(size_t n, int dir) {
+    fft_plan* p = calloc(1, sizeof(fft_plan));
+    if (!p) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for fft plan!\n");
+        return NULL;
+    }
+    p->n = n;
+    p->dir = dir;
+    return p;
+}
+
+static int plan_stockham(fft_plan* p) {
+    size_t n = p->n;
+    int radices[MAX_STAGES];
+    size_t ns = 0;
+    while (n % 4 == 0) {
+        radices[ns++] = 4;
+        n /= 4;
+    }
+    while (n % 2 == 0) {
+        radices[ns++] = 2;
+        n /= 2;
+    }
+    while (n % 3 == 0) {
+        radices[ns++] = 3;
+        n /= 3;
+    }
+    while (n % 5 == 0) {
+        radices[ns++] = 5;
+        n /= 5;
+    }
+    /* every pass holds (radix - 1) * m <= n twiddles */
+    p->twiddles = malloc(2 * (ns ? ns : 1) * p->n * sizeof(double));
+    if (!p->twiddles)
+        return 1;
+    double* tw = p->twiddles;
+    size_t len = p->n;
+    size_t stride = 1;
+    for (size_t i = 0; i < ns; i++) {
+        fft_stage* st = &p->stages[i];
+        st->radix = radices[i];
+        st->m = len / (size_t)st->radix;
+        st->stride = stride;
+        st->tw = tw;
+        for (int r = 1; r < st->radix; r++)
+            for (size_t q = 0; q < st->m; q++)
+                unit_root(tw + 2 * ((r - 1) * st->m + q), q * (size_t)r, len,
+                          p->dir);
+        tw += 2 * (st->radix - 1) * st->m;
+        len = st->m;
+        stride *= (size_t)st->radix;
+    }
+    p->nstages = ns;
+    p->nwork = 2 * p->n;
+    return 0;
+}
+
+static int plan_bluestein(fft_plan* p) {
+    const size_t n = p->n;
+    size_t bn = 1;
+    while (bn < 2 * n - 1)
+        bn *= 2;
+    p->bn = bn;
+    p->bfwd = new_fft_plan(bn, FFT_FORWARD);
+    p->bbwd = new_fft_plan(bn, FFT_BACKWARD);
+    p->chirp = malloc(2 * n * sizeof(double));
+    p->bhat = calloc(2 * bn, sizeof(double));
+    double* sub = malloc(2 * bn * sizeof(double));
+    if (!p->bfwd || !p->bbwd || !p->chirp || !p->bhat || !sub) {
+        free(sub);
+        return 1;
+    }
+    /* chirp_k = exp(dir * i pi k^2 / n), with k^2 reduced mod 2n */
+    for (size_t k = 0; k < n; k++) {
+        const size_t k2 = (size_t)(((unsigned long long)k * k) % (2 * n));
+        const double angle = (double)p->dir * M_PI * (double)k2 / (double)n;
+        p->chirp[2 * k] = cos(angle);
+        p->chirp[2 * k + 1] = sin(angle);
+    }
+    /* b = conj(chirp), wrapped around, pre-transformed and pre-scaled */
+    const double scale = 1.0 / (double)bn;
+    for (size_t k = 0; k < n; k++) {
+        p->bhat[2 * k] = p->chirp[2 * k] * scale;
+        p->bhat[2 * k + 1] = -p->chirp[2 * k + 1] * scale;
+        if (k) {
+            p->bhat[2 * (bn - k)] = p->bhat[2 * k];
+            p->bhat[2 * (bn - k) + 1] = p->bhat[2 * k + 1];
+        }
+    }
+    exec_complex(p->bfwd, p->bhat, sub);
+    free(sub);
+    p->nwork = 2 * bn + p->bfwd->nwork;
+    return 0;
+}
+
+fft_plan* new_fft_plan(size_t n, int dir) {
+    if (!n || (dir != FFT_FORWARD && dir != FFT_BACKWARD)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Invalid length or direction @ new_fft_plan!\n");
+        return NULL;
+    }
+    fft_plan* p = alloc_plan(n, dir);
+    if (!p)
+        return NULL;
+    int fail = (smooth_remainder(n) == 1) ? plan_stockham(p)
+                                          : plan_bluestein(p);
+    if (!fail) {
+        p->work = malloc(p->nwork * sizeof(double));
+        fail = !p->work;
+    }
+    if (fail) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for fft plan!\n");
+        free_fft_plan(p);
+        return NULL;
+    }
+    return p;
+}
+
+fft_plan* new_rfft_plan(size_t n, int dir) {
+    if (!n || (dir != FFT_FORWARD && dir != FFT_BACKWARD)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Invalid length or direction @ new_rfft_plan!\n");
+        return NULL;
+    }
+    fft_plan* p = alloc_plan(n, dir);
+    if (!p)
+        return NULL;
+    p->real = 1;
+    int fail = 0;
+    if (n % 2) {
+        p->half = new_fft_plan(n, dir);
+        fail = !p->half;
+        if (!fail)
+            p->nwork = p->half->nwork + 2 * n;
+    } else {
+        const size_t h = n / 2;
+        p->half = new_fft_plan(h, dir);
+        p->rtw = malloc(2 * (h + 1) * sizeof(double));
+        fail = !p->half || !p->rtw;
+        if (!fail) {
+            for (size_t k = 0; k <= h; k++)
+                unit_root(p->rtw + 2 * k, k, n, FFT_FORWARD);
+            p->nwork = p->half->nwork;
+        }
+    }
+    if (!fail) {
+        p->work = malloc(p->nwork * sizeof(double));
+        fail = !p->work;
+    }
+    if (fail) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for fft plan!\n");
+        free_fft_plan(p);
+        return NULL;
+    }
+    return p;
+}
+
+void free_fft_plan(fft_plan* plan) {
+    if (!plan)
+        return;
+    free(plan->twiddles);
+    free_fft_plan(plan->bfwd);
+    free_fft_plan(plan->bbwd);
+    free(plan->chirp);
+    free(plan->bhat);
+    free_fft_plan(plan->half);
+    free(plan->rtw);
+    free(plan->work);
+    free(plan);
+}
+
+void fft_execute(fft_plan* plan, void* out, const void* in) {
+    if (!plan || !out || !in) {
+        raise_error(SIMUTIL_NULL_ERROR,
+                    "Received null pointer in 'fft_execute()'\n");
+        return;
+    }
+    if (plan->real) {
+        exec_real(plan, (double*)out, (const double*)in, plan->work);
+        return;
+    }
+    if (out != in)
+        memcpy(out, in, 2 * plan->n * sizeof(double));
+    exec_complex(plan, (double*)out, plan->work);
+}
+
+int __fft_vector(fft_plan* plan, void* out, size_t out_len, const void* in,
+                 size_t in_len) {
+    if (!plan)
+        return 1;
+    const size_t n = plan->n;
+    size_t want_in = n;
+    size_t want_out = n;
+    if (plan->real && plan->dir == FFT_FORWARD)
+        want_out = n / 2 + 1;
+    else if (plan->real)
+        want_in = n / 2 + 1;
+    if (in_len != want_in || out_len != want_out)
+        return 1;
+    fft_execute(plan, out, in);
+    return 0;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                         Multi-dimensional Passes                         */
+/*                                                                          */
+/****************************************************************************/
+
+/* complex transform of 'nl' contiguous lines of length 'len' */
+static void fft_contiguous(char* const* lines, size_t nl, size_t len,
+                           int dir) {
+    if (len < 2)
+        return;
+    fft_plan* p = new_fft_plan(len, dir);
+    if (!p)
+        return;
+#pragma omp parallel
+    {
+        double* work = malloc(p->nwork * sizeof(double));
+#pragma omp for schedule(static)
+        for (long i = 0; i < (long)nl; i++)
+            if (work)
+                exec_complex(p, (double*)lines[i], work);
+        free(work);
+    }
+    free_fft_plan(p);
+}
+
+/*
+ * Complex transform across lines. Slice 'sl' is made of the 'nl' lines
+ * 'lines[sl * slice_step + t * line_step]', each 'len' long, and is
+ * transformed along 't'. Blocks of ACROSS_BLOCK columns are gathered with
+ * the blocked transpose, transformed contiguously and scattered back.
+ */
+static void fft_across(char* const* lines, size_t nslices, size_t slice_step,
+                       size_t line_step, size_t nl, size_t len, int dir) {
+    if (nl < 2)
+        return;
+    fft_plan* p = new_fft_plan(nl, dir);
+    if (!p)
+        return;
+    const size_t es = 2 * sizeof(double);
+    const size_t nblocks = (len + ACROSS_BLOCK - 1) / ACROSS_BLOCK;
+#pragma omp parallel
+    {
+        double* work = malloc(p->nwork * sizeof(double));
+        double* tmp = malloc(2 * ACROSS_BLOCK * nl * sizeof(double));
+        char** src = malloc(nl * sizeof(char*));
+        char* dst[ACROSS_BLOCK];
+#pragma omp for schedule(static)
+        for (long task = 0; task < (long)(nslices * nblocks); task++) {
+            if (!work || !tmp || !src)
+                continue;
+            const size_t sl = (size_t)task / nblocks;
+            const size_t c0 = ((size_t)task % nblocks) * ACROSS_BLOCK;
+            const size_t nc =
+                (c0 + ACROSS_BLOCK < len) ? ACROSS_BLOCK : len - c0;
+            for (size_t t = 0; t < nl; t++)
+                src[t] = lines[sl * slice_step + t * line_step] + c0 * es;
+            for (size_t c = 0; c < nc; c++)
+                dst[c] = (char*)(tmp + 2 * c * nl);
+            __transpose_tables(dst, src, nl, nc, es);
+            for (size_t c = 0; c < nc; c++)
+                exec_complex(p, (double*)dst[c], work);
+            __transpose_tables(src, dst, nc, nl, es);
+        }
+        free(work);
+        free(tmp);
+        free(src);
+    }
+    free_fft_plan(p);
+}
+
+/* real/complex transform between two sets of 'nl' lines */
+static void rfft_contiguous(char* const* cplx, char* const* real, size_t nl,
+                            size_t n, int dir) {
+    fft_plan* p = new_rfft_plan(n, dir);
+    if (!p)
+        return;
+#pragma omp parallel
+    {
+        double* work = malloc(p->nwork * sizeof(double));
+#pragma omp for schedule(static)
+        for (long i = 0; i < (long)nl; i++) {
+            if (!work)
+                continue;
+            if (dir == FFT_FORWARD)
+                exec_real(p, (double*)cplx[i], (const double*)real[i], work);
+            else
+                exec_real(p, (double*)real[i], (const double*)cplx[i], work);
+        }
+        free(work);
+    }
+    free_fft_plan(p);
+}
+
+/* 0-indexed table of the element-[1] pointers of a matrix */
+static char** table2(void** mat, size_t nlines, size_t es) {
+    char** t = malloc((nlines ? nlines : 1) * sizeof(char*));
+    if (!t) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for fft line table!\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < nlines; i++)
+        t[i] = (char*)mat[i + 1] + es;
+    return t;
+}
+
+/* 0-indexed table of the element-[1] pointers of a matrix3 */
+static char** table3(void*** mat3, const size_t* ext, size_t es) {
+    const size_t nl = ext[0] * ext[1];
+    char** t = malloc((nl ? nl : 1) * sizeof(char*));
+    if (!t) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for fft line table!\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < ext[0]; i++)
+        for (size_t j = 0; j < ext[1]; j++)
+            t[i * ext[1] + j] = (char*)mat3[i + 1][j + 1] + es;
+    return t;
+}
+
+void __fft_lines2(void** mat, size_t nlines, size_t linelen, int dir) {
+    char** lines = table2(mat, nlines, 2 * sizeof(double));
+    if (!lines)
+        return;
+    fft_contiguous(lines, nlines, linelen, dir);
+    fft_across(lines, 1, 0, 1, nlines, linelen, dir);
+    free(lines);
+}
+
+void __fft_lines3(void*** mat3, const size_t* ext, int dir) {
+    char** lines = table3(mat3, ext, 2 * sizeof(double));
+    if (!lines)
+        return;
+    fft_contiguous(lines, ext[0] * ext[1], ext[2], dir);
+    fft_across(lines, ext[0], ext[1], 1, ext[1], ext[2], dir);
+    fft_across(lines, ext[1], 1, ext[1], ext[0], ext[2], dir);
+    free(lines);
+}
+
+void __rfft_lines2(void** out, void** in, size_t nlines, size_t linelen,
+                   int dir) {
+    char** cplx = table2(out, nlines, 2 * sizeof(double));
+    char** real = table2(in, nlines, sizeof(double));
+    if (cplx && real) {
+        const size_t hl = linelen / 2 + 1;
+        if (dir == FFT_FORWARD) {
+            rfft_contiguous(cplx, real, nlines, linelen, dir);
+            fft_across(cplx, 1, 0, 1, nlines, hl, dir);
+        } else {
+            fft_across(cplx, 1, 0, 1, nlines, hl, dir);
+            rfft_contiguous(cplx, real, nlines, linelen, dir);
+        }
+    }
+    free(cplx);
+    free(real);
+}
+
+void __rfft_lines3(void*** out, void*** in, const size_t* ext, int dir) {
+    char** cplx = table3(out, ext, 2 * sizeof(double));
+    char** real = table3(in, ext, sizeof(double));
+    if (cplx && real) {
+        const size_t hl = ext[2] / 2 + 1;
+        if (dir == FFT_FORWARD)
+            rfft_contiguous(cplx, real, ext[0] * ext[1], ext[2], dir);
+        fft_across(cplx, ext[0], ext[1], 1, ext[1], hl, dir);
+        fft_across(cplx, ext[1], 1, ext[1], ext[0], hl, dir);
+        if (dir == FFT_BACKWARD)
+            rfft_contiguous(cplx, real, ext[0] * ext[1], ext[2], dir);
+    }
+    free(cplx);
+    free(real);
+}
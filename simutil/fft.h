@@ -0,0 +1,230 @@
+#ifndef SIMUTIL_FFT_H
+#define SIMUTIL_FFT_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/* sign of the exponent of the transform */
+#define FFT_FORWARD (-1)
+#define FFT_BACKWARD (+1)
+
+/**
+ * @brief Opaque transform plan. Holds the factorization, the twiddle tables
+ * and the scratch space for one transform length and direction, so it can be
+ * reused for any number of transforms of that length. A plan must not be
+ * executed from several threads at once.
+ *
+ */
+typedef struct fft_plan fft_plan;
+
+/**
+ * @brief Function to create a complex-to-complex plan. Lengths with prime
+ * factors 2, 3 and 5 use mixed radix-2/3/4/5 passes, any other length is
+ * handled with Bluestein's algorithm.
+ *
+ * @param n Transform length
+ * @param dir FFT_FORWARD or FFT_BACKWARD
+ */
+SIMUTIL_API fft_plan* new_fft_plan(size_t n, int dir);
+
+/**
+ * @brief Function to create a real-data plan. A forward plan maps 'n' real
+ * values to the 'n / 2 + 1' non-redundant complex coefficients, a backward
+ * plan maps them back to 'n' real values.
+ *
+ * @param n Length of the real signal
+ * @param dir FFT_FORWARD (real to complex) or FFT_BACKWARD (complex to real)
+ */
+SIMUTIL_API fft_plan* new_rfft_plan(size_t n, int dir);
+
+SIMUTIL_API void free_fft_plan(fft_plan* plan);
+
+/**
+ * @brief Function to execute a plan on raw, 0-indexed arrays. Complex data is
+ * stored as interleaved real/imaginary doubles ('double _Complex'). Complex
+ * transforms may be done in place. Backward transforms are unnormalized, so a
+ * forward/backward round trip scales the data by 'n'.
+ *
+ * @param plan Plan to execute
+ * @param out Output array
+ * @param in Input array
+ */
+SIMUTIL_API void fft_execute(fft_plan* plan, void* out, const void* in);
+
+SIMUTIL_API int __fft_vector(fft_plan* plan, void* out, size_t out_len,
+                             const void* in, size_t in_len);
+
+SIMUTIL_API void __fft_lines2(void** mat, size_t nlines, size_t linelen,
+                              int dir);
+
+SIMUTIL_API void __fft_lines3(void*** mat3, const size_t* ext, int dir);
+
+SIMUTIL_API void __rfft_lines2(void** out, void** in, size_t nlines,
+                               size_t linelen, int dir);
+
+SIMUTIL_API void __rfft_lines3(void*** out, void*** in, const size_t* ext,
+                               int dir);
+
+/****************************************************************************/
+/*                                                                          */
+/*                             Vector Transforms                            */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to run a plan on vectors. For complex plans both vectors are
+ * 'vector(double _Complex)' of the plan length (and may be the same vector).
+ * For real plans the real side is a 'vector(double)' of the plan length and
+ * the complex side holds 'n / 2 + 1' elements.
+ *
+ * @param plan Plan to execute
+ * @param out Output vector
+ * @param in Input vector
+ */
+#define fft_vector(plan, out, in)                                              \
+    do {                                                                       \
+        if (__fft_vector((plan), (void*)((out) + 1), LENGTH(out),              \
+                         (const void*)((in) + 1), LENGTH(in)))                 \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching vector lengths @ fft_vector!\n");          \
+    } while (0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                         Multi-dimensional Transforms                     */
+/*                                                                          */
+/****************************************************************************/
+
+#define __FFT_CHECK_COMPLEX(x, name)                                           \
+    do {                                                                       \
+        if (sizeof(x) != sizeof(double _Complex)) {                            \
+            raise_error(SIMUTIL_TYPE_ERROR,                                    \
+                        "Expected double _Complex elements @ " name "!\n");    \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @brief Macro to do an in-place 2-D transform of a 'matrix(double _Complex)'.
+ * Runs in parallel over lines when the library is built with OpenMP.
+ *
+ * @param mat Matrix to transform
+ * @param dir FFT_FORWARD or FFT_BACKWARD
+ */
+#define fft_matrix(mat, dir)                                                   \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(**(mat), "fft_matrix");                            \
+        __fft_lines2((void**)(mat), MATRIX_NLINES(mat), MATRIX_LINELEN(mat),   \
+                     (dir));                                                   \
+    } while (0)
+
+/**
+ * @brief Macro to do an in-place 3-D transform of a
+ * 'matrix3(double _Complex)'.
+ *
+ * @param mat3 Matrix3 to transform
+ * @param dir FFT_FORWARD or FFT_BACKWARD
+ */
+#define fft_matrix3(mat3, dir)                                                 \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(***(mat3), "fft_matrix3");                         \
+        const size_t ext[3] = {MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),         \
+                               MATRIX3_EXT3(mat3)};                            \
+        __fft_lines3((void***)(mat3), ext, (dir));                             \
+    } while (0)
+
+/**
+ * @brief Macro to do a real-to-complex 2-D transform. The contiguous axis of
+ * the complex 'out' holds 'n / 2 + 1' coefficients, where 'n' is the length
+ * of the contiguous axis of 'in' (the columns, or the rows with
+ * SIMUTIL_COL_MAJOR).
+ *
+ * @param out 'matrix(double _Complex)' holding the half spectrum
+ * @param in 'matrix(double)' with the real data
+ */
+#define rfft_matrix(out, in)                                                   \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(**(out), "rfft_matrix");                           \
+        if (MATRIX_NLINES(out) != MATRIX_NLINES(in) ||                         \
+            MATRIX_LINELEN(out) != MATRIX_LINELEN(in) / 2 + 1) {               \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching matrix dimensions @ rfft_matrix!\n");      \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __rfft_lines2((void**)(out), (void**)(in), MATRIX_NLINES(in),          \
+                      MATRIX_LINELEN(in), FFT_FORWARD);                        \
+    } while (0)
+
+/**
+ * @brief Macro to do the complex-to-real inverse of 'rfft_matrix'. Like the
+ * other backward transforms it is unnormalized. The complex input is
+ * overwritten.
+ *
+ * @param out 'matrix(double)' receiving the real data
+ * @param in 'matrix(double _Complex)' holding the half spectrum
+ */
+#define irfft_matrix(out, in)                                                  \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(**(in), "irfft_matrix");                           \
+        if (MATRIX_NLINES(out) != MATRIX_NLINES(in) ||                         \
+            MATRIX_LINELEN(in) != MATRIX_LINELEN(out) / 2 + 1) {               \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching matrix dimensions @ irfft_matrix!\n");     \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __rfft_lines2((void**)(in), (void**)(out), MATRIX_NLINES(out),         \
+                      MATRIX_LINELEN(out), FFT_BACKWARD);                      \
+    } while (0)
+
+/**
+ * @brief Macro to do a real-to-complex 3-D transform. The contiguous (third)
+ * axis of 'out' holds 'DIM3(in) / 2 + 1' coefficients.
+ *
+ * @param out 'matrix3(double _Complex)' holding the half spectrum
+ * @param in 'matrix3(double)' with the real data
+ */
+#define rfft_matrix3(out, in)                                                  \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(***(out), "rfft_matrix3");                         \
+        const size_t ext[3] = {MATRIX3_EXT1(in), MATRIX3_EXT2(in),             \
+                               MATRIX3_EXT3(in)};                              \
+        if ((size_t)MATRIX3_EXT1(out) != ext[0] ||                             \
+            (size_t)MATRIX3_EXT2(out) != ext[1] ||                             \
+            (size_t)MATRIX3_EXT3(out) != ext[2] / 2 + 1) {                     \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching matrix3 dimensions @ rfft_matrix3!\n");    \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __rfft_lines3((void***)(out), (void***)(in), ext, FFT_FORWARD);        \
+    } while (0)
+
+/**
+ * @brief Macro to do the complex-to-real inverse of 'rfft_matrix3'. The
+ * complex input is overwritten.
+ *
+ * @param out 'matrix3(double)' receiving the real data
+ * @param in 'matrix3(double _Complex)' holding the half spectrum
+ */
+#define irfft_matrix3(out, in)                                                 \
+    do {                                                                       \
+        __FFT_CHECK_COMPLEX(***(in), "irfft_matrix3");                         \
+        const size_t ext[3] = {MATRIX3_EXT1(out), MATRIX3_EXT2(out),           \
+                               MATRIX3_EXT3(out)};                             \
+        if ((size_t)MATRIX3_EXT1(in) != ext[0] ||                              \
+            (size_t)MATRIX3_EXT2(in) != ext[1] ||                              \
+            (size_t)MATRIX3_EXT3(in) != ext[2] / 2 + 1) {                      \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching matrix3 dimensions @ irfft_matrix3!\n");   \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __rfft_lines3((void***)(in), (void***)(out), ext, FFT_BACKWARD);       \
+    } while (0)
+
+#endif
@@ -0,0 +1,387 @@
+#include "interp.h"
+#include "error.h"
+#include <math.h>
+#include <string.h>
+
+/*
+ * Resampling of one axis: target sample t reads the 'width' consecutive source
+ * samples starting at first[t], with weights w[k * n_dst + t]. Windows are
+ * padded with zero weights to a common width, so the tables have no ragged
+ * rows and the innermost loops run over t.
+ */
+typedef struct {
+    size_t n_src;
+    size_t n_dst;
+    size_t width;
+    size_t* first;
+    double* w;
+} interp_axis;
+
+/*
+ * Fields are handled as tables of contiguous lines of extent ext[2], indexed
+ * by (i0, i1) as line i0 * ext[1] + i1. A plan resamples one axis per pass,
+ * in the order that moves the least data, ping-ponging between two buffers.
+ */
+struct interp_plan {
+    interp_method_t method;
+    size_t src_ext[3];
+    size_t dst_ext[3];
+    interp_axis axis[3];
+    size_t npass;
+    int order[3];
+    /* line tables of the user fields, filled at every apply */
+    double** src_lines;
+    double** dst_lines;
+    /* intermediate fields and their line tables, one per inner pass */
+    double* buf[2];
+    double** tmp_lines[2];
+};
+
+static void free_axis(interp_axis* ax) {
+    free(ax->first);
+    free(ax->w);
+}
+
+/* Adds a tap to the window of t, clamping the index to the edges. */
+static void add_tap(double* taps, long n, long idx, double w) {
+    if (idx < 0)
+        idx = 0;
+    if (idx >= n)
+        idx = n - 1;
+    taps[idx] += w;
+}
+
+static double cubic_weight(double x) {
+    const double a = -0.5;
+    x = fabs(x);
+    if (x < 1.0)
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    if (x < 2.0)
+        return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+    return 0.0;
+}
+
+/* Returns 0 on success, -1 when out of memory. */
+static int build_axis(interp_axis* ax, interp_method_t method, size_t n_src,
+                      size_t n_dst) {
+    const double scale = (double)n_src / (double)n_dst;
+    size_t width;
+    switch (method) {
+    case INTERP_LINEAR:
+        width = 2;
+        break;
+    case INTERP_CUBIC:
+        width = 4;
+        break;
+    default:
+        width = (size_t)ceil(scale) + 1;
+        break;
+    }
+    if (width > n_src)
+        width = n_src;
+
+    ax->n_src = n_src;
+    ax->n_dst = n_dst;
+    ax->width = width;
+    ax->first = malloc(n_dst * sizeof(size_t));
+    ax->w = calloc(width * n_dst, sizeof(double));
+    /* dense scratch row over the source axis, cleared after each target */
+    double* taps = calloc(n_src, sizeof(double));
+    if (!ax->first || !ax->w || !taps) {
+        free(taps);
+        return -1;
+    }
+
+    for (size_t t = 0; t < n_dst; t++) {
+        long lo, hi;
+        if (method == INTERP_CONSERVATIVE) {
+            const double x0 = (double)t * scale;
+            const double x1 = (double)(t + 1) * scale;
+            lo = (long)floor(x0);
+            hi = (long)ceil(x1) - 1;
+            for (long s = lo; s <= hi; s++) {
+                const double a = fmax(x0, (double)s);
+                const double b = fmin(x1, (double)(s + 1));
+                if (b > a)
+                    add_tap(taps, (long)n_src, s, (b - a) / scale);
+            }
+        } else {
+            const double x = ((double)t + 0.5) * scale - 0.5;
+            const long i0 = (long)floor(x);
+            const double f = x - (double)i0;
+            if (method == INTERP_LINEAR) {
+                lo = i0;
+                hi = i0 + 1;
+                add_tap(taps, (long)n_src, i0, 1.0 - f);
+                add_tap(taps, (long)n_src, i0 + 1, f);
+            } else {
+                lo = i0 - 1;
+                hi = i0 + 2;
+                for (long k = -1; k <= 2; k++)
+                    add_tap(taps, (long)n_src, i0 + k,
+                            cubic_weight(f - (double)k));
+            }
+        }
+        /* every clamped tap lies in [lo, hi], which fits the window */
+        if (lo < 0)
+            lo = 0;
+        size_t first = (size_t)lo;
+        if (first > n_src - width)
+            first = n_src - width;
+        ax->first[t] = first;
+        for (size_t k = 0; k < width; k++) {
+            ax->w[k * n_dst + t] = taps[first + k];
+            taps[first + k] = 0.0;
+        }
+    }
+    free(taps);
+    return 0;
+}
+
+static double pass_cost(const size_t* ext, const interp_axis* axis,
+                        const int* order, size_t npass) {
+    size_t cur[3] = {ext[0], ext[1], ext[2]};
+    double cost = 0.0;
+    for (size_t p = 0; p < npass; p++) {
+        const int a = order[p];
+        cur[a] = axis[a].n_dst;
+        cost += (double)cur[0] * (double)cur[1] * (double)cur[2] *
+                (double)axis[a].width;
+    }
+    return cost;
+}
+
+/* Picks the cheapest order of the resampled axes among all permutations. */
+static void choose_order(interp_plan* plan) {
+    static const int perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                                    {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    double best = -1.0;
+    for (size_t p = 0; p < 6; p++) {
+        int order[3];
+        size_t n = 0;
+        for (size_t i = 0; i < 3; i++) {
+            const int a = perms[p][i];
+            if (plan->src_ext[a] != plan->dst_ext[a])
+                order[n++] = a;
+        }
+        const double cost = pass_cost(plan->src_ext, plan->axis, order, n);
+        if (best < 0.0 || cost < best) {
+            best = cost;
+            plan->npass = n;
+            memcpy(plan->order, order, sizeof(order));
+        }
+    }
+}
+
+/*
+ * Pass along the contiguous axis: every line is resampled on its own. The
+ * loops over targets gather from the window starts, so they vectorize.
+ */
+static void pass_contig(double* const* dst, double* const* src, size_t nlines,
+                        const interp_axis* ax) {
+    const size_t n = ax->n_dst;
+    const size_t* restrict first = ax->first;
+#pragma omp parallel for schedule(static) if (nlines * n >= SIMUTIL_PAR_MIN)
+    for (size_t l = 0; l < nlines; l++) {
+        double* restrict d = dst[l];
+        const double* restrict s = src[l];
+        const double* restrict w = ax->w;
+        /* the common widths keep each target in a register */
+        if (ax->width == 2) {
+            for (size_t t = 0; t < n; t++) {
+                const double* sf = s + first[t];
+                d[t] = w[t] * sf[0] + w[n + t] * sf[1];
+            }
+            continue;
+        }
+        if (ax->width == 4) {
+            for (size_t t = 0; t < n; t++) {
+                const double* sf = s + first[t];
+                d[t] = w[t] * sf[0] + w[n + t] * sf[1] +
+                       w[2 * n + t] * sf[2] + w[3 * n + t] * sf[3];
+            }
+            continue;
+        }
+        for (size_t t = 0; t < n; t++)
+            d[t] = w[t] * s[first[t]];
+        for (size_t k = 1; k < ax->width; k++) {
+            const double* restrict wk = w + k * n;
+            const double* restrict sk = s + k;
+            for (size_t t = 0; t < n; t++)
+                d[t] += wk[t] * sk[first[t]];
+        }
+    }
+}
+
+/*
+ * Pass across lines: target line (p, t) is a weighted sum of whole source
+ * lines, where p runs over the untouched line index. Line (p, i) is found at
+ * p * stride_p + i * stride_i, with separate strides for source and target.
+ */
+static void pass_lines(double* const* dst, double* const* src, size_t np,
+                       size_t dst_sp, size_t dst_si, size_t src_sp,
+                       size_t src_si, size_t len, const interp_axis* ax) {
+    const size_t n = ax->n_dst;
+    const size_t width = ax->width;
+    const size_t total = np * n;
+#pragma omp parallel for schedule(static) if (total * len >= SIMUTIL_PAR_MIN)
+    for (size_t j = 0; j < total; j++) {
+        const size_t p = j / n;
+        const size_t t = j % n;
+        double* restrict d = dst[p * dst_sp + t * dst_si];
+        const size_t base = p * src_sp + ax->first[t] * src_si;
+        const double w0 = ax->w[t];
+        const double* restrict s0 = src[base];
+        for (size_t i = 0; i < len; i++)
+            d[i] = w0 * s0[i];
+        for (size_t k = 1; k < width; k++) {
+            const double wk = ax->w[k * n + t];
+            /* conservative windows are padded with zero weights */
+            if (wk == 0.0)
+                continue;
+            const double* restrict sk = src[base + k * src_si];
+            for (size_t i = 0; i < len; i++)
+                d[i] += wk * sk[i];
+        }
+    }
+}
+
+static void copy_lines(double* const* dst, double* const* src, size_t nlines,
+                       size_t len) {
+#pragma omp parallel for schedule(static) if (nlines * len >= SIMUTIL_PAR_MIN)
+    for (size_t l = 0; l < nlines; l++)
+        memcpy(dst[l], src[l], len * sizeof(double));
+}
+
+/* Runs the passes of the plan once the user line tables are filled. */
+static void run_plan(interp_plan* plan) {
+    if (plan->npass == 0) {
+        copy_lines(plan->dst_lines, plan->src_lines,
+                   plan->src_ext[0] * plan->src_ext[1], plan->src_ext[2]);
+        return;
+    }
+    size_t cur[3] = {plan->src_ext[0], plan->src_ext[1], plan->src_ext[2]};
+    double* const* in = plan->src_lines;
+    for (size_t p = 0; p < plan->npass; p++) {
+        const int a = plan->order[p];
+        const interp_axis* ax = &plan->axis[a];
+        double* const* out =
+            p + 1 < plan->npass ? plan->tmp_lines[p] : plan->dst_lines;
+        if (a == 2) {
+            pass_contig(out, in, cur[0] * cur[1], ax);
+        } else if (a == 1) {
+            pass_lines(out, in, cur[0], ax->n_dst, 1, cur[1], 1, cur[2], ax);
+        } else {
+            pass_lines(out, in, cur[1], 1, cur[1], 1, cur[1], cur[2], ax);
+        }
+        cur[a] = ax->n_dst;
+        in = out;
+    }
+}
+
+static int check_shape(const interp_plan* plan, const size_t* dst_ext,
+                       const size_t* src_ext) {
+    for (size_t a = 0; a < 3; a++)
+        if (plan->src_ext[a] != src_ext[a] || plan->dst_ext[a] != dst_ext[a])
+            return 0;
+    return 1;
+}
+
+interp_plan* __new_interp_plan(interp_method_t method, const size_t* dst_ext,
+                               const size_t* src_ext) {
+    if (method != INTERP_LINEAR && method != INTERP_CUBIC &&
+        method != INTERP_CONSERVATIVE) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Unknown method @ new_interp_plan!\n");
+        return NULL;
+    }
+    for (size_t a = 0; a < 3; a++) {
+        if (src_ext[a] == 0 || dst_ext[a] == 0) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Empty grid @ new_interp_plan!\n");
+            return NULL;
+        }
+    }
+    interp_plan* plan = calloc(1, sizeof(interp_plan));
+    if (!plan) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for interp plan!\n");
+        return NULL;
+    }
+    plan->method = method;
+    memcpy(plan->src_ext, src_ext, 3 * sizeof(size_t));
+    memcpy(plan->dst_ext, dst_ext, 3 * sizeof(size_t));
+    for (size_t a = 0; a < 3; a++)
+        if (src_ext[a] != dst_ext[a] &&
+            build_axis(&plan->axis[a], method, src_ext[a], dst_ext[a]))
+            goto fail;
+    choose_order(plan);
+
+    plan->src_lines = malloc(src_ext[0] * src_ext[1] * sizeof(double*));
+    plan->dst_lines = malloc(dst_ext[0] * dst_ext[1] * sizeof(double*));
+    if (!plan->src_lines || !plan->dst_lines)
+        goto fail;
+
+    /* pass p < npass - 1 writes buffer p with the extents after it */
+    size_t cur[3] = {src_ext[0], src_ext[1], src_ext[2]};
+    for (size_t p = 0; p + 1 < plan->npass; p++) {
+        cur[plan->order[p]] = dst_ext[plan->order[p]];
+        const size_t nlines = cur[0] * cur[1];
+        plan->buf[p] = malloc(nlines * cur[2] * sizeof(double));
+        plan->tmp_lines[p] = malloc(nlines * sizeof(double*));
+        if (!plan->buf[p] || !plan->tmp_lines[p])
+            goto fail;
+        for (size_t l = 0; l < nlines; l++)
+            plan->tmp_lines[p][l] = plan->buf[p] + l * cur[2];
+    }
+    return plan;
+
+fail:
+    free_interp_plan(plan);
+    raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for interp plan!\n");
+    return NULL;
+}
+
+void free_interp_plan(interp_plan* plan) {
+    if (!plan)
+        return;
+    for (size_t a = 0; a < 3; a++)
+        free_axis(&plan->axis[a]);
+    free(plan->src_lines);
+    free(plan->dst_lines);
+    for (size_t b = 0; b < 2; b++) {
+        free(plan->buf[b]);
+        free(plan->tmp_lines[b]);
+    }
+    free(plan);
+}
+
+void __interp_lines2(interp_plan* plan, double** dst, double** src,
+                     const size_t* dst_ext, const size_t* src_ext) {
+    if (!check_shape(plan, dst_ext, src_ext)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching plan shape @ interp_matrix!\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t l = 0; l < src_ext[1]; l++)
+        plan->src_lines[l] = src[l + 1] + 1;
+    for (size_t l = 0; l < dst_ext[1]; l++)
+        plan->dst_lines[l] = dst[l + 1] + 1;
+    run_plan(plan);
+}
+
+void __interp_lines3(interp_plan* plan, double*** dst, double*** src,
+                     const size_t* dst_ext, const size_t* src_ext) {
+    if (!check_shape(plan, dst_ext, src_ext)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching plan shape @ interp_matrix3!\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < src_ext[0]; i++)
+        for (size_t j = 0; j < src_ext[1]; j++)
+            plan->src_lines[i * src_ext[1] + j] = src[i + 1][j + 1] + 1;
+    for (size_t i = 0; i < dst_ext[0]; i++)
+        for (size_t j = 0; j < dst_ext[1]; j++)
+            plan->dst_lines[i * dst_ext[1] + j] = dst[i + 1][j + 1] + 1;
+    run_plan(plan);
+}
@@ -0,0 +1,132 @@
+#ifndef SIMUTIL_INTERP_H
+#define SIMUTIL_INTERP_H
+
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/*
+ * Both grids of a plan cover the same domain with cell-centered samples, so
+ * sample i of an axis with n points sits at (i + 0.5) / n. Values beyond the
+ * outermost samples are clamped to the edge.
+ */
+typedef enum {
+    INTERP_LINEAR,      /* bilinear / trilinear */
+    INTERP_CUBIC,       /* Keys cubic convolution, a = -0.5 */
+    INTERP_CONSERVATIVE /* cell-overlap averages, preserves integrals */
+} interp_method_t;
+
+/**
+ * @brief Opaque remap plan. Holds per-axis index and weight tables for one
+ * source and target shape plus the intermediate buffers, so applying it
+ * allocates nothing. A plan must not be applied from several threads at once.
+ *
+ */
+typedef struct interp_plan interp_plan;
+
+SIMUTIL_API interp_plan* __new_interp_plan(interp_method_t method,
+                                           const size_t* dst_ext,
+                                           const size_t* src_ext);
+
+SIMUTIL_API void free_interp_plan(interp_plan* plan);
+
+SIMUTIL_API void __interp_lines2(interp_plan* plan, double** dst,
+                                 double** src, const size_t* dst_ext,
+                                 const size_t* src_ext);
+
+SIMUTIL_API void __interp_lines3(interp_plan* plan, double*** dst,
+                                 double*** src, const size_t* dst_ext,
+                                 const size_t* src_ext);
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Matrix Remaps                              */
+/*                                                                          */
+/****************************************************************************/
+
+#define __INTERP_CHECK_DOUBLE(x, name)                                         \
+    do {                                                                       \
+        if (sizeof(x) != sizeof(double)) {                                     \
+            raise_error(SIMUTIL_TYPE_ERROR,                                    \
+                        "Expected double elements @ " name "!\n");             \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @brief Macro to create a plan remapping 'matrix(double)' fields shaped like
+ * 'src' onto fields shaped like 'dst'.
+ *
+ * @param method INTERP_LINEAR, INTERP_CUBIC or INTERP_CONSERVATIVE
+ * @param dst Matrix with the target shape
+ * @param src Matrix with the source shape
+ */
+#define new_interp_plan_matrix(method, dst, src)                               \
+    __new_interp_plan(                                                         \
+        (method),                                                              \
+        (const size_t[3]){1, MATRIX_NLINES(dst), MATRIX_LINELEN(dst)},         \
+        (const size_t[3]){1, MATRIX_NLINES(src), MATRIX_LINELEN(src)})
+
+/**
+ * @brief Macro to remap 'src' onto 'dst' with a plan made for their shapes.
+ *
+ * @param plan Plan from 'new_interp_plan_matrix'
+ * @param dst Target 'matrix(double)'
+ * @param src Source 'matrix(double)'
+ */
+#define interp_matrix(plan, dst, src)                                          \
+    do {                                                                       \
+        __INTERP_CHECK_DOUBLE(**(dst), "interp_matrix");                       \
+        __INTERP_CHECK_DOUBLE(**(src), "interp_matrix");                       \
+        const size_t dst_ext[3] = {1, MATRIX_NLINES(dst),                      \
+                                   MATRIX_LINELEN(dst)};                       \
+        const size_t src_ext[3] = {1, MATRIX_NLINES(src),                      \
+                                   MATRIX_LINELEN(src)};                       \
+        __interp_lines2((plan), (double**)(dst), (double**)(src), dst_ext,     \
+                        src_ext);                                              \
+    } while (0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Matrix3 Remaps                              */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to create a plan remapping 'matrix3(double)' fields shaped
+ * like 'src' onto fields shaped like 'dst'.
+ *
+ * @param method INTERP_LINEAR, INTERP_CUBIC or INTERP_CONSERVATIVE
+ * @param dst Matrix3 with the target shape
+ * @param src Matrix3 with the source shape
+ */
+#define new_interp_plan_matrix3(method, dst, src)                              \
+    __new_interp_plan((method),                                                \
+                      (const size_t[3]){MATRIX3_EXT1(dst), MATRIX3_EXT2(dst),  \
+                                        MATRIX3_EXT3(dst)},                    \
+                      (const size_t[3]){MATRIX3_EXT1(src), MATRIX3_EXT2(src),  \
+                                        MATRIX3_EXT3(src)})
+
+/**
+ * @brief Macro to remap 'src' onto 'dst' with a plan made for their shapes.
+ *
+ * @param plan Plan from 'new_interp_plan_matrix3'
+ * @param dst Target 'matrix3(double)'
+ * @param src Source 'matrix3(double)'
+ */
+#define interp_matrix3(plan, dst, src)                                         \
+    do {                                                                       \
+        __INTERP_CHECK_DOUBLE(***(dst), "interp_matrix3");                     \
+        __INTERP_CHECK_DOUBLE(***(src), "interp_matrix3");                     \
+        const size_t dst_ext[3] = {MATRIX3_EXT1(dst), MATRIX3_EXT2(dst),       \
+                                   MATRIX3_EXT3(dst)};                         \
+        const size_t src_ext[3] = {MATRIX3_EXT1(src), MATRIX3_EXT2(src),       \
+                                   MATRIX3_EXT3(src)};                         \
+        __interp_lines3((plan), (double***)(dst), (double***)(src), dst_ext,   \
+                        src_ext);                                              \
+    } while (0)
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * Shared copies of the container kernels, for programs built with
+ * SIMUTIL_EXTERN_KERNELS: the vector kernels and the row-major matrix and
+ * matrix3 kernels. The column-major ones are instantiated in kernels_col.c.
+ */
+#undef SIMUTIL_COL_MAJOR
+#define SIMUTIL_INSTANTIATE_KERNELS
+#include "matrix.h"
+#include "matrix3.h"
+#include "vector.h"
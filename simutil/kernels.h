@@ -0,0 +1,67 @@
+#ifndef SIMUTIL_KERNELS_H
+#define SIMUTIL_KERNELS_H
+
+#ifndef SIMUTIL_DUAL_BASE_H
+#include "dual_base.h"
+#endif
+#include "simutil_includes.h"
+
+/*
+ * Where the typed helper kernels of the container headers (constructors and
+ * printers) live.
+ *
+ * By default every translation unit gets its own 'static inline' copies.
+ * Defining SIMUTIL_EXTERN_KERNELS before the first simutil include turns the
+ * headers into declarations of a single copy instantiated in the library,
+ * which keeps large programs small and lets the kernels be tuned in one
+ * place; link against the static library with -flto to keep them inlinable.
+ * SIMUTIL_INSTANTIATE_KERNELS is only defined by the library sources that
+ * provide those copies.
+ */
+#if defined(SIMUTIL_INSTANTIATE_KERNELS)
+#define __SIMUTIL_KERNEL SIMUTIL_API
+#define __SIMUTIL_KERNEL_BODY 1
+#elif defined(SIMUTIL_EXTERN_KERNELS)
+#define __SIMUTIL_KERNEL SIMUTIL_API
+#define __SIMUTIL_KERNEL_BODY 0
+#else
+#define __SIMUTIL_KERNEL static inline
+#define __SIMUTIL_KERNEL_BODY 1
+#endif
+
+/*
+ * Name of a kernel whose body depends on the matrix layout. The library
+ * provides both layouts, so shared copies carry a '_cm' or '_rm' suffix.
+ */
+#if defined(SIMUTIL_INSTANTIATE_KERNELS) || defined(SIMUTIL_EXTERN_KERNELS)
+#ifdef SIMUTIL_COL_MAJOR
+#define __SIMUTIL_LAYOUT_NAME(name) name##_cm
+#else
+#define __SIMUTIL_LAYOUT_NAME(name) name##_rm
+#endif
+#else
+#define __SIMUTIL_LAYOUT_NAME(name) name
+#endif
+
+/*
+ * Instantiation table of the element types with typed kernels:
+ * X(suffix, type, print format, print argument expander). Dual numbers are
+ * printed by value; the element-wise macros of matrix.h do not take them.
+ */
+#define SIMUTIL_ELEM_TYPES(X)                                                  \
+    X(_float, float, "%6.3f", __SIMUTIL_ARG)                                   \
+    X(_double, double, "%6.3f", __SIMUTIL_ARG)                                 \
+    X(_long_double, long double, "%6.3Lf", __SIMUTIL_ARG)                      \
+    X(_cfloat, float _Complex, "%6.3f%+6.3fi", __SIMUTIL_CFARG)                \
+    X(_cdouble, double _Complex, "%6.3f%+6.3fi", __SIMUTIL_CARG)               \
+    X(_char, char, "%c", __SIMUTIL_ARG)                                        \
+    X(_uchar, unsigned char, "%3d", __SIMUTIL_ARG)                             \
+    X(_short, short, "%3hd", __SIMUTIL_ARG)                                    \
+    X(_ushort, unsigned short, "%3hd", __SIMUTIL_ARG)                          \
+    X(_int, int, "%3d", __SIMUTIL_ARG)                                         \
+    X(_uint, unsigned int, "%3u", __SIMUTIL_ARG)                               \
+    X(_long, long, "%3ld", __SIMUTIL_ARG)                                      \
+    X(_ulong, unsigned long, "%3lu", __SIMUTIL_ARG)                            \
+    X(_dual, dual, "%6.3f", __SIMUTIL_DARG)
+
+#endif
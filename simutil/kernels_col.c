@@ -0,0 +1,10 @@
+/*
+ * Column-major matrix and matrix3 kernels for SIMUTIL_EXTERN_KERNELS. The
+ * vector kernels do not depend on the layout and live in kernels.c only.
+ */
+#ifndef SIMUTIL_COL_MAJOR
+#define SIMUTIL_COL_MAJOR
+#endif
+#define SIMUTIL_INSTANTIATE_KERNELS
+#include "matrix.h"
+#include "matrix3.h"
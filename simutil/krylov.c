@@ -0,0 +1,888 @@
+#include "krylov.h"
+#include "error.h"
+#include "reduce.h"
+#include <math.h>
+#include <string.h>
+
+/* elements of 'w' kept in cache while it is swept against every basis vector */
+#define CHUNK 1024
+
+struct krylov_solver {
+    krylov_method_t method;
+    size_t n;
+    size_t restart;
+    /* CG: r, z, p, q; BiCGSTAB: r, r0, p, v, phat, s, shat, t */
+    vector(double) work[8];
+    /* GMRES: 'restart + 1' basis vectors, correction u, Hessenberg system */
+    vector(double)* basis;
+    double** v;
+    double* hess;
+    double* cs;
+    double* sn;
+    double* g;
+    double* h;
+    /* GMRES: 'restart + 1' Gram-Schmidt results per reduction chunk */
+    double* part;
+};
+
+struct krylov_precond {
+    krylov_precond_t type;
+    size_t n;
+    double omega;
+    /* Jacobi: 1 / a_ii; ILU(0) and SSOR: 1 / u_ii and 1 / a_ii */
+    double* inv_diag;
+    /* nonzero pattern in compressed rows, 0-indexed, sorted columns */
+    size_t* rowptr;
+    size_t* colind;
+    size_t* diagpos;
+    double* val;
+    /* custom */
+    krylov_op_t apply;
+    void* ctx;
+};
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Vector Kernels                              */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * All kernels work on 0-indexed views ('vec + 1') and fuse the updates of one
+ * iteration with the reductions that follow them, so each vector is streamed
+ * once per use instead of once per BLAS-1 call. Reductions are summed over
+ * the fixed chunks of 'reduce_chunks' and combined by 'reduce_tree', so the
+ * iterates do not depend on the number of threads.
+ */
+
+static double dot(const double* a, const double* b, size_t n) {
+    return __reduce_dot(a, n, b, n);
+}
+
+/* r = b - q, returns r . r */
+static double residual(double* r, const double* b, const double* q, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double s = 0.0;
+        const size_t hi = reduce_chunk_end(c, len, n);
+        for (size_t i = c * len; i < hi; i++) {
+            r[i] = b[i] - q[i];
+            s += r[i] * r[i];
+        }
+        part[c] = s;
+    }
+    return reduce_tree(part, nchunks);
+}
+
+/* x += alpha * p, r -= alpha * q, returns r . r */
+static double update_xr(double* x, double* r, const double* p, const double* q,
+                        double alpha, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double s = 0.0;
+        const size_t hi = reduce_chunk_end(c, len, n);
+        for (size_t i = c * len; i < hi; i++) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            s += r[i] * r[i];
+        }
+        part[c] = s;
+    }
+    return reduce_tree(part, nchunks);
+}
+
+/* p = z + beta * p */
+static void xpby(double* p, const double* z, double beta, size_t n) {
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (long i = 0; i < (long)n; i++)
+        p[i] = z[i] + beta * p[i];
+}
+
+/* p = r + beta * (p - omega * v) */
+static void bicg_direction(double* p, const double* r, const double* v,
+                           double beta, double omega, size_t n) {
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (long i = 0; i < (long)n; i++)
+        p[i] = r[i] + beta * (p[i] - omega * v[i]);
+}
+
+/* s = r - alpha * v, returns s . s */
+static double bicg_half(double* s, const double* r, const double* v,
+                        double alpha, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double ss = 0.0;
+        const size_t hi = reduce_chunk_end(c, len, n);
+        for (size_t i = c * len; i < hi; i++) {
+            s[i] = r[i] - alpha * v[i];
+            ss += s[i] * s[i];
+        }
+        part[c] = ss;
+    }
+    return reduce_tree(part, nchunks);
+}
+
+/* returns t . t and t . s in one sweep */
+static void dot2(const double* t, const double* s, size_t n, double* tt,
+                 double* ts) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part_a[REDUCE_MAX_CHUNKS], part_b[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double a = 0.0, b = 0.0;
+        const size_t hi = reduce_chunk_end(c, len, n);
+        for (size_t i = c * len; i < hi; i++) {
+            a += t[i] * t[i];
+            b += t[i] * s[i];
+        }
+        part_a[c] = a;
+        part_b[c] = b;
+    }
+    *tt = reduce_tree(part_a, nchunks);
+    *ts = reduce_tree(part_b, nchunks);
+}
+
+/*
+ * x += alpha * phat + omega * shat, r = s - omega * t, returns r . r and
+ * r0 . r (the next rho)
+ */
+static void bicg_update(double* x, double* r, const double* phat,
+                        const double* shat, const double* s, const double* t,
+                        const double* r0, double alpha, double omega, size_t n,
+                        double* rr, double* rho) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part_a[REDUCE_MAX_CHUNKS], part_b[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double a = 0.0, b = 0.0;
+        const size_t hi = reduce_chunk_end(c, len, n);
+        for (size_t i = c * len; i < hi; i++) {
+            x[i] += alpha * phat[i] + omega * shat[i];
+            r[i] = s[i] - omega * t[i];
+            a += r[i] * r[i];
+            b += r0[i] * r[i];
+        }
+        part_a[c] = a;
+        part_b[c] = b;
+    }
+    *rr = reduce_tree(part_a, nchunks);
+    *rho = reduce_tree(part_b, nchunks);
+}
+
+/*
+ * h[j] = v[j] . w for j < k, sweeping 'w' once in cache-sized blocks. 'part'
+ * holds k results for every reduction chunk.
+ */
+static void multi_dot(double* h, double* const* v, size_t k, const double* w,
+                      size_t n, double* part) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        double* hc = part + c * k;
+        const size_t end = reduce_chunk_end(c, len, n);
+        for (size_t j = 0; j < k; j++)
+            hc[j] = 0.0;
+        for (size_t lo = c * len; lo < end; lo += CHUNK) {
+            const size_t hi = lo + CHUNK < end ? lo + CHUNK : end;
+            for (size_t j = 0; j < k; j++) {
+                const double* vj = v[j];
+                double s = 0.0;
+                for (size_t i = lo; i < hi; i++)
+                    s += vj[i] * w[i];
+                hc[j] += s;
+            }
+        }
+    }
+    /* gather every h[j] into the chunk order the tree expects */
+    double col[REDUCE_MAX_CHUNKS];
+    for (size_t j = 0; j < k; j++) {
+        for (size_t c = 0; c < nchunks; c++)
+            col[c] = part[c * k + j];
+        h[j] = reduce_tree(col, nchunks);
+    }
+}
+
+/* w += sign * sum_j h[j] * v[j], returns w . w */
+static double multi_axpy(double* w, double* const* v, const double* h,
+                         size_t k, double sign, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        const size_t end = reduce_chunk_end(c, len, n);
+        double s = 0.0;
+        for (size_t lo = c * len; lo < end; lo += CHUNK) {
+            const size_t hi = lo + CHUNK < end ? lo + CHUNK : end;
+            for (size_t j = 0; j < k; j++) {
+                const double* vj = v[j];
+                const double hj = sign * h[j];
+                for (size_t i = lo; i < hi; i++)
+                    w[i] += hj * vj[i];
+            }
+            for (size_t i = lo; i < hi; i++)
+                s += w[i] * w[i];
+        }
+        part[c] = s;
+    }
+    return reduce_tree(part, nchunks);
+}
+
+static void scale(double* y, const double* x, double a, size_t n) {
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (long i = 0; i < (long)n; i++)
+        y[i] = a * x[i];
+}
+
+/* y += a * x */
+static void axpy(double* y, const double* x, double a, size_t n) {
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (long i = 0; i < (long)n; i++)
+        y[i] += a * x[i];
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                             Preconditioners                              */
+/*                                                                          */
+/****************************************************************************/
+
+/* z = M^-1 r on the vectors themselves, returns r . z */
+static double precond_apply(const krylov_precond* pc, vector(double) z_vec,
+                            vector(double) r_vec) {
+    const size_t n = pc->n;
+    const size_t* rp = pc->rowptr;
+    const size_t* ci = pc->colind;
+    const size_t* dp = pc->diagpos;
+    const double* a = pc->val;
+    const double* id = pc->inv_diag;
+    double* z = z_vec + 1;
+    const double* r = r_vec + 1;
+    double s = 0.0;
+
+    switch (pc->type) {
+    case KRYLOV_PRECOND_JACOBI: {
+        size_t len;
+        const size_t nchunks = reduce_chunks(n, &len);
+        double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t c = 0; c < nchunks; c++) {
+            double sc = 0.0;
+            const size_t hi = reduce_chunk_end(c, len, n);
+            for (size_t i = c * len; i < hi; i++) {
+                z[i] = id[i] * r[i];
+                sc += r[i] * z[i];
+            }
+            part[c] = sc;
+        }
+        return reduce_tree(part, nchunks);
+    }
+    case KRYLOV_PRECOND_ILU0:
+        /* L y = r (unit diagonal), then U z = y, both in 'z' */
+        for (size_t i = 0; i < n; i++) {
+            double t = r[i];
+            for (size_t k = rp[i]; k < dp[i]; k++)
+                t -= a[k] * z[ci[k]];
+            z[i] = t;
+        }
+        for (size_t i = n; i-- > 0;) {
+            double t = z[i];
+            for (size_t k = dp[i] + 1; k < rp[i + 1]; k++)
+                t -= a[k] * z[ci[k]];
+            z[i] = t * id[i];
+            s += r[i] * z[i];
+        }
+        return s;
+    case KRYLOV_PRECOND_SSOR: {
+        /* M = (D + wL) D^-1 (D + wU) / (w (2 - w)) */
+        const double w = pc->omega;
+        const double c = w * (2.0 - w);
+        for (size_t i = 0; i < n; i++) {
+            double t = c * r[i];
+            for (size_t k = rp[i]; k < dp[i]; k++)
+                t -= w * a[k] * z[ci[k]];
+            z[i] = t * id[i];
+        }
+        for (size_t i = n; i-- > 0;) {
+            double t = 0.0;
+            for (size_t k = dp[i] + 1; k < rp[i + 1]; k++)
+                t += a[k] * z[ci[k]];
+            z[i] -= w * t * id[i];
+            s += r[i] * z[i];
+        }
+        return s;
+    }
+    case KRYLOV_PRECOND_CUSTOM:
+        /* built without a size: the vectors give it */
+        pc->apply(z_vec, r_vec, pc->ctx);
+        return dot(r, z, (size_t)LENGTH(r_vec));
+    }
+    return 0.0;
+}
+
+static krylov_precond* alloc_precond(krylov_precond_t type, size_t n) {
+    krylov_precond* pc = calloc(1, sizeof(krylov_precond));
+    if (!pc) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for preconditioner!\n");
+        return NULL;
+    }
+    pc->type = type;
+    pc->n = n;
+    pc->omega = 1.0;
+    if (type != KRYLOV_PRECOND_CUSTOM) {
+        pc->inv_diag = malloc((n ? n : 1) * sizeof(double));
+        if (!pc->inv_diag) {
+            free(pc);
+            raise_error(SIMUTIL_ALLOCATE_ERROR,
+                        "NULL allocation for preconditioner!\n");
+            return NULL;
+        }
+    }
+    return pc;
+}
+
+/* a_ij of a square matrix given by its storage lines, 0-indexed */
+static inline double dense_elem(double** mat, int lines_are_cols, size_t i,
+                                size_t j) {
+    return lines_are_cols ? mat[j + 1][i + 1] : mat[i + 1][j + 1];
+}
+
+/* copies the nonzeros of the matrix, plus its full diagonal, into CSR */
+static int build_csr(krylov_precond* pc, double** mat, size_t nlines,
+                     size_t linelen, int lines_are_cols) {
+    const size_t n = pc->n;
+    size_t* fill = calloc(n + 1, sizeof(size_t));
+    pc->rowptr = calloc(n + 1, sizeof(size_t));
+    pc->diagpos = malloc((n ? n : 1) * sizeof(size_t));
+    if (!fill || !pc->rowptr || !pc->diagpos) {
+        free(fill);
+        return 1;
+    }
+
+    /* lines are walked in order, so every row receives sorted columns */
+    for (size_t l = 0; l < nlines; l++) {
+        const double* line = mat[l + 1] + 1;
+        for (size_t p = 0; p < linelen; p++)
+            if (line[p] != 0.0 || l == p)
+                pc->rowptr[(lines_are_cols ? p : l) + 1]++;
+    }
+    for (size_t i = 0; i < n; i++)
+        pc->rowptr[i + 1] += pc->rowptr[i];
+    const size_t nnz = pc->rowptr[n];
+    pc->colind = malloc((nnz ? nnz : 1) * sizeof(size_t));
+    pc->val = malloc((nnz ? nnz : 1) * sizeof(double));
+    if (!pc->colind || !pc->val) {
+        free(fill);
+        return 1;
+    }
+
+    for (size_t l = 0; l < nlines; l++) {
+        const double* line = mat[l + 1] + 1;
+        for (size_t p = 0; p < linelen; p++) {
+            if (line[p] == 0.0 && l != p)
+                continue;
+            const size_t i = lines_are_cols ? p : l;
+            const size_t j = lines_are_cols ? l : p;
+            const size_t k = pc->rowptr[i] + fill[i]++;
+            pc->colind[k] = j;
+            pc->val[k] = line[p];
+            if (i == j)
+                pc->diagpos[i] = k;
+        }
+    }
+    free(fill);
+    return 0;
+}
+
+/* ILU(0): incomplete LU restricted to the nonzero pattern, in place */
+static int factor_ilu0(krylov_precond* pc) {
+    const size_t n = pc->n;
+    const size_t* rp = pc->rowptr;
+    const size_t* ci = pc->colind;
+    const size_t* dp = pc->diagpos;
+    double* a = pc->val;
+    size_t* pos = malloc((n ? n : 1) * sizeof(size_t));
+    if (!pos)
+        return 1;
+    for (size_t j = 0; j < n; j++)
+        pos[j] = (size_t)-1;
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = rp[i]; k < rp[i + 1]; k++)
+            pos[ci[k]] = k;
+        for (size_t k = rp[i]; k < dp[i]; k++) {
+            const size_t c = ci[k];
+            a[k] *= pc->inv_diag[c];
+            for (size_t m = dp[c] + 1; m < rp[c + 1]; m++)
+                if (pos[ci[m]] != (size_t)-1)
+                    a[pos[ci[m]]] -= a[k] * a[m];
+        }
+        if (a[dp[i]] == 0.0) {
+            free(pos);
+            return 2;
+        }
+        pc->inv_diag[i] = 1.0 / a[dp[i]];
+        for (size_t k = rp[i]; k < rp[i + 1]; k++)
+            pos[ci[k]] = (size_t)-1;
+    }
+    free(pos);
+    return 0;
+}
+
+krylov_precond* __new_krylov_precond(krylov_precond_t type, double** mat,
+                                     size_t nlines, size_t linelen,
+                                     int lines_are_cols, double omega) {
+    if (nlines != linelen) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Non-square matrix @ new_krylov_precond!\n");
+        return NULL;
+    }
+    if (type == KRYLOV_PRECOND_SSOR && !(omega > 0.0 && omega < 2.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "SSOR relaxation factor must be in (0, 2)!\n");
+        return NULL;
+    }
+    krylov_precond* pc = alloc_precond(type, nlines);
+    if (!pc)
+        return NULL;
+    pc->omega = omega;
+
+    if (type == KRYLOV_PRECOND_JACOBI) {
+        for (size_t i = 0; i < nlines; i++) {
+            const double d = dense_elem(mat, lines_are_cols, i, i);
+            if (d == 0.0) {
+                free_krylov_precond(pc);
+                raise_error(SIMUTIL_DEFAULT_ERROR,
+                            "Zero diagonal @ new_jacobi_precond!\n");
+                return NULL;
+            }
+            pc->inv_diag[i] = 1.0 / d;
+        }
+        return pc;
+    }
+
+    if (build_csr(pc, mat, nlines, linelen, lines_are_cols)) {
+        free_krylov_precond(pc);
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for preconditioner!\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < nlines; i++) {
+        const double d = pc->val[pc->diagpos[i]];
+        if (d == 0.0) {
+            free_krylov_precond(pc);
+            raise_error(SIMUTIL_DEFAULT_ERROR,
+                        "Zero diagonal @ new_krylov_precond!\n");
+            return NULL;
+        }
+        pc->inv_diag[i] = 1.0 / d;
+    }
+    if (type == KRYLOV_PRECOND_ILU0) {
+        const int err = factor_ilu0(pc);
+        if (err) {
+            free_krylov_precond(pc);
+            if (err == 1)
+                raise_error(SIMUTIL_ALLOCATE_ERROR,
+                            "NULL allocation for preconditioner!\n");
+            else
+                raise_error(SIMUTIL_DEFAULT_ERROR,
+                            "Zero pivot @ new_ilu0_precond!\n");
+            return NULL;
+        }
+    }
+    return pc;
+}
+
+krylov_precond* new_jacobi_precond_diag(vector(double) diag) {
+    const size_t n = (size_t)LENGTH(diag);
+    krylov_precond* pc = alloc_precond(KRYLOV_PRECOND_JACOBI, n);
+    if (!pc)
+        return NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (diag[i + 1] == 0.0) {
+            free_krylov_precond(pc);
+            raise_error(SIMUTIL_DEFAULT_ERROR,
+                        "Zero diagonal @ new_jacobi_precond_diag!\n");
+            return NULL;
+        }
+        pc->inv_diag[i] = 1.0 / diag[i + 1];
+    }
+    return pc;
+}
+
+krylov_precond* new_custom_precond(krylov_op_t apply, void* ctx) {
+    krylov_precond* pc = alloc_precond(KRYLOV_PRECOND_CUSTOM, 0);
+    if (!pc)
+        return NULL;
+    pc->apply = apply;
+    pc->ctx = ctx;
+    return pc;
+}
+
+void free_krylov_precond(krylov_precond* pc) {
+    if (!pc)
+        return;
+    free(pc->inv_diag);
+    free(pc->rowptr);
+    free(pc->colind);
+    free(pc->diagpos);
+    free(pc->val);
+    free(pc);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Dense Operator                              */
+/*                                                                          */
+/****************************************************************************/
+
+void krylov_dense_matvec(vector(double) y, vector(double) x, void* ctx) {
+    const krylov_dense_op* A = (const krylov_dense_op*)ctx;
+    const size_t n = A->nlines;
+    if (A->linelen != n || (size_t)LENGTH(x) != n || (size_t)LENGTH(y) != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ krylov_dense_matvec!\n");
+        exit(EXIT_FAILURE);
+    }
+    const double* xs = x + 1;
+    double* ys = y + 1;
+
+    if (!A->lines_are_cols) {
+        /* rows are contiguous: one dot product per row */
+#pragma omp parallel for schedule(static) if (n * n >= SIMUTIL_PAR_MIN)
+        for (long l = 0; l < (long)n; l++) {
+            const double* row = A->mat[l + 1] + 1;
+            double s = 0.0;
+            for (size_t j = 0; j < n; j++)
+                s += row[j] * xs[j];
+            ys[l] = s;
+        }
+        return;
+    }
+
+    /* columns are contiguous: accumulate columns into one chunk of y */
+    const long nchunks = (long)((n + CHUNK - 1) / CHUNK);
+#pragma omp parallel for schedule(static) if (n * n >= SIMUTIL_PAR_MIN)
+    for (long c = 0; c < nchunks; c++) {
+        const size_t lo = (size_t)c * CHUNK;
+        const size_t hi = lo + CHUNK < n ? lo + CHUNK : n;
+        for (size_t i = lo; i < hi; i++)
+            ys[i] = 0.0;
+        for (size_t l = 0; l < n; l++) {
+            const double* col = A->mat[l + 1] + 1;
+            const double xl = xs[l];
+            for (size_t i = lo; i < hi; i++)
+                ys[i] += xl * col[i];
+        }
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Solvers                                  */
+/*                                                                          */
+/****************************************************************************/
+
+static const size_t nwork[] = {4, 8, 1};
+
+krylov_solver* new_krylov_solver(krylov_method_t method, size_t n,
+                                 size_t restart) {
+    if (method != KRYLOV_CG && method != KRYLOV_BICGSTAB &&
+        method != KRYLOV_GMRES) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Unknown method @ new_krylov_solver!\n");
+        return NULL;
+    }
+    if (method == KRYLOV_GMRES && restart == 0) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "GMRES restart length must be positive!\n");
+        return NULL;
+    }
+    krylov_solver* s = calloc(1, sizeof(krylov_solver));
+    if (!s) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for solver!\n");
+        return NULL;
+    }
+    s->method = method;
+    s->n = n;
+    s->restart = method == KRYLOV_GMRES ? restart : 0;
+
+    for (size_t i = 0; i < nwork[method]; i++)
+        if (!(s->work[i] = new_vector(double, n)))
+            goto fail;
+
+    if (method == KRYLOV_GMRES) {
+        const size_t m = restart;
+        s->basis = calloc(m + 1, sizeof(vector(double)));
+        s->v = malloc((m + 1) * sizeof(double*));
+        s->hess = malloc((m + 1) * m * sizeof(double));
+        s->cs = malloc(m * sizeof(double));
+        s->sn = malloc(m * sizeof(double));
+        s->g = malloc((m + 1) * sizeof(double));
+        s->h = malloc((m + 1) * sizeof(double));
+        size_t len;
+        s->part = malloc((m + 1) * (reduce_chunks(n, &len) + 1) *
+                         sizeof(double));
+        if (!s->basis || !s->v || !s->hess || !s->cs || !s->sn || !s->g ||
+            !s->h || !s->part)
+            goto fail;
+        for (size_t j = 0; j <= m; j++) {
+            if (!(s->basis[j] = new_vector(double, n)))
+                goto fail;
+            s->v[j] = s->basis[j] + 1;
+        }
+    }
+    return s;
+
+fail:
+    free_krylov_solver(s);
+    raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for solver!\n");
+    return NULL;
+}
+
+void free_krylov_solver(krylov_solver* s) {
+    if (!s)
+        return;
+    for (size_t i = 0; i < 8; i++)
+        if (s->work[i])
+            free_vector(s->work[i]);
+    if (s->basis)
+        for (size_t j = 0; j <= s->restart; j++)
+            if (s->basis[j])
+                free_vector(s->basis[j]);
+    free(s->basis);
+    free(s->v);
+    free(s->hess);
+    free(s->cs);
+    free(s->sn);
+    free(s->g);
+    free(s->h);
+    free(s->part);
+    free(s);
+}
+
+static krylov_result solve_cg(krylov_solver* s, krylov_op_t op, void* ctx,
+                              const krylov_precond* pc, vector(double) x,
+                              vector(double) b, double target, size_t maxit) {
+    const size_t n = s->n;
+    vector(double) r = s->work[0];
+    vector(double) z = pc ? s->work[1] : r;
+    vector(double) p = s->work[2];
+    vector(double) q = s->work[3];
+    krylov_result res = {0, 0.0, 0};
+
+    op(q, x, ctx);
+    double rr = residual(r + 1, b + 1, q + 1, n);
+    double rz = pc ? precond_apply(pc, z, r) : rr;
+    memcpy(p + 1, z + 1, n * sizeof(double));
+
+    while (sqrt(rr) > target && res.iterations < maxit) {
+        op(q, p, ctx);
+        const double pq = dot(p + 1, q + 1, n);
+        if (!(pq > 0.0))
+            break;
+        rr = update_xr(x + 1, r + 1, p + 1, q + 1, rz / pq, n);
+        res.iterations++;
+        if (sqrt(rr) <= target)
+            break;
+        const double rz_new = pc ? precond_apply(pc, z, r) : rr;
+        xpby(p + 1, z + 1, rz_new / rz, n);
+        rz = rz_new;
+    }
+    res.residual = sqrt(rr);
+    return res;
+}
+
+static krylov_result solve_bicgstab(krylov_solver* s, krylov_op_t op,
+                                    void* ctx, const krylov_precond* pc,
+                                    vector(double) x, vector(double) b,
+                                    double target, size_t maxit) {
+    const size_t n = s->n;
+    vector(double) r = s->work[0];
+    vector(double) r0 = s->work[1];
+    vector(double) p = s->work[2];
+    vector(double) v = s->work[3];
+    vector(double) phat = pc ? s->work[4] : p;
+    vector(double) sv = s->work[5];
+    vector(double) shat = pc ? s->work[6] : sv;
+    vector(double) t = s->work[7];
+    krylov_result res = {0, 0.0, 0};
+
+    op(t, x, ctx);
+    double rr = residual(r + 1, b + 1, t + 1, n);
+    memcpy(r0 + 1, r + 1, n * sizeof(double));
+    memset(p + 1, 0, n * sizeof(double));
+    memset(v + 1, 0, n * sizeof(double));
+    double rho = 1.0, alpha = 1.0, omega = 1.0, rho_new = rr;
+
+    while (sqrt(rr) > target && res.iterations < maxit) {
+        if (rho_new == 0.0 || omega == 0.0)
+            break;
+        bicg_direction(p + 1, r + 1, v + 1, (rho_new / rho) * (alpha / omega),
+                       omega, n);
+        rho = rho_new;
+        if (pc)
+            precond_apply(pc, phat, p);
+        op(v, phat, ctx);
+        const double r0v = dot(r0 + 1, v + 1, n);
+        if (r0v == 0.0)
+            break;
+        alpha = rho / r0v;
+        const double ss = bicg_half(sv + 1, r + 1, v + 1, alpha, n);
+        res.iterations++;
+        if (sqrt(ss) <= target) {
+            axpy(x + 1, phat + 1, alpha, n);
+            memcpy(r + 1, sv + 1, n * sizeof(double));
+            rr = ss;
+            break;
+        }
+        if (pc)
+            precond_apply(pc, shat, sv);
+        op(t, shat, ctx);
+        double tt, ts;
+        dot2(t + 1, sv + 1, n, &tt, &ts);
+        omega = tt > 0.0 ? ts / tt : 0.0;
+        bicg_update(x + 1, r + 1, phat + 1, shat + 1, sv + 1, t + 1, r0 + 1,
+                    alpha, omega, n, &rr, &rho_new);
+    }
+    res.residual = sqrt(rr);
+    return res;
+}
+
+static krylov_result solve_gmres(krylov_solver* s, krylov_op_t op, void* ctx,
+                                 const krylov_precond* pc, vector(double) x,
+                                 vector(double) b, double target,
+                                 size_t maxit) {
+    const size_t n = s->n;
+    const size_t m = s->restart;
+    vector(double) u = s->work[0];
+    double* const* v = s->v;
+    double* H = s->hess;
+    double* g = s->g;
+    double* h = s->h;
+    krylov_result res = {0, 0.0, 0};
+    double beta = 0.0;
+
+    /* H is stored by columns: H(i, j) = H[j * (m + 1) + i] */
+    for (;;) {
+        /* true residual at every restart */
+        op(u, x, ctx);
+        beta = sqrt(residual(v[0], b + 1, u + 1, n));
+        if (beta <= target || res.iterations >= maxit)
+            break;
+        scale(v[0], v[0], 1.0 / beta, n);
+        g[0] = beta;
+
+        size_t k = 0;
+        double est = beta;
+        while (k < m && res.iterations < maxit) {
+            double* w = v[k + 1];
+            double* Hk = H + k * (m + 1);
+            if (pc) {
+                precond_apply(pc, u, s->basis[k]);
+                op(s->basis[k + 1], u, ctx);
+            } else {
+                op(s->basis[k + 1], s->basis[k], ctx);
+            }
+            /* classical Gram-Schmidt, done twice for stability */
+            multi_dot(Hk, v, k + 1, w, n, s->part);
+            multi_axpy(w, v, Hk, k + 1, -1.0, n);
+            multi_dot(h, v, k + 1, w, n, s->part);
+            const double hn = sqrt(multi_axpy(w, v, h, k + 1, -1.0, n));
+            for (size_t i = 0; i <= k; i++)
+                Hk[i] += h[i];
+            Hk[k + 1] = hn;
+
+            for (size_t i = 0; i < k; i++) {
+                const double t = s->cs[i] * Hk[i] + s->sn[i] * Hk[i + 1];
+                Hk[i + 1] = -s->sn[i] * Hk[i] + s->cs[i] * Hk[i + 1];
+                Hk[i] = t;
+            }
+            const double den = hypot(Hk[k], Hk[k + 1]);
+            s->cs[k] = den > 0.0 ? Hk[k] / den : 1.0;
+            s->sn[k] = den > 0.0 ? Hk[k + 1] / den : 0.0;
+            Hk[k] = den;
+            Hk[k + 1] = 0.0;
+            g[k + 1] = -s->sn[k] * g[k];
+            g[k] = s->cs[k] * g[k];
+
+            k++;
+            res.iterations++;
+            est = fabs(g[k]);
+            if (est <= target || hn == 0.0)
+                break;
+            scale(w, w, 1.0 / hn, n);
+        }
+
+        /* back substitution for the k coefficients, kept in g */
+        for (size_t i = k; i-- > 0;) {
+            double t = g[i];
+            for (size_t j = i + 1; j < k; j++)
+                t -= H[j * (m + 1) + i] * g[j];
+            g[i] = t / H[i * (m + 1) + i];
+        }
+        if (pc) {
+            /* x += M^-1 (V g), with V g built in the spare basis vector */
+            memset(v[m], 0, n * sizeof(double));
+            multi_axpy(v[m], v, g, k, 1.0, n);
+            precond_apply(pc, u, s->basis[m]);
+            axpy(x + 1, u + 1, 1.0, n);
+        } else {
+            multi_axpy(x + 1, v, g, k, 1.0, n);
+        }
+    }
+    res.residual = beta;
+    return res;
+}
+
+krylov_result krylov_solve(krylov_solver* solver, krylov_op_t op, void* ctx,
+                           const krylov_precond* pc, vector(double) x,
+                           vector(double) b, double tol, size_t maxit) {
+    if (!solver || !op) {
+        raise_error(SIMUTIL_NULL_ERROR,
+                    "NULL solver or operator @ krylov_solve!\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)LENGTH(x) != solver->n || (size_t)LENGTH(b) != solver->n ||
+        (pc && pc->type != KRYLOV_PRECOND_CUSTOM && pc->n != solver->n)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching vector lengths @ krylov_solve!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const double bnorm = sqrt(dot(b + 1, b + 1, solver->n));
+    if (bnorm == 0.0) {
+        memset(x + 1, 0, solver->n * sizeof(double));
+        return (krylov_result){0, 0.0, 1};
+    }
+    const double target = tol * bnorm;
+
+    krylov_result res;
+    switch (solver->method) {
+    case KRYLOV_CG:
+        res = solve_cg(solver, op, ctx, pc, x, b, target, maxit);
+        break;
+    case KRYLOV_BICGSTAB:
+        res = solve_bicgstab(solver, op, ctx, pc, x, b, target, maxit);
+        break;
+    default:
+        res = solve_gmres(solver, op, ctx, pc, x, b, target, maxit);
+        break;
+    }
+    res.converged = res.residual <= target;
+    res.residual /= bnorm;
+    return res;
+}
@@ -0,0 +1,168 @@
+#ifndef SIMUTIL_KRYLOV_H
+#define SIMUTIL_KRYLOV_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+
+typedef enum { KRYLOV_CG, KRYLOV_BICGSTAB, KRYLOV_GMRES } krylov_method_t;
+
+/**
+ * @brief Linear operator callback. Must set 'y' to A * x, where both vectors
+ * have the length of the system.
+ *
+ */
+typedef void (*krylov_op_t)(vector(double) y, vector(double) x, void* ctx);
+
+/**
+ * @brief Outcome of a solve. 'residual' is the final relative residual
+ * ||b - A x|| / ||b||.
+ *
+ */
+typedef struct {
+    size_t iterations;
+    double residual;
+    int converged;
+} krylov_result;
+
+/**
+ * @brief Opaque solver. Owns every work vector needed by its method, so
+ * repeated solves of the same size allocate nothing.
+ *
+ */
+typedef struct krylov_solver krylov_solver;
+
+/**
+ * @brief Opaque preconditioner, applied as z = M^-1 r.
+ *
+ */
+typedef struct krylov_precond krylov_precond;
+
+/**
+ * @brief Function to create a solver and its workspace.
+ *
+ * @param method KRYLOV_CG (symmetric positive definite A), KRYLOV_BICGSTAB or
+ * KRYLOV_GMRES
+ * @param n Size of the system
+ * @param restart Krylov subspace size of GMRES(restart), ignored otherwise
+ */
+SIMUTIL_API krylov_solver* new_krylov_solver(krylov_method_t method, size_t n,
+                                             size_t restart);
+
+SIMUTIL_API void free_krylov_solver(krylov_solver* solver);
+
+/**
+ * @brief Function to solve A x = b. 'x' holds the initial guess on entry and
+ * the solution on exit. Iterates until the relative residual drops below
+ * 'tol' or 'maxit' iterations have been done.
+ *
+ * @param solver Solver created for the length of 'x' and 'b'
+ * @param op Callback computing A * x
+ * @param ctx User data passed to 'op'
+ * @param pc Preconditioner, or NULL for none
+ * @param x Initial guess and solution
+ * @param b Right hand side
+ * @param tol Relative residual tolerance
+ * @param maxit Maximum number of iterations
+ */
+SIMUTIL_API krylov_result krylov_solve(krylov_solver* solver, krylov_op_t op,
+                                       void* ctx, const krylov_precond* pc,
+                                       vector(double) x, vector(double) b,
+                                       double tol, size_t maxit);
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Dense Operators                             */
+/*                                                                          */
+/****************************************************************************/
+
+typedef struct {
+    double** mat;
+    size_t nlines;
+    size_t linelen;
+    int lines_are_cols;
+} krylov_dense_op;
+
+/**
+ * @brief Callback computing y = A * x for a square 'matrix(double)' wrapped in
+ * a 'krylov_dense_op' context.
+ *
+ */
+SIMUTIL_API void krylov_dense_matvec(vector(double) y, vector(double) x,
+                                     void* ctx);
+
+/**
+ * @brief Macro to wrap a square 'matrix(double)' as the context of
+ * 'krylov_dense_matvec'.
+ *
+ * @param mat Matrix to wrap
+ */
+#define krylov_dense_operator(mat)                                             \
+    ((krylov_dense_op){(double**)(mat), MATRIX_NLINES(mat),                    \
+                       MATRIX_LINELEN(mat), __SIMUTIL_LINES_ARE_COLS})
+
+/****************************************************************************/
+/*                                                                          */
+/*                             Preconditioners                              */
+/*                                                                          */
+/****************************************************************************/
+
+typedef enum {
+    KRYLOV_PRECOND_JACOBI,
+    KRYLOV_PRECOND_ILU0,
+    KRYLOV_PRECOND_SSOR,
+    KRYLOV_PRECOND_CUSTOM
+} krylov_precond_t;
+
+SIMUTIL_API krylov_precond* __new_krylov_precond(krylov_precond_t type,
+                                                 double** mat, size_t nlines,
+                                                 size_t linelen,
+                                                 int lines_are_cols,
+                                                 double omega);
+
+/**
+ * @brief Macros to build a preconditioner from a square 'matrix(double)'.
+ * ILU(0) and SSOR keep the nonzero pattern of the matrix in compressed rows,
+ * so a mostly-zero matrix gives a cheap preconditioner. 'omega' is the SSOR
+ * relaxation factor, 0 < omega < 2.
+ *
+ * @param mat Matrix of the system
+ */
+#define new_jacobi_precond(mat)                                                \
+    __new_krylov_precond(KRYLOV_PRECOND_JACOBI, (double**)(mat),               \
+                         MATRIX_NLINES(mat), MATRIX_LINELEN(mat),              \
+                         __SIMUTIL_LINES_ARE_COLS, 1.0)
+
+#define new_ilu0_precond(mat)                                                  \
+    __new_krylov_precond(KRYLOV_PRECOND_ILU0, (double**)(mat),                 \
+                         MATRIX_NLINES(mat), MATRIX_LINELEN(mat),              \
+                         __SIMUTIL_LINES_ARE_COLS, 1.0)
+
+#define new_ssor_precond(mat, omega)                                           \
+    __new_krylov_precond(KRYLOV_PRECOND_SSOR, (double**)(mat),                 \
+                         MATRIX_NLINES(mat), MATRIX_LINELEN(mat),              \
+                         __SIMUTIL_LINES_ARE_COLS, (omega))
+
+/**
+ * @brief Function to build a Jacobi preconditioner from the diagonal of a
+ * matrix-free operator.
+ *
+ * @param diag Diagonal of A
+ */
+SIMUTIL_API krylov_precond* new_jacobi_precond_diag(vector(double) diag);
+
+/**
+ * @brief Function to wrap a user callback as a preconditioner. 'apply' must
+ * set its first argument to M^-1 times its second.
+ *
+ * @param apply Callback applying the preconditioner
+ * @param ctx User data passed to 'apply'
+ */
+SIMUTIL_API krylov_precond* new_custom_precond(krylov_op_t apply, void* ctx);
+
+SIMUTIL_API void free_krylov_precond(krylov_precond* pc);
+
+#endif
@@ -0,0 +1,203 @@
+#include "matrix.h"
+#include "error.h"
+#include "profile.h"
+#include <string.h>
+
+/*
+ * Header words of a matrix: columns, rows, reference count, capacity in
+ * lines and in elements per line. The functions here handle both layouts,
+ * told apart by 'lines_are_cols':
+ *
+ *   row-major: the header and a table of at least 2 line pointers in one
+ *   block, the elements in another starting at 'mat[1]', lines packed one
+ *   after another;
+ *   column-major: header, table and elements in one block, line 'l' starting
+ *   'l * (cap_linelen + 1)' elements into the element area.
+ */
+#define HEAD(mat) ((size_t*)((char*)(mat) - MATRIX_SIZE_BYTE))
+
+static size_t grow_cap(size_t want, size_t cap, int reserve) {
+    if (want <= cap)
+        return cap;
+    return reserve || want > 2 * cap ? want : 2 * cap;
+}
+
+/*
+ * zeroed storage for cap_lines x cap_len elements; returns the line table and
+ * the bytes taken by all of its blocks in 'bytes'
+ */
+static char** alloc_lines(size_t cap_lines, size_t cap_len, size_t elem_size,
+                          int lines_are_cols, size_t* bytes) {
+    const size_t ntab = (cap_lines > 1 ? cap_lines : 1) + 1;
+    const size_t head = MATRIX_SIZE_BYTE + ntab * sizeof(char*);
+    char* start;
+    char* data;
+    size_t pitch;
+    if (lines_are_cols) {
+        pitch = (cap_len + 1) * elem_size;
+        *bytes = head + (cap_lines + 1) * pitch;
+        start = __simutil_alloc(*bytes, head + pitch, cap_lines, pitch);
+        if (!start)
+            return NULL;
+        SIMUTIL_PROF_TRACK(start, *bytes, 1);
+        data = start + head;
+    } else {
+        pitch = cap_len * elem_size;
+        const size_t data_size = (cap_lines * cap_len + 1) * elem_size;
+        *bytes = head + data_size;
+        start = calloc(1, head);
+        data = __simutil_alloc(data_size, elem_size, cap_lines, pitch);
+        if (!start || !data) {
+            free(start);
+            free(data);
+            return NULL;
+        }
+        SIMUTIL_PROF_TRACK(start, head, 1);
+        SIMUTIL_PROF_TRACK(data, data_size, 0);
+    }
+    char** lines = (char**)(start + MATRIX_SIZE_BYTE);
+    HEAD(lines)[2] = 1;
+    HEAD(lines)[3] = cap_lines;
+    HEAD(lines)[4] = cap_len;
+    lines[1] = lines_are_cols ? data + pitch : data;
+    for (size_t l = 2; l <= cap_lines; l++)
+        lines[l] = lines[l - 1] + pitch;
+    return lines;
+}
+
+static void free_lines(char** lines, int lines_are_cols) {
+    if (!lines_are_cols) {
+        SIMUTIL_PROF_FREE(lines[1]);
+        free(lines[1]);
+    }
+    SIMUTIL_PROF_FREE(HEAD(lines));
+    free(HEAD(lines));
+}
+
+int __resize_matrix(void** mat_mem, size_t ncols, size_t nrows,
+                    size_t elem_size, int lines_are_cols, int reserve) {
+    if (!mat_mem || !*mat_mem) {
+        raise_error(SIMUTIL_NULL_ERROR, "Pointer passed in is NULL!\n");
+        return 1;
+    }
+    char** mat = *mat_mem;
+    size_t* h = HEAD(mat);
+    const size_t nlines = lines_are_cols ? h[0] : h[1];
+    const size_t len = lines_are_cols ? h[1] : h[0];
+    if (h[3] < nlines || h[4] < len) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Matrix views cannot be resized @ resize_matrix!\n");
+        return 1;
+    }
+    size_t new_lines = lines_are_cols ? ncols : nrows;
+    size_t new_len = lines_are_cols ? nrows : ncols;
+    size_t cap_lines = grow_cap(new_lines, h[3], reserve);
+    /* row-major lines stay packed, so their length is not padded */
+    size_t cap_len = lines_are_cols ? grow_cap(new_len, h[4], reserve)
+                     : new_len == len ? h[4]
+                                      : new_len;
+    if (reserve) {
+        new_lines = nlines;
+        new_len = len;
+        cap_len = lines_are_cols ? cap_len : len;
+    }
+    const int shared = __atomic_load_n(&h[2], __ATOMIC_ACQUIRE) != 1;
+    SIMUTIL_PROF_START(prof_start);
+
+    /* within capacity: zero what comes into view */
+    if (!shared && cap_lines == h[3] && cap_len == h[4]) {
+        const size_t keep = nlines < new_lines ? nlines : new_lines;
+        if (new_len > len)
+            for (size_t l = 1; l <= keep; l++)
+                memset(mat[l] + (len + 1) * elem_size, 0,
+                       (new_len - len) * elem_size);
+        for (size_t l = nlines + 1; l <= new_lines; l++)
+            memset(mat[l] + elem_size, 0, new_len * elem_size);
+        h[lines_are_cols ? 0 : 1] = new_lines;
+        h[lines_are_cols ? 1 : 0] = new_len;
+        return 0;
+    }
+
+    /*
+     * more row-major rows of the same length: extend both blocks in place,
+     * the table first, so that if the elements cannot move the old lines are
+     * still valid in the larger table
+     */
+    if (!shared && !lines_are_cols && cap_len == h[4]) {
+        const size_t ntab = (cap_lines > 1 ? cap_lines : 1) + 1;
+        const size_t head = MATRIX_SIZE_BYTE + ntab * sizeof(char*);
+        const size_t bytes = (cap_lines * cap_len + 1) * elem_size;
+        SIMUTIL_PROF_ADDR(old_head, h);
+        char* start = realloc(h, head);
+        if (!start)
+            return 1;
+        SIMUTIL_PROF_FREE(old_head);
+        SIMUTIL_PROF_TRACK(start, head, 1);
+        h = (size_t*)start;
+        mat = (char**)(start + MATRIX_SIZE_BYTE);
+        *mat_mem = mat;
+        SIMUTIL_PROF_ADDR(old_data, mat[1]);
+        char* data = realloc(mat[1], bytes);
+        if (!data)
+            return 1;
+        SIMUTIL_PROF_FREE(old_data);
+        SIMUTIL_PROF_TRACK(data, bytes, 0);
+        SIMUTIL_PROF_RECORD(SIMUTIL_PROF_RESIZE_MATRIX, head + bytes,
+                            prof_start);
+        mat[1] = data;
+        for (size_t l = 2; l <= cap_lines; l++)
+            mat[l] = mat[l - 1] + cap_len * elem_size;
+        memset(mat[1] + (nlines * cap_len + 1) * elem_size, 0,
+               (new_lines - nlines) * cap_len * elem_size);
+        h[1] = new_lines;
+        h[3] = cap_lines;
+        return 0;
+    }
+
+    /* new storage: copy what is kept and release this owner's share */
+    size_t bytes;
+    char** out =
+        alloc_lines(cap_lines, cap_len, elem_size, lines_are_cols, &bytes);
+    if (!out)
+        return 1;
+    SIMUTIL_PROF_RECORD(SIMUTIL_PROF_RESIZE_MATRIX, bytes, prof_start);
+    const size_t keep_lines = nlines < new_lines ? nlines : new_lines;
+    const size_t keep_len = len < new_len ? len : new_len;
+    for (size_t l = 1; l <= keep_lines; l++)
+        memcpy(out[l] + elem_size, mat[l] + elem_size, keep_len * elem_size);
+    HEAD(out)[lines_are_cols ? 0 : 1] = new_lines;
+    HEAD(out)[lines_are_cols ? 1 : 0] = new_len;
+    if (!shared || __atomic_sub_fetch(&h[2], 1, __ATOMIC_ACQ_REL) == 0)
+        free_lines(mat, lines_are_cols);
+    *mat_mem = out;
+    return 0;
+}
+
+int __append_matrix_row(void** mat_mem, const void* row, size_t len,
+                        size_t elem_size, int lines_are_cols) {
+    if (!mat_mem || !*mat_mem) {
+        raise_error(SIMUTIL_NULL_ERROR, "Pointer passed in is NULL!\n");
+        return 1;
+    }
+    const size_t ncols = (size_t)COLS(*mat_mem);
+    const size_t nrows = (size_t)ROWS(*mat_mem) + 1;
+    if (len != ncols) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Row of %zu elements for a matrix of %zu columns @ "
+                    "append_matrix_row!\n",
+                    len, ncols);
+        return 1;
+    }
+    if (__resize_matrix(mat_mem, ncols, nrows, elem_size, lines_are_cols, 0))
+        return 1;
+    char** mat = *mat_mem;
+    if (!lines_are_cols) {
+        memcpy(mat[nrows] + elem_size, row, len * elem_size);
+        return 0;
+    }
+    const char* src = row;
+    for (size_t i = 1; i <= len; i++)
+        memcpy(mat[i] + nrows * elem_size, src + (i - 1) * elem_size,
+               elem_size);
+    return 0;
+}
@@ -11,9 +11,14 @@
 /*                                                                          */
 /****************************************************************************/
 
-#ifdef SIMUTIL_COL_MAJOR
-#define PRINT_FUNC(name, type, fmt)                                            \
-    static inline void __print##name##_m(FILE* fp, type mat) {                 \
+#if !__SIMUTIL_KERNEL_BODY
+#define PRINT_FUNC(name, T, fmt, arg)                                          \
+    SIMUTIL_API void __SIMUTIL_LAYOUT_NAME(__print##name##_m)(FILE* fp,        \
+                                                              matrix(T) mat);
+#elif defined(SIMUTIL_COL_MAJOR)
+#define PRINT_FUNC(name, T, fmt, arg)                                          \
+    __SIMUTIL_KERNEL void __SIMUTIL_LAYOUT_NAME(__print##name##_m)(            \
+        FILE* fp, matrix(T) mat) {                                             \
         const int nrow = ROWS(mat);                                            \
         const int ncol = COLS(mat);                                            \
         fprintf(fp, "[");                                                      \
@@ -22,18 +27,19 @@
             fprintf(fp, "[");                                                  \
             for (i = 1; i <= ncol; i++) {                                      \
                 if (i != ncol) {                                               \
-                    fprintf(fp, fmt, mat[i][j]);                               \
+                    fprintf(fp, fmt, arg(mat[i][j]));                          \
                     fprintf(fp, ", ");                                         \
                 } else                                                         \
-                    fprintf(fp, fmt, mat[i][j]);                               \
+                    fprintf(fp, fmt, arg(mat[i][j]));                          \
             }                                                                  \
             (j == nrow) ? fprintf(fp, "]") : fprintf(fp, "]\n ");              \
         }                                                                      \
         fprintf(fp, "]\n");                                                    \
     }
 #else
-#define PRINT_FUNC(name, type, fmt)                                            \
-    static inline void __print##name##_m(FILE* fp, type mat) {                 \
+#define PRINT_FUNC(name, T, fmt, arg)                                          \
+    __SIMUTIL_KERNEL void __SIMUTIL_LAYOUT_NAME(__print##name##_m)(            \
+        FILE* fp, matrix(T) mat) {                                             \
         const int nrow = ROWS(mat);                                            \
         const int ncol = COLS(mat);                                            \
         fprintf(fp, "[");                                                      \
@@ -42,10 +48,10 @@
             fprintf(fp, "[");                                                  \
             for (i = 1; i <= ncol; i++) {                                      \
                 if (i != ncol) {                                               \
-                    fprintf(fp, fmt, mat[j][i]);                               \
+                    fprintf(fp, fmt, arg(mat[j][i]));                          \
                     fprintf(fp, ", ");                                         \
                 } else                                                         \
-                    fprintf(fp, fmt, mat[j][i]);                               \
+                    fprintf(fp, fmt, arg(mat[j][i]));                          \
             }                                                                  \
             (j == nrow) ? fprintf(fp, "]") : fprintf(fp, "]\n ");              \
         }                                                                      \
@@ -53,49 +59,106 @@
     }
 #endif
 
-// printing floating-point numbers
-PRINT_FUNC(_float, matrix(float), "%6.3f")
-PRINT_FUNC(_double, matrix(double), "%6.3f")
-PRINT_FUNC(_long_double, matrix(long double), "%6.3Lf")
+SIMUTIL_ELEM_TYPES(PRINT_FUNC)
 
-// printing integers / char
-PRINT_FUNC(_char, matrix(char), "%c")
-PRINT_FUNC(_uchar, matrix(unsigned char), "%3d")
-PRINT_FUNC(_short, matrix(short), "%3hd")
-PRINT_FUNC(_ushort, matrix(unsigned short), "%3hd")
-PRINT_FUNC(_int, matrix(int), "%3d")
-PRINT_FUNC(_uint, matrix(unsigned int), "%3u")
-PRINT_FUNC(_long, matrix(long), "%3ld")
-PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
+#define __PRINT_MATRIX_FUNC(mat)                                               \
+    _Generic((mat),                                                            \
+        matrix(char): __SIMUTIL_LAYOUT_NAME(__print_char_m),                   \
+        matrix(unsigned char): __SIMUTIL_LAYOUT_NAME(__print_uchar_m),         \
+        matrix(short): __SIMUTIL_LAYOUT_NAME(__print_short_m),                 \
+        matrix(unsigned short): __SIMUTIL_LAYOUT_NAME(__print_ushort_m),       \
+        matrix(int): __SIMUTIL_LAYOUT_NAME(__print_int_m),                     \
+        matrix(unsigned int): __SIMUTIL_LAYOUT_NAME(__print_uint_m),           \
+        matrix(long): __SIMUTIL_LAYOUT_NAME(__print_long_m),                   \
+        matrix(unsigned long): __SIMUTIL_LAYOUT_NAME(__print_ulong_m),         \
+        matrix(float): __SIMUTIL_LAYOUT_NAME(__print_float_m),                 \
+        matrix(double): __SIMUTIL_LAYOUT_NAME(__print_double_m),               \
+        matrix(float _Complex): __SIMUTIL_LAYOUT_NAME(__print_cfloat_m),       \
+        matrix(double _Complex): __SIMUTIL_LAYOUT_NAME(__print_cdouble_m),     \
+        matrix(long double): __SIMUTIL_LAYOUT_NAME(__print_long_double_m),     \
+        matrix(dual): __SIMUTIL_LAYOUT_NAME(__print_dual_m))
 
 /* Function-like macros for printing numerical matrices */
-#define print_matrix(mat)                                                      \
-    _Generic((mat),                                                            \
-        matrix(char): __print_char_m,                                          \
-        matrix(unsigned char): __print_uchar_m,                                \
-        matrix(short): __print_short_m,                                        \
-        matrix(unsigned short): __print_ushort_m,                              \
-        matrix(int): __print_int_m,                                            \
-        matrix(unsigned int): __print_uint_m,                                  \
-        matrix(long): __print_long_m,                                          \
-        matrix(unsigned long): __print_ulong_m,                                \
-        matrix(float): __print_float_m,                                        \
-        matrix(double): __print_double_m,                                      \
-        matrix(long double): __print_long_double_m)(stdout, mat)
+#define print_matrix(mat) __PRINT_MATRIX_FUNC(mat)(stdout, mat)
 
-#define fprint_matrix(fp, mat)                                                 \
-    _Generic((mat),                                                            \
-        matrix(char): __print_char_m,                                          \
-        matrix(unsigned char): __print_uchar_m,                                \
-        matrix(short): __print_short_m,                                        \
-        matrix(unsigned short): __print_ushort_m,                              \
-        matrix(int): __print_int_m,                                            \
-        matrix(unsigned int): __print_uint_m,                                  \
-        matrix(long): __print_long_m,                                          \
-        matrix(unsigned long): __print_ulong_m,                                \
-        matrix(float): __print_float_m,                                        \
-        matrix(double): __print_double_m,                                      \
-        matrix(long double): __print_long_double_m)(fp, mat)
+#define fprint_matrix(fp, mat) __PRINT_MATRIX_FUNC(mat)(fp, mat)
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Resizing                                 */
+/*                                                                          */
+/****************************************************************************/
+
+SIMUTIL_API int __resize_matrix(void** mat_mem, size_t ncols, size_t nrows,
+                                size_t elem_size, int lines_are_cols,
+                                int reserve);
+
+SIMUTIL_API int __append_matrix_row(void** mat_mem, const void* row,
+                                    size_t len, size_t elem_size,
+                                    int lines_are_cols);
+
+/**
+ * @brief Macro to change the size of a matrix, keeping the elements that
+ * remain in range and zeroing the new ones. Growing past the capacity at
+ * least doubles it, so adding rows one at a time costs amortized O(1) per
+ * element; within the capacity nothing is moved or reallocated. Changing
+ * the number of columns of a row-major matrix moves every row. The matrix
+ * pointer changes when the memory is reallocated, and a shared matrix is
+ * replaced by a private copy.
+ *
+ * @param mat A pointer to the matrix
+ * @param ncols New number of columns
+ * @param nrows New number of rows
+ */
+#define resize_matrix(mat, ncols, nrows)                                       \
+    do {                                                                       \
+        if (__resize_matrix((void**)(mat), (ncols), (nrows), sizeof(***(mat)), \
+                            __SIMUTIL_LINES_ARE_COLS, 0))                      \
+            raise_error(SIMUTIL_NULL_ERROR,                                    \
+                        "Could not resize matrix in 'resize_matrix()'\n");     \
+    } while (0)
+
+/**
+ * @brief Macro to make room for a matrix to grow to ncols x nrows without
+ * reallocating. The size of the matrix does not change.
+ *
+ * @param mat A pointer to the matrix
+ * @param ncols Number of columns to make room for
+ * @param nrows Number of rows to make room for
+ */
+#define reserve_matrix(mat, ncols, nrows)                                      \
+    do {                                                                       \
+        if (__resize_matrix((void**)(mat), (ncols), (nrows), sizeof(***(mat)), \
+                            __SIMUTIL_LINES_ARE_COLS, 1))                      \
+            raise_error(SIMUTIL_NULL_ERROR,                                    \
+                        "Could not reserve matrix in 'reserve_matrix()'\n");   \
+    } while (0)
+
+/**
+ * @brief Macro to add 'nrows' zeroed rows at the bottom of a matrix.
+ *
+ * @param mat A pointer to the matrix
+ * @param nrows Number of rows to add
+ */
+#define grow_matrix_rows(mat, nrows)                                           \
+    resize_matrix((mat), (size_t)COLS(*(mat)),                                 \
+                  (size_t)ROWS(*(mat)) + (size_t)(nrows))
+
+/**
+ * @brief Macro to add a copy of a vector as the last row of a matrix, e.g.
+ * to record the observables of every timestep.
+ *
+ * @param mat A pointer to the matrix
+ * @param row 'vector(T)' of length COLS
+ */
+#define append_matrix_row(mat, row)                                            \
+    do {                                                                       \
+        if (__append_matrix_row((void**)(mat), (const void*)((row) + 1),       \
+                                (size_t)LENGTH(row), sizeof(***(mat)),         \
+                                __SIMUTIL_LINES_ARE_COLS))                     \
+            raise_error(SIMUTIL_NULL_ERROR,                                    \
+                        "Could not append row in 'append_matrix_row()'\n");    \
+    } while (0)
 
 /****************************************************************************/
 /*                                                                          */
@@ -106,6 +169,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
 #ifdef SIMUTIL_COL_MAJOR
 #define FROM_MATRIX(_from, _targ, _ncols, _nrows)                              \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         int cols = (int)(_nrows);                                              \
         int rows = (int)(_ncols);                                              \
         __typeof__(_targ) targ = (_targ);                                      \
@@ -117,10 +181,12 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i + 1][j + 1] = (_from)[j][i];                            \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_FROM_MATRIX, rows * cols, prof_start);   \
     } while (0)
 #else
 #define FROM_MATRIX(_from, _targ, _ncols, _nrows)                              \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         int cols = (int)(_ncols);                                              \
         int rows = (int)(_nrows);                                              \
         __typeof__(_targ) targ = (_targ);                                      \
@@ -132,6 +198,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i + 1][j + 1] = (_from)[i][j];                            \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_FROM_MATRIX, rows * cols, prof_start);   \
     } while (0)
 #endif
 
@@ -180,6 +247,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_SET_EQUAL(_targ, _from)                                           \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_from) from = (_from);                                      \
         if (NOT_SAME_SHAPE(targ, from)) {                                      \
@@ -195,6 +263,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = from[i][j];                                       \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_SET_EQUAL,                          \
+                         nrows * ncols, prof_start);                           \
     } while (0)
 
 /**
@@ -205,6 +275,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_SET_CONST(_targ, _constant)                                       \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         double constant = (_constant);                                         \
         const int nrows = (const int)ROWS(targ);                               \
@@ -214,6 +285,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = constant;                                         \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_SET_CONST,                          \
+                         nrows * ncols, prof_start);                           \
     } while (0)
 
 /**
@@ -226,6 +299,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_OPER(_targ, _from, _oper)                                         \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_from) from = (_from);                                      \
         if (NOT_SAME_SHAPE(targ, from)) {                                      \
@@ -240,6 +314,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = targ[i][j] _oper from[i][j];                      \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_OPER, nrows * ncols, prof_start);   \
     } while (0)
 
 /**
@@ -252,6 +327,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_OPER_TARG(_targ, _lhs, _rhs, _oper)                               \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_lhs) lhs = (_lhs);                                         \
         __typeof__(_rhs) rhs = (_rhs);                                         \
@@ -269,6 +345,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = lhs[i][j] _oper rhs[i][j];                        \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_OPER_TARG,                          \
+                         nrows * ncols, prof_start);                           \
     } while (0)
 
 /**
@@ -289,6 +367,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_OPER_SLICE(_targ, _from, _oper, _l, _r, _u, _d)                   \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_from) from = (_from);                                      \
         int l = (_l);                                                          \
@@ -312,6 +391,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = a _oper b;                                        \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_OPER_SLICE,                         \
+                         (r - l + 1) * (d - u + 1), prof_start);               \
     } while (0)
 
 /**
@@ -327,6 +408,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define ELEM_OPER_SLICE_LIKE(_targ, _from, _oper, _like)                       \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_from) from = (_from);                                      \
         __typeof__(_like) like = (_like);                                      \
@@ -347,6 +429,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = a _oper b;                                        \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_ELEM_OPER_SLICE_LIKE,                    \
+                         nrows * ncols, prof_start);                           \
     } while (0)
 
 /**
@@ -360,6 +444,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define CONST_OPER(_targ, _constant, _oper)                                    \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         const int ncols = (const int)COLS(targ);                               \
         const int nrows = (const int)ROWS(targ);                               \
@@ -370,6 +455,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = a _oper constant;                                 \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_CONST_OPER, nrows * ncols, prof_start);  \
     } while (0)
 
 /**
@@ -390,6 +476,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define CONST_OPER_SLICE(_targ, _constant, _oper, _l, _r, _u, _d)              \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         const double constant = (double)(_constant);                           \
         int l = (_l);                                                          \
@@ -411,6 +498,8 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = a _oper constant;                                 \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_CONST_OPER_SLICE,                        \
+                         (r - l + 1) * (d - u + 1), prof_start);               \
     } while (0)
 
 /**
@@ -425,6 +514,7 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
  */
 #define CONST_OPER_SLICE_LIKE(_targ, _constant, _oper, _like)                  \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         __typeof__(_targ) targ = (_targ);                                      \
         __typeof__(_like) like = (_like);                                      \
         const double constant = (double)(_constant);                           \
@@ -444,6 +534,9 @@ PRINT_FUNC(_ulong, matrix(unsigned long), "%3lu")
                 targ[i][j] = a _oper constant;                                 \
             }                                                                  \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_CONST_OPER_SLICE_LIKE,                   \
+                         nrows * ncols, prof_start);                           \
     } while (0)
 
+#undef PRINT_FUNC
 #endif
@@ -1,7 +1,10 @@
 #ifndef SIMUTIL_MATRIX3_BASE_H
 #define SIMUTIL_MATRIX3_BASE_H
 
+#include "alloc.h"
 #include "error.h"
+#include "kernels.h"
+#include "profile.h"
 #include "simutil_includes.h"
 
 #define matrix3(T) T***
@@ -29,9 +32,36 @@
     ((int)(*(                                                                  \
         (size_t*)(((char*)(ten) - MATRIX3_SIZE_BYTE + sizeof(size_t) * 2)))))
 
-static inline void* __init_matrix3(size_t size, size_t elem_size, size_t ncols,
-                                   size_t nrows, size_t ndeps) {
+/**
+ * @brief Macros for the storage extents of a matrix3, in the order the
+ * pointer levels are indexed ('mat3[1..EXT1][1..EXT2][1..EXT3]'). The third
+ * level is always contiguous.
+ *
+ */
+#ifdef SIMUTIL_COL_MAJOR
+#define MATRIX3_EXT1(ten) DIM1(ten)
+#define MATRIX3_EXT2(ten) DIM2(ten)
+#else
+#define MATRIX3_EXT1(ten) DIM2(ten)
+#define MATRIX3_EXT2(ten) DIM1(ten)
+#endif
+#define MATRIX3_EXT3(ten) DIM3(ten)
+
+#if __SIMUTIL_KERNEL_BODY
+__SIMUTIL_KERNEL void* __SIMUTIL_LAYOUT_NAME(__init_matrix3)(
+    size_t size, size_t elem_size, size_t ncols, size_t nrows, size_t ndeps) {
+    SIMUTIL_PROF_START(prof_start);
+#ifdef SIMUTIL_COL_MAJOR
+    /* the lines of column i start i * (nrows + 1) lines into the data */
+    const size_t line_bytes = (ndeps + 1) * elem_size;
+    void* mat_start = __simutil_alloc(
+        size, MATRIX3_SIZE_BYTE + (ncols + 1) * sizeof(char**) +
+                  (ncols + 1) * (nrows + 1) * sizeof(char*) +
+                  (nrows + 1) * line_bytes,
+        ncols * (nrows + 1), line_bytes);
+#else
     void* mat_start = calloc(1, size);
+#endif
     SIMUTIL_NULLPTR_CHECK(mat_start);
     *((size_t*)mat_start + 0) = ncols;
     *((size_t*)mat_start + 1) = nrows;
@@ -53,11 +83,20 @@ static inline void* __init_matrix3(size_t size, size_t elem_size, size_t ncols,
             SIMUTIL_NULLPTR_CHECK(out[i][j]);
         }
     }
+    SIMUTIL_PROF_ALLOC(SIMUTIL_PROF_INIT_MATRIX3, mat_start, size, prof_start);
 #else
-    out[1] = (char**)calloc(1, (size_t)(nrows * ncols + 1) * sizeof(void*));
+    const size_t table_size = (size_t)(nrows * ncols + 1) * sizeof(void*);
+    out[1] = (char**)calloc(1, table_size);
     SIMUTIL_NULLPTR_CHECK(out[1]);
-    out[1][1] = (char*)calloc(1, (nrows * ncols * ndeps + 1) * elem_size);
+    const size_t data_size = (nrows * ncols * ndeps + 1) * elem_size;
+    out[1][1] = (char*)__simutil_alloc(data_size, elem_size, nrows * ncols,
+                                       ndeps * elem_size);
     SIMUTIL_NULLPTR_CHECK(out[1][1]);
+    SIMUTIL_PROF_TRACK(mat_start, size, 1);
+    SIMUTIL_PROF_TRACK(out[1], table_size, 0);
+    SIMUTIL_PROF_TRACK(out[1][1], data_size, 0);
+    SIMUTIL_PROF_RECORD(SIMUTIL_PROF_INIT_MATRIX3,
+                        size + table_size + data_size, prof_start);
     int i, j;
     for (j = 2; j <= (int)ncols; j++)
         out[1][j] = out[1][j - 1] + (ndeps * elem_size);
@@ -70,10 +109,17 @@ static inline void* __init_matrix3(size_t size, size_t elem_size, size_t ncols,
 #endif
     return (void*)out;
 }
+#else
+SIMUTIL_API void* __SIMUTIL_LAYOUT_NAME(__init_matrix3)(size_t size,
+                                                        size_t elem_size,
+                                                        size_t ncols,
+                                                        size_t nrows,
+                                                        size_t ndeps);
+#endif
 
 #ifdef SIMUTIL_COL_MAJOR
 #define new_matrix3(T, ncols, nrows, ndeps)                                    \
-    ((matrix3(T))__init_matrix3(                                               \
+    ((matrix3(T))__SIMUTIL_LAYOUT_NAME(__init_matrix3)(                        \
         ((ncols + 1) * sizeof(T**) + (ncols + 1) * (nrows + 1) * sizeof(T*) +  \
          (ncols + 1) * (nrows + 1) * (ndeps + 1) * sizeof(T) +                 \
          MATRIX3_SIZE_BYTE),                                                   \
@@ -82,20 +128,24 @@ static inline void* __init_matrix3(size_t size, size_t elem_size, size_t ncols,
 #define free_matrix3(mat)                                                      \
     do {                                                                       \
         void* mat_start = (void*)((char*)(mat) - MATRIX3_SIZE_BYTE);           \
+        SIMUTIL_PROF_FREE(mat_start);                                          \
         free(mat_start);                                                       \
         mat_start = NULL;                                                      \
     } while (0)
 #else
 #define new_matrix3(T, ncols, nrows, ndeps)                                    \
-    ((matrix3(T))__init_matrix3(                                               \
+    ((matrix3(T))__SIMUTIL_LAYOUT_NAME(__init_matrix3)(                        \
         ((nrows + 1) * sizeof(T**) + MATRIX3_SIZE_BYTE), sizeof(T), ncols,     \
         nrows, ndeps))
 
 #define free_matrix3(mat3)                                                     \
     do {                                                                       \
+        SIMUTIL_PROF_FREE(mat3[1][1]);                                         \
         free((char*)mat3[1][1]);                                               \
-        free((char*)mat3[1]);                                               \
+        SIMUTIL_PROF_FREE(mat3[1]);                                            \
+        free((char*)mat3[1]);                                                  \
         void* mat3_mem = (void*)((char*)mat3 - MATRIX3_SIZE_BYTE);             \
+        SIMUTIL_PROF_FREE(mat3_mem);                                           \
         free(mat3_mem);                                                        \
     } while (0)
 #endif
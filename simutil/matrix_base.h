@@ -1,14 +1,21 @@
 #ifndef SIMUTIL_MATRIX_BASE_H
 #define SIMUTIL_MATRIX_BASE_H
 
+#include "alloc.h"
 #include "error.h"
+#include "kernels.h"
+#include "profile.h"
 #include "simutil_includes.h"
+#include <string.h>
 
 /* Type alias for matrix */
 #define matrix(T) T**
 
-/* Metadata memory size */
-#define MATRIX_SIZE_BYTE (size_t)(sizeof(size_t) * 2)
+/*
+ * Metadata memory size: columns, rows, the reference count, then the
+ * capacity in lines and in elements per line
+ */
+#define MATRIX_SIZE_BYTE (size_t)(sizeof(size_t) * 5)
 
 /****************************************************************************/
 /*                                                                          */
@@ -28,6 +35,46 @@
     ((int)(*(                                                                  \
         (size_t*)(((char*)(mat) - MATRIX_SIZE_BYTE + sizeof(size_t) * 1)))))
 
+/**
+ * @brief Macro to access the number of owners sharing the matrix's memory
+ *
+ */
+#define MATRIX_REFS(mat)                                                       \
+    (*((size_t*)(((char*)(mat) - MATRIX_SIZE_BYTE + sizeof(size_t) * 2))))
+
+/**
+ * @brief Macros to access the capacity of a matrix: the storage lines (see
+ * MATRIX_NLINES) and the elements per line it can hold without reallocating.
+ * Both are zero for views over memory the matrix does not own.
+ *
+ */
+#define MATRIX_CAP_LINES(mat)                                                  \
+    (*((size_t*)(((char*)(mat) - MATRIX_SIZE_BYTE + sizeof(size_t) * 3))))
+
+#define MATRIX_CAP_LINELEN(mat)                                                \
+    (*((size_t*)(((char*)(mat) - MATRIX_SIZE_BYTE + sizeof(size_t) * 4))))
+
+/**
+ * @brief Macros for the storage view of a matrix. 'mat[1..MATRIX_NLINES]' are
+ * the contiguous lines (rows, or columns with SIMUTIL_COL_MAJOR), each holding
+ * MATRIX_LINELEN elements.
+ *
+ */
+#ifdef SIMUTIL_COL_MAJOR
+#define MATRIX_NLINES(mat) COLS(mat)
+#define MATRIX_LINELEN(mat) ROWS(mat)
+#else
+#define MATRIX_NLINES(mat) ROWS(mat)
+#define MATRIX_LINELEN(mat) COLS(mat)
+#endif
+
+/* non-zero when the storage lines of a matrix are its columns */
+#ifdef SIMUTIL_COL_MAJOR
+#define __SIMUTIL_LINES_ARE_COLS 1
+#else
+#define __SIMUTIL_LINES_ARE_COLS 0
+#endif
+
 /**
  * @brief Function to initialize the memory needed for a new matrix.
  *
@@ -36,12 +83,32 @@
  * @param ncols The number of columns in the matrix
  * @param nrows The number of rows in the matrix
  */
-static inline void* __init_matrix(size_t size, size_t elem_size, size_t ncols,
-                                  size_t nrows) {
+#if __SIMUTIL_KERNEL_BODY
+__SIMUTIL_KERNEL void* __SIMUTIL_LAYOUT_NAME(__init_matrix)(size_t size,
+                                                            size_t elem_size,
+                                                            size_t ncols,
+                                                            size_t nrows) {
+    SIMUTIL_PROF_START(prof_start);
+#ifdef SIMUTIL_COL_MAJOR
+    /* column i starts i * (nrows + 1) elements after the pointer table */
+    void* mat_start = __simutil_alloc(
+        size, MATRIX_SIZE_BYTE + (ncols + 1) * sizeof(char*) +
+                  (nrows + 1) * elem_size,
+        ncols, (nrows + 1) * elem_size);
+#else
     void* mat_start = calloc(1, size);
+#endif
     SIMUTIL_NULLPTR_CHECK(mat_start);
     *((size_t*)mat_start + 0) = ncols;
     *((size_t*)mat_start + 1) = nrows;
+    *((size_t*)mat_start + 2) = 1;
+#ifdef SIMUTIL_COL_MAJOR
+    *((size_t*)mat_start + 3) = ncols;
+    *((size_t*)mat_start + 4) = nrows;
+#else
+    *((size_t*)mat_start + 3) = nrows;
+    *((size_t*)mat_start + 4) = ncols;
+#endif
     char** out = (char**)((char*)mat_start + MATRIX_SIZE_BYTE);
     SIMUTIL_NULLPTR_CHECK(out);
 #ifdef SIMUTIL_COL_MAJOR
@@ -51,14 +118,27 @@ static inline void* __init_matrix(size_t size, size_t elem_size, size_t ncols,
         out[i] = data_start + i * (nrows + 1) * elem_size;
         SIMUTIL_NULLPTR_CHECK(out[i]);
     }
+    SIMUTIL_PROF_ALLOC(SIMUTIL_PROF_INIT_MATRIX, mat_start, size, prof_start);
 #else
-    out[1] = (char*)calloc(
-        1, (size_t)(((nrows * ncols) + MATRIX_SIZE_BYTE) * elem_size));
+    const size_t data_size =
+        (size_t)(((nrows * ncols) + MATRIX_SIZE_BYTE) * elem_size);
+    out[1] = (char*)__simutil_alloc(data_size, elem_size, nrows,
+                                    ncols * elem_size);
+    SIMUTIL_NULLPTR_CHECK(out[1]);
+    SIMUTIL_PROF_TRACK(mat_start, size, 1);
+    SIMUTIL_PROF_TRACK(out[1], data_size, 0);
+    SIMUTIL_PROF_RECORD(SIMUTIL_PROF_INIT_MATRIX, size + data_size, prof_start);
     for (size_t i = 2; i <= nrows; i++)
         out[i] = out[i - 1] + (ncols * elem_size);
 #endif
     return (void*)out;
 }
+#else
+SIMUTIL_API void* __SIMUTIL_LAYOUT_NAME(__init_matrix)(size_t size,
+                                                       size_t elem_size,
+                                                       size_t ncols,
+                                                       size_t nrows);
+#endif
 
 /**
  * @brief Macro to create a new matrix of type T
@@ -69,19 +149,21 @@ static inline void* __init_matrix(size_t size, size_t elem_size, size_t ncols,
  */
 #ifdef SIMUTIL_COL_MAJOR
 #define new_matrix(T, ncols, nrows)                                            \
-    ((matrix(T))__init_matrix(((ncols + 1) * sizeof(T*) +                      \
-                               (ncols + 1) * (nrows + 1) * sizeof(T) +         \
-                               MATRIX_SIZE_BYTE),                              \
-                              sizeof(T), ncols, nrows))
+    ((matrix(T))__SIMUTIL_LAYOUT_NAME(__init_matrix)(                          \
+        ((ncols + 1) * sizeof(T*) + (ncols + 1) * (nrows + 1) * sizeof(T) +    \
+         MATRIX_SIZE_BYTE),                                                    \
+        sizeof(T), ncols, nrows))
 #else
+/* the line table keeps 'mat[1]', the element block, even with no rows */
 #define new_matrix(T, ncols, nrows)                                            \
-    ((matrix(T))__init_matrix((size_t)(nrows + 1) * sizeof(void*) +            \
-                                  MATRIX_SIZE_BYTE,                            \
-                              sizeof(T), ncols, nrows))
+    ((matrix(T))__SIMUTIL_LAYOUT_NAME(__init_matrix)(                          \
+        (size_t)(nrows + 2) * sizeof(void*) + MATRIX_SIZE_BYTE, sizeof(T),     \
+        ncols, nrows))
 #endif
 
 /**
- * @brief Macro to properly free the memory allocated to the matrix
+ * @brief Macro to release a matrix. The memory is freed when the last owner
+ * (see 'share_matrix') releases it.
  *
  * @param mat Matrix to free
  */
@@ -89,18 +171,66 @@ static inline void* __init_matrix(size_t size, size_t elem_size, size_t ncols,
 #define free_matrix(mat)                                                       \
     do {                                                                       \
         void* mat_start = (void*)((char*)(mat) - MATRIX_SIZE_BYTE);            \
-        free(mat_start);                                                       \
+        if (__atomic_sub_fetch(&MATRIX_REFS(mat), 1, __ATOMIC_ACQ_REL) == 0) { \
+            SIMUTIL_PROF_FREE(mat_start);                                      \
+            free(mat_start);                                                   \
+        }                                                                      \
         mat_start = NULL;                                                      \
     } while (0)
 #else
 #define free_matrix(mat)                                                       \
     do {                                                                       \
-        free((char*)mat[1]);                                                   \
-        mat[1] = NULL;                                                         \
-        void* mat_start = (void*)((char*)mat - MATRIX_SIZE_BYTE);              \
-        free(mat_start);                                                       \
-        mat_start = NULL;                                                      \
+        if (__atomic_sub_fetch(&MATRIX_REFS(mat), 1, __ATOMIC_ACQ_REL) == 0) { \
+            SIMUTIL_PROF_FREE(mat[1]);                                         \
+            free((char*)mat[1]);                                               \
+            mat[1] = NULL;                                                     \
+            void* mat_start = (void*)((char*)mat - MATRIX_SIZE_BYTE);          \
+            SIMUTIL_PROF_FREE(mat_start);                                      \
+            free(mat_start);                                                   \
+            mat_start = NULL;                                                  \
+        }                                                                      \
     } while (0)
 #endif
 
+/****************************************************************************/
+/*                                                                          */
+/*                              Shared Matrices                             */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to add an owner to a matrix in O(1), e.g. to hand a snapshot
+ * to output or diagnostics without copying it. Returns the same pointer,
+ * which must be released with 'free_matrix' like any other matrix. Owners
+ * only read the shared memory; call 'cow_matrix' before writing to it.
+ *
+ * @param mat Matrix to share
+ */
+#define share_matrix(mat)                                                      \
+    (__atomic_add_fetch(&MATRIX_REFS(mat), 1, __ATOMIC_RELAXED), (mat))
+
+/**
+ * @brief Macro to make a matrix safe to write to. A matrix with other owners
+ * is replaced by a private copy and the caller's share of the old memory is
+ * released, so that the other owners keep seeing the values from before the
+ * write. Does nothing when the caller is the only owner.
+ *
+ * @param mat Matrix to detach, assigned the copy if one is made
+ */
+#define cow_matrix(mat)                                                        \
+    do {                                                                       \
+        if (__atomic_load_n(&MATRIX_REFS(mat), __ATOMIC_ACQUIRE) != 1) {       \
+            __typeof__(mat) mat_copy =                                         \
+                new_matrix(__typeof__(**(mat)), (size_t)COLS(mat),             \
+                           (size_t)ROWS(mat));                                 \
+            const int nlines = MATRIX_NLINES(mat);                             \
+            const size_t line_bytes =                                          \
+                (size_t)MATRIX_LINELEN(mat) * sizeof(**(mat));                 \
+            for (int l = 1; l <= nlines; l++)                                  \
+                memcpy(&mat_copy[l][1], &(mat)[l][1], line_bytes);             \
+            free_matrix(mat);                                                  \
+            (mat) = mat_copy;                                                  \
+        }                                                                      \
+    } while (0)
+
 #endif
@@ -0,0 +1,597 @@
+#include "mesh.h"
+#include "error.h"
+#include <stdint.h>
+#include <string.h>
+
+/* rows at most this long are sorted by insertion */
+#define SMALL_SORT 32
+
+static void* alloc_or_die(size_t bytes, const char* name) {
+    void* p = malloc(bytes ? bytes : 1);
+    if (!p) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation @ %s!\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static mesh_graph* alloc_graph(size_t nrows, size_t ncols, size_t nnz,
+                               const char* name) {
+    mesh_graph* g = alloc_or_die(sizeof(mesh_graph), name);
+    g->nrows = nrows;
+    g->ncols = ncols;
+    g->nnz = nnz;
+    g->start = alloc_or_die((nrows + 1) * sizeof(size_t), name);
+    g->index = alloc_or_die(nnz * sizeof(size_t), name);
+    g->tstart = alloc_or_die((ncols + 1) * sizeof(size_t), name);
+    g->tpos = alloc_or_die(nnz * sizeof(size_t), name);
+    g->start[0] = 0;
+    return g;
+}
+
+void free_mesh_graph(mesh_graph* g) {
+    if (!g)
+        return;
+    free(g->start);
+    free(g->index);
+    free(g->tstart);
+    free(g->tpos);
+    free(g);
+}
+
+/* lists the entries of every column; a counting sort keeps them in order */
+static void build_transpose(mesh_graph* g) {
+    size_t* ts = g->tstart;
+    memset(ts, 0, (g->ncols + 1) * sizeof(size_t));
+    for (size_t k = 0; k < g->nnz; k++)
+        ts[g->index[k]]++;
+    for (size_t j = 1; j <= g->ncols; j++)
+        ts[j] += ts[j - 1];
+    size_t* cur = alloc_or_die((g->ncols + 1) * sizeof(size_t), "mesh_graph");
+    memcpy(cur, ts, (g->ncols + 1) * sizeof(size_t));
+    for (size_t k = 0; k < g->nnz; k++)
+        g->tpos[cur[g->index[k] - 1]++] = k;
+    free(cur);
+}
+
+static int cmp_index(const void* a, const void* b) {
+    const size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void sort_index(size_t* a, size_t n) {
+    if (n > SMALL_SORT) {
+        qsort(a, n, sizeof(size_t), cmp_index);
+        return;
+    }
+    for (size_t i = 1; i < n; i++) {
+        const size_t v = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > v; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Builders                                 */
+/*                                                                          */
+/****************************************************************************/
+
+mesh_graph* new_mesh_graph(size_t nrows, size_t ncols, const size_t* start,
+                           const size_t* index) {
+    if (!start || (start[nrows] && !index)) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL rows @ new_mesh_graph!\n");
+        return NULL;
+    }
+    if (start[0] != 0) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Rows do not start at 0 @ new_mesh_graph!\n");
+        return NULL;
+    }
+    for (size_t i = 1; i <= nrows; i++)
+        if (start[i] < start[i - 1]) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Decreasing offset of row %zu @ new_mesh_graph!\n", i);
+            return NULL;
+        }
+    const size_t nnz = start[nrows];
+    for (size_t k = 0; k < nnz; k++)
+        if (index[k] < 1 || index[k] > ncols) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Index %zu of entry %zu not in [1, %zu] @ "
+                        "new_mesh_graph!\n",
+                        index[k], k, ncols);
+            return NULL;
+        }
+    mesh_graph* g = alloc_graph(nrows, ncols, nnz, "new_mesh_graph");
+    memcpy(g->start, start, (nrows + 1) * sizeof(size_t));
+    memcpy(g->index, index, nnz * sizeof(size_t));
+    build_transpose(g);
+    return g;
+}
+
+mesh_graph* mesh_from_elements(vector(size_t) conn, size_t width,
+                               size_t nnodes) {
+    if (!conn) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL connectivity @ "
+                                        "mesh_from_elements!\n");
+        return NULL;
+    }
+    const size_t len = (size_t)LENGTH(conn);
+    if (width == 0 || len % width) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Connectivity of %zu nodes is not a multiple of %zu @ "
+                    "mesh_from_elements!\n",
+                    len, width);
+        return NULL;
+    }
+    const size_t nelems = len / width;
+    size_t* start = alloc_or_die((nelems + 1) * sizeof(size_t),
+                                 "mesh_from_elements");
+    for (size_t e = 0; e <= nelems; e++)
+        start[e] = e * width;
+    mesh_graph* g = new_mesh_graph(nelems, nnodes, start, conn + 1);
+    free(start);
+    return g;
+}
+
+mesh_graph* mesh_transpose(const mesh_graph* g) {
+    mesh_graph* t = alloc_graph(g->ncols, g->nrows, g->nnz, "mesh_transpose");
+    memcpy(t->start, g->tstart, (g->ncols + 1) * sizeof(size_t));
+    /* the row of every entry, so that entry k of 't' is the row of tpos[k] */
+    size_t* row = alloc_or_die(g->nnz * sizeof(size_t), "mesh_transpose");
+#pragma omp parallel for schedule(static) if (g->nrows >= SIMUTIL_PAR_MIN)
+    for (size_t i = 1; i <= g->nrows; i++)
+        for (size_t k = g->start[i - 1]; k < g->start[i]; k++)
+            row[k] = i;
+#pragma omp parallel for schedule(static) if (g->nnz >= SIMUTIL_PAR_MIN)
+    for (size_t k = 0; k < g->nnz; k++)
+        t->index[k] = row[g->tpos[k]];
+    free(row);
+    build_transpose(t);
+    return t;
+}
+
+/*
+ * Rows of 'a' linked through the items they share: row 'r' links to every
+ * other row 'q' found at least 'shared' times among the rows of 'at' (items
+ * to rows) of the items of 'r'. 'cnt' is zero on entry and exit; 'touched'
+ * holds the distinct rows met. Writes the sorted links to 'out' if not NULL
+ * and returns their number.
+ */
+static size_t shared_row(const mesh_graph* a, const mesh_graph* at, size_t r,
+                         size_t shared, size_t* cnt, size_t* touched,
+                         size_t* out) {
+    size_t nt = 0;
+    for (size_t k = a->start[r - 1]; k < a->start[r]; k++) {
+        const size_t item = a->index[k];
+        for (size_t m = at->start[item - 1]; m < at->start[item]; m++) {
+            const size_t q = at->index[m];
+            if (q != r && cnt[q - 1]++ == 0)
+                touched[nt++] = q;
+        }
+    }
+    size_t n = 0;
+    for (size_t t = 0; t < nt; t++) {
+        const size_t q = touched[t];
+        if (cnt[q - 1] >= shared) {
+            if (out)
+                out[n] = q;
+            n++;
+        }
+        cnt[q - 1] = 0;
+    }
+    if (out)
+        sort_index(out, n);
+    return n;
+}
+
+
+/* counts the links of every row, then fills them at their offsets */
+static mesh_graph* shared_graph(const mesh_graph* a, const mesh_graph* at,
+                                size_t shared, const char* name) {
+    const size_t n = a->nrows;
+    mesh_graph* g = NULL;
+    size_t* start = alloc_or_die((n + 1) * sizeof(size_t), name);
+    int fail = 0;
+    start[0] = 0;
+#pragma omp parallel if (n >= SIMUTIL_PAR_MIN)
+    {
+        size_t* cnt = calloc(n ? n : 1, sizeof(size_t));
+        size_t* touched = malloc((n ? n : 1) * sizeof(size_t));
+        if (!cnt || !touched) {
+#pragma omp atomic write
+            fail = 1;
+        }
+#pragma omp barrier
+        if (!fail) {
+#pragma omp for schedule(static)
+            for (size_t r = 1; r <= n; r++)
+                start[r] = shared_row(a, at, r, shared, cnt, touched, NULL);
+#pragma omp single
+            {
+                for (size_t r = 1; r <= n; r++)
+                    start[r] += start[r - 1];
+                g = alloc_graph(n, n, start[n], name);
+                memcpy(g->start, start, (n + 1) * sizeof(size_t));
+            }
+#pragma omp for schedule(static)
+            for (size_t r = 1; r <= n; r++)
+                shared_row(a, at, r, shared, cnt, touched,
+                           g->index + g->start[r - 1]);
+        }
+        free(cnt);
+        free(touched);
+    }
+    free(start);
+    if (fail) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation @ %s!\n", name);
+        exit(EXIT_FAILURE);
+    }
+    build_transpose(g);
+    return g;
+}
+
+mesh_graph* mesh_node_graph(const mesh_graph* elems) {
+    mesh_graph* nodes = mesh_transpose(elems);
+    mesh_graph* g = shared_graph(nodes, elems, 1, "mesh_node_graph");
+    free_mesh_graph(nodes);
+    return g;
+}
+
+mesh_graph* mesh_cell_graph(const mesh_graph* elems, size_t shared) {
+    if (shared == 0) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Cells must share at least one node @ mesh_cell_graph!\n");
+        return NULL;
+    }
+    mesh_graph* nodes = mesh_transpose(elems);
+    mesh_graph* g = shared_graph(elems, nodes, shared, "mesh_cell_graph");
+    free_mesh_graph(nodes);
+    return g;
+}
+
+static int check_square(const mesh_graph* g, const char* name) {
+    if (!g) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL graph @ %s!\n", name);
+        return 0;
+    }
+    if (g->nrows != g->ncols) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Graph of %zu rows and %zu columns is not square @ %s!\n",
+                    g->nrows, g->ncols, name);
+        return 0;
+    }
+    return 1;
+}
+
+mesh_graph* mesh_faces(const mesh_graph* cells) {
+    if (!check_square(cells, "mesh_faces"))
+        return NULL;
+    const size_t n = cells->nrows;
+    /* faces before those of cell c, counting each face at its lower cell */
+    size_t* first = alloc_or_die((n + 1) * sizeof(size_t), "mesh_faces");
+    first[0] = 0;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 1; c <= n; c++) {
+        size_t nf = 0;
+        for (size_t k = cells->start[c - 1]; k < cells->start[c]; k++)
+            nf += cells->index[k] > c;
+        first[c] = nf;
+    }
+    for (size_t c = 1; c <= n; c++)
+        first[c] += first[c - 1];
+    mesh_graph* f = alloc_graph(first[n], n, 2 * first[n], "mesh_faces");
+    for (size_t i = 0; i <= first[n]; i++)
+        f->start[i] = 2 * i;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 1; c <= n; c++) {
+        size_t* out = f->index + 2 * first[c - 1];
+        for (size_t k = cells->start[c - 1]; k < cells->start[c]; k++)
+            if (cells->index[k] > c) {
+                *out++ = c;
+                *out++ = cells->index[k];
+            }
+    }
+    free(first);
+    build_transpose(f);
+    return f;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Reordering                                */
+/*                                                                          */
+/****************************************************************************/
+
+typedef struct {
+    size_t degree;
+    size_t node;
+} rcm_key;
+
+static int cmp_key(const void* a, const void* b) {
+    const rcm_key* x = a;
+    const rcm_key* y = b;
+    if (x->degree != y->degree)
+        return (x->degree > y->degree) - (x->degree < y->degree);
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+static void sort_keys(rcm_key* a, size_t n) {
+    if (n > SMALL_SORT) {
+        qsort(a, n, sizeof(rcm_key), cmp_key);
+        return;
+    }
+    for (size_t i = 1; i < n; i++) {
+        const rcm_key v = a[i];
+        size_t j = i;
+        for (; j > 0 && cmp_key(&a[j - 1], &v) > 0; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+#define DEGREE(g, i) ((g)->start[i] - (g)->start[(i) - 1])
+
+/*
+ * Breadth-first search from 'root' over the nodes not yet marked 'stamp'.
+ * Leaves the nodes in 'queue' by level and returns the number of levels;
+ * the last level starts at '*last'.
+ */
+static size_t bfs_levels(const mesh_graph* g, size_t root, size_t* mark,
+                         size_t stamp, size_t* queue, size_t* count,
+                         size_t* last) {
+    size_t head = 0, tail = 0, levels = 0;
+    queue[tail++] = root;
+    mark[root - 1] = stamp;
+    while (head < tail) {
+        const size_t end = tail;
+        *last = head;
+        levels++;
+        for (; head < end; head++) {
+            const size_t v = queue[head];
+            for (size_t k = g->start[v - 1]; k < g->start[v]; k++) {
+                const size_t w = g->index[k];
+                if (mark[w - 1] != stamp) {
+                    mark[w - 1] = stamp;
+                    queue[tail++] = w;
+                }
+            }
+        }
+    }
+    *count = tail;
+    return levels;
+}
+
+/*
+ * George-Liu: moves the root to a node of least degree in the last level
+ * for as long as that adds levels.
+ */
+static size_t peripheral(const mesh_graph* g, size_t root, size_t* mark,
+                         size_t* stamp, size_t* queue) {
+    size_t count, last;
+    size_t levels = bfs_levels(g, root, mark, ++*stamp, queue, &count, &last);
+    for (;;) {
+        size_t best = queue[last];
+        for (size_t i = last + 1; i < count; i++)
+            if (DEGREE(g, queue[i]) < DEGREE(g, best))
+                best = queue[i];
+        const size_t more =
+            bfs_levels(g, best, mark, ++*stamp, queue, &count, &last);
+        if (more <= levels)
+            return root;
+        root = best;
+        levels = more;
+    }
+}
+
+void mesh_rcm_order(vector(size_t) perm, const mesh_graph* g) {
+    if (!check_square(g, "mesh_rcm_order"))
+        return;
+    const size_t n = g->nrows;
+    if (!perm || (size_t)LENGTH(perm) != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching permutation length @ mesh_rcm_order!\n");
+        return;
+    }
+    size_t* mark = alloc_or_die(n * sizeof(size_t), "mesh_rcm_order");
+    size_t* queue = alloc_or_die(n * sizeof(size_t), "mesh_rcm_order");
+    rcm_key* keys = alloc_or_die(n * sizeof(rcm_key), "mesh_rcm_order");
+    memset(mark, 0, n * sizeof(size_t));
+    /* stamps 1 and up mark searches; SIZE_MAX marks nodes already placed */
+    size_t stamp = 0, placed = 0;
+    for (size_t s = 1; s <= n; s++) {
+        if (mark[s - 1] == SIZE_MAX)
+            continue;
+        const size_t root = peripheral(g, s, mark, &stamp, queue);
+        /* Cuthill-McKee: visit neighbours by increasing degree */
+        size_t head = placed;
+        perm[n - placed++] = root;
+        mark[root - 1] = SIZE_MAX;
+        for (; head < placed; head++) {
+            const size_t v = perm[n - head];
+            size_t nk = 0;
+            for (size_t k = g->start[v - 1]; k < g->start[v]; k++) {
+                const size_t w = g->index[k];
+                if (mark[w - 1] != SIZE_MAX) {
+                    mark[w - 1] = SIZE_MAX;
+                    keys[nk].degree = DEGREE(g, w);
+                    keys[nk++].node = w;
+                }
+            }
+            sort_keys(keys, nk);
+            for (size_t i = 0; i < nk; i++)
+                perm[n - placed++] = keys[i].node;
+        }
+    }
+    free(mark);
+    free(queue);
+    free(keys);
+}
+
+/* inverse of a 1-based permutation of 1..n; returns NULL if 'p' is not one */
+static size_t* invert(vector(size_t) p, size_t n, const char* name) {
+    if ((size_t)LENGTH(p) != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching permutation length @ %s!\n", name);
+        return NULL;
+    }
+    size_t* inv = alloc_or_die((n + 1) * sizeof(size_t), name);
+    memset(inv, 0, (n + 1) * sizeof(size_t));
+    for (size_t i = 1; i <= n; i++) {
+        if (p[i] < 1 || p[i] > n || inv[p[i]]) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Entry %zu is not a permutation @ %s!\n", i, name);
+            free(inv);
+            return NULL;
+        }
+        inv[p[i]] = i;
+    }
+    return inv;
+}
+
+mesh_graph* mesh_permute(const mesh_graph* g, vector(size_t) row_perm,
+                         vector(size_t) col_perm) {
+    if (!g) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL graph @ mesh_permute!\n");
+        return NULL;
+    }
+    size_t* inv_col = NULL;
+    if (row_perm) {
+        size_t* inv_row = invert(row_perm, g->nrows, "mesh_permute");
+        if (!inv_row)
+            return NULL;
+        free(inv_row);
+    }
+    if (col_perm && !(inv_col = invert(col_perm, g->ncols, "mesh_permute")))
+        return NULL;
+    const size_t n = g->nrows;
+    mesh_graph* out = alloc_graph(n, g->ncols, g->nnz, "mesh_permute");
+    for (size_t i = 1; i <= n; i++) {
+        const size_t r = row_perm ? row_perm[i] : i;
+        out->start[i] = out->start[i - 1] + DEGREE(g, r);
+    }
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 1; i <= n; i++) {
+        const size_t r = row_perm ? row_perm[i] : i;
+        size_t* dst = out->index + out->start[i - 1];
+        for (size_t k = g->start[r - 1]; k < g->start[r]; k++)
+            *dst++ = inv_col ? inv_col[g->index[k]] : g->index[k];
+        sort_index(out->index + out->start[i - 1], DEGREE(out, i));
+    }
+    free(inv_col);
+    build_transpose(out);
+    return out;
+}
+
+size_t mesh_bandwidth(const mesh_graph* g) {
+    if (!check_square(g, "mesh_bandwidth"))
+        return 0;
+    const size_t n = g->nrows;
+    size_t bw = 0;
+#pragma omp parallel for schedule(static) reduction(max : bw)                  \
+    if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 1; i <= n; i++)
+        for (size_t k = g->start[i - 1]; k < g->start[i]; k++) {
+            const size_t j = g->index[k];
+            const size_t d = j > i ? j - i : i - j;
+            if (d > bw)
+                bw = d;
+        }
+    return bw;
+}
+
+void mesh_centroids(vector(double) cx, vector(double) cy, vector(double) cz,
+                    const mesh_graph* g, vector(double) x, vector(double) y,
+                    vector(double) z) {
+    if (!g || !cx || !cy || !x || !y) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL argument @ mesh_centroids!\n");
+        return;
+    }
+    const size_t n = g->nrows;
+    if ((size_t)LENGTH(cx) != n || (size_t)LENGTH(cy) != n ||
+        (cz && (size_t)LENGTH(cz) != n) || (size_t)LENGTH(x) != g->ncols ||
+        (size_t)LENGTH(y) != g->ncols || (z && (size_t)LENGTH(z) != g->ncols) ||
+        (!cz != !z)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching coordinate lengths @ mesh_centroids!\n");
+        return;
+    }
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 1; i <= n; i++) {
+        double s[3] = {0.0, 0.0, 0.0};
+        for (size_t k = g->start[i - 1]; k < g->start[i]; k++) {
+            s[0] += x[g->index[k]];
+            s[1] += y[g->index[k]];
+            if (z)
+                s[2] += z[g->index[k]];
+        }
+        const double w = DEGREE(g, i) ? 1.0 / DEGREE(g, i) : 0.0;
+        cx[i] = s[0] * w;
+        cy[i] = s[1] * w;
+        if (cz)
+            cz[i] = s[2] * w;
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Kernels                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static int check_data(const mesh_graph* g, vector(double) a, size_t na,
+                      vector(double) b, size_t nb, const char* name) {
+    if (!g || !a || !b) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL argument @ %s!\n", name);
+        return 0;
+    }
+    if ((size_t)LENGTH(a) != na || (size_t)LENGTH(b) != nb) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Unmatching lengths @ %s!\n",
+                    name);
+        return 0;
+    }
+    return 1;
+}
+
+void mesh_gather(vector(double) edge, const mesh_graph* g, vector(double) in) {
+    if (!check_data(g, edge, g ? g->nnz : 0, in, g ? g->ncols : 0,
+                    "mesh_gather"))
+        return;
+    const size_t* index = g->index;
+#pragma omp parallel for schedule(static) if (g->nnz >= SIMUTIL_PAR_MIN)
+    for (size_t k = 0; k < g->nnz; k++)
+        edge[k + 1] = in[index[k]];
+}
+
+void mesh_scatter_add(vector(double) out, const mesh_graph* g,
+                      vector(double) edge) {
+    if (!check_data(g, out, g ? g->ncols : 0, edge, g ? g->nnz : 0,
+                    "mesh_scatter_add"))
+        return;
+    const size_t n = g->ncols;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t j = 1; j <= n; j++) {
+        double s = 0.0;
+        for (size_t m = g->tstart[j - 1]; m < g->tstart[j]; m++)
+            s += edge[g->tpos[m] + 1];
+        out[j] += s;
+    }
+}
+
+void mesh_row_sum(vector(double) out, const mesh_graph* g,
+                  vector(double) edge) {
+    if (!check_data(g, out, g ? g->nrows : 0, edge, g ? g->nnz : 0,
+                    "mesh_row_sum"))
+        return;
+    const size_t n = g->nrows;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 1; i <= n; i++) {
+        double s = 0.0;
+        for (size_t k = g->start[i - 1]; k < g->start[i]; k++)
+            s += edge[k + 1];
+        out[i] = s;
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef SIMUTIL_MESH_H
+#define SIMUTIL_MESH_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+
+/**
+ * @brief Adjacency in compressed rows (CSR): row i (1-based) links to the
+ * entities 'index[start[i - 1]]' to 'index[start[i] - 1]', given as 1-based
+ * indices from 1 to ncols. Entries are numbered 0 to nnz - 1 in that order,
+ * so edge data of entry k lives at position k + 1 of a 'vector(double)'.
+ * 'tstart' and 'tpos' list the entries of every column in row order and are
+ * kept up to date by the builders; they make scatters free of write
+ * conflicts.
+ *
+ */
+typedef struct {
+    size_t nrows;
+    size_t ncols;
+    size_t nnz;
+    size_t* start;
+    size_t* index;
+    size_t* tstart;
+    size_t* tpos;
+} mesh_graph;
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Builders                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Function to build a graph from compressed rows, which are copied.
+ * Returns NULL if an index is out of range.
+ *
+ * @param nrows Number of rows
+ * @param ncols Number of columns, the range of the indices
+ * @param start nrows + 1 offsets into 'index', from start[0] = 0
+ * @param index 1-based column indices
+ */
+SIMUTIL_API mesh_graph* new_mesh_graph(size_t nrows, size_t ncols,
+                                       const size_t* start,
+                                       const size_t* index);
+
+/**
+ * @brief Function to build the element-to-node graph of a mesh whose
+ * elements all have 'width' nodes, e.g. 3 for triangles or 8 for hexahedra.
+ *
+ * @param conn 'vector(size_t)' of 1-based node indices, 'width' per element
+ * @param width Nodes per element
+ * @param nnodes Number of nodes
+ */
+SIMUTIL_API mesh_graph* mesh_from_elements(vector(size_t) conn, size_t width,
+                                           size_t nnodes);
+
+SIMUTIL_API void free_mesh_graph(mesh_graph* g);
+
+/**
+ * @brief Function to build the transpose of a graph, e.g. node-to-element
+ * from element-to-node. Rows of the result are sorted.
+ *
+ * @param g Graph
+ */
+SIMUTIL_API mesh_graph* mesh_transpose(const mesh_graph* g);
+
+/**
+ * @brief Function to build the node-to-node graph of a mesh: two nodes are
+ * linked when an element holds both. Rows are sorted and exclude the node
+ * itself.
+ *
+ * @param elems Element-to-node graph
+ */
+SIMUTIL_API mesh_graph* mesh_node_graph(const mesh_graph* elems);
+
+/**
+ * @brief Function to build the cell-to-cell graph of a mesh: two elements
+ * are linked when they share at least 'shared' nodes, i.e. a face for
+ * 'shared' equal to the nodes of a face (2 for triangles, 3 for tetrahedra,
+ * 4 for hexahedra). Rows are sorted.
+ *
+ * @param elems Element-to-node graph
+ * @param shared Nodes that two linked elements share
+ */
+SIMUTIL_API mesh_graph* mesh_cell_graph(const mesh_graph* elems,
+                                        size_t shared);
+
+/**
+ * @brief Function to list the interior faces of a cell graph as a
+ * face-to-cell graph with two entries per face, the lower cell first. Faces
+ * are ordered by their first cell, so a cell-ordered mesh gives
+ * cell-ordered faces.
+ *
+ * @param cells Symmetric cell-to-cell graph
+ */
+SIMUTIL_API mesh_graph* mesh_faces(const mesh_graph* cells);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Reordering                                */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Function to compute the reverse Cuthill-McKee order of a square
+ * graph, which reduces its bandwidth: perm[i] is the old index of the i-th
+ * row. Each connected component starts from a pseudo-peripheral row.
+ *
+ * @param perm 'vector(size_t)' of length g->nrows
+ * @param g Symmetric square graph, e.g. from mesh_node_graph
+ */
+SIMUTIL_API void mesh_rcm_order(vector(size_t) perm, const mesh_graph* g);
+
+/**
+ * @brief Function to renumber a graph: row i of the result is row
+ * row_perm[i] of 'g', and column col_perm[j] becomes column j. Rows of the
+ * result are sorted. Permute the data with 'permute_vector' and the same
+ * permutations; orders can come from mesh_rcm_order or, for locality, from
+ * spatial_morton_order on mesh_centroids.
+ *
+ * @param g Graph
+ * @param row_perm 'vector(size_t)' of length g->nrows, or NULL to keep rows
+ * @param col_perm 'vector(size_t)' of length g->ncols, or NULL to keep
+ * columns
+ */
+SIMUTIL_API mesh_graph* mesh_permute(const mesh_graph* g,
+                                     vector(size_t) row_perm,
+                                     vector(size_t) col_perm);
+
+/**
+ * @brief Function to get the bandwidth of a square graph: the largest
+ * |i - j| over its entries.
+ *
+ * @param g Graph
+ */
+SIMUTIL_API size_t mesh_bandwidth(const mesh_graph* g);
+
+/**
+ * @brief Function to compute the centroid of every row from the coordinates
+ * of its columns, e.g. of elements from their nodes.
+ *
+ * @param cx, cy, cz 'vector(double)' of length g->nrows; cz may be NULL
+ * @param g Graph, e.g. element-to-node
+ * @param x, y, z Column coordinates; z may be NULL
+ */
+SIMUTIL_API void mesh_centroids(vector(double) cx, vector(double) cy,
+                                vector(double) cz, const mesh_graph* g,
+                                vector(double) x, vector(double) y,
+                                vector(double) z);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Kernels                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Function to copy column data to every entry: edge[k + 1] =
+ * in[index[k]], e.g. the two cell values of every face.
+ *
+ * @param edge 'vector(double)' of length g->nnz
+ * @param g Graph
+ * @param in 'vector(double)' of length g->ncols
+ */
+SIMUTIL_API void mesh_gather(vector(double) edge, const mesh_graph* g,
+                             vector(double) in);
+
+/**
+ * @brief Function to add entry data to the columns: out[j] += the sum of
+ * edge[k + 1] over the entries k of column j, e.g. face fluxes into cells.
+ * Every column is summed by one thread in row order, so there are no
+ * atomics and the result does not depend on the number of threads.
+ *
+ * @param out 'vector(double)' of length g->ncols
+ * @param g Graph
+ * @param edge 'vector(double)' of length g->nnz
+ */
+SIMUTIL_API void mesh_scatter_add(vector(double) out, const mesh_graph* g,
+                                  vector(double) edge);
+
+/**
+ * @brief Function to sum entry data over every row: out[i] = the sum of
+ * edge[k + 1] over the entries k of row i.
+ *
+ * @param out 'vector(double)' of length g->nrows
+ * @param g Graph
+ * @param edge 'vector(double)' of length g->nnz
+ */
+SIMUTIL_API void mesh_row_sum(vector(double) out, const mesh_graph* g,
+                              vector(double) edge);
+
+#endif
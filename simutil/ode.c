@@ -0,0 +1,767 @@
+#include "ode.h"
+#include "error.h"
+#include "reduce.h"
+#include <math.h>
+#include <string.h>
+
+#define MAX_STAGES 7
+
+/* elements (or systems of a batch) handled per cache-resident chunk */
+#define CHUNK 512
+
+/* step size controller */
+#define SAFETY 0.9
+#define FAC_MIN 0.2
+#define FAC_MAX 5.0
+
+typedef struct {
+    size_t stages;
+    int embedded;
+    int fsal;
+    double order; /* order of the lower (error) solution */
+    double c[MAX_STAGES];
+    double a[MAX_STAGES][MAX_STAGES];
+    double b[MAX_STAGES];
+    double e[MAX_STAGES]; /* b - b_hat */
+} tableau;
+
+static const tableau tableaus[] = {
+    [ODE_RK4] = {.stages = 4,
+                 .c = {0.0, 0.5, 0.5, 1.0},
+                 .a = {{0}, {0.5}, {0.0, 0.5}, {0.0, 0.0, 1.0}},
+                 .b = {1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0}},
+    [ODE_RK23] = {.stages = 4,
+                  .embedded = 1,
+                  .fsal = 1,
+                  .order = 2.0,
+                  .c = {0.0, 0.5, 0.75, 1.0},
+                  .a = {{0},
+                        {0.5},
+                        {0.0, 0.75},
+                        {2.0 / 9.0, 1.0 / 3.0, 4.0 / 9.0}},
+                  .b = {2.0 / 9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0},
+                  .e = {-5.0 / 72.0, 1.0 / 12.0, 1.0 / 9.0, -1.0 / 8.0}},
+    [ODE_DOPRI5] = {.stages = 7,
+                    .embedded = 1,
+                    .fsal = 1,
+                    .order = 4.0,
+                    .c = {0.0, 0.2, 0.3, 0.8, 8.0 / 9.0, 1.0, 1.0},
+                    .a = {{0},
+                          {0.2},
+                          {3.0 / 40.0, 9.0 / 40.0},
+                          {44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0},
+                          {19372.0 / 6561.0, -25360.0 / 2187.0,
+                           64448.0 / 6561.0, -212.0 / 729.0},
+                          {9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0,
+                           49.0 / 176.0, -5103.0 / 18656.0},
+                          {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0,
+                           -2187.0 / 6784.0, 11.0 / 84.0}},
+                    .b = {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0,
+                          -2187.0 / 6784.0, 11.0 / 84.0, 0.0},
+                    .e = {71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0,
+                          -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0}},
+};
+
+struct ode_solver {
+    ode_method_t method;
+    const tableau* tab;
+    size_t n;    /* components of a system */
+    size_t nsys; /* systems of a batch, 0 for a single system */
+    int lines_are_cols;
+    double rtol;
+    double atol;
+    double h0;
+    double hmin;
+    double hmax;
+    size_t max_steps;
+    double h; /* step proposed for the next call */
+    /* single system: stage derivatives, stage input, current and new state */
+    vector(double) k[MAX_STAGES];
+    vector(double) ytmp;
+    vector(double) ycur;
+    vector(double) ynew;
+    /* batch: the same as line tables, plus per-system times and steps */
+    double** mk[MAX_STAGES];
+    double** mtmp;
+    double** mcur;
+    double** mnew;
+    vector(double) tlane;
+    vector(double) tstage;
+    double* hprop;
+    double* hstep;
+    double* err;
+    double* accept;
+};
+
+/****************************************************************************/
+/*                                                                          */
+/*                          Single System Kernels                           */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Stage combinations sweep the state in cache-sized chunks and add every
+ * stage derivative to the chunk before moving on, so a step reads each stage
+ * vector once per combination and the output stays in L1. A parallel region
+ * is only opened for long states: small systems are stepped millions of
+ * times and would pay for the fork on every stage.
+ */
+
+static inline size_t chunk_end(long c, size_t n) {
+    const size_t hi = (size_t)c * CHUNK + CHUNK;
+    return hi < n ? hi : n;
+}
+
+/* out = y + h * sum_j a[j] * k[j] for j < m, on 0-indexed views */
+static inline void combine_chunk(double* out, const double* y,
+                                 double* const* k, const double* a, size_t m,
+                                 double h, size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++)
+        out[i] = y[i];
+    for (size_t j = 0; j < m; j++) {
+        if (a[j] == 0.0)
+            continue;
+        const double hj = h * a[j];
+        const double* kj = k[j];
+        for (size_t i = lo; i < hi; i++)
+            out[i] += hj * kj[i];
+    }
+}
+
+/* sum of squares of (h * sum_j e[j] k[j]) / (atol + rtol * max(|y|, |ynew|)) */
+static inline double err_chunk(const double* y, const double* ynew,
+                               double* const* k, const double* e, size_t m,
+                               double h, double rtol, double atol, size_t lo,
+                               size_t hi) {
+    double buf[CHUNK];
+    double sum = 0.0;
+    for (size_t i = lo; i < hi; i++)
+        buf[i - lo] = 0.0;
+    for (size_t j = 0; j < m; j++) {
+        if (e[j] == 0.0)
+            continue;
+        const double hj = h * e[j];
+        const double* kj = k[j];
+        for (size_t i = lo; i < hi; i++)
+            buf[i - lo] += hj * kj[i];
+    }
+    for (size_t i = lo; i < hi; i++) {
+        const double sc = atol + rtol * fmax(fabs(y[i]), fabs(ynew[i]));
+        const double r = buf[i - lo] / sc;
+        sum += r * r;
+    }
+    return sum;
+}
+
+static void combine(double* out, const double* y, double* const* k,
+                    const double* a, size_t m, double h, size_t n) {
+    const long nchunks = (long)((n + CHUNK - 1) / CHUNK);
+    if (n < SIMUTIL_PAR_MIN) {
+        for (long c = 0; c < nchunks; c++)
+            combine_chunk(out, y, k, a, m, h, (size_t)c * CHUNK,
+                          chunk_end(c, n));
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (long c = 0; c < nchunks; c++)
+        combine_chunk(out, y, k, a, m, h, (size_t)c * CHUNK, chunk_end(c, n));
+}
+
+/*
+ * Summed over the fixed chunks of 'reduce_chunks', each made of whole
+ * CHUNKs, and combined by 'reduce_tree', so that step sizes do not depend on
+ * the number of threads.
+ */
+static double err_sum(const double* y, const double* ynew, double* const* k,
+                      const double* e, size_t m, double h, double rtol,
+                      double atol, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        const size_t end = reduce_chunk_end(c, len, n);
+        double sum = 0.0;
+        for (size_t lo = c * len; lo < end; lo += CHUNK)
+            sum += err_chunk(y, ynew, k, e, m, h, rtol, atol, lo,
+                             lo + CHUNK < end ? lo + CHUNK : end);
+        part[c] = sum;
+    }
+    return reduce_tree(part, nchunks);
+}
+
+/* RMS of v / (atol + rtol * |y|), used once per call to pick the first step */
+static double scaled_rms(const double* v, const double* y, double rtol,
+                         double atol, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        const double r = v[i] / (atol + rtol * fabs(y[i]));
+        sum += r * r;
+    }
+    return n ? sqrt(sum / (double)n) : 0.0;
+}
+
+static double initial_step(double d0, double d1, double span) {
+    double h = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    return fmin(h, fabs(span));
+}
+
+/*
+ * A non-finite error means a stage overflowed: the step is rejected like any
+ * error above 1 and shrinks by the most allowed, never grows.
+ */
+static double next_step(const tableau* tab, double h, double err) {
+    if (!isfinite(err))
+        return h * FAC_MIN;
+    double fac = err > 0.0 ? SAFETY * pow(err, -1.0 / (tab->order + 1.0))
+                           : FAC_MAX;
+    fac = fmin(FAC_MAX, fmax(FAC_MIN, fac));
+    return h * fac;
+}
+
+/*
+ * One step from (t, ycur) with k[0] = f(t, ycur) already set, leaving the
+ * result in ynew and, for FSAL methods, f(t + h, ynew) in the last stage.
+ * Returns the scaled RMS error, or 0 without an embedded estimate.
+ */
+static double rk_step(ode_solver* s, ode_rhs_t f, void* ctx, double t,
+                      double h, size_t* evals) {
+    const tableau* tab = s->tab;
+    const size_t n = s->n;
+    const size_t ns = tab->stages;
+    double* kv[MAX_STAGES];
+    for (size_t j = 0; j < ns; j++)
+        kv[j] = s->k[j] + 1;
+
+    const size_t last = tab->fsal ? ns - 1 : ns;
+    for (size_t i = 1; i < last; i++) {
+        combine(s->ytmp + 1, s->ycur + 1, kv, tab->a[i], i, h, n);
+        f(s->k[i], t + tab->c[i] * h, s->ytmp, ctx);
+        (*evals)++;
+    }
+    combine(s->ynew + 1, s->ycur + 1, kv, tab->b, last, h, n);
+    if (tab->fsal) {
+        f(s->k[ns - 1], t + h, s->ynew, ctx);
+        (*evals)++;
+    }
+    if (!tab->embedded)
+        return 0.0;
+    const double sum = err_sum(s->ycur + 1, s->ynew + 1, kv, tab->e, ns, h,
+                               s->rtol, s->atol, n);
+    return n ? sqrt(sum / (double)n) : 0.0;
+}
+
+static inline void swap_vectors(vector(double) * a, vector(double) * b) {
+    vector(double) t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Batch Kernels                               */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Line tables are 1-indexed like a matrix: line l (component) holds system s
+ * at position s. Kernels take a chunk of systems and walk the components, so
+ * the innermost loop always runs over contiguous systems.
+ */
+
+/* out = y + hs[s] * sum_j a[j] * k[j] for the systems of [lo, hi) */
+static void combine_lanes(double** out, double** y, double** const* k,
+                          const double* a, size_t m, const double* hs,
+                          size_t ncomp, size_t lo, size_t hi) {
+    for (size_t l = 1; l <= ncomp; l++) {
+        double* o = out[l] + 1;
+        const double* yl = y[l] + 1;
+        for (size_t s = lo; s < hi; s++)
+            o[s] = yl[s];
+        for (size_t j = 0; j < m; j++) {
+            if (a[j] == 0.0)
+                continue;
+            const double aj = a[j];
+            const double* kj = k[j][l] + 1;
+            for (size_t s = lo; s < hi; s++)
+                o[s] += aj * hs[s] * kj[s];
+        }
+    }
+}
+
+static void err_lanes(double* err, double** y, double** ynew,
+                      double** const* k, const double* e, size_t m,
+                      const double* hs, double rtol, double atol, size_t ncomp,
+                      size_t lo, size_t hi) {
+    double buf[CHUNK];
+    for (size_t s = lo; s < hi; s++)
+        err[s] = 0.0;
+    for (size_t l = 1; l <= ncomp; l++) {
+        const double* yl = y[l] + 1;
+        const double* nl = ynew[l] + 1;
+        for (size_t s = lo; s < hi; s++)
+            buf[s - lo] = 0.0;
+        for (size_t j = 0; j < m; j++) {
+            if (e[j] == 0.0)
+                continue;
+            const double ej = e[j];
+            const double* kj = k[j][l] + 1;
+            for (size_t s = lo; s < hi; s++)
+                buf[s - lo] += ej * kj[s];
+        }
+        for (size_t s = lo; s < hi; s++) {
+            const double sc = atol + rtol * fmax(fabs(yl[s]), fabs(nl[s]));
+            const double r = hs[s] * buf[s - lo] / sc;
+            err[s] += r * r;
+        }
+    }
+    for (size_t s = lo; s < hi; s++)
+        err[s] = sqrt(err[s] / (double)ncomp);
+}
+
+/*
+ * dst = accept[s] ? src : dst as a select, which still runs in SIMD lanes
+ * and, unlike a blend, keeps dst when a rejected src is inf or NaN
+ */
+static void blend_lanes(double** dst, double** src, const double* accept,
+                        size_t ncomp, size_t lo, size_t hi) {
+    for (size_t l = 1; l <= ncomp; l++) {
+        double* d = dst[l] + 1;
+        const double* sl = src[l] + 1;
+        for (size_t s = lo; s < hi; s++)
+            d[s] = accept[s] != 0.0 ? sl[s] : d[s];
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                            Solver Management                             */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * A line table with a matrix header, so the batched callback can index it
+ * and read COLS/ROWS with the layout it was compiled with.
+ */
+static double** new_lines(size_t nlines, size_t linelen, int lines_are_cols) {
+    const size_t bytes = MATRIX_SIZE_BYTE + (nlines + 1) * sizeof(double*) +
+                         (nlines * linelen + 1) * sizeof(double);
+    char* start = calloc(1, bytes);
+    if (!start)
+        return NULL;
+    ((size_t*)start)[0] = lines_are_cols ? nlines : linelen;
+    ((size_t*)start)[1] = lines_are_cols ? linelen : nlines;
+    ((size_t*)start)[2] = 1;
+    double** lines = (double**)(start + MATRIX_SIZE_BYTE);
+    double* data = (double*)(lines + nlines + 1);
+    for (size_t l = 1; l <= nlines; l++)
+        lines[l] = data + (l - 1) * linelen;
+    return lines;
+}
+
+static void free_lines(double** lines) {
+    if (lines)
+        free((char*)lines - MATRIX_SIZE_BYTE);
+}
+
+static ode_solver* alloc_solver(ode_method_t method, size_t n, size_t nsys) {
+    if (method != ODE_RK4 && method != ODE_RK23 && method != ODE_DOPRI5) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Unknown method @ new_ode_solver!\n");
+        return NULL;
+    }
+    ode_solver* s = calloc(1, sizeof(ode_solver));
+    if (!s) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for ode solver!\n");
+        return NULL;
+    }
+    s->method = method;
+    s->tab = &tableaus[method];
+    s->n = n;
+    s->nsys = nsys;
+    s->rtol = 1e-6;
+    s->atol = 1e-9;
+    s->hmax = INFINITY;
+    s->max_steps = 100000;
+    return s;
+}
+
+ode_solver* new_ode_solver(ode_method_t method, size_t n) {
+    ode_solver* s = alloc_solver(method, n, 0);
+    if (!s)
+        return NULL;
+    for (size_t j = 0; j < s->tab->stages; j++)
+        if (!(s->k[j] = new_vector(double, n)))
+            goto fail;
+    if (!(s->ytmp = new_vector(double, n)) ||
+        !(s->ycur = new_vector(double, n)) ||
+        !(s->ynew = new_vector(double, n)))
+        goto fail;
+    return s;
+
+fail:
+    free_ode_solver(s);
+    raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for ode solver!\n");
+    return NULL;
+}
+
+ode_solver* __new_ode_batch(ode_method_t method, size_t ncomp, size_t nsys,
+                            int lines_are_cols) {
+    if (nsys == 0) {
+        raise_error(SIMUTIL_DEFAULT_ERROR, "Empty batch @ new_ode_batch!\n");
+        return NULL;
+    }
+    ode_solver* s = alloc_solver(method, ncomp, nsys);
+    if (!s)
+        return NULL;
+    s->lines_are_cols = lines_are_cols;
+    for (size_t j = 0; j < s->tab->stages; j++)
+        if (!(s->mk[j] = new_lines(ncomp, nsys, lines_are_cols)))
+            goto fail;
+    if (!(s->mtmp = new_lines(ncomp, nsys, lines_are_cols)) ||
+        !(s->mcur = new_lines(ncomp, nsys, lines_are_cols)) ||
+        !(s->mnew = new_lines(ncomp, nsys, lines_are_cols)) ||
+        !(s->tlane = new_vector(double, nsys)) ||
+        !(s->tstage = new_vector(double, nsys)))
+        goto fail;
+    s->hprop = malloc(nsys * sizeof(double));
+    s->hstep = malloc(nsys * sizeof(double));
+    s->err = malloc(nsys * sizeof(double));
+    s->accept = malloc(nsys * sizeof(double));
+    if (!s->hprop || !s->hstep || !s->err || !s->accept)
+        goto fail;
+    return s;
+
+fail:
+    free_ode_solver(s);
+    raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for ode batch!\n");
+    return NULL;
+}
+
+void free_ode_solver(ode_solver* s) {
+    if (!s)
+        return;
+    for (size_t j = 0; j < MAX_STAGES; j++) {
+        if (s->k[j])
+            free_vector(s->k[j]);
+        free_lines(s->mk[j]);
+    }
+    if (s->ytmp)
+        free_vector(s->ytmp);
+    if (s->ycur)
+        free_vector(s->ycur);
+    if (s->ynew)
+        free_vector(s->ynew);
+    free_lines(s->mtmp);
+    free_lines(s->mcur);
+    free_lines(s->mnew);
+    if (s->tlane)
+        free_vector(s->tlane);
+    if (s->tstage)
+        free_vector(s->tstage);
+    free(s->hprop);
+    free(s->hstep);
+    free(s->err);
+    free(s->accept);
+    free(s);
+}
+
+void ode_set_tolerance(ode_solver* s, double rtol, double atol) {
+    s->rtol = rtol;
+    s->atol = atol;
+}
+
+void ode_set_step(ode_solver* s, double h0, double hmin, double hmax) {
+    s->h0 = fabs(h0);
+    s->hmin = fabs(hmin);
+    s->hmax = hmax > 0.0 ? hmax : INFINITY;
+    s->h = 0.0;
+}
+
+void ode_set_max_steps(ode_solver* s, size_t max_steps) {
+    s->max_steps = max_steps;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Integration                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Batch phases work on chunks of systems. As for single systems, threads are
+ * only started when the batch is large enough to pay for them.
+ */
+typedef struct {
+    double** out;
+    const double* a;
+    size_t m;
+    double c;
+} stage_args;
+
+typedef void (*lane_fn)(ode_solver* s, const void* args, size_t lo,
+                        size_t hi);
+
+static void for_lane_chunks(ode_solver* s, lane_fn fn, const void* args) {
+    const size_t nsys = s->nsys;
+    const long nchunks = (long)((nsys + CHUNK - 1) / CHUNK);
+    if (nchunks < 2 || nsys * s->n < SIMUTIL_PAR_MIN) {
+        for (long c = 0; c < nchunks; c++)
+            fn(s, args, (size_t)c * CHUNK, chunk_end(c, nsys));
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (long c = 0; c < nchunks; c++)
+        fn(s, args, (size_t)c * CHUNK, chunk_end(c, nsys));
+}
+
+/* the stage input 'out' and the stage time of every system */
+static void stage_lanes(ode_solver* s, const void* args, size_t lo,
+                        size_t hi) {
+    const stage_args* st = (const stage_args*)args;
+    double* ts = s->tstage + 1;
+    const double* tl = s->tlane + 1;
+    combine_lanes(st->out, s->mcur, s->mk, st->a, st->m, s->hstep, s->n, lo,
+                  hi);
+    for (size_t i = lo; i < hi; i++)
+        ts[i] = tl[i] + st->c * s->hstep[i];
+}
+
+static void error_lanes(ode_solver* s, const void* args, size_t lo,
+                        size_t hi) {
+    (void)args;
+    err_lanes(s->err, s->mcur, s->mnew, s->mk, s->tab->e, s->tab->stages,
+              s->hstep, s->rtol, s->atol, s->n, lo, hi);
+}
+
+/* moves accepted systems to their new state (and first stage, for FSAL) */
+static void accept_lanes(ode_solver* s, const void* args, size_t lo,
+                         size_t hi) {
+    (void)args;
+    blend_lanes(s->mcur, s->mnew, s->accept, s->n, lo, hi);
+    if (s->tab->fsal)
+        blend_lanes(s->mk[0], s->mk[s->tab->stages - 1], s->accept, s->n, lo,
+                    hi);
+}
+
+static void batch_stage(ode_solver* s, double** out, const double* a,
+                        size_t m, double c) {
+    const stage_args st = {out, a, m, c};
+    for_lane_chunks(s, stage_lanes, &st);
+}
+
+static void check_single(const ode_solver* s, vector(double) y,
+                         const char* name) {
+    if (!s || s->nsys) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Expected a single-system solver @ %s!\n", name);
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)LENGTH(y) != s->n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Unmatching vector length @ %s!\n",
+                    name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+double ode_step(ode_solver* s, ode_rhs_t f, void* ctx, double* t,
+                vector(double) y, double h) {
+    check_single(s, y, "ode_step");
+    size_t evals = 0;
+    memcpy(s->ycur + 1, y + 1, s->n * sizeof(double));
+    f(s->k[0], *t, s->ycur, ctx);
+    const double err = rk_step(s, f, ctx, *t, h, &evals);
+    memcpy(y + 1, s->ynew + 1, s->n * sizeof(double));
+    *t += h;
+    return err;
+}
+
+ode_result ode_integrate(ode_solver* s, ode_rhs_t f, void* ctx, double* t,
+                         vector(double) y, double t_end) {
+    check_single(s, y, "ode_integrate");
+    const tableau* tab = s->tab;
+    const size_t n = s->n;
+    const double dir = t_end >= *t ? 1.0 : -1.0;
+    ode_result res = {0, 0, 0, 1};
+    double tc = *t;
+
+    if (!tab->embedded && s->h0 == 0.0) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "ODE_RK4 needs a step size from ode_set_step!\n");
+        res.success = 0;
+        return res;
+    }
+
+    memcpy(s->ycur + 1, y + 1, n * sizeof(double));
+    f(s->k[0], tc, s->ycur, ctx);
+    res.evals++;
+
+    double h = tab->embedded ? (s->h != 0.0 ? s->h : s->h0) : s->h0;
+    if (h == 0.0)
+        h = initial_step(scaled_rms(s->ycur + 1, s->ycur + 1, s->rtol,
+                                    s->atol, n),
+                         scaled_rms(s->k[0] + 1, s->ycur + 1, s->rtol,
+                                    s->atol, n),
+                         t_end - tc);
+    h = fmin(fabs(h), s->hmax);
+
+    while (dir * (t_end - tc) > 0.0) {
+        if (res.steps + res.rejected >= s->max_steps || h <= s->hmin ||
+            tc + dir * h == tc) {
+            res.success = 0;
+            break;
+        }
+        const int last = h >= fabs(t_end - tc);
+        const double hs = last ? t_end - tc : dir * h;
+        if (!tab->fsal && res.steps + res.rejected > 0) {
+            f(s->k[0], tc, s->ycur, ctx);
+            res.evals++;
+        }
+        const double err = rk_step(s, f, ctx, tc, hs, &res.evals);
+
+        if (err <= 1.0) {
+            tc = last ? t_end : tc + hs;
+            swap_vectors(&s->ycur, &s->ynew);
+            if (tab->fsal)
+                swap_vectors(&s->k[0], &s->k[tab->stages - 1]);
+            res.steps++;
+        } else {
+            res.rejected++;
+        }
+        if (tab->embedded) {
+            const double hn = fmin(next_step(tab, fabs(hs), err), s->hmax);
+            /* a truncated last step must not shrink the stored proposal */
+            h = (last && err <= 1.0) ? fmax(hn, h) : hn;
+        }
+    }
+
+    memcpy(y + 1, s->ycur + 1, n * sizeof(double));
+    *t = tc;
+    s->h = h;
+    return res;
+}
+
+ode_result __ode_batch_integrate(ode_solver* s, ode_batch_rhs_t f, void* ctx,
+                                 vector(double) t, double** y, size_t nlines,
+                                 size_t linelen, double t_end) {
+    if (!s || !s->nsys) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Expected a batch solver @ ode_batch_integrate!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nlines != s->n || linelen != s->nsys || (size_t)LENGTH(t) != s->nsys) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ ode_batch_integrate!\n");
+        exit(EXIT_FAILURE);
+    }
+    const tableau* tab = s->tab;
+    const size_t ncomp = s->n;
+    const size_t nsys = s->nsys;
+    const size_t ns = tab->stages;
+    const size_t last = tab->fsal ? ns - 1 : ns;
+    double* tl = s->tlane + 1;
+    double* hp = s->hprop;
+    double* hs = s->hstep;
+    ode_result res = {0, 0, 0, 1};
+
+    if (!tab->embedded && s->h0 == 0.0) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "ODE_RK4 needs a step size from ode_set_step!\n");
+        res.success = 0;
+        return res;
+    }
+
+    for (size_t l = 1; l <= ncomp; l++)
+        memcpy(s->mcur[l] + 1, y[l] + 1, nsys * sizeof(double));
+    memcpy(tl, t + 1, nsys * sizeof(double));
+    f((matrix(double))s->mk[0], s->tlane, (matrix(double))s->mcur, ctx);
+    res.evals++;
+
+    /* first step of every system */
+    for (size_t i = 0; i < nsys; i++) {
+        double h = s->h0;
+        if (tab->embedded && h == 0.0) {
+            double d0 = 0.0, d1 = 0.0;
+            for (size_t l = 1; l <= ncomp; l++) {
+                const double yv = s->mcur[l][i + 1];
+                const double sc = s->atol + s->rtol * fabs(yv);
+                d0 += (yv / sc) * (yv / sc);
+                d1 += (s->mk[0][l][i + 1] / sc) * (s->mk[0][l][i + 1] / sc);
+            }
+            h = initial_step(sqrt(d0 / (double)ncomp),
+                             sqrt(d1 / (double)ncomp), t_end - tl[i]);
+        }
+        hp[i] = fmin(h, s->hmax);
+    }
+
+    for (size_t iter = 0;; iter++) {
+        size_t active = 0;
+        for (size_t i = 0; i < nsys; i++) {
+            const double span = t_end - tl[i];
+            const double dir = span >= 0.0 ? 1.0 : -1.0;
+            hs[i] = 0.0;
+            if (span == 0.0 || !(hp[i] > 0.0))
+                continue;
+            if (hp[i] <= s->hmin || tl[i] + dir * hp[i] == tl[i] ||
+                iter >= s->max_steps) {
+                res.success = 0;
+                hp[i] = 0.0;
+                continue;
+            }
+            hs[i] = hp[i] >= fabs(span) ? span : dir * hp[i];
+            active++;
+        }
+        if (!active)
+            break;
+
+        if (!tab->fsal && iter > 0) {
+            f((matrix(double))s->mk[0], s->tlane, (matrix(double))s->mcur,
+              ctx);
+            res.evals++;
+        }
+        for (size_t j = 1; j < last; j++) {
+            batch_stage(s, s->mtmp, tab->a[j], j, tab->c[j]);
+            f((matrix(double))s->mk[j], s->tstage, (matrix(double))s->mtmp,
+              ctx);
+            res.evals++;
+        }
+        batch_stage(s, s->mnew, tab->b, last, 1.0);
+        if (tab->fsal) {
+            f((matrix(double))s->mk[ns - 1], s->tstage,
+              (matrix(double))s->mnew, ctx);
+            res.evals++;
+        }
+        if (tab->embedded)
+            for_lane_chunks(s, error_lanes, NULL);
+
+        double* err = s->err;
+        double* acc = s->accept;
+        for (size_t i = 0; i < nsys; i++) {
+            if (hs[i] == 0.0) {
+                acc[i] = 0.0;
+                continue;
+            }
+            const double e = tab->embedded ? err[i] : 0.0;
+            acc[i] = e <= 1.0 ? 1.0 : 0.0;
+            if (e <= 1.0) {
+                const int reached = fabs(hs[i]) >= fabs(t_end - tl[i]);
+                tl[i] = reached ? t_end : tl[i] + hs[i];
+                res.steps++;
+            } else {
+                res.rejected++;
+            }
+            if (tab->embedded) {
+                const double hn = fmin(next_step(tab, fabs(hs[i]), e), s->hmax);
+                hp[i] = (e <= 1.0 && fabs(hs[i]) < hp[i]) ? fmax(hn, hp[i])
+                                                          : hn;
+            }
+        }
+        for_lane_chunks(s, accept_lanes, NULL);
+    }
+
+    for (size_t l = 1; l <= ncomp; l++)
+        memcpy(y[l] + 1, s->mcur[l] + 1, nsys * sizeof(double));
+    memcpy(t + 1, tl, nsys * sizeof(double));
+    return res;
+}
@@ -0,0 +1,156 @@
+#ifndef SIMUTIL_ODE_H
+#define SIMUTIL_ODE_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+
+/*
+ * ODE_RK4 is the classical fixed-step method. ODE_RK23 (Bogacki-Shampine) and
+ * ODE_DOPRI5 (Dormand-Prince 5(4)) carry an embedded error estimate and adapt
+ * their step; both reuse the last stage of a step as the first of the next.
+ */
+typedef enum { ODE_RK4, ODE_RK23, ODE_DOPRI5 } ode_method_t;
+
+/**
+ * @brief Right hand side callback. Must set 'dydt' to f(t, y).
+ *
+ */
+typedef void (*ode_rhs_t)(vector(double) dydt, double t, vector(double) y,
+                          void* ctx);
+
+/**
+ * @brief Right hand side callback of a batch. 'y' and 'dydt' are matrices
+ * whose storage lines are the components, so 'y[c][s]' is component c of
+ * system s: the components are the rows of the matrix, or its columns with
+ * SIMUTIL_COL_MAJOR. 't' holds the time of every system.
+ *
+ */
+typedef void (*ode_batch_rhs_t)(matrix(double) dydt, vector(double) t,
+                                matrix(double) y, void* ctx);
+
+/**
+ * @brief Outcome of an integration. For a batch the counters are summed over
+ * the systems, except 'evals', which counts calls of the batched callback.
+ *
+ */
+typedef struct {
+    size_t steps;
+    size_t rejected;
+    size_t evals;
+    int success;
+} ode_result;
+
+/**
+ * @brief Opaque integrator. Owns the stage derivatives and state buffers of
+ * its method, so stepping allocates nothing.
+ *
+ */
+typedef struct ode_solver ode_solver;
+
+/**
+ * @brief Function to create an integrator for one system.
+ *
+ * @param method ODE_RK4, ODE_RK23 or ODE_DOPRI5
+ * @param n Number of components of the system
+ */
+SIMUTIL_API ode_solver* new_ode_solver(ode_method_t method, size_t n);
+
+SIMUTIL_API ode_solver* __new_ode_batch(ode_method_t method, size_t ncomp,
+                                        size_t nsys, int lines_are_cols);
+
+/**
+ * @brief Macro to create an integrator that advances 'nsys' independent
+ * systems of 'ncomp' components together, each with its own step size.
+ * States are laid out as in 'ode_batch_rhs_t', so every kernel runs across
+ * systems in SIMD lanes.
+ *
+ * @param method ODE_RK4, ODE_RK23 or ODE_DOPRI5
+ * @param ncomp Number of components of every system
+ * @param nsys Number of systems
+ */
+#define new_ode_batch(method, ncomp, nsys)                                     \
+    __new_ode_batch((method), (ncomp), (nsys), __SIMUTIL_LINES_ARE_COLS)
+
+SIMUTIL_API void free_ode_solver(ode_solver* solver);
+
+/**
+ * @brief Function to set the error tolerances of the adaptive methods. The
+ * error of component i is measured against atol + rtol * |y_i|.
+ *
+ * @param solver Integrator to configure
+ * @param rtol Relative tolerance (default 1e-6)
+ * @param atol Absolute tolerance (default 1e-9)
+ */
+SIMUTIL_API void ode_set_tolerance(ode_solver* solver, double rtol,
+                                   double atol);
+
+/**
+ * @brief Function to set the step sizes. 'h0' is the first step of the
+ * adaptive methods (chosen automatically when 0) and the fixed step of
+ * ODE_RK4, which has no default.
+ *
+ * @param solver Integrator to configure
+ * @param h0 Initial (or fixed) step
+ * @param hmin Smallest step before the integration fails
+ * @param hmax Largest step
+ */
+SIMUTIL_API void ode_set_step(ode_solver* solver, double h0, double hmin,
+                              double hmax);
+
+SIMUTIL_API void ode_set_max_steps(ode_solver* solver, size_t max_steps);
+
+/**
+ * @brief Function to take a single step of size 'h' without step control.
+ * Returns the scaled RMS error estimate of the step, or 0 for ODE_RK4.
+ *
+ * @param solver Integrator created for the length of 'y'
+ * @param f Right hand side
+ * @param ctx User data passed to 'f'
+ * @param t Time, advanced by 'h'
+ * @param y State, advanced in place
+ * @param h Step size
+ */
+SIMUTIL_API double ode_step(ode_solver* solver, ode_rhs_t f, void* ctx,
+                            double* t, vector(double) y, double h);
+
+/**
+ * @brief Function to integrate from '*t' to 't_end', with adaptive steps for
+ * ODE_RK23 and ODE_DOPRI5. The last proposed step is kept to start the next
+ * call.
+ *
+ * @param solver Integrator created for the length of 'y'
+ * @param f Right hand side
+ * @param ctx User data passed to 'f'
+ * @param t Start time, set to the time reached
+ * @param y Initial state, set to the state reached
+ * @param t_end End time
+ */
+SIMUTIL_API ode_result ode_integrate(ode_solver* solver, ode_rhs_t f, void* ctx,
+                                     double* t, vector(double) y, double t_end);
+
+SIMUTIL_API ode_result __ode_batch_integrate(ode_solver* solver,
+                                             ode_batch_rhs_t f, void* ctx,
+                                             vector(double) t, double** y,
+                                             size_t nlines, size_t linelen,
+                                             double t_end);
+
+/**
+ * @brief Macro to integrate every system of a batch from its own time to
+ * 't_end'.
+ *
+ * @param solver Integrator created by 'new_ode_batch'
+ * @param f Batched right hand side
+ * @param ctx User data passed to 'f'
+ * @param t 'vector(double)' with the start time of every system
+ * @param y 'matrix(double)' with the state of every system
+ * @param t_end End time
+ */
+#define ode_batch_integrate(solver, f, ctx, t, y, t_end)                       \
+    __ode_batch_integrate((solver), (f), (ctx), (t), (double**)(y),            \
+                          MATRIX_NLINES(y), MATRIX_LINELEN(y), (t_end))
+
+#endif
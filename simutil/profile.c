@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 199309L
+#include "profile.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROF_HIST_BINS 48
+
+typedef struct {
+    unsigned long long calls;
+    unsigned long long amount;
+    unsigned long long nanos;
+    unsigned long long size_hist[PROF_HIST_BINS];
+    unsigned long long time_hist[PROF_HIST_BINS];
+} site_stats;
+
+/* 'object' marks the block a container is counted by, e.g. its header */
+typedef struct {
+    uintptr_t key;
+    size_t bytes;
+    int object;
+} alloc_slot;
+
+static const char* site_names[SIMUTIL_PROF_NSITES] = {
+    "__init_vector",      "__init_matrix",         "__init_matrix3",
+    "__append_element",   "__resize_vector",       "__resize_matrix",
+    "FROM_VECTOR",        "FROM_MATRIX",           "ELEM_SET_EQUAL",
+    "ELEM_SET_CONST",     "ELEM_OPER",             "ELEM_OPER_TARG",
+    "ELEM_OPER_SLICE",    "ELEM_OPER_SLICE_LIKE",  "CONST_OPER",
+    "CONST_OPER_SLICE",   "CONST_OPER_SLICE_LIKE",
+};
+
+static site_stats sites[SIMUTIL_PROF_NSITES];
+
+/* open-addressing table of live allocations, keyed by the block address */
+static alloc_slot* table = NULL;
+static size_t table_cap = 0;
+static size_t table_used = 0;
+
+static unsigned long long live_bytes = 0;
+static unsigned long long peak_bytes = 0;
+static unsigned long long live_objects = 0;
+static unsigned long long peak_objects = 0;
+static unsigned long long total_frees = 0;
+
+static char lock = 0;
+static int report_registered = 0;
+
+static inline void prof_lock(void) {
+    while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void prof_unlock(void) {
+    __atomic_clear(&lock, __ATOMIC_RELEASE);
+}
+
+static inline int log2_bin(unsigned long long x) {
+    int bin = 0;
+    while (x > 1 && bin < PROF_HIST_BINS - 1) {
+        x >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static inline size_t slot_of(uintptr_t key, size_t cap) {
+    key ^= key >> 17;
+    key *= (uintptr_t)0x9E3779B97F4A7C15ull;
+    return (size_t)(key >> 7) & (cap - 1);
+}
+
+static void table_insert(uintptr_t key, size_t bytes, int object);
+
+static int table_grow(void) {
+    size_t old_cap = table_cap;
+    alloc_slot* old = table;
+    size_t new_cap = old_cap ? old_cap * 2 : 1024;
+    alloc_slot* fresh = calloc(new_cap, sizeof(alloc_slot));
+    if (!fresh)
+        return 1;
+    table = fresh;
+    table_cap = new_cap;
+    table_used = 0;
+    for (size_t i = 0; i < old_cap; i++)
+        if (old[i].key)
+            table_insert(old[i].key, old[i].bytes, old[i].object);
+    free(old);
+    return 0;
+}
+
+static void table_insert(uintptr_t key, size_t bytes, int object) {
+    if ((table_used + 1) * 4 > table_cap * 3 && table_grow())
+        return;
+    size_t i = slot_of(key, table_cap);
+    while (table[i].key && table[i].key != key)
+        i = (i + 1) & (table_cap - 1);
+    if (!table[i].key)
+        table_used++;
+    table[i].key = key;
+    table[i].bytes = bytes;
+    table[i].object = object;
+}
+
+/* removes 'key' with backward-shift deletion, returns 0 if it was untracked */
+static size_t table_remove(uintptr_t key, int* object) {
+    if (!table_cap)
+        return 0;
+    size_t i = slot_of(key, table_cap);
+    while (table[i].key && table[i].key != key)
+        i = (i + 1) & (table_cap - 1);
+    if (!table[i].key)
+        return 0;
+    size_t bytes = table[i].bytes;
+    *object = table[i].object;
+    size_t j = i;
+    for (;;) {
+        table[i].key = 0;
+        for (;;) {
+            j = (j + 1) & (table_cap - 1);
+            if (!table[j].key) {
+                table_used--;
+                return bytes;
+            }
+            size_t home = slot_of(table[j].key, table_cap);
+            if ((j > i && (home <= i || home > j)) ||
+                (j < i && (home <= i && home > j)))
+                break;
+        }
+        table[i] = table[j];
+        i = j;
+    }
+}
+
+static void report_at_exit(void) { simutil_profile_report(stderr); }
+
+static inline void register_report(void) {
+    if (!report_registered) {
+        report_registered = 1;
+        atexit(report_at_exit);
+    }
+}
+
+static inline void record(simutil_prof_site_t site, unsigned long long amount,
+                          unsigned long long start) {
+    unsigned long long elapsed = __simutil_prof_now() - start;
+    site_stats* s = &sites[site];
+    s->calls++;
+    s->amount += amount;
+    s->nanos += elapsed;
+    s->size_hist[log2_bin(amount)]++;
+    s->time_hist[log2_bin(elapsed)]++;
+}
+
+unsigned long long __simutil_prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull +
+           (unsigned long long)ts.tv_nsec;
+}
+
+static void track(void* ptr, size_t bytes, int object) {
+    table_insert((uintptr_t)ptr, bytes, object);
+    live_bytes += bytes;
+    live_objects += object != 0;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    if (live_objects > peak_objects)
+        peak_objects = live_objects;
+}
+
+void __simutil_prof_alloc(simutil_prof_site_t site, void* ptr, size_t bytes,
+                          unsigned long long start) {
+    if (!ptr || site >= SIMUTIL_PROF_NSITES)
+        return;
+    prof_lock();
+    register_report();
+    record(site, bytes, start);
+    track(ptr, bytes, 1);
+    prof_unlock();
+}
+
+void __simutil_prof_track(void* ptr, size_t bytes, int object) {
+    if (!ptr)
+        return;
+    prof_lock();
+    track(ptr, bytes, object);
+    prof_unlock();
+}
+
+void __simutil_prof_free(uintptr_t addr) {
+    if (!addr)
+        return;
+    prof_lock();
+    int object = 0;
+    size_t bytes = table_remove(addr, &object);
+    if (bytes) {
+        live_bytes -= bytes;
+        if (object) {
+            live_objects--;
+            total_frees++;
+        }
+    }
+    prof_unlock();
+}
+
+void __simutil_prof_ops(simutil_prof_site_t site, size_t nelem,
+                        unsigned long long start) {
+    if (site >= SIMUTIL_PROF_NSITES)
+        return;
+    prof_lock();
+    register_report();
+    record(site, nelem, start);
+    prof_unlock();
+}
+
+static void print_hist(FILE* fp, const char* label,
+                       const unsigned long long* hist) {
+    fprintf(fp, "    %-6s", label);
+    for (int b = 0; b < PROF_HIST_BINS; b++)
+        if (hist[b])
+            fprintf(fp, " [2^%d]:%llu", b, hist[b]);
+    fprintf(fp, "\n");
+}
+
+void simutil_profile_report(FILE* fp) {
+    prof_lock();
+    fprintf(fp, "\n\033[1;34mSIMUTIL PROFILE:\033[0m\n");
+    fprintf(fp, "  live bytes   : %llu\n", live_bytes);
+    fprintf(fp, "  peak bytes   : %llu\n", peak_bytes);
+    fprintf(fp, "  live objects : %llu\n", live_objects);
+    fprintf(fp, "  peak objects : %llu\n", peak_objects);
+    fprintf(fp, "  frees        : %llu\n", total_frees);
+    fprintf(fp, "  %-22s %12s %16s %14s\n", "site", "calls", "bytes/elems",
+            "time (ns)");
+    for (int i = 0; i < SIMUTIL_PROF_NSITES; i++) {
+        const site_stats* s = &sites[i];
+        if (!s->calls)
+            continue;
+        fprintf(fp, "  %-22s %12llu %16llu %14llu\n", site_names[i], s->calls,
+                s->amount, s->nanos);
+        print_hist(fp, "size", s->size_hist);
+        print_hist(fp, "ns", s->time_hist);
+    }
+    prof_unlock();
+}
+
+void simutil_profile_reset(void) {
+    prof_lock();
+    memset(sites, 0, sizeof(sites));
+    free(table);
+    table = NULL;
+    table_cap = 0;
+    table_used = 0;
+    live_bytes = peak_bytes = 0;
+    live_objects = peak_objects = 0;
+    total_frees = 0;
+    prof_unlock();
+}
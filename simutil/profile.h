@@ -0,0 +1,100 @@
+#ifndef SIMUTIL_PROFILE_H
+#define SIMUTIL_PROFILE_H
+
+#include "simutil_includes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Instrumented call sites. Allocation sites record bytes, element-wise
+ * macro sites record the number of elements touched.
+ *
+ */
+typedef enum {
+    SIMUTIL_PROF_INIT_VECTOR,
+    SIMUTIL_PROF_INIT_MATRIX,
+    SIMUTIL_PROF_INIT_MATRIX3,
+    SIMUTIL_PROF_APPEND_ELEMENT,
+    SIMUTIL_PROF_RESIZE_VECTOR,
+    SIMUTIL_PROF_RESIZE_MATRIX,
+    SIMUTIL_PROF_FROM_VECTOR,
+    SIMUTIL_PROF_FROM_MATRIX,
+    SIMUTIL_PROF_ELEM_SET_EQUAL,
+    SIMUTIL_PROF_ELEM_SET_CONST,
+    SIMUTIL_PROF_ELEM_OPER,
+    SIMUTIL_PROF_ELEM_OPER_TARG,
+    SIMUTIL_PROF_ELEM_OPER_SLICE,
+    SIMUTIL_PROF_ELEM_OPER_SLICE_LIKE,
+    SIMUTIL_PROF_CONST_OPER,
+    SIMUTIL_PROF_CONST_OPER_SLICE,
+    SIMUTIL_PROF_CONST_OPER_SLICE_LIKE,
+    SIMUTIL_PROF_NSITES
+} simutil_prof_site_t;
+
+SIMUTIL_API unsigned long long __simutil_prof_now(void);
+
+SIMUTIL_API void __simutil_prof_alloc(simutil_prof_site_t site, void* ptr,
+                                      size_t bytes, unsigned long long start);
+
+SIMUTIL_API void __simutil_prof_track(void* ptr, size_t bytes, int object);
+
+SIMUTIL_API void __simutil_prof_free(uintptr_t addr);
+
+SIMUTIL_API void __simutil_prof_ops(simutil_prof_site_t site, size_t nelem,
+                                    unsigned long long start);
+
+/**
+ * @brief Writes the collected counters, peak/live memory and per-site
+ * histograms to 'fp'. Only has data when built with SIMUTIL_PROFILE.
+ *
+ * @param fp File stream to write the report to
+ */
+SIMUTIL_API void simutil_profile_report(FILE* fp);
+
+/**
+ * @brief Clears every counter and forgets all tracked allocations.
+ *
+ */
+SIMUTIL_API void simutil_profile_reset(void);
+
+/****************************************************************************/
+/*                                                                          */
+/*                           Instrumentation Hooks                          */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * The hooks below expand to nothing unless SIMUTIL_PROFILE is defined before
+ * the simutil headers are included. The library itself has to be built with
+ * 'make profile' for the realloc traffic in vector.c to be recorded. A block
+ * passed to realloc is released only if the call succeeds, so its address is
+ * kept with SIMUTIL_PROF_ADDR and handed to SIMUTIL_PROF_FREE afterwards.
+ *
+ * A container made of several blocks is one call and one object: every
+ * block is tracked with SIMUTIL_PROF_TRACK, 'object' set for the one whose
+ * free releases the container, and SIMUTIL_PROF_RECORD counts the call once
+ * with the total bytes.
+ */
+#ifdef SIMUTIL_PROFILE
+#define SIMUTIL_PROF_START(t) const unsigned long long t = __simutil_prof_now()
+#define SIMUTIL_PROF_ALLOC(site, p, bytes, t)                                  \
+    __simutil_prof_alloc((site), (void*)(p), (size_t)(bytes), (t))
+#define SIMUTIL_PROF_TRACK(p, bytes, object)                                   \
+    __simutil_prof_track((void*)(p), (size_t)(bytes), (object))
+#define SIMUTIL_PROF_RECORD(site, bytes, t)                                    \
+    __simutil_prof_ops((site), (size_t)(bytes), (t))
+#define SIMUTIL_PROF_FREE(p) __simutil_prof_free((uintptr_t)(p))
+#define SIMUTIL_PROF_ADDR(a, p) const uintptr_t a = (uintptr_t)(p)
+#define SIMUTIL_PROF_OPS(site, nelem, t)                                       \
+    __simutil_prof_ops((site), (size_t)(nelem), (t))
+#else
+#define SIMUTIL_PROF_START(t) ((void)0)
+#define SIMUTIL_PROF_ALLOC(site, p, bytes, t) ((void)0)
+#define SIMUTIL_PROF_TRACK(p, bytes, object) ((void)0)
+#define SIMUTIL_PROF_RECORD(site, bytes, t) ((void)0)
+#define SIMUTIL_PROF_FREE(p) ((void)0)
+#define SIMUTIL_PROF_ADDR(a, p) ((void)0)
+#define SIMUTIL_PROF_OPS(site, nelem, t) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+#include "reduce.h"
+#include "error.h"
+#include <math.h>
+
+/* chunks below which reductions stay serial */
+#define PAR_MIN_CHUNKS 16
+
+/*
+ * Independent partial sums inside a chunk, so that its loop vectorizes:
+ * element i of the chunk goes to lane i % LANES. Lanes are combined by a
+ * fixed tree.
+ */
+#define LANES 8
+
+/* rows of a column-major matrix summed together, one lane set per row */
+#define BLOCK_ROWS 256
+
+static inline double lanes_total(const double* acc) {
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+size_t reduce_chunks(size_t n, size_t* len) {
+    size_t l = REDUCE_CHUNK;
+    if (n > (size_t)REDUCE_CHUNK * REDUCE_MAX_CHUNKS) {
+        l = (n + REDUCE_MAX_CHUNKS - 1) / REDUCE_MAX_CHUNKS;
+        l = (l + REDUCE_CHUNK - 1) / REDUCE_CHUNK * REDUCE_CHUNK;
+    }
+    *len = l;
+    return (n + l - 1) / l;
+}
+
+double reduce_tree(double* part, size_t nparts) {
+    if (nparts == 0)
+        return 0.0;
+    for (size_t step = 1; step < nparts; step *= 2)
+        for (size_t i = 0; i + step < nparts; i += 2 * step)
+            part[i] += part[i + step];
+    return part[0];
+}
+
+static double chunk_sum(const double* x, size_t n) {
+    double acc[LANES] = {0.0};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (int j = 0; j < LANES; j++)
+            acc[j] += x[i + j];
+    for (; i < n; i++)
+        acc[i % LANES] += x[i];
+    return lanes_total(acc);
+}
+
+static double chunk_dot(const double* x, const double* y, size_t n) {
+    double acc[LANES] = {0.0};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (int j = 0; j < LANES; j++)
+            acc[j] += x[i + j] * y[i + j];
+    for (; i < n; i++)
+        acc[i % LANES] += x[i] * y[i];
+    return lanes_total(acc);
+}
+
+double __reduce_sum(const double* x, size_t n) {
+    size_t len;
+    const size_t nchunks = reduce_chunks(n, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (nchunks >= PAR_MIN_CHUNKS)
+    for (size_t c = 0; c < nchunks; c++)
+        part[c] = chunk_sum(x + c * len, reduce_chunk_end(c, len, n) - c * len);
+    return reduce_tree(part, nchunks);
+}
+
+double __reduce_dot(const double* x, size_t nx, const double* y, size_t ny) {
+    if (nx != ny) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching vector lengths %zu and %zu @ "
+                    "reduce_dot_vector!\n",
+                    nx, ny);
+        return NAN;
+    }
+    size_t len;
+    const size_t nchunks = reduce_chunks(nx, &len);
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (nchunks >= PAR_MIN_CHUNKS)
+    for (size_t c = 0; c < nchunks; c++)
+        part[c] = chunk_dot(x + c * len, y + c * len,
+                            reduce_chunk_end(c, len, nx) - c * len);
+    return reduce_tree(part, nchunks);
+}
+
+double __reduce_norm2(const double* x, size_t n) {
+    return sqrt(__reduce_dot(x, n, x, n));
+}
+
+/*
+ * Rows [lo, hi) of a column-major matrix: the lanes of a block of rows are
+ * swept column by column, adding every column to lane 'column % LANES', which
+ * is the order in which chunk_sum adds a row-major row.
+ */
+static double col_rows_sum(const double* const* cols, size_t ncols, size_t lo,
+                           size_t hi) {
+    double acc[LANES][BLOCK_ROWS];
+    double s = 0.0;
+    for (size_t b = lo; b < hi; b += BLOCK_ROWS) {
+        const size_t nb = hi - b < BLOCK_ROWS ? hi - b : BLOCK_ROWS;
+        for (int j = 0; j < LANES; j++)
+            for (size_t r = 0; r < nb; r++)
+                acc[j][r] = 0.0;
+        for (size_t c = 0; c < ncols; c++) {
+            const double* col = cols[c + 1] + 1 + b;
+            double* lane = acc[c % LANES];
+            for (size_t r = 0; r < nb; r++)
+                lane[r] += col[r];
+        }
+        for (size_t r = 0; r < nb; r++) {
+            double row[LANES];
+            for (int j = 0; j < LANES; j++)
+                row[j] = acc[j][r];
+            s += lanes_total(row);
+        }
+    }
+    return s;
+}
+
+double __reduce_sum_matrix(const void* mat, size_t nrows, size_t ncols,
+                           int lines_are_cols) {
+    const double* const* lines = mat;
+    if (nrows == 0 || ncols == 0)
+        return 0.0;
+    /* chunks of whole rows, about as many as for the same number of elements */
+    size_t len;
+    const size_t target = reduce_chunks(nrows * ncols, &len);
+    const size_t per = (nrows + target - 1) / target;
+    const size_t nchunks = (nrows + per - 1) / per;
+    double part[REDUCE_MAX_CHUNKS];
+#pragma omp parallel for schedule(static) if (nchunks >= PAR_MIN_CHUNKS)
+    for (size_t c = 0; c < nchunks; c++) {
+        const size_t lo = c * per;
+        const size_t hi = reduce_chunk_end(c, per, nrows);
+        if (lines_are_cols) {
+            part[c] = col_rows_sum(lines, ncols, lo, hi);
+            continue;
+        }
+        double s = 0.0;
+        for (size_t r = lo; r < hi; r++)
+            s += chunk_sum(lines[r + 1] + 1, ncols);
+        part[c] = s;
+    }
+    return reduce_tree(part, nchunks);
+}
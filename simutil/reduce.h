@@ -0,0 +1,106 @@
+#ifndef SIMUTIL_REDUCE_H
+#define SIMUTIL_REDUCE_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+
+/*
+ * Reductions split their input into chunks whose size depends only on the
+ * length: REDUCE_CHUNK elements, or the smallest multiple of it that keeps
+ * longer inputs within REDUCE_MAX_CHUNKS chunks. Every chunk is summed on its
+ * own, in index order, and the chunk results are combined by a fixed pairwise
+ * tree. Threads only decide who computes a chunk, never the order of the
+ * additions, so results are bitwise identical for any number of threads.
+ */
+#define REDUCE_CHUNK 1024
+#define REDUCE_MAX_CHUNKS 1024
+
+/**
+ * @brief Function to split 'n' elements into the chunks of a deterministic
+ * reduction. Returns the number of chunks, at most REDUCE_MAX_CHUNKS; chunk
+ * 'c' covers the 0-based elements 'c * len' to 'min((c + 1) * len, n) - 1'.
+ *
+ * @param n Number of elements
+ * @param len Set to the elements per chunk
+ */
+SIMUTIL_API size_t reduce_chunks(size_t n, size_t* len);
+
+/**
+ * @brief Function to get the end of chunk 'c' from 'reduce_chunks': one past
+ * its last 0-based element.
+ *
+ * @param c Chunk, from 0
+ * @param len Elements per chunk
+ * @param n Number of elements
+ */
+static inline size_t reduce_chunk_end(size_t c, size_t len, size_t n) {
+    return len < n - c * len ? (c + 1) * len : n;
+}
+
+/**
+ * @brief Function to combine chunk results by a fixed pairwise tree. 'part'
+ * is overwritten.
+ *
+ * @param part Results of the chunks, in chunk order
+ * @param nparts Number of chunks
+ */
+SIMUTIL_API double reduce_tree(double* part, size_t nparts);
+
+SIMUTIL_API double __reduce_sum(const double* x, size_t n);
+
+SIMUTIL_API double __reduce_dot(const double* x, size_t nx, const double* y,
+                                size_t ny);
+
+SIMUTIL_API double __reduce_norm2(const double* x, size_t n);
+
+SIMUTIL_API double __reduce_sum_matrix(const void* mat, size_t nrows,
+                                       size_t ncols, int lines_are_cols);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Reductions                                */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to sum a vector, with the same result on any number of
+ * threads.
+ *
+ * @param vec 'vector(double)'
+ */
+#define reduce_sum_vector(vec) __reduce_sum(&(vec)[1], (size_t)LENGTH(vec))
+
+/**
+ * @brief Macro to compute the dot product of two vectors, with the same
+ * result on any number of threads.
+ *
+ * @param a 'vector(double)'
+ * @param b 'vector(double)' as long as 'a'
+ */
+#define reduce_dot_vector(a, b)                                                \
+    __reduce_dot(&(a)[1], (size_t)LENGTH(a), &(b)[1], (size_t)LENGTH(b))
+
+/**
+ * @brief Macro to compute the Euclidean norm of a vector, with the same
+ * result on any number of threads.
+ *
+ * @param vec 'vector(double)'
+ */
+#define reduce_norm2_vector(vec) __reduce_norm2(&(vec)[1], (size_t)LENGTH(vec))
+
+/**
+ * @brief Macro to sum a matrix. Every row is summed on its own and the rows
+ * are added in order, so the result is the same on any number of threads and
+ * with either matrix layout.
+ *
+ * @param mat 'matrix(double)'
+ */
+#define reduce_sum_matrix(mat)                                                 \
+    __reduce_sum_matrix((const void*)(mat), (size_t)ROWS(mat),                 \
+                        (size_t)COLS(mat), __SIMUTIL_LINES_ARE_COLS)
+
+#endif
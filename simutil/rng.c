@@ -0,0 +1,252 @@
+#include "rng.h"
+#include "error.h"
+#include <math.h>
+#include <string.h>
+
+/* elements per parallel task; even, so tasks start on a block boundary */
+#define CHUNK 4096
+
+/* counter blocks generated together, so the Philox rounds vectorize */
+#define BATCH 64
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+/* 2^-53 */
+#define TO_DOUBLE 0x1.0p-53
+
+/*
+ * Philox4x32-10 on 'nb' consecutive counters starting at 'ctr'. The 128-bit
+ * counter is (ctr, stream) and the 64-bit key is the seed.
+ */
+static void philox_batch(uint64_t seed, uint64_t stream, uint64_t ctr,
+                         size_t nb, uint32_t x[4][BATCH]) {
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)(seed >> 32);
+    for (size_t i = 0; i < nb; i++) {
+        x[0][i] = (uint32_t)(ctr + i);
+        x[1][i] = (uint32_t)((ctr + i) >> 32);
+        x[2][i] = (uint32_t)stream;
+        x[3][i] = (uint32_t)(stream >> 32);
+    }
+    for (int r = 0; r < 10; r++) {
+        for (size_t i = 0; i < nb; i++) {
+            const uint64_t p0 = (uint64_t)PHILOX_M0 * x[0][i];
+            const uint64_t p1 = (uint64_t)PHILOX_M1 * x[2][i];
+            const uint32_t y0 = (uint32_t)(p1 >> 32) ^ x[1][i] ^ k0;
+            const uint32_t y2 = (uint32_t)(p0 >> 32) ^ x[3][i] ^ k1;
+            x[0][i] = y0;
+            x[1][i] = (uint32_t)p1;
+            x[2][i] = y2;
+            x[3][i] = (uint32_t)p0;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+/* Uniform double on (0, 1) from 53 of the 64 bits of (hi, lo). */
+static inline double to_unit(uint32_t hi, uint32_t lo) {
+    const uint64_t bits = ((uint64_t)(hi >> 5) << 26) | (uint64_t)(lo >> 6);
+    return ((double)bits + 0.5) * TO_DOUBLE;
+}
+
+/*
+ * Natural log of x in (0, 1], branch-free so the callers vectorize, and free
+ * of libm so fills do not change with its version. x = m * 2^e with m in
+ * [sqrt(1/2), sqrt(2)), and log(m) = 2 atanh(s), s = (m - 1) / (m + 1).
+ */
+static inline double unit_log(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int64_t e = (int64_t)(bits >> 52) - 1023;
+    bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    const int big = m > 1.4142135623730951;
+    m = big ? 0.5 * m : m;
+    e += big;
+    const double s = (m - 1.0) / (m + 1.0);
+    const double z = s * s;
+    /* |s| < 0.1716, so the series is exact to double precision at z^10 */
+    double p = 1.0 / 21.0;
+    p = p * z + 1.0 / 19.0;
+    p = p * z + 1.0 / 17.0;
+    p = p * z + 1.0 / 15.0;
+    p = p * z + 1.0 / 13.0;
+    p = p * z + 1.0 / 11.0;
+    p = p * z + 1.0 / 9.0;
+    p = p * z + 1.0 / 7.0;
+    p = p * z + 1.0 / 5.0;
+    p = p * z + 1.0 / 3.0;
+    p = p * z + 1.0;
+    return (double)e * 0.69314718055994530942 + 2.0 * s * p;
+}
+
+/*
+ * sin and cos of 2 pi u for u in (0, 1). u is reduced to the nearest quarter
+ * turn exactly, leaving |r| <= pi / 4 for the Taylor polynomials.
+ */
+static inline void turn_sincos(double u, double* sn, double* cs) {
+    const int q = (int)(4.0 * u + 0.5);
+    const double r = (u - 0.25 * (double)q) * 6.283185307179586476925;
+    const double z = r * r;
+    double ps = -1.0 / 1307674368000.0;
+    ps = ps * z + 1.0 / 6227020800.0;
+    ps = ps * z - 1.0 / 39916800.0;
+    ps = ps * z + 1.0 / 362880.0;
+    ps = ps * z - 1.0 / 5040.0;
+    ps = ps * z + 1.0 / 120.0;
+    ps = ps * z - 1.0 / 6.0;
+    const double s = r + r * z * ps;
+    double pc = 1.0 / 20922789888000.0;
+    pc = pc * z - 1.0 / 87178291200.0;
+    pc = pc * z + 1.0 / 479001600.0;
+    pc = pc * z - 1.0 / 3628800.0;
+    pc = pc * z + 1.0 / 40320.0;
+    pc = pc * z - 1.0 / 720.0;
+    pc = pc * z + 1.0 / 24.0;
+    pc = pc * z - 0.5;
+    const double c = 1.0 + z * pc;
+    /* rotate by q quarter turns: swap on odd q, signs from q and q + 1 */
+    const int odd = q & 1;
+    const double x = odd ? c : s;
+    const double y = odd ? s : c;
+    *sn = (1.0 - (double)(q & 2)) * x;
+    *cs = (1.0 - (double)((q + 1) & 2)) * y;
+}
+
+/*
+ * Writes elements [e0, e0 + n) of the stream that starts at 'rng'. Element e
+ * is drawn from counter block rng->counter + e / 2, which yields the pair of
+ * elements 2q and 2q + 1.
+ */
+static void fill_range(const rng_state* rng, rng_dist_t dist, double a,
+                       double b, double* out, size_t e0, size_t n) {
+    uint32_t x[4][BATCH];
+    double pair[2 * BATCH];
+    double radius[BATCH];
+    size_t e = e0;
+    const size_t end = e0 + n;
+    while (e < end) {
+        const size_t q0 = e / 2;
+        size_t nb = (end + 1) / 2 - q0;
+        if (nb > BATCH)
+            nb = BATCH;
+        philox_batch(rng->seed, rng->stream, rng->counter + q0, nb, x);
+        switch (dist) {
+        case RNG_UNIFORM:
+            for (size_t i = 0; i < nb; i++) {
+                pair[2 * i] = a + (b - a) * to_unit(x[0][i], x[1][i]);
+                pair[2 * i + 1] = a + (b - a) * to_unit(x[2][i], x[3][i]);
+            }
+            break;
+        case RNG_NORMAL:
+            /* Box-Muller: both outputs of a block are used */
+            for (size_t i = 0; i < nb; i++) {
+                double sn, cs;
+                turn_sincos(to_unit(x[2][i], x[3][i]), &sn, &cs);
+                pair[2 * i] = cs;
+                pair[2 * i + 1] = sn;
+                radius[i] = -2.0 * unit_log(to_unit(x[0][i], x[1][i]));
+            }
+            /* sqrt keeps its errno branch, so it gets a loop of its own */
+            for (size_t i = 0; i < nb; i++)
+                radius[i] = b * sqrt(radius[i]);
+            for (size_t i = 0; i < nb; i++) {
+                pair[2 * i] = a + radius[i] * pair[2 * i];
+                pair[2 * i + 1] = a + radius[i] * pair[2 * i + 1];
+            }
+            break;
+        default:
+            for (size_t i = 0; i < nb; i++) {
+                pair[2 * i] = -unit_log(to_unit(x[0][i], x[1][i])) / a;
+                pair[2 * i + 1] = -unit_log(to_unit(x[2][i], x[3][i])) / a;
+            }
+            break;
+        }
+        /* the first and last blocks may be shared with a neighbouring task */
+        const size_t skip = e - 2 * q0;
+        size_t take = 2 * nb - skip;
+        if (take > end - e)
+            take = end - e;
+        memcpy(out + (e - e0), pair + skip, take * sizeof(double));
+        e += take;
+    }
+}
+
+static int check_dist(rng_dist_t dist, double a, const char* name) {
+    if (dist != RNG_UNIFORM && dist != RNG_NORMAL &&
+        dist != RNG_EXPONENTIAL) {
+        raise_error(SIMUTIL_DEFAULT_ERROR, "Unknown distribution @ %s!\n",
+                    name);
+        return 0;
+    }
+    if (dist == RNG_EXPONENTIAL && !(a > 0.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR, "Non-positive rate @ %s!\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Fills 'nlines' lines of 'linelen' elements, numbered line by line. 'lines'
+ * is a matrix (depth 2) or a matrix3 (depth 3) whose second level has 'ext1'
+ * entries. Work is split into (line, chunk) tasks so that both many short
+ * lines and a few long ones keep every thread busy.
+ */
+static void fill_lines(rng_state* rng, rng_dist_t dist, double a, double b,
+                       void* lines, int depth, size_t nlines, size_t ext1,
+                       size_t linelen) {
+    const size_t per_line = (linelen + CHUNK - 1) / CHUNK;
+    const size_t ntask = nlines * per_line;
+    const rng_state start = *rng;
+#pragma omp parallel for schedule(static)                                      \
+    if (nlines * linelen >= SIMUTIL_PAR_MIN)
+    for (size_t task = 0; task < ntask; task++) {
+        const size_t l = task / per_line;
+        const size_t c = (task % per_line) * CHUNK;
+        double* line =
+            depth == 2 ? ((double**)lines)[l + 1] + 1
+                       : ((double***)lines)[l / ext1 + 1][l % ext1 + 1] + 1;
+        const size_t len = linelen - c < CHUNK ? linelen - c : CHUNK;
+        fill_range(&start, dist, a, b, line + c, l * linelen + c, len);
+    }
+    rng->counter += (nlines * linelen + 1) / 2;
+}
+
+rng_state rng_init(uint64_t seed, uint64_t stream) {
+    rng_state rng = {seed, stream, 0};
+    return rng;
+}
+
+double rng_uniform(rng_state* rng) {
+    uint32_t x[4][BATCH];
+    philox_batch(rng->seed, rng->stream, rng->counter++, 1, x);
+    return to_unit(x[0][0], x[1][0]);
+}
+
+void __rng_fill(rng_state* rng, rng_dist_t dist, double a, double b,
+                double* out, size_t n) {
+    if (!check_dist(dist, a, "rng_fill_vector"))
+        return;
+    /* a vector is a single line with the data right after the header */
+    double* lines[2] = {NULL, out - 1};
+    fill_lines(rng, dist, a, b, lines, 2, 1, 1, n);
+}
+
+void __rng_fill_lines2(rng_state* rng, rng_dist_t dist, double a, double b,
+                       double** mat, size_t nlines, size_t linelen) {
+    if (!check_dist(dist, a, "rng_fill_matrix"))
+        return;
+    fill_lines(rng, dist, a, b, mat, 2, nlines, 1, linelen);
+}
+
+void __rng_fill_lines3(rng_state* rng, rng_dist_t dist, double a, double b,
+                       double*** mat3, const size_t* ext) {
+    if (!check_dist(dist, a, "rng_fill_matrix3"))
+        return;
+    fill_lines(rng, dist, a, b, mat3, 3, ext[0] * ext[1], ext[1], ext[2]);
+}
@@ -0,0 +1,132 @@
+#ifndef SIMUTIL_RNG_H
+#define SIMUTIL_RNG_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+#include <stdint.h>
+
+/*
+ * Counter-based generator (Philox4x32-10). Every block of random bits is a
+ * pure function of the seed, the stream id and a 64-bit counter, so the value
+ * written to element i of a fill depends only on i and the state the fill
+ * started from: fills are bitwise identical for any number of threads.
+ */
+typedef struct {
+    uint64_t seed;
+    uint64_t stream;
+    uint64_t counter;
+} rng_state;
+
+/*
+ * Distributions of the fill routines and the meaning of their parameters.
+ */
+typedef enum {
+    RNG_UNIFORM,    /* on (a, b) */
+    RNG_NORMAL,     /* mean a, standard deviation b */
+    RNG_EXPONENTIAL /* rate a, b unused */
+} rng_dist_t;
+
+/**
+ * @brief Function to create a generator state. States with the same seed and
+ * different streams produce independent sequences, e.g. one per thread or
+ * per MPI rank.
+ *
+ * @param seed Key of the generator
+ * @param stream Id of the stream
+ */
+SIMUTIL_API rng_state rng_init(uint64_t seed, uint64_t stream);
+
+/**
+ * @brief Function to draw a single uniform double on (0, 1). Uses one counter
+ * block per call; prefer the fill routines for bulk draws.
+ *
+ * @param rng Generator state, advanced
+ */
+SIMUTIL_API double rng_uniform(rng_state* rng);
+
+SIMUTIL_API void __rng_fill(rng_state* rng, rng_dist_t dist, double a,
+                            double b, double* out, size_t n);
+
+SIMUTIL_API void __rng_fill_lines2(rng_state* rng, rng_dist_t dist, double a,
+                                   double b, double** mat, size_t nlines,
+                                   size_t linelen);
+
+SIMUTIL_API void __rng_fill_lines3(rng_state* rng, rng_dist_t dist, double a,
+                                   double b, double*** mat3,
+                                   const size_t* ext);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Bulk Fills                                */
+/*                                                                          */
+/****************************************************************************/
+
+#define __RNG_CHECK_DOUBLE(x, name)                                            \
+    do {                                                                       \
+        if (sizeof(x) != sizeof(double)) {                                     \
+            raise_error(SIMUTIL_TYPE_ERROR,                                    \
+                        "Expected double elements @ " name "!\n");             \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @brief Macro to fill a 'vector(double)' with draws from 'dist'. Two
+ * elements are drawn per counter block, and the state is advanced past every
+ * block used.
+ *
+ * @param rng Generator state
+ * @param vec Vector to fill
+ * @param dist RNG_UNIFORM, RNG_NORMAL or RNG_EXPONENTIAL
+ * @param a First parameter of 'dist'
+ * @param b Second parameter of 'dist'
+ */
+#define rng_fill_vector(rng, vec, dist, a, b)                                  \
+    do {                                                                       \
+        __RNG_CHECK_DOUBLE(*(vec), "rng_fill_vector");                         \
+        __rng_fill((rng), (dist), (a), (b), (double*)(vec) + 1, LENGTH(vec));  \
+    } while (0)
+
+/**
+ * @brief Macro to fill a 'matrix(double)' with draws from 'dist', numbered in
+ * storage order (line by line).
+ *
+ * @param rng Generator state
+ * @param mat Matrix to fill
+ * @param dist RNG_UNIFORM, RNG_NORMAL or RNG_EXPONENTIAL
+ * @param a First parameter of 'dist'
+ * @param b Second parameter of 'dist'
+ */
+#define rng_fill_matrix(rng, mat, dist, a, b)                                  \
+    do {                                                                       \
+        __RNG_CHECK_DOUBLE(**(mat), "rng_fill_matrix");                        \
+        __rng_fill_lines2((rng), (dist), (a), (b), (double**)(mat),            \
+                          MATRIX_NLINES(mat), MATRIX_LINELEN(mat));            \
+    } while (0)
+
+/**
+ * @brief Macro to fill a 'matrix3(double)' with draws from 'dist', numbered
+ * in storage order.
+ *
+ * @param rng Generator state
+ * @param mat3 Matrix3 to fill
+ * @param dist RNG_UNIFORM, RNG_NORMAL or RNG_EXPONENTIAL
+ * @param a First parameter of 'dist'
+ * @param b Second parameter of 'dist'
+ */
+#define rng_fill_matrix3(rng, mat3, dist, a, b)                                \
+    do {                                                                       \
+        __RNG_CHECK_DOUBLE(***(mat3), "rng_fill_matrix3");                     \
+        const size_t ext[3] = {MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),         \
+                               MATRIX3_EXT3(mat3)};                            \
+        __rng_fill_lines3((rng), (dist), (a), (b), (double***)(mat3), ext);    \
+    } while (0)
+
+#endif
@@ -4,4 +4,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/*
+ * Marks the functions exported from libsimutils.so. The shared library is
+ * built with -fvisibility=hidden, so anything without SIMUTIL_API stays
+ * internal and calls to it inside the library bind directly instead of going
+ * through the PLT.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMUTIL_API __attribute__((visibility("default")))
+#else
+#define SIMUTIL_API
+#endif
+
+/*
+ * Elements (or rows, points, values) below which the parallel loops of the
+ * library stay on one thread: smaller loops finish before a team of threads
+ * would have started.
+ */
+#define SIMUTIL_PAR_MIN 16384
+
+/*
+ * Argument expanders for the print-function generators. Complex elements are
+ * printed as their real and imaginary parts, read through the array layout
+ * guaranteed for complex types so that <complex.h> is not needed here.
+ */
+#define __SIMUTIL_ARG(x) (x)
+#define __SIMUTIL_CARG(x) ((const double*)&(x))[0], ((const double*)&(x))[1]
+#define __SIMUTIL_CFARG(x) ((const float*)&(x))[0], ((const float*)&(x))[1]
+
 #endif
@@ -0,0 +1,692 @@
+#include "sort.h"
+#include "error.h"
+#include <stdint.h>
+#include <string.h>
+
+/* elements per parallel task of the radix passes */
+#define RADIX_CHUNK 65536
+
+/* radix digit width */
+#define RADIX_BITS 8
+#define RADIX_BINS (1 << RADIX_BITS)
+
+/* runs sorted by insertion before merging; a power of two */
+#define MERGE_RUN 32
+
+/* merged elements per parallel task; a power of two >= MERGE_RUN */
+#define MERGE_SEG 16384
+
+/* elements per scan, compaction and partition chunk */
+#define CHUNK 4096
+
+/* mask entries converted to flags at a time */
+#define BLOCK 256
+
+static const char* const sort_names[] = {"radix_sort_vector",
+                                         "merge_sort_vector"};
+
+/* number of 'len' pieces covering n elements */
+static size_t nchunks_of(size_t n, size_t len) { return (n + len - 1) / len; }
+
+/****************************************************************************/
+/*                                                                          */
+/*                                   Keys                                   */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Every element type is sorted as 64-bit unsigned keys with the same order:
+ * signed integers have their sign bit flipped, and floating-point numbers
+ * also have their magnitude bits inverted when negative.
+ */
+static void to_keys(uint64_t* key, const char* src, size_t n,
+                    sort_elem_t elem) {
+    switch (elem) {
+    case SORT_DOUBLE: {
+        const uint64_t* b = (const uint64_t*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++) {
+            const uint64_t neg = (uint64_t)((int64_t)b[i] >> 63);
+            key[i] = b[i] ^ (neg | ((uint64_t)1 << 63));
+        }
+        break;
+    }
+    case SORT_FLOAT: {
+        const uint32_t* b = (const uint32_t*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t neg = (uint32_t)((int32_t)b[i] >> 31);
+            key[i] = b[i] ^ (neg | ((uint32_t)1 << 31));
+        }
+        break;
+    }
+    case SORT_INT: {
+        const int* b = (const int*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            key[i] = (uint32_t)b[i] ^ ((uint32_t)1 << 31);
+        break;
+    }
+    case SORT_LONG: {
+        const long* b = (const long*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            key[i] = (uint64_t)b[i] ^ ((uint64_t)1 << 63);
+        break;
+    }
+    case SORT_UINT: {
+        const unsigned int* b = (const unsigned int*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            key[i] = b[i];
+        break;
+    }
+    default: {
+        const unsigned long* b = (const unsigned long*)src;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            key[i] = b[i];
+        break;
+    }
+    }
+}
+
+static void from_keys(char* dst, const uint64_t* key, size_t n,
+                      sort_elem_t elem) {
+    switch (elem) {
+    case SORT_DOUBLE: {
+        uint64_t* b = (uint64_t*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++) {
+            const uint64_t pos = (uint64_t)((int64_t)key[i] >> 63);
+            b[i] = key[i] ^ (~pos | ((uint64_t)1 << 63));
+        }
+        break;
+    }
+    case SORT_FLOAT: {
+        uint32_t* b = (uint32_t*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t k = (uint32_t)key[i];
+            const uint32_t pos = (uint32_t)((int32_t)k >> 31);
+            b[i] = k ^ (~pos | ((uint32_t)1 << 31));
+        }
+        break;
+    }
+    case SORT_INT: {
+        int* b = (int*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            b[i] = (int)((uint32_t)key[i] ^ ((uint32_t)1 << 31));
+        break;
+    }
+    case SORT_LONG: {
+        long* b = (long*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            b[i] = (long)(key[i] ^ ((uint64_t)1 << 63));
+        break;
+    }
+    case SORT_UINT: {
+        unsigned int* b = (unsigned int*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            b[i] = (unsigned int)key[i];
+        break;
+    }
+    default: {
+        unsigned long* b = (unsigned long*)dst;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            b[i] = (unsigned long)key[i];
+        break;
+    }
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Radix Sort                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * LSD radix sort of 'key' (and 'idx', if any) using the equally long 'ktmp'
+ * and 'itmp'. Each pass counts the digits of every chunk in parallel, turns
+ * the counts into per-chunk offsets, then scatters every chunk in parallel.
+ * Returns non-zero if the result ended up in the scratch arrays.
+ */
+static int radix_sort(uint64_t* key, uint64_t* ktmp, size_t* idx,
+                      size_t* itmp, size_t n, size_t* counts) {
+    const size_t nchunks =
+        n >= SIMUTIL_PAR_MIN ? nchunks_of(n, RADIX_CHUNK) : 1;
+    const size_t clen = nchunks_of(n, nchunks);
+
+    /* bits that differ between keys; other digits need no pass */
+    uint64_t diff = 0;
+    const uint64_t first = key[0];
+#pragma omp parallel for schedule(static) reduction(| : diff)                  \
+    if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < n; i++)
+        diff |= key[i] ^ first;
+
+    int swapped = 0;
+    for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+        if (!((diff >> shift) & (RADIX_BINS - 1)))
+            continue;
+#pragma omp parallel for schedule(static) if (nchunks > 1)
+        for (size_t c = 0; c < nchunks; c++) {
+            size_t* cnt = counts + c * RADIX_BINS;
+            const size_t i1 = (c + 1) * clen < n ? (c + 1) * clen : n;
+            memset(cnt, 0, RADIX_BINS * sizeof(size_t));
+            for (size_t i = c * clen; i < i1; i++)
+                cnt[(key[i] >> shift) & (RADIX_BINS - 1)]++;
+        }
+        size_t sum = 0;
+        for (size_t b = 0; b < RADIX_BINS; b++)
+            for (size_t c = 0; c < nchunks; c++) {
+                const size_t cnt = counts[c * RADIX_BINS + b];
+                counts[c * RADIX_BINS + b] = sum;
+                sum += cnt;
+            }
+#pragma omp parallel for schedule(static) if (nchunks > 1)
+        for (size_t c = 0; c < nchunks; c++) {
+            size_t* off = counts + c * RADIX_BINS;
+            const size_t i1 = (c + 1) * clen < n ? (c + 1) * clen : n;
+            for (size_t i = c * clen; i < i1; i++) {
+                const size_t o = off[(key[i] >> shift) & (RADIX_BINS - 1)]++;
+                ktmp[o] = key[i];
+                if (idx)
+                    itmp[o] = idx[i];
+            }
+        }
+        uint64_t* kt = key;
+        key = ktmp;
+        ktmp = kt;
+        size_t* it = idx;
+        idx = itmp;
+        itmp = it;
+        swapped = !swapped;
+    }
+    return swapped;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Merge Sort                                */
+/*                                                                          */
+/****************************************************************************/
+
+static void insertion_sort(uint64_t* key, size_t* idx, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        const uint64_t k = key[i];
+        const size_t id = idx ? idx[i] : 0;
+        size_t j = i;
+        for (; j > 0 && key[j - 1] > k; j--) {
+            key[j] = key[j - 1];
+            if (idx)
+                idx[j] = idx[j - 1];
+        }
+        key[j] = k;
+        if (idx)
+            idx[j] = id;
+    }
+}
+
+/*
+ * Number of elements of 'a' among the first 'k' outputs of the stable merge
+ * of 'a' (la long) and 'b' (lb long), where ties are taken from 'a' first.
+ */
+static size_t co_rank(const uint64_t* a, size_t la, const uint64_t* b,
+                      size_t lb, size_t k) {
+    size_t lo = k > lb ? k - lb : 0;
+    size_t hi = k < la ? k : la;
+    while (lo < hi) {
+        const size_t i = lo + (hi - lo) / 2;
+        if (a[i] <= b[k - i - 1])
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+/* outputs [k0, k1) of the stable merge of a and b into 'out' */
+static void merge_range(const uint64_t* a, const size_t* ia, size_t la,
+                        const uint64_t* b, const size_t* ib, size_t lb,
+                        uint64_t* out, size_t* iout, size_t k0, size_t k1) {
+    size_t i = co_rank(a, la, b, lb, k0);
+    size_t j = k0 - i;
+    for (size_t k = k0; k < k1; k++) {
+        const int take_a = j >= lb || (i < la && a[i] <= b[j]);
+        out[k] = take_a ? a[i] : b[j];
+        if (iout)
+            iout[k] = take_a ? ia[i] : ib[j];
+        i += take_a;
+        j += !take_a;
+    }
+}
+
+/*
+ * Bottom-up merge sort: runs of MERGE_RUN are sorted by insertion, then
+ * every level merges pairs of runs. Each level is split into MERGE_SEG
+ * outputs per task, located in their pair by co-ranking, so the last levels
+ * with few long runs stay parallel. Returns non-zero if the result ended up
+ * in the scratch arrays.
+ */
+static int merge_sort(uint64_t* key, uint64_t* ktmp, size_t* idx,
+                      size_t* itmp, size_t n) {
+    const size_t nruns = nchunks_of(n, MERGE_RUN);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t r = 0; r < nruns; r++) {
+        const size_t i0 = r * MERGE_RUN;
+        const size_t len = n - i0 < MERGE_RUN ? n - i0 : MERGE_RUN;
+        insertion_sort(key + i0, idx ? idx + i0 : NULL, len);
+    }
+
+    int swapped = 0;
+    for (size_t width = MERGE_RUN; width < n; width *= 2) {
+        /* pair starts and segment starts are both multiples of the other */
+        const size_t ntasks = nchunks_of(n, MERGE_SEG);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t t = 0; t < ntasks; t++) {
+            const size_t t0 = t * MERGE_SEG;
+            const size_t t1 = t0 + MERGE_SEG < n ? t0 + MERGE_SEG : n;
+            for (size_t lo = t0 - t0 % (2 * width); lo < t1;
+                 lo += 2 * width) {
+                const size_t mid = lo + width < n ? lo + width : n;
+                const size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+                const size_t k0 = (t0 > lo ? t0 : lo) - lo;
+                const size_t k1 = (t1 < hi ? t1 : hi) - lo;
+                merge_range(key + lo, idx ? idx + lo : NULL, mid - lo,
+                            key + mid, idx ? idx + mid : NULL, hi - mid,
+                            ktmp + lo, idx ? itmp + lo : NULL, k0, k1);
+            }
+        }
+        uint64_t* kt = key;
+        key = ktmp;
+        ktmp = kt;
+        size_t* it = idx;
+        idx = itmp;
+        itmp = it;
+        swapped = !swapped;
+    }
+    return swapped;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Sorting                                  */
+/*                                                                          */
+/****************************************************************************/
+
+void __sort(void* vec, size_t n, sort_elem_t elem, sort_method_t method,
+            size_t* perm, size_t nperm) {
+    static const size_t sizes[] = {sizeof(double),       sizeof(float),
+                                   sizeof(int),          sizeof(long),
+                                   sizeof(unsigned int), sizeof(unsigned long)};
+    const char* name = sort_names[method == SORT_MERGE];
+    if ((unsigned)elem >= SORT_UNKNOWN) {
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Expected double, float, int, long or unsigned elements "
+                    "@ %s!\n",
+                    name);
+        return;
+    }
+    if (perm && nperm != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Unmatching dimensions @ %s!\n",
+                    name);
+        return;
+    }
+    if (n == 0)
+        return;
+    const size_t nchunks =
+        n >= SIMUTIL_PAR_MIN ? nchunks_of(n, RADIX_CHUNK) : 1;
+    uint64_t* key = malloc(2 * n * sizeof(uint64_t));
+    size_t* idx = perm ? malloc(2 * n * sizeof(size_t)) : NULL;
+    size_t* counts = method == SORT_RADIX
+                         ? malloc(nchunks * RADIX_BINS * sizeof(size_t))
+                         : NULL;
+    if (!key || (perm && !idx) || (method == SORT_RADIX && !counts)) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ %s!\n", name);
+        goto done;
+    }
+    char* data = (char*)vec + sizes[elem];
+    to_keys(key, data, n, elem);
+    if (idx) {
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+        for (size_t i = 0; i < n; i++)
+            idx[i] = i + 1;
+    }
+
+    const int swapped =
+        method == SORT_RADIX
+            ? radix_sort(key, key + n, idx, idx ? idx + n : NULL, n, counts)
+            : merge_sort(key, key + n, idx, idx ? idx + n : NULL, n);
+    from_keys(data, swapped ? key + n : key, n, elem);
+    if (idx)
+        memcpy(perm, swapped ? idx + n : idx, n * sizeof(size_t));
+done:
+    free(key);
+    free(idx);
+    free(counts);
+}
+
+/* copies one element; the common sizes compile to plain moves */
+static inline void copy_elem(char* dst, const char* src, size_t size) {
+    switch (size) {
+    case 4:
+        memcpy(dst, src, 4);
+        break;
+    case 8:
+        memcpy(dst, src, 8);
+        break;
+    case 16:
+        memcpy(dst, src, 16);
+        break;
+    default:
+        memcpy(dst, src, size);
+    }
+}
+
+void __permute(void* vec, size_t n, size_t elem_size, const size_t* perm,
+               size_t nperm) {
+    if (nperm != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ permute_vector!\n");
+        return;
+    }
+    char* data = (char*)vec + elem_size;
+    char* tmp = malloc(n * elem_size + 1);
+    if (!tmp) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ permute_vector!\n");
+        return;
+    }
+    int bad = 0;
+#pragma omp parallel for schedule(static) reduction(| : bad)                   \
+    if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < n; i++) {
+        const size_t p = perm[i];
+        if (p < 1 || p > n) {
+            bad = 1;
+            continue;
+        }
+        copy_elem(tmp + i * elem_size, data + (p - 1) * elem_size, elem_size);
+    }
+    if (bad)
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Permutation index out of range @ permute_vector!\n");
+    else
+        memcpy(data, tmp, n * elem_size);
+    free(tmp);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Scans                                   */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Every CHUNK is scanned on its own, leaving its total in 'carry'; the
+ * totals are scanned serially and added back to every chunk but the first.
+ */
+#define SCAN_FUNC(name, T)                                                     \
+    static void scan##name(T* out, const T* in, size_t n, int inclusive,      \
+                           T* carry) {                                         \
+        const size_t nchunks = nchunks_of(n, CHUNK);                           \
+        const int par = n >= SIMUTIL_PAR_MIN;                                  \
+        _Pragma("omp parallel for schedule(static) if (par)")                  \
+        for (size_t c = 0; c < nchunks; c++) {                                 \
+            const size_t i1 = (c + 1) * CHUNK < n ? (c + 1) * CHUNK : n;       \
+            T s = 0;                                                           \
+            if (inclusive)                                                     \
+                for (size_t i = c * CHUNK; i < i1; i++) {                      \
+                    s += in[i];                                                \
+                    out[i] = s;                                                \
+                }                                                              \
+            else                                                               \
+                for (size_t i = c * CHUNK; i < i1; i++) {                      \
+                    const T x = in[i];                                         \
+                    out[i] = s;                                                \
+                    s += x;                                                    \
+                }                                                              \
+            carry[c] = s;                                                      \
+        }                                                                      \
+        T s = 0;                                                               \
+        for (size_t c = 0; c < nchunks; c++) {                                 \
+            const T x = carry[c];                                              \
+            carry[c] = s;                                                      \
+            s += x;                                                            \
+        }                                                                      \
+        _Pragma("omp parallel for schedule(static) if (par)")                  \
+        for (size_t c = 1; c < nchunks; c++) {                                 \
+            const size_t i1 = (c + 1) * CHUNK < n ? (c + 1) * CHUNK : n;       \
+            const T off = carry[c];                                            \
+            for (size_t i = c * CHUNK; i < i1; i++)                            \
+                out[i] += off;                                                 \
+        }                                                                      \
+    }
+
+SCAN_FUNC(_double, double)
+SCAN_FUNC(_float, float)
+SCAN_FUNC(_int, int)
+SCAN_FUNC(_long, long)
+SCAN_FUNC(_uint, unsigned int)
+SCAN_FUNC(_ulong, unsigned long)
+
+#undef SCAN_FUNC
+
+void __scan(void* out, const void* in, size_t n, size_t nout,
+            sort_elem_t elem, int inclusive) {
+    const char* name =
+        inclusive ? "inclusive_scan_vector" : "exclusive_scan_vector";
+    if ((unsigned)elem >= SORT_UNKNOWN) {
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Expected double, float, int, long or unsigned elements "
+                    "@ %s!\n",
+                    name);
+        return;
+    }
+    if (nout != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Unmatching dimensions @ %s!\n",
+                    name);
+        return;
+    }
+    if (n == 0)
+        return;
+    /* one carry per chunk, as wide as the widest element */
+    const size_t width = sizeof(double) > sizeof(long) ? sizeof(double)
+                                                       : sizeof(long);
+    void* carry = malloc(nchunks_of(n, CHUNK) * width);
+    if (!carry) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ %s!\n", name);
+        return;
+    }
+    switch (elem) {
+    case SORT_DOUBLE:
+        scan_double((double*)out + 1, (const double*)in + 1, n, inclusive,
+                    carry);
+        break;
+    case SORT_FLOAT:
+        scan_float((float*)out + 1, (const float*)in + 1, n, inclusive, carry);
+        break;
+    case SORT_INT:
+        scan_int((int*)out + 1, (const int*)in + 1, n, inclusive, carry);
+        break;
+    case SORT_LONG:
+        scan_long((long*)out + 1, (const long*)in + 1, n, inclusive, carry);
+        break;
+    case SORT_UINT:
+        scan_uint((unsigned int*)out + 1, (const unsigned int*)in + 1, n,
+                  inclusive, carry);
+        break;
+    default:
+        scan_ulong((unsigned long*)out + 1, (const unsigned long*)in + 1, n,
+                   inclusive, carry);
+    }
+    free(carry);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                       Compaction and Partitioning                        */
+/*                                                                          */
+/****************************************************************************/
+
+/* mask entries [i0, i0 + len) as 0/1 flags, for any integer width */
+static void load_flags(unsigned char* flags, const char* mask, size_t i0,
+                       size_t len, size_t size) {
+    switch (size) {
+    case 1:
+        for (size_t i = 0; i < len; i++)
+            flags[i] = ((const uint8_t*)mask)[i0 + i] != 0;
+        break;
+    case 2:
+        for (size_t i = 0; i < len; i++)
+            flags[i] = ((const uint16_t*)mask)[i0 + i] != 0;
+        break;
+    case 4:
+        for (size_t i = 0; i < len; i++)
+            flags[i] = ((const uint32_t*)mask)[i0 + i] != 0;
+        break;
+    default:
+        for (size_t i = 0; i < len; i++)
+            flags[i] = ((const uint64_t*)mask)[i0 + i] != 0;
+    }
+}
+
+/* number of selected entries in every chunk, scanned into chunk offsets */
+static size_t count_selected(size_t* offset, const char* mask, size_t n,
+                             size_t size) {
+    const size_t nchunks = nchunks_of(n, CHUNK);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        unsigned char flags[BLOCK];
+        const size_t i1 = (c + 1) * CHUNK < n ? (c + 1) * CHUNK : n;
+        size_t cnt = 0;
+        for (size_t i = c * CHUNK; i < i1; i += BLOCK) {
+            const size_t len = i1 - i < BLOCK ? i1 - i : BLOCK;
+            load_flags(flags, mask, i, len, size);
+            for (size_t k = 0; k < len; k++)
+                cnt += flags[k];
+        }
+        offset[c] = cnt;
+    }
+    size_t sum = 0;
+    for (size_t c = 0; c < nchunks; c++) {
+        const size_t cnt = offset[c];
+        offset[c] = sum;
+        sum += cnt;
+    }
+    return sum;
+}
+
+static int check_mask(size_t n, size_t nmask, size_t mask_size,
+                      const char* name) {
+    if (nmask != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "Unmatching dimensions @ %s!\n",
+                    name);
+        return 0;
+    }
+    if (mask_size != 1 && mask_size != 2 && mask_size != 4 && mask_size != 8) {
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Expected an integer mask @ %s!\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+size_t __compact(void* out, const void* in, size_t n, size_t nout,
+                 size_t elem_size, const void* mask, size_t nmask,
+                 size_t mask_size) {
+    if (!check_mask(n, nmask, mask_size, "compact_vector"))
+        return 0;
+    if (nout != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ compact_vector!\n");
+        return 0;
+    }
+    if (n == 0)
+        return 0;
+    size_t* offset = malloc(nchunks_of(n, CHUNK) * sizeof(size_t));
+    if (!offset) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for workspace @ compact_vector!\n");
+        return 0;
+    }
+    const char* m = (const char*)mask + mask_size;
+    const char* src = (const char*)in + elem_size;
+    char* dst = (char*)out + elem_size;
+    const size_t total = count_selected(offset, m, n, mask_size);
+    const size_t nchunks = nchunks_of(n, CHUNK);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        unsigned char flags[BLOCK];
+        const size_t i1 = (c + 1) * CHUNK < n ? (c + 1) * CHUNK : n;
+        size_t o = offset[c];
+        for (size_t i = c * CHUNK; i < i1; i += BLOCK) {
+            const size_t len = i1 - i < BLOCK ? i1 - i : BLOCK;
+            load_flags(flags, m, i, len, mask_size);
+            for (size_t k = 0; k < len; k++)
+                if (flags[k])
+                    copy_elem(dst + o++ * elem_size,
+                              src + (i + k) * elem_size, elem_size);
+        }
+    }
+    free(offset);
+    return total;
+}
+
+size_t __partition(void* vec, size_t n, size_t elem_size, const void* mask,
+                   size_t nmask, size_t mask_size, size_t* perm,
+                   size_t nperm) {
+    if (!check_mask(n, nmask, mask_size, "stable_partition_vector"))
+        return 0;
+    if (perm && nperm != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching dimensions @ stable_partition_vector!\n");
+        return 0;
+    }
+    if (n == 0)
+        return 0;
+    const size_t nchunks = nchunks_of(n, CHUNK);
+    size_t* offset = malloc(nchunks * sizeof(size_t));
+    char* tmp = malloc(n * elem_size);
+    if (!offset || !tmp) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation for workspace @ "
+                                            "stable_partition_vector!\n");
+        free(offset);
+        free(tmp);
+        return 0;
+    }
+    const char* m = (const char*)mask + mask_size;
+    char* data = (char*)vec + elem_size;
+    const size_t total = count_selected(offset, m, n, mask_size);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t c = 0; c < nchunks; c++) {
+        unsigned char flags[BLOCK];
+        const size_t i1 = (c + 1) * CHUNK < n ? (c + 1) * CHUNK : n;
+        /* the rejected elements before this chunk follow all selected ones */
+        size_t sel = offset[c];
+        size_t rej = total + c * CHUNK - offset[c];
+        for (size_t i = c * CHUNK; i < i1; i += BLOCK) {
+            const size_t len = i1 - i < BLOCK ? i1 - i : BLOCK;
+            load_flags(flags, m, i, len, mask_size);
+            for (size_t k = 0; k < len; k++) {
+                const size_t o = flags[k] ? sel++ : rej++;
+                copy_elem(tmp + o * elem_size, data + (i + k) * elem_size,
+                          elem_size);
+                if (perm)
+                    perm[o] = i + k + 1;
+            }
+        }
+    }
+    memcpy(data, tmp, n * elem_size);
+    free(offset);
+    free(tmp);
+    return total;
+}
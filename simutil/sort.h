@@ -0,0 +1,166 @@
+#ifndef SIMUTIL_SORT_H
+#define SIMUTIL_SORT_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+
+/*
+ * Element types accepted by the sorting and scan kernels. 'unsigned long'
+ * also covers size_t.
+ */
+typedef enum {
+    SORT_DOUBLE,
+    SORT_FLOAT,
+    SORT_INT,
+    SORT_LONG,
+    SORT_UINT,
+    SORT_ULONG,
+    SORT_UNKNOWN
+} sort_elem_t;
+
+typedef enum { SORT_RADIX, SORT_MERGE } sort_method_t;
+
+SIMUTIL_API void __sort(void* vec, size_t n, sort_elem_t elem,
+                        sort_method_t method, size_t* perm, size_t nperm);
+
+SIMUTIL_API void __permute(void* vec, size_t n, size_t elem_size,
+                           const size_t* perm, size_t nperm);
+
+SIMUTIL_API void __scan(void* out, const void* in, size_t n, size_t nout,
+                        sort_elem_t elem, int inclusive);
+
+SIMUTIL_API size_t __compact(void* out, const void* in, size_t n, size_t nout,
+                             size_t elem_size, const void* mask, size_t nmask,
+                             size_t mask_size);
+
+SIMUTIL_API size_t __partition(void* vec, size_t n, size_t elem_size,
+                               const void* mask, size_t nmask,
+                               size_t mask_size, size_t* perm, size_t nperm);
+
+#define __SORT_ELEM(x)                                                         \
+    _Generic((x),                                                              \
+        double: SORT_DOUBLE,                                                   \
+        float: SORT_FLOAT,                                                     \
+        int: SORT_INT,                                                         \
+        long: SORT_LONG,                                                       \
+        unsigned int: SORT_UINT,                                               \
+        unsigned long: SORT_ULONG,                                             \
+        default: SORT_UNKNOWN)
+
+/* data and length of an optional 'vector(size_t)', zero for NULL */
+#define __SORT_PERM(perm) ((perm) ? (size_t*)(perm) + 1 : NULL)
+#define __SORT_NPERM(perm) ((perm) ? (size_t)LENGTH(perm) : 0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Sorting                                  */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to sort a vector in increasing order with a parallel LSD
+ * radix sort on 8-bit digits. The sort is stable; digits shared by every key
+ * are skipped, so keys spanning a small range cost fewer passes. Negative
+ * zero sorts before zero, and NaNs sort to the ends by their sign bit.
+ *
+ * @param vec 'vector(T)' with T double, float, int, long, unsigned int or
+ * unsigned long
+ * @param perm 'vector(size_t)' as long as 'vec', set so that the sorted
+ * vec[i] was vec[perm[i]] before the sort, or NULL
+ */
+#define radix_sort_vector(vec, perm)                                           \
+    __sort((vec), (size_t)LENGTH(vec), __SORT_ELEM(*(vec)), SORT_RADIX,        \
+           __SORT_PERM(perm), __SORT_NPERM(perm))
+
+/**
+ * @brief Macro to sort a vector in increasing order with a parallel stable
+ * merge sort. Its cost does not depend on the spread of the keys, unlike
+ * 'radix_sort_vector'; keys are ordered the same way.
+ *
+ * @param vec 'vector(T)' with T double, float, int, long, unsigned int or
+ * unsigned long
+ * @param perm 'vector(size_t)' as long as 'vec', set to the source index of
+ * every sorted element, or NULL
+ */
+#define merge_sort_vector(vec, perm)                                           \
+    __sort((vec), (size_t)LENGTH(vec), __SORT_ELEM(*(vec)), SORT_MERGE,        \
+           __SORT_PERM(perm), __SORT_NPERM(perm))
+
+/**
+ * @brief Macro to reorder a companion vector by the permutation of a sort or
+ * partition, so that vec[i] becomes the old vec[perm[i]].
+ *
+ * @param vec 'vector(T)' of any element type
+ * @param perm 'vector(size_t)' permutation, as long as 'vec'
+ */
+#define permute_vector(vec, perm)                                              \
+    __permute((vec), (size_t)LENGTH(vec), sizeof(*(vec)), (perm) + 1,          \
+              (size_t)LENGTH(perm))
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Scans                                   */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to set out[i] to the sum of in[1] to in[i]. 'out' may be
+ * 'in'. The additions are grouped in fixed chunks, so floating-point results
+ * do not depend on the number of threads.
+ *
+ * @param out 'vector(T)' as long as 'in'
+ * @param in 'vector(T)' with T double, float, int, long, unsigned int or
+ * unsigned long
+ */
+#define inclusive_scan_vector(out, in)                                         \
+    __scan((out), (in), (size_t)LENGTH(in), (size_t)LENGTH(out),               \
+           __SORT_ELEM(*(in)), 1)
+
+/**
+ * @brief Macro to set out[i] to the sum of in[1] to in[i - 1], and out[1] to
+ * zero. 'out' may be 'in'.
+ *
+ * @param out 'vector(T)' as long as 'in'
+ * @param in 'vector(T)' with T double, float, int, long, unsigned int or
+ * unsigned long
+ */
+#define exclusive_scan_vector(out, in)                                         \
+    __scan((out), (in), (size_t)LENGTH(in), (size_t)LENGTH(out),               \
+           __SORT_ELEM(*(in)), 0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                       Compaction and Partitioning                        */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to copy the elements of 'in' whose mask entry is non-zero to
+ * the front of 'out', in order. Returns their number as a size_t; the rest
+ * of 'out' is left unchanged.
+ *
+ * @param out 'vector(T)' as long as 'in', distinct from it
+ * @param in 'vector(T)' of any element type
+ * @param mask Vector of any integer type, as long as 'in'
+ */
+#define compact_vector(out, in, mask)                                          \
+    __compact((out), (in), (size_t)LENGTH(in), (size_t)LENGTH(out),            \
+              sizeof(*(in)), (mask), (size_t)LENGTH(mask), sizeof(*(mask)))
+
+/**
+ * @brief Macro to reorder a vector so that the elements with a non-zero mask
+ * entry come first, each group keeping its order. Returns the number of
+ * selected elements as a size_t.
+ *
+ * @param vec 'vector(T)' of any element type
+ * @param mask Vector of any integer type, as long as 'vec'
+ * @param perm 'vector(size_t)' as long as 'vec', set to the source index of
+ * every element for 'permute_vector', or NULL
+ */
+#define stable_partition_vector(vec, mask, perm)                               \
+    __partition((vec), (size_t)LENGTH(vec), sizeof(*(vec)), (mask),            \
+                (size_t)LENGTH(mask), sizeof(*(mask)), __SORT_PERM(perm),      \
+                __SORT_NPERM(perm))
+
+#endif
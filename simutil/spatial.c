@@ -0,0 +1,970 @@
+#include "spatial.h"
+#include "error.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/* query batches smaller than this are searched on one thread */
+#define PAR_MIN_QUERIES 256
+
+/* largest leaf of the k-d tree; median splits leave at least half of it */
+#define LEAF 8
+
+/* candidates tested per block when collecting radius hits */
+#define SCAN_BLOCK 64
+
+/* the grid never has more cells than this many per point (plus a floor) */
+#define CELLS_PER_POINT 2
+#define MIN_CELLS 64
+
+typedef struct {
+    double lo[3];
+    double hi[3];
+    size_t begin;
+    size_t end;
+    /* children, 0 for a leaf (the root is never a child) */
+    size_t left;
+    size_t right;
+} kd_node;
+
+typedef struct {
+    double d2;
+    size_t p;
+} knn_entry;
+
+struct spatial_index {
+    spatial_method_t method;
+    int dim;
+    size_t n;
+    size_t cap;
+    /* coordinates in index order, 0-indexed; z is zero for 2-D points */
+    double* pos[3];
+    /* perm[p] is the 1-based user index of the point at position p */
+    size_t* perm;
+    /* grid: cells are ranked along the Morton curve */
+    double cell_size;
+    double h;
+    double inv_h;
+    double lo[3];
+    size_t nc[3];
+    size_t ncells;
+    size_t* rank;
+    size_t* cell_start;
+    size_t* cell_of;
+    /* k-d tree */
+    kd_node* nodes;
+    size_t nnodes;
+};
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Morton Codes                               */
+/*                                                                          */
+/****************************************************************************/
+
+/* Spreads the low 21 bits of v to every third bit. */
+static inline uint64_t spread3(uint64_t v) {
+    v &= 0x1FFFFF;
+    v = (v | v << 32) & 0x1F00000000FFFFull;
+    v = (v | v << 16) & 0x1F0000FF0000FFull;
+    v = (v | v << 8) & 0x100F00F00F00F00Full;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+/* Spreads the low 32 bits of v to every other bit. */
+static inline uint64_t spread2(uint64_t v) {
+    v &= 0xFFFFFFFF;
+    v = (v | v << 16) & 0x0000FFFF0000FFFFull;
+    v = (v | v << 8) & 0x00FF00FF00FF00FFull;
+    v = (v | v << 4) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | v << 2) & 0x3333333333333333ull;
+    v = (v | v << 1) & 0x5555555555555555ull;
+    return v;
+}
+
+static inline uint64_t morton(int dim, const uint64_t* c) {
+    if (dim == 3)
+        return spread3(c[0]) | spread3(c[1]) << 1 | spread3(c[2]) << 2;
+    return spread2(c[0]) | spread2(c[1]) << 1;
+}
+
+/*
+ * Stable LSD radix sort of (key, val) pairs, 8 bits per pass, with only as
+ * many passes as the largest key needs. The result ends up in 'key'/'val'.
+ */
+static void radix_sort(uint64_t* key, size_t* val, uint64_t* tkey,
+                       size_t* tval, size_t n) {
+    uint64_t max = 0;
+    for (size_t i = 0; i < n; i++)
+        max = key[i] > max ? key[i] : max;
+    int passes = 0;
+    while (passes < 8 && (max >> (8 * passes)))
+        passes++;
+    for (int pass = 0; pass < passes; pass++) {
+        const int shift = 8 * pass;
+        size_t count[257] = {0};
+        for (size_t i = 0; i < n; i++)
+            count[((key[i] >> shift) & 0xFF) + 1]++;
+        for (size_t b = 0; b < 256; b++)
+            count[b + 1] += count[b];
+        for (size_t i = 0; i < n; i++) {
+            const size_t dst = count[(key[i] >> shift) & 0xFF]++;
+            tkey[dst] = key[i];
+            tval[dst] = val[i];
+        }
+        uint64_t* sk = key;
+        size_t* sv = val;
+        key = tkey;
+        val = tval;
+        tkey = sk;
+        tval = sv;
+    }
+    if (passes % 2) {
+        memcpy(tkey, key, n * sizeof(uint64_t));
+        memcpy(tval, val, n * sizeof(size_t));
+    }
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Points                                  */
+/*                                                                          */
+/****************************************************************************/
+
+static int check_coords(vector(double) x, vector(double) y, vector(double) z,
+                        const char* name) {
+    if (!x || !y) {
+        raise_error(SIMUTIL_NULL_ERROR, "NULL coordinates @ %s!\n", name);
+        return 0;
+    }
+    if (LENGTH(y) != LENGTH(x) || (z && LENGTH(z) != LENGTH(x))) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching coordinate lengths @ %s!\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Makes room for 'n' points. Returns 0 when out of memory. */
+static int reserve_points(spatial_index* s, size_t n) {
+    if (n <= s->cap)
+        return 1;
+    for (int a = 0; a < 3; a++) {
+        double* p = realloc(s->pos[a], n * sizeof(double));
+        if (!p)
+            return 0;
+        s->pos[a] = p;
+    }
+    size_t* perm = realloc(s->perm, n * sizeof(size_t));
+    if (!perm)
+        return 0;
+    s->perm = perm;
+    size_t* cell_of = realloc(s->cell_of, n * sizeof(size_t));
+    if (!cell_of)
+        return 0;
+    s->cell_of = cell_of;
+    s->cap = n;
+    return 1;
+}
+
+/* Copies the user coordinates into index order through 'perm'. */
+static void gather_points(spatial_index* s, vector(double) x, vector(double) y,
+                          vector(double) z) {
+    double* restrict px = s->pos[0];
+    double* restrict py = s->pos[1];
+    double* restrict pz = s->pos[2];
+    const size_t* restrict perm = s->perm;
+#pragma omp parallel for schedule(static) if (s->n >= SIMUTIL_PAR_MIN)
+    for (size_t p = 0; p < s->n; p++) {
+        px[p] = x[perm[p]];
+        py[p] = y[perm[p]];
+        pz[p] = z ? z[perm[p]] : 0.0;
+    }
+}
+
+static void bounding_box(int dim, size_t n, vector(double) x, vector(double) y,
+                         vector(double) z, double* lo, double* hi) {
+    double l0 = INFINITY, l1 = INFINITY, l2 = INFINITY;
+    double h0 = -INFINITY, h1 = -INFINITY, h2 = -INFINITY;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)            \
+    reduction(min : l0, l1, l2) reduction(max : h0, h1, h2)
+    for (size_t i = 1; i <= n; i++) {
+        l0 = fmin(l0, x[i]);
+        h0 = fmax(h0, x[i]);
+        l1 = fmin(l1, y[i]);
+        h1 = fmax(h1, y[i]);
+        if (dim == 3) {
+            l2 = fmin(l2, z[i]);
+            h2 = fmax(h2, z[i]);
+        }
+    }
+    lo[0] = l0;
+    lo[1] = l1;
+    lo[2] = dim == 3 ? l2 : 0.0;
+    hi[0] = h0;
+    hi[1] = h1;
+    hi[2] = dim == 3 ? h2 : 0.0;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                   Grid                                   */
+/*                                                                          */
+/****************************************************************************/
+
+static inline size_t clamp_cell(double c, size_t nc) {
+    if (!(c > 0.0))
+        return 0;
+    if (c >= (double)(nc - 1))
+        return nc - 1;
+    return (size_t)c;
+}
+
+/* Ranks the cells of the current shape along the Morton curve. */
+static int rank_cells(spatial_index* s) {
+    const size_t nc = s->ncells;
+    uint64_t* key = malloc(2 * nc * sizeof(uint64_t));
+    size_t* val = malloc(2 * nc * sizeof(size_t));
+    size_t* rank = realloc(s->rank, nc * sizeof(size_t));
+    size_t* start = realloc(s->cell_start, (nc + 1) * sizeof(size_t));
+    if (rank)
+        s->rank = rank;
+    if (start)
+        s->cell_start = start;
+    if (!key || !val || !rank || !start) {
+        free(key);
+        free(val);
+        return 0;
+    }
+    for (size_t c = 0; c < nc; c++) {
+        const uint64_t cc[3] = {c % s->nc[0], c / s->nc[0] % s->nc[1],
+                                c / (s->nc[0] * s->nc[1])};
+        key[c] = morton(s->dim, cc);
+        val[c] = c;
+    }
+    radix_sort(key, val, key + nc, val + nc, nc);
+    for (size_t r = 0; r < nc; r++)
+        rank[val[r]] = r;
+    free(key);
+    free(val);
+    return 1;
+}
+
+/*
+ * Bins the points into Morton-ranked cells with a counting sort, so points of
+ * one cell are contiguous and cells close on the curve are close in memory.
+ * With 'reuse' set the cell ranks are only recomputed when the grid shape
+ * changes.
+ */
+static int grid_build(spatial_index* s, vector(double) x, vector(double) y,
+                      vector(double) z, int reuse) {
+    double lo[3], hi[3];
+    bounding_box(s->dim, s->n, x, y, z, lo, hi);
+    if (s->n == 0)
+        lo[0] = lo[1] = lo[2] = hi[0] = hi[1] = hi[2] = 0.0;
+
+    /* widen the cells of a sparse grid; queries stay exact for any size */
+    const size_t max_cells = CELLS_PER_POINT * s->n + MIN_CELLS;
+    double h = s->cell_size;
+    size_t nc[3], ncells;
+    for (;;) {
+        ncells = 1;
+        for (int a = 0; a < 3; a++) {
+            nc[a] = 1;
+            if (a < s->dim) {
+                const double ext = (hi[a] - lo[a]) / h;
+                nc[a] = ext < (double)max_cells ? (size_t)ext + 1
+                                                : max_cells + 1;
+            }
+            if (ncells <= max_cells)
+                ncells *= nc[a];
+        }
+        if (ncells <= max_cells)
+            break;
+        h *= 1.2599210498948732;
+    }
+    s->h = h;
+    s->inv_h = 1.0 / h;
+    memcpy(s->lo, lo, sizeof(lo));
+    if (!reuse || ncells != s->ncells || nc[0] != s->nc[0] ||
+        nc[1] != s->nc[1]) {
+        memcpy(s->nc, nc, sizeof(nc));
+        s->ncells = ncells;
+        if (!rank_cells(s))
+            return 0;
+    }
+
+    const size_t n = s->n;
+    size_t* restrict cell_of = s->cell_of;
+    const size_t* restrict rank = s->rank;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < n; i++) {
+        const size_t cx = clamp_cell((x[i + 1] - lo[0]) * s->inv_h, nc[0]);
+        const size_t cy = clamp_cell((y[i + 1] - lo[1]) * s->inv_h, nc[1]);
+        const size_t cz =
+            z ? clamp_cell((z[i + 1] - lo[2]) * s->inv_h, nc[2]) : 0;
+        cell_of[i] = rank[(cz * nc[1] + cy) * nc[0] + cx];
+    }
+    size_t* start = s->cell_start;
+    memset(start, 0, (ncells + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+        start[cell_of[i] + 1]++;
+    for (size_t c = 0; c < ncells; c++)
+        start[c + 1] += start[c];
+    /* stable placement, using cell_of as the running insertion point */
+    for (size_t i = 0; i < n; i++) {
+        const size_t c = cell_of[i];
+        s->perm[start[c]++] = i + 1;
+    }
+    for (size_t c = ncells; c > 0; c--)
+        start[c] = start[c - 1];
+    start[0] = 0;
+    gather_points(s, x, y, z);
+    return 1;
+}
+
+/*
+ * Reports the points of [begin, end) within sqrt(r2) of q, except position
+ * 'skip'. Without 'out' only counts, in a loop with no stores or branches.
+ */
+static inline size_t scan_range(const spatial_index* s, size_t begin,
+                                size_t end, const double* q, double r2,
+                                size_t skip, size_t* out) {
+    const double* restrict px = s->pos[0];
+    const double* restrict py = s->pos[1];
+    const double* restrict pz = s->pos[2];
+    size_t count = 0;
+    if (!out) {
+        for (size_t p = begin; p < end; p++) {
+            const double dx = px[p] - q[0];
+            const double dy = py[p] - q[1];
+            const double dz = pz[p] - q[2];
+            count += dx * dx + dy * dy + dz * dz <= r2;
+        }
+        /* a skipped point is a query itself, at distance 0 */
+        return count - (skip >= begin && skip < end);
+    }
+    /* compact hits without branching through a block on the stack */
+    size_t hits[SCAN_BLOCK];
+    for (size_t b = begin; b < end; b += SCAN_BLOCK) {
+        const size_t e = end - b < SCAN_BLOCK ? end : b + SCAN_BLOCK;
+        size_t nh = 0;
+        for (size_t p = b; p < e; p++) {
+            const double dx = px[p] - q[0];
+            const double dy = py[p] - q[1];
+            const double dz = pz[p] - q[2];
+            hits[nh] = s->perm[p];
+            nh += (dx * dx + dy * dy + dz * dz <= r2) & (p != skip);
+        }
+        /* blocks are short; a call to memcpy would cost more than the copy */
+        for (size_t i = 0; i < nh; i++)
+            out[count + i] = hits[i];
+        count += nh;
+    }
+    return count;
+}
+
+static size_t grid_radius(const spatial_index* s, const double* q, double r,
+                          size_t skip, size_t* out) {
+    size_t c0[3], c1[3];
+    for (int a = 0; a < 3; a++) {
+        c0[a] = clamp_cell((q[a] - r - s->lo[a]) * s->inv_h, s->nc[a]);
+        c1[a] = clamp_cell((q[a] + r - s->lo[a]) * s->inv_h, s->nc[a]);
+    }
+    const double r2 = r * r;
+    size_t count = 0;
+    for (size_t cz = c0[2]; cz <= c1[2]; cz++)
+        for (size_t cy = c0[1]; cy <= c1[1]; cy++)
+            for (size_t cx = c0[0]; cx <= c1[0]; cx++) {
+                const size_t rk =
+                    s->rank[(cz * s->nc[1] + cy) * s->nc[0] + cx];
+                count += scan_range(s, s->cell_start[rk],
+                                    s->cell_start[rk + 1], q, r2, skip,
+                                    out ? out + count : NULL);
+            }
+    return count;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 K-d Tree                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static inline void swap_points(spatial_index* s, size_t i, size_t j) {
+    for (int a = 0; a < 3; a++) {
+        const double t = s->pos[a][i];
+        s->pos[a][i] = s->pos[a][j];
+        s->pos[a][j] = t;
+    }
+    const size_t t = s->perm[i];
+    s->perm[i] = s->perm[j];
+    s->perm[j] = t;
+}
+
+/*
+ * Partially sorts the points of [lo, hi] along 'axis' so that position 'nth'
+ * holds its median, moving coordinates and 'perm' together.
+ */
+static void select_nth(spatial_index* s, long lo, long hi, long nth,
+                       int axis) {
+    const double* key = s->pos[axis];
+    while (hi > lo) {
+        const double a = key[lo];
+        const double b = key[(lo + hi) / 2];
+        const double c = key[hi];
+        const double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                                   : (a < c ? a : (b < c ? c : b));
+        long i = lo, j = hi;
+        while (i <= j) {
+            while (key[i] < pivot)
+                i++;
+            while (key[j] > pivot)
+                j--;
+            if (i <= j)
+                swap_points(s, (size_t)i++, (size_t)j--);
+        }
+        if (nth <= j)
+            hi = j;
+        else if (nth >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+/*
+ * Splits the points of [begin, end) at the median of their widest extent.
+ * Nodes are stored in preorder, so every child comes after its parent.
+ */
+static size_t tree_split(spatial_index* s, size_t begin, size_t end) {
+    const size_t id = s->nnodes++;
+    kd_node* node = &s->nodes[id];
+    node->begin = begin;
+    node->end = end;
+    node->left = node->right = 0;
+    if (end - begin <= LEAF)
+        return id;
+    int axis = 0;
+    double widest = -1.0;
+    for (int a = 0; a < s->dim; a++) {
+        double lo = INFINITY, hi = -INFINITY;
+        for (size_t p = begin; p < end; p++) {
+            lo = fmin(lo, s->pos[a][p]);
+            hi = fmax(hi, s->pos[a][p]);
+        }
+        if (hi - lo > widest) {
+            widest = hi - lo;
+            axis = a;
+        }
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    select_nth(s, (long)begin, (long)end - 1, (long)mid, axis);
+    const size_t left = tree_split(s, begin, mid);
+    const size_t right = tree_split(s, mid, end);
+    s->nodes[id].left = left;
+    s->nodes[id].right = right;
+    return id;
+}
+
+/* Recomputes every bounding box from the children up. */
+static void tree_refit(spatial_index* s) {
+    for (size_t id = s->nnodes; id-- > 0;) {
+        kd_node* node = &s->nodes[id];
+        if (node->left) {
+            const kd_node* l = &s->nodes[node->left];
+            const kd_node* r = &s->nodes[node->right];
+            for (int a = 0; a < 3; a++) {
+                node->lo[a] = fmin(l->lo[a], r->lo[a]);
+                node->hi[a] = fmax(l->hi[a], r->hi[a]);
+            }
+            continue;
+        }
+        for (int a = 0; a < 3; a++) {
+            node->lo[a] = INFINITY;
+            node->hi[a] = -INFINITY;
+            for (size_t p = node->begin; p < node->end; p++) {
+                node->lo[a] = fmin(node->lo[a], s->pos[a][p]);
+                node->hi[a] = fmax(node->hi[a], s->pos[a][p]);
+            }
+        }
+    }
+}
+
+static int tree_build(spatial_index* s, vector(double) x, vector(double) y,
+                      vector(double) z) {
+    const size_t max_nodes = s->n / 2 + 3;
+    kd_node* nodes = realloc(s->nodes, max_nodes * sizeof(kd_node));
+    if (!nodes)
+        return 0;
+    s->nodes = nodes;
+    s->nnodes = 0;
+    for (size_t p = 0; p < s->n; p++)
+        s->perm[p] = p + 1;
+    gather_points(s, x, y, z);
+    if (s->n > 0)
+        tree_split(s, 0, s->n);
+    tree_refit(s);
+    return 1;
+}
+
+static inline double box_d2(const kd_node* node, const double* q) {
+    double d2 = 0.0;
+    for (int a = 0; a < 3; a++) {
+        /* two selects (maxsd) instead of fmax, which has to handle NaN */
+        const double below = node->lo[a] - q[a];
+        const double above = q[a] - node->hi[a];
+        double d = below > above ? below : above;
+        d = d > 0.0 ? d : 0.0;
+        d2 += d * d;
+    }
+    return d2;
+}
+
+static size_t tree_radius(const spatial_index* s, size_t id, const double* q,
+                          double r2, size_t skip, size_t* out) {
+    const kd_node* node = &s->nodes[id];
+    if (box_d2(node, q) > r2)
+        return 0;
+    if (node->left) {
+        const size_t nl = tree_radius(s, node->left, q, r2, skip, out);
+        return nl + tree_radius(s, node->right, q, r2, skip,
+                                out ? out + nl : NULL);
+    }
+    return scan_range(s, node->begin, node->end, q, r2, skip, out);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                               kNN Searches                               */
+/*                                                                          */
+/****************************************************************************/
+
+/* Offers a candidate to a max-heap holding the k best so far. */
+static inline void heap_offer(knn_entry* heap, size_t* len, size_t k,
+                              double d2, size_t p) {
+    size_t i;
+    if (*len < k) {
+        i = (*len)++;
+        while (i > 0 && heap[(i - 1) / 2].d2 < d2) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else if (d2 < heap[0].d2) {
+        i = 0;
+        for (;;) {
+            size_t c = 2 * i + 1;
+            if (c >= k)
+                break;
+            if (c + 1 < k && heap[c + 1].d2 > heap[c].d2)
+                c++;
+            if (heap[c].d2 <= d2)
+                break;
+            heap[i] = heap[c];
+            i = c;
+        }
+    } else {
+        return;
+    }
+    heap[i].d2 = d2;
+    heap[i].p = p;
+}
+
+static inline void scan_points(const spatial_index* s, size_t begin,
+                               size_t end, const double* q, size_t skip,
+                               knn_entry* heap, size_t* len, size_t k) {
+    for (size_t p = begin; p < end; p++) {
+        const double dx = s->pos[0][p] - q[0];
+        const double dy = s->pos[1][p] - q[1];
+        const double dz = s->pos[2][p] - q[2];
+        if (p != skip)
+            heap_offer(heap, len, k, dx * dx + dy * dy + dz * dz, p);
+    }
+}
+
+/*
+ * Searches rings of cells around the cell of q. After ring R every point
+ * outside the searched block is farther than R cell sides, so the search
+ * stops once the k-th candidate is within that distance.
+ */
+static void grid_knn(const spatial_index* s, const double* q, size_t k,
+                     size_t skip, knn_entry* heap, size_t* len) {
+    size_t c[3];
+    long reach = 0;
+    for (int a = 0; a < 3; a++) {
+        c[a] = clamp_cell((q[a] - s->lo[a]) * s->inv_h, s->nc[a]);
+        reach = (long)s->nc[a] > reach ? (long)s->nc[a] : reach;
+    }
+    for (long ring = 0; ring <= reach; ring++) {
+        long b0[3], b1[3];
+        for (int a = 0; a < 3; a++) {
+            b0[a] = (long)c[a] - ring < 0 ? 0 : (long)c[a] - ring;
+            b1[a] = (long)c[a] + ring >= (long)s->nc[a] ? (long)s->nc[a] - 1
+                                                        : (long)c[a] + ring;
+        }
+        for (long cz = b0[2]; cz <= b1[2]; cz++)
+            for (long cy = b0[1]; cy <= b1[1]; cy++)
+                for (long cx = b0[0]; cx <= b1[0]; cx++) {
+                    const long dx = labs(cx - (long)c[0]);
+                    const long dy = labs(cy - (long)c[1]);
+                    const long dz = labs(cz - (long)c[2]);
+                    const long cheb = dx > dy ? (dx > dz ? dx : dz)
+                                              : (dy > dz ? dy : dz);
+                    if (cheb != ring)
+                        continue;
+                    const size_t rk =
+                        s->rank[((size_t)cz * s->nc[1] + (size_t)cy) *
+                                    s->nc[0] +
+                                (size_t)cx];
+                    scan_points(s, s->cell_start[rk], s->cell_start[rk + 1],
+                                q, skip, heap, len, k);
+                }
+        const double reached = (double)ring * s->h;
+        if (*len == k && heap[0].d2 <= reached * reached)
+            return;
+    }
+}
+
+static void tree_knn(const spatial_index* s, size_t id, const double* q,
+                     size_t k, size_t skip, knn_entry* heap, size_t* len) {
+    const kd_node* node = &s->nodes[id];
+    if (!node->left) {
+        scan_points(s, node->begin, node->end, q, skip, heap, len, k);
+        return;
+    }
+    size_t near = node->left, far = node->right;
+    double dn = box_d2(&s->nodes[near], q), df = box_d2(&s->nodes[far], q);
+    if (df < dn) {
+        const size_t t = near;
+        near = far;
+        far = t;
+        const double d = dn;
+        dn = df;
+        df = d;
+    }
+    if (*len < k || dn < heap[0].d2)
+        tree_knn(s, near, q, k, skip, heap, len);
+    if (*len < k || df < heap[0].d2)
+        tree_knn(s, far, q, k, skip, heap, len);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Public Functions                            */
+/*                                                                          */
+/****************************************************************************/
+
+static int build(spatial_index* s, vector(double) x, vector(double) y,
+                 vector(double) z) {
+    s->dim = z ? 3 : 2;
+    s->n = (size_t)LENGTH(x);
+    if (!reserve_points(s, s->n))
+        return 0;
+    if (s->method == SPATIAL_GRID)
+        return grid_build(s, x, y, z, 0);
+    return tree_build(s, x, y, z);
+}
+
+spatial_index* new_spatial_index(spatial_method_t method, vector(double) x,
+                                 vector(double) y, vector(double) z,
+                                 double cell_size) {
+    if (method != SPATIAL_GRID && method != SPATIAL_KDTREE) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Unknown method @ new_spatial_index!\n");
+        return NULL;
+    }
+    if (method == SPATIAL_GRID && !(cell_size > 0.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Non-positive cell size @ new_spatial_index!\n");
+        return NULL;
+    }
+    if (!check_coords(x, y, z, "new_spatial_index"))
+        return NULL;
+    spatial_index* s = calloc(1, sizeof(spatial_index));
+    if (!s) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for spatial index!\n");
+        return NULL;
+    }
+    s->method = method;
+    s->cell_size = cell_size;
+    if (!build(s, x, y, z)) {
+        free_spatial_index(s);
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for spatial index!\n");
+        return NULL;
+    }
+    return s;
+}
+
+void free_spatial_index(spatial_index* s) {
+    if (!s)
+        return;
+    for (int a = 0; a < 3; a++)
+        free(s->pos[a]);
+    free(s->perm);
+    free(s->rank);
+    free(s->cell_start);
+    free(s->cell_of);
+    free(s->nodes);
+    free(s);
+}
+
+void spatial_rebuild(spatial_index* s, vector(double) x, vector(double) y,
+                     vector(double) z) {
+    if (!check_coords(x, y, z, "spatial_rebuild"))
+        return;
+    if (!build(s, x, y, z)) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation @ spatial_rebuild!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void spatial_update(spatial_index* s, vector(double) x, vector(double) y,
+                    vector(double) z) {
+    if (!check_coords(x, y, z, "spatial_update"))
+        return;
+    if ((size_t)LENGTH(x) != s->n || (z != NULL) != (s->dim == 3)) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Point set changed shape @ spatial_update!\n");
+        return;
+    }
+    if (s->method == SPATIAL_KDTREE) {
+        gather_points(s, x, y, z);
+        tree_refit(s);
+        return;
+    }
+    if (!grid_build(s, x, y, z, 1)) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation @ spatial_update!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Resolves the queries of a bulk search. With qx NULL the queries are the
+ * indexed points, visited in index order for locality; 'slot' maps a query
+ * to its output row and 'skip' to the position it must not report.
+ */
+typedef struct {
+    size_t m;
+    int self;
+    vector(double) qx;
+    vector(double) qy;
+    vector(double) qz;
+} query_set;
+
+static int make_queries(const spatial_index* s, vector(double) qx,
+                        vector(double) qy, vector(double) qz, query_set* qs,
+                        const char* name) {
+    qs->self = qx == NULL;
+    qs->qx = qx;
+    qs->qy = qy;
+    qs->qz = qz;
+    if (qs->self) {
+        qs->m = s->n;
+        return 1;
+    }
+    if (!check_coords(qx, qy, qz, name))
+        return 0;
+    qs->m = (size_t)LENGTH(qx);
+    return 1;
+}
+
+static inline void query_point(const spatial_index* s, const query_set* qs,
+                               size_t j, double* q, size_t* slot,
+                               size_t* skip) {
+    if (qs->self) {
+        for (int a = 0; a < 3; a++)
+            q[a] = s->pos[a][j];
+        *slot = s->perm[j] - 1;
+        *skip = j;
+        return;
+    }
+    q[0] = qs->qx[j + 1];
+    q[1] = qs->qy[j + 1];
+    q[2] = s->dim == 3 && qs->qz ? qs->qz[j + 1] : 0.0;
+    *slot = j;
+    *skip = SIZE_MAX;
+}
+
+static inline size_t radius_one(const spatial_index* s, const double* q,
+                                double r, size_t skip, size_t* out) {
+    if (s->n == 0)
+        return 0;
+    if (s->method == SPATIAL_GRID)
+        return grid_radius(s, q, r, skip, out);
+    return tree_radius(s, 0, q, r * r, skip, out);
+}
+
+void spatial_radius(spatial_index* s, vector(double) qx, vector(double) qy,
+                    vector(double) qz, double r, spatial_neighbors* out) {
+    if (!(r >= 0.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Negative radius @ spatial_radius!\n");
+        return;
+    }
+    query_set qs;
+    if (!make_queries(s, qx, qy, qz, &qs, "spatial_radius"))
+        return;
+    const size_t m = qs.m;
+    size_t* start = realloc(out->start, (m + 1) * sizeof(size_t));
+    if (!start) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation @ spatial_radius!\n");
+        exit(EXIT_FAILURE);
+    }
+    out->start = start;
+    out->nqueries = m;
+
+    /* count, then fill at the offsets; both passes run in parallel */
+    start[0] = 0;
+#pragma omp parallel for schedule(dynamic, 64) if (m >= PAR_MIN_QUERIES)
+    for (size_t j = 0; j < m; j++) {
+        double q[3];
+        size_t slot, skip;
+        query_point(s, &qs, j, q, &slot, &skip);
+        start[slot + 1] = radius_one(s, q, r, skip, NULL);
+    }
+    for (size_t i = 0; i < m; i++)
+        start[i + 1] += start[i];
+    if (start[m] > out->capacity) {
+        size_t* index = realloc(out->index, start[m] * sizeof(size_t));
+        if (!index) {
+            raise_error(SIMUTIL_ALLOCATE_ERROR,
+                        "NULL allocation @ spatial_radius!\n");
+            exit(EXIT_FAILURE);
+        }
+        out->index = index;
+        out->capacity = start[m];
+    }
+#pragma omp parallel for schedule(dynamic, 64) if (m >= PAR_MIN_QUERIES)
+    for (size_t j = 0; j < m; j++) {
+        double q[3];
+        size_t slot, skip;
+        query_point(s, &qs, j, q, &slot, &skip);
+        radius_one(s, q, r, skip, out->index + start[slot]);
+    }
+}
+
+void spatial_knn(spatial_index* s, vector(double) qx, vector(double) qy,
+                 vector(double) qz, size_t k, vector(size_t) idx,
+                 vector(double) dist) {
+    query_set qs;
+    if (!make_queries(s, qx, qy, qz, &qs, "spatial_knn"))
+        return;
+    const size_t m = qs.m;
+    if (k == 0 || (size_t)LENGTH(idx) != m * k ||
+        (size_t)LENGTH(dist) != m * k) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching output length @ spatial_knn!\n");
+        return;
+    }
+    int fail = 0;
+#pragma omp parallel if (m >= PAR_MIN_QUERIES)
+    {
+        knn_entry* heap = malloc(k * sizeof(knn_entry));
+        if (!heap) {
+#pragma omp atomic write
+            fail = 1;
+        }
+#pragma omp for schedule(dynamic, 64)
+        for (size_t j = 0; j < m; j++) {
+            if (!heap)
+                continue;
+            double q[3];
+            size_t slot, skip, len = 0;
+            query_point(s, &qs, j, q, &slot, &skip);
+            if (s->n > 0) {
+                if (s->method == SPATIAL_GRID)
+                    grid_knn(s, q, k, skip, heap, &len);
+                else
+                    tree_knn(s, 0, q, k, skip, heap, &len);
+            }
+            /* pop the max-heap from the back of the output row */
+            size_t* row_idx = idx + slot * k + 1;
+            double* row_dist = dist + slot * k + 1;
+            for (size_t i = len; i < k; i++) {
+                row_idx[i] = 0;
+                row_dist[i] = INFINITY;
+            }
+            for (size_t i = len; i-- > 0;) {
+                row_idx[i] = s->perm[heap[0].p];
+                row_dist[i] = sqrt(heap[0].d2);
+                const knn_entry last = heap[i];
+                size_t h = 0;
+                for (;;) {
+                    size_t c = 2 * h + 1;
+                    if (c >= i)
+                        break;
+                    if (c + 1 < i && heap[c + 1].d2 > heap[c].d2)
+                        c++;
+                    if (heap[c].d2 <= last.d2)
+                        break;
+                    heap[h] = heap[c];
+                    h = c;
+                }
+                heap[h] = last;
+            }
+        }
+        free(heap);
+    }
+    if (fail) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR, "NULL allocation @ spatial_knn!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void free_spatial_neighbors(spatial_neighbors* nb) {
+    free(nb->start);
+    free(nb->index);
+    nb->start = NULL;
+    nb->index = NULL;
+    nb->nqueries = 0;
+    nb->capacity = 0;
+}
+
+void spatial_morton_order(vector(size_t) perm, vector(double) x,
+                          vector(double) y, vector(double) z) {
+    if (!check_coords(x, y, z, "spatial_morton_order"))
+        return;
+    const size_t n = (size_t)LENGTH(x);
+    if ((size_t)LENGTH(perm) != n) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching permutation length @ spatial_morton_order!\n");
+        return;
+    }
+    const int dim = z ? 3 : 2;
+    double lo[3], hi[3];
+    bounding_box(dim, n, x, y, z, lo, hi);
+    uint64_t* key = malloc(2 * n * sizeof(uint64_t));
+    size_t* val = malloc(2 * n * sizeof(size_t));
+    if (!key || !val) {
+        free(key);
+        free(val);
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation @ spatial_morton_order!\n");
+        exit(EXIT_FAILURE);
+    }
+    /* quantize to the full resolution of a 64-bit code */
+    const double levels = dim == 3 ? 2097151.0 : 4294967295.0;
+    double scale[3];
+    for (int a = 0; a < 3; a++)
+        scale[a] = hi[a] > lo[a] ? levels / (hi[a] - lo[a]) : 0.0;
+    const double* c[3] = {x, y, z};
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < n; i++) {
+        uint64_t cc[3] = {0, 0, 0};
+        for (int a = 0; a < dim; a++)
+            cc[a] = (uint64_t)((c[a][i + 1] - lo[a]) * scale[a]);
+        key[i] = morton(dim, cc);
+        val[i] = i + 1;
+    }
+    radix_sort(key, val, key + n, val + n, n);
+    memcpy(perm + 1, val, n * sizeof(size_t));
+    free(key);
+    free(val);
+}
@@ -0,0 +1,129 @@
+#ifndef SIMUTIL_SPATIAL_H
+#define SIMUTIL_SPATIAL_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+
+/*
+ * SPATIAL_GRID bins the points into a uniform grid of cells whose side is at
+ * least the cell size given at creation, the usual choice for a fixed
+ * interaction cutoff. SPATIAL_KDTREE splits the points at the median of
+ * their widest extent and suits clustered data and kNN queries. Both keep the
+ * points sorted so that spatial neighbours are neighbours in memory.
+ */
+typedef enum { SPATIAL_GRID, SPATIAL_KDTREE } spatial_method_t;
+
+/**
+ * @brief Opaque spatial index over a set of 2-D or 3-D points.
+ *
+ */
+typedef struct spatial_index spatial_index;
+
+/**
+ * @brief Neighbours found by a radius query, in compressed rows. The points
+ * near query i (1-based) are 'index[start[i - 1]]' to 'index[start[i] - 1]',
+ * given as 1-based point indices. Zero-initialize before the first query and
+ * reuse across queries; storage only grows.
+ *
+ */
+typedef struct {
+    size_t nqueries;
+    size_t* start;
+    size_t* index;
+    size_t capacity;
+} spatial_neighbors;
+
+/**
+ * @brief Function to build an index over the points (x[i], y[i], z[i]).
+ *
+ * @param method SPATIAL_GRID or SPATIAL_KDTREE
+ * @param x First coordinates
+ * @param y Second coordinates
+ * @param z Third coordinates, or NULL for 2-D points
+ * @param cell_size Smallest cell side of SPATIAL_GRID, ignored otherwise
+ */
+SIMUTIL_API spatial_index* new_spatial_index(spatial_method_t method,
+                                             vector(double) x, vector(double) y,
+                                             vector(double) z,
+                                             double cell_size);
+
+SIMUTIL_API void free_spatial_index(spatial_index* index);
+
+/**
+ * @brief Function to rebuild the index from scratch, possibly for a
+ * different number of points. Storage is reused when it is large enough.
+ *
+ * @param index Index to rebuild
+ * @param x First coordinates
+ * @param y Second coordinates
+ * @param z Third coordinates, or NULL for 2-D points
+ */
+SIMUTIL_API void spatial_rebuild(spatial_index* index, vector(double) x,
+                                 vector(double) y, vector(double) z);
+
+/**
+ * @brief Function to update the index after the same points have moved, in
+ * O(N). The grid re-bins the points; the k-d tree keeps its structure and
+ * only refits its bounding boxes, which stays exact but prunes less as the
+ * points drift, so rebuild it every so many steps.
+ *
+ * @param index Index to update
+ * @param x First coordinates
+ * @param y Second coordinates
+ * @param z Third coordinates, or NULL for 2-D points
+ */
+SIMUTIL_API void spatial_update(spatial_index* index, vector(double) x,
+                                vector(double) y, vector(double) z);
+
+/**
+ * @brief Function to find, for every query point, all indexed points within
+ * distance 'r'. With 'qx' NULL the queries are the indexed points themselves
+ * and each point is left out of its own list.
+ *
+ * @param index Index to search
+ * @param qx First coordinates of the queries, or NULL
+ * @param qy Second coordinates of the queries
+ * @param qz Third coordinates of the queries, or NULL for 2-D points
+ * @param r Search radius
+ * @param out Neighbour lists, resized as needed
+ */
+SIMUTIL_API void spatial_radius(spatial_index* index, vector(double) qx,
+                                vector(double) qy, vector(double) qz, double r,
+                                spatial_neighbors* out);
+
+/**
+ * @brief Function to find the 'k' nearest indexed points of every query.
+ * Neighbour j of query i is 'idx[(i - 1) * k + j]' at distance
+ * 'dist[(i - 1) * k + j]', in increasing distance. Missing neighbours (fewer
+ * than k points) have index 0 and distance INFINITY. With 'qx' NULL the
+ * queries are the indexed points themselves, each excluded from its result.
+ *
+ * @param index Index to search
+ * @param qx First coordinates of the queries, or NULL
+ * @param qy Second coordinates of the queries
+ * @param qz Third coordinates of the queries, or NULL for 2-D points
+ * @param k Number of neighbours
+ * @param idx 'vector(size_t)' of length k times the number of queries
+ * @param dist 'vector(double)' of the same length
+ */
+SIMUTIL_API void spatial_knn(spatial_index* index, vector(double) qx,
+                             vector(double) qy, vector(double) qz, size_t k,
+                             vector(size_t) idx, vector(double) dist);
+
+SIMUTIL_API void free_spatial_neighbors(spatial_neighbors* nb);
+
+/**
+ * @brief Function to compute the Morton (Z-order) permutation of a point set:
+ * perm[i] is the index of the i-th point along the curve. Storing particle
+ * data as 'a_sorted[i] = a[perm[i]]' places nearby particles close in memory.
+ *
+ * @param perm 'vector(size_t)' with the length of 'x'
+ * @param x First coordinates
+ * @param y Second coordinates
+ * @param z Third coordinates, or NULL for 2-D points
+ */
+SIMUTIL_API void spatial_morton_order(vector(size_t) perm, vector(double) x,
+                                      vector(double) y, vector(double) z);
+
+#endif
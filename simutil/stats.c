@@ -0,0 +1,505 @@
+#include "stats.h"
+#include "error.h"
+#include <math.h>
+#include <string.h>
+
+/* elements per parallel task */
+#define CHUNK 4096
+
+/* elements converted to double at a time */
+#define BLOCK 256
+
+/* independent partial sums, so the reductions vectorize without reordering */
+#define LANES 8
+
+/*
+ * Histograms up to this many bins are counted into several interleaved
+ * copies, so that runs of equal bins do not serialize on one counter.
+ */
+#define STRIPE_MAX_BINS 4096
+#define STRIPES 4
+
+/* ranges this short are finished by insertion sort */
+#define SELECT_SMALL 16
+
+/*
+ * Storage lines of a vector (depth 1), matrix (depth 2) or matrix3 (depth
+ * 3). A matrix3 has 'ext1' lines per entry of its first level.
+ */
+typedef struct {
+    const void* lines;
+    int depth;
+    size_t nlines;
+    size_t ext1;
+    size_t linelen;
+    stats_elem_t elem;
+    size_t elem_size;
+} source;
+
+static int make_source(source* src, stats_elem_t elem, const void* lines,
+                       int depth, size_t nlines, size_t ext1, size_t linelen,
+                       const char* name) {
+    static const size_t sizes[] = {sizeof(double), sizeof(float), sizeof(int),
+                                   sizeof(long)};
+    if ((unsigned)elem >= STATS_UNKNOWN) {
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Expected double, float, int or long elements @ %s!\n",
+                    name);
+        return 0;
+    }
+    src->lines = lines;
+    src->depth = depth;
+    src->nlines = nlines;
+    src->ext1 = ext1;
+    src->linelen = linelen;
+    src->elem = elem;
+    src->elem_size = sizes[elem];
+    return 1;
+}
+
+/* first element of storage line 'l' (0-based) */
+static const char* line_at(const source* src, size_t l) {
+    if (src->depth == 1)
+        return (const char*)src->lines + src->elem_size;
+    if (src->depth == 2)
+        return ((char* const*)src->lines)[l + 1] + src->elem_size;
+    return ((char* const* const*)src->lines)[l / src->ext1 + 1]
+                                            [l % src->ext1 + 1] +
+           src->elem_size;
+}
+
+/*
+ * The 'n' <= BLOCK values at 'p' as doubles: doubles are read in place,
+ * other types are converted into 'buf'.
+ */
+static const double* values(const source* src, const char* p, size_t n,
+                            double* buf) {
+    switch (src->elem) {
+    case STATS_DOUBLE:
+        return (const double*)p;
+    case STATS_FLOAT:
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (double)((const float*)p)[i];
+        break;
+    case STATS_INT:
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (double)((const int*)p)[i];
+        break;
+    default:
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (double)((const long*)p)[i];
+        break;
+    }
+    return buf;
+}
+
+/* number of (line, chunk) tasks covering the source */
+static size_t ntasks(const source* src, size_t* per_line) {
+    *per_line = (src->linelen + CHUNK - 1) / CHUNK;
+    return src->nlines * *per_line;
+}
+
+/* start and length of task 'task' */
+static const char* task_range(const source* src, size_t per_line,
+                              size_t task, size_t* len) {
+    const size_t c = (task % per_line) * CHUNK;
+    *len = src->linelen - c < CHUNK ? src->linelen - c : CHUNK;
+    return line_at(src, task / per_line) + c * src->elem_size;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                            Mean and Variance                             */
+/*                                                                          */
+/****************************************************************************/
+
+stats_running stats_init(void) {
+    stats_running s = {0, 0.0, 0.0, INFINITY, -INFINITY};
+    return s;
+}
+
+void stats_push(stats_running* s, double x) {
+    s->n++;
+    const double d = x - s->mean;
+    s->mean += d / (double)s->n;
+    s->m2 += d * (x - s->mean);
+    s->min = x < s->min ? x : s->min;
+    s->max = x > s->max ? x : s->max;
+}
+
+void stats_merge(stats_running* s, const stats_running* other) {
+    if (other->n == 0)
+        return;
+    if (s->n == 0) {
+        *s = *other;
+        return;
+    }
+    /* Chan et al.: combine the two means and sums of squared deviations */
+    const double na = (double)s->n;
+    const double nb = (double)other->n;
+    const double n = na + nb;
+    const double d = other->mean - s->mean;
+    s->mean += d * (nb / n);
+    s->m2 += other->m2 + d * d * (na * nb / n);
+    s->n += other->n;
+    s->min = other->min < s->min ? other->min : s->min;
+    s->max = other->max > s->max ? other->max : s->max;
+}
+
+double stats_variance(const stats_running* s) {
+    if (s->n < 2)
+        return 0.0;
+    return s->m2 / (double)(s->n - 1);
+}
+
+/*
+ * Statistics of 'n' values, two passes over data that is still in cache:
+ * the sum and extrema, then the squared deviations from the chunk mean.
+ */
+static stats_running chunk_stats(const source* src, const char* p, size_t n) {
+    double buf[BLOCK];
+    double sum[LANES] = {0.0};
+    double lo[LANES], hi[LANES];
+    for (int j = 0; j < LANES; j++) {
+        lo[j] = INFINITY;
+        hi[j] = -INFINITY;
+    }
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t m = n - b < BLOCK ? n - b : BLOCK;
+        const double* x = values(src, p + b * src->elem_size, m, buf);
+        size_t i = 0;
+        for (; i + LANES <= m; i += LANES)
+            for (int j = 0; j < LANES; j++) {
+                const double v = x[i + j];
+                sum[j] += v;
+                lo[j] = v < lo[j] ? v : lo[j];
+                hi[j] = v > hi[j] ? v : hi[j];
+            }
+        for (; i < m; i++) {
+            sum[0] += x[i];
+            lo[0] = x[i] < lo[0] ? x[i] : lo[0];
+            hi[0] = x[i] > hi[0] ? x[i] : hi[0];
+        }
+    }
+    stats_running s = {n, 0.0, 0.0, lo[0], hi[0]};
+    double total = 0.0;
+    for (int j = 0; j < LANES; j++) {
+        total += sum[j];
+        s.min = lo[j] < s.min ? lo[j] : s.min;
+        s.max = hi[j] > s.max ? hi[j] : s.max;
+    }
+    s.mean = total / (double)n;
+    double dev[LANES] = {0.0};
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t m = n - b < BLOCK ? n - b : BLOCK;
+        const double* x = values(src, p + b * src->elem_size, m, buf);
+        size_t i = 0;
+        for (; i + LANES <= m; i += LANES)
+            for (int j = 0; j < LANES; j++) {
+                const double d = x[i + j] - s.mean;
+                dev[j] += d * d;
+            }
+        for (; i < m; i++)
+            dev[0] += (x[i] - s.mean) * (x[i] - s.mean);
+    }
+    for (int j = 0; j < LANES; j++)
+        s.m2 += dev[j];
+    return s;
+}
+
+/* per-task results are merged in task order, for any number of threads */
+static void update(stats_running* s, const source* src) {
+    size_t per_line;
+    const size_t ntask = ntasks(src, &per_line);
+    if (ntask == 0)
+        return;
+    stats_running* part = malloc(ntask * sizeof(stats_running));
+    if (!part) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate task results @ stats_update!\n");
+        return;
+    }
+#pragma omp parallel for schedule(static)                                      \
+    if (src->nlines * src->linelen >= SIMUTIL_PAR_MIN)
+    for (size_t task = 0; task < ntask; task++) {
+        size_t len;
+        const char* p = task_range(src, per_line, task, &len);
+        part[task] = chunk_stats(src, p, len);
+    }
+    for (size_t task = 0; task < ntask; task++)
+        stats_merge(s, &part[task]);
+    free(part);
+}
+
+void __stats_update(stats_running* s, stats_elem_t elem, const void* vec,
+                    size_t n) {
+    source src;
+    if (make_source(&src, elem, vec, 1, 1, 1, n, "stats_update_vector"))
+        update(s, &src);
+}
+
+void __stats_update_lines2(stats_running* s, stats_elem_t elem, void* mat,
+                           size_t nlines, size_t linelen) {
+    source src;
+    if (make_source(&src, elem, mat, 2, nlines, 1, linelen,
+                    "stats_update_matrix"))
+        update(s, &src);
+}
+
+void __stats_update_lines3(stats_running* s, stats_elem_t elem, void* mat3,
+                           const size_t* ext) {
+    source src;
+    if (make_source(&src, elem, mat3, 3, ext[0] * ext[1], ext[1], ext[2],
+                    "stats_update_matrix3"))
+        update(s, &src);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Histograms                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Adds 'n' values to the private counts 'cnt'. Bin indices are computed a
+ * block at a time without branches; values outside [lo, hi) go to the extra
+ * bin 'nbins'. With several copies of the bins, consecutive values are
+ * counted in different copies.
+ */
+static void bin_chunk(size_t* cnt, size_t nstripe, size_t nbins, double lo,
+                      double hi, const source* src, const char* p, size_t n) {
+    double buf[BLOCK];
+    size_t idx[BLOCK];
+    const double scale = (double)nbins / (hi - lo);
+    const double last = (double)(nbins - 1);
+    const double skip = (double)nbins;
+    const size_t stride = nstripe > 1 ? nbins + 1 : 0;
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t m = n - b < BLOCK ? n - b : BLOCK;
+        const double* x = values(src, p + b * src->elem_size, m, buf);
+        for (size_t i = 0; i < m; i++) {
+            const int in = (x[i] >= lo) & (x[i] < hi);
+            double t = (x[i] - lo) * scale;
+            /* rounding can put values just below 'hi' past the last bin */
+            t = t < last ? t : last;
+            t = in ? t : skip;
+            idx[i] = (size_t)t;
+        }
+        size_t i = 0;
+        for (; i + STRIPES <= m; i += STRIPES)
+            for (size_t s = 0; s < STRIPES; s++)
+                cnt[s * stride + idx[i + s]]++;
+        for (; i < m; i++)
+            cnt[idx[i]]++;
+    }
+}
+
+static void histogram(size_t* counts, size_t nbins, double lo, double hi,
+                      const source* src, const char* name) {
+    if (nbins == 0)
+        return;
+    if (!(hi > lo)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR, "Empty bin range @ %s!\n", name);
+        return;
+    }
+    size_t per_line;
+    const size_t ntask = ntasks(src, &per_line);
+    const size_t nstripe = nbins <= STRIPE_MAX_BINS ? STRIPES : 1;
+    const size_t stride = nbins + 1;
+    int failed = 0;
+#pragma omp parallel if (src->nlines * src->linelen >= SIMUTIL_PAR_MIN)
+    {
+        size_t* cnt = calloc(nstripe * stride, sizeof(size_t));
+#pragma omp for schedule(static)
+        for (size_t task = 0; task < ntask; task++) {
+            if (!cnt)
+                continue;
+            size_t len;
+            const char* p = task_range(src, per_line, task, &len);
+            bin_chunk(cnt, nstripe, nbins, lo, hi, src, p, len);
+        }
+#pragma omp critical
+        {
+            if (cnt)
+                for (size_t s = 0; s < nstripe; s++)
+                    for (size_t k = 0; k < nbins; k++)
+                        counts[k] += cnt[s * stride + k];
+            else
+                failed = 1;
+        }
+        free(cnt);
+    }
+    if (failed)
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate private bins @ %s!\n", name);
+}
+
+void __histogram(size_t* counts, size_t nbins, double lo, double hi,
+                 stats_elem_t elem, const void* vec, size_t n) {
+    source src;
+    if (make_source(&src, elem, vec, 1, 1, 1, n, "histogram_vector"))
+        histogram(counts, nbins, lo, hi, &src, "histogram_vector");
+}
+
+void __histogram_lines2(size_t* counts, size_t nbins, double lo, double hi,
+                        stats_elem_t elem, void* mat, size_t nlines,
+                        size_t linelen) {
+    source src;
+    if (make_source(&src, elem, mat, 2, nlines, 1, linelen,
+                    "histogram_matrix"))
+        histogram(counts, nbins, lo, hi, &src, "histogram_matrix");
+}
+
+void __histogram_lines3(size_t* counts, size_t nbins, double lo, double hi,
+                        stats_elem_t elem, void* mat3, const size_t* ext) {
+    source src;
+    if (make_source(&src, elem, mat3, 3, ext[0] * ext[1], ext[1], ext[2],
+                    "histogram_matrix3"))
+        histogram(counts, nbins, lo, hi, &src, "histogram_matrix3");
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Percentiles                                */
+/*                                                                          */
+/****************************************************************************/
+
+static inline void swap(double* a, long i, long j) {
+    const double t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+}
+
+/*
+ * Moves the k-th smallest of a[lo, hi) to a[k], with nothing larger before
+ * it and nothing smaller after it (Hoare partitions, median-of-3 pivots).
+ */
+static void select_kth(double* a, long lo, long hi, long k) {
+    while (hi - lo > SELECT_SMALL) {
+        const long mid = lo + (hi - lo) / 2;
+        if (a[mid] < a[lo])
+            swap(a, mid, lo);
+        if (a[hi - 1] < a[lo])
+            swap(a, hi - 1, lo);
+        if (a[hi - 1] < a[mid])
+            swap(a, hi - 1, mid);
+        const double pivot = a[mid];
+        long i = lo;
+        long j = hi - 1;
+        while (i <= j) {
+            while (a[i] < pivot)
+                i++;
+            while (a[j] > pivot)
+                j--;
+            if (i <= j)
+                swap(a, i++, j--);
+        }
+        /* a[lo, j] <= pivot <= a[i, hi), and anything between equals it */
+        if (k <= j)
+            hi = j + 1;
+        else if (k >= i)
+            lo = i;
+        else
+            return;
+    }
+    for (long i = lo + 1; i < hi; i++) {
+        const double v = a[i];
+        long j = i;
+        for (; j > lo && a[j - 1] > v; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+static void percentiles(double* out, const double* p, size_t np,
+                        const source* src, const char* name) {
+    for (size_t i = 0; i < np; i++)
+        if (!(p[i] >= 0.0 && p[i] <= 1.0)) {
+            raise_error(SIMUTIL_DEFAULT_ERROR,
+                        "Probability outside [0, 1] @ %s!\n", name);
+            return;
+        }
+    const size_t n = src->nlines * src->linelen;
+    double* a = malloc((n ? n : 1) * sizeof(double));
+    size_t* order = malloc((np ? np : 1) * sizeof(size_t));
+    if (!a || !order) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate scratch copy @ %s!\n", name);
+        goto done;
+    }
+    size_t per_line;
+    const size_t ntask = ntasks(src, &per_line);
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t task = 0; task < ntask; task++) {
+        size_t len;
+        const char* q = task_range(src, per_line, task, &len);
+        double* dst = a + (task / per_line) * src->linelen +
+                      (task % per_line) * CHUNK;
+        double buf[BLOCK];
+        for (size_t b = 0; b < len; b += BLOCK) {
+            const size_t m = len - b < BLOCK ? len - b : BLOCK;
+            memcpy(dst + b, values(src, q + b * src->elem_size, m, buf),
+                   m * sizeof(double));
+        }
+    }
+    /* drop NaNs, which have no rank */
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        a[m] = a[i];
+        m += a[i] == a[i];
+    }
+    /* answer in increasing order, so every selection narrows the next */
+    for (size_t i = 0; i < np; i++) {
+        size_t j = i;
+        for (; j > 0 && p[order[j - 1]] > p[i]; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    long lo = 0;
+    for (size_t t = 0; t < np; t++) {
+        const size_t i = order[t];
+        if (m == 0) {
+            out[i] = NAN;
+            continue;
+        }
+        const double h = p[i] * (double)(m - 1);
+        const long k = (long)h;
+        const double frac = h - (double)k;
+        select_kth(a, lo, (long)m, k);
+        lo = k;
+        double next = a[k];
+        if (frac > 0.0) {
+            next = a[k + 1];
+            for (long r = k + 2; r < (long)m; r++)
+                next = a[r] < next ? a[r] : next;
+        }
+        out[i] = a[k] + frac * (next - a[k]);
+    }
+done:
+    free(a);
+    free(order);
+}
+
+void __percentiles(double* out, const double* p, size_t np,
+                   stats_elem_t elem, const void* vec, size_t n) {
+    source src;
+    if (make_source(&src, elem, vec, 1, 1, 1, n, "percentiles_vector"))
+        percentiles(out, p, np, &src, "percentiles_vector");
+}
+
+void __percentiles_lines2(double* out, const double* p, size_t np,
+                          stats_elem_t elem, void* mat, size_t nlines,
+                          size_t linelen) {
+    source src;
+    if (make_source(&src, elem, mat, 2, nlines, 1, linelen,
+                    "percentiles_matrix"))
+        percentiles(out, p, np, &src, "percentiles_matrix");
+}
+
+void __percentiles_lines3(double* out, const double* p, size_t np,
+                          stats_elem_t elem, void* mat3, const size_t* ext) {
+    source src;
+    if (make_source(&src, elem, mat3, 3, ext[0] * ext[1], ext[1], ext[2],
+                    "percentiles_matrix3"))
+        percentiles(out, p, np, &src, "percentiles_matrix3");
+}
@@ -0,0 +1,263 @@
+#ifndef SIMUTIL_STATS_H
+#define SIMUTIL_STATS_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/*
+ * Element types accepted by the statistics kernels. Values are converted to
+ * double as they are read.
+ */
+typedef enum {
+    STATS_DOUBLE,
+    STATS_FLOAT,
+    STATS_INT,
+    STATS_LONG,
+    STATS_UNKNOWN
+} stats_elem_t;
+
+/**
+ * @brief Running count, mean, sum of squared deviations and extrema of a
+ * stream of values. Start from 'stats_init()' and feed it single values or
+ * whole containers; two states over disjoint data merge exactly.
+ *
+ */
+typedef struct {
+    size_t n;
+    double mean;
+    double m2;
+    double min;
+    double max;
+} stats_running;
+
+/**
+ * @brief Function to create an empty running state.
+ *
+ */
+SIMUTIL_API stats_running stats_init(void);
+
+/**
+ * @brief Function to add a single value to a running state (Welford).
+ *
+ * @param s Running state
+ * @param x Value to add
+ */
+SIMUTIL_API void stats_push(stats_running* s, double x);
+
+/**
+ * @brief Function to fold 'other' into 's', as if the values of 'other' had
+ * been pushed to 's'.
+ *
+ * @param s Running state, updated
+ * @param other Running state to add
+ */
+SIMUTIL_API void stats_merge(stats_running* s, const stats_running* other);
+
+/**
+ * @brief Function to get the sample variance (divided by n - 1) of a running
+ * state, or 0 for fewer than two values.
+ *
+ * @param s Running state
+ */
+SIMUTIL_API double stats_variance(const stats_running* s);
+
+SIMUTIL_API void __stats_update(stats_running* s, stats_elem_t elem,
+                                const void* vec, size_t n);
+
+SIMUTIL_API void __stats_update_lines2(stats_running* s, stats_elem_t elem,
+                                       void* mat, size_t nlines,
+                                       size_t linelen);
+
+SIMUTIL_API void __stats_update_lines3(stats_running* s, stats_elem_t elem,
+                                       void* mat3, const size_t* ext);
+
+SIMUTIL_API void __histogram(size_t* counts, size_t nbins, double lo,
+                             double hi, stats_elem_t elem, const void* vec,
+                             size_t n);
+
+SIMUTIL_API void __histogram_lines2(size_t* counts, size_t nbins, double lo,
+                                    double hi, stats_elem_t elem, void* mat,
+                                    size_t nlines, size_t linelen);
+
+SIMUTIL_API void __histogram_lines3(size_t* counts, size_t nbins, double lo,
+                                    double hi, stats_elem_t elem, void* mat3,
+                                    const size_t* ext);
+
+SIMUTIL_API void __percentiles(double* out, const double* p, size_t np,
+                               stats_elem_t elem, const void* vec, size_t n);
+
+SIMUTIL_API void __percentiles_lines2(double* out, const double* p,
+                                      size_t np, stats_elem_t elem, void* mat,
+                                      size_t nlines, size_t linelen);
+
+SIMUTIL_API void __percentiles_lines3(double* out, const double* p,
+                                      size_t np, stats_elem_t elem,
+                                      void* mat3, const size_t* ext);
+
+#define __STATS_ELEM(x)                                                        \
+    _Generic((x),                                                              \
+        double: STATS_DOUBLE,                                                  \
+        float: STATS_FLOAT,                                                    \
+        int: STATS_INT,                                                        \
+        long: STATS_LONG,                                                      \
+        default: STATS_UNKNOWN)
+
+#define __STATS_CHECK_LENGTH(a, b, name)                                       \
+    do {                                                                       \
+        if (LENGTH(a) != LENGTH(b)) {                                          \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Unmatching vector lengths @ " name "!\n");            \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+    } while (0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                            Mean and Variance                             */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to add every element of a vector to a running state. The
+ * result does not depend on the number of threads.
+ *
+ * @param s Pointer to the running state
+ * @param vec 'vector(T)' with T double, float, int or long
+ */
+#define stats_update_vector(s, vec)                                            \
+    __stats_update((s), __STATS_ELEM(*(vec)), (vec), (size_t)LENGTH(vec))
+
+/**
+ * @brief Macro to add every element of a matrix to a running state.
+ *
+ * @param s Pointer to the running state
+ * @param mat 'matrix(T)' with T double, float, int or long
+ */
+#define stats_update_matrix(s, mat)                                            \
+    __stats_update_lines2((s), __STATS_ELEM(**(mat)), (void*)(mat),            \
+                          MATRIX_NLINES(mat), MATRIX_LINELEN(mat))
+
+/**
+ * @brief Macro to add every element of a matrix3 to a running state.
+ *
+ * @param s Pointer to the running state
+ * @param mat3 'matrix3(T)' with T double, float, int or long
+ */
+#define stats_update_matrix3(s, mat3)                                          \
+    __stats_update_lines3(                                                     \
+        (s), __STATS_ELEM(***(mat3)), (void*)(mat3),                           \
+        (const size_t[3]){MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),              \
+                          MATRIX3_EXT3(mat3)})
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Histograms                                */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to count the elements of a vector into LENGTH(counts) equal
+ * bins over [lo, hi). Counts are added to 'counts', so one histogram can
+ * collect several calls; values outside the range and NaNs are skipped.
+ *
+ * @param counts 'vector(size_t)' of bin counts
+ * @param vec 'vector(T)' with T double, float, int or long
+ * @param lo Lower edge of the first bin
+ * @param hi Upper edge of the last bin
+ */
+#define histogram_vector(counts, vec, lo, hi)                                  \
+    __histogram((counts) + 1, (size_t)LENGTH(counts), (lo), (hi),              \
+                __STATS_ELEM(*(vec)), (vec), (size_t)LENGTH(vec))
+
+/**
+ * @brief Macro to count the elements of a matrix into LENGTH(counts) equal
+ * bins over [lo, hi).
+ *
+ * @param counts 'vector(size_t)' of bin counts
+ * @param mat 'matrix(T)' with T double, float, int or long
+ * @param lo Lower edge of the first bin
+ * @param hi Upper edge of the last bin
+ */
+#define histogram_matrix(counts, mat, lo, hi)                                  \
+    __histogram_lines2((counts) + 1, (size_t)LENGTH(counts), (lo), (hi),       \
+                       __STATS_ELEM(**(mat)), (void*)(mat),                    \
+                       MATRIX_NLINES(mat), MATRIX_LINELEN(mat))
+
+/**
+ * @brief Macro to count the elements of a matrix3 into LENGTH(counts) equal
+ * bins over [lo, hi).
+ *
+ * @param counts 'vector(size_t)' of bin counts
+ * @param mat3 'matrix3(T)' with T double, float, int or long
+ * @param lo Lower edge of the first bin
+ * @param hi Upper edge of the last bin
+ */
+#define histogram_matrix3(counts, mat3, lo, hi)                                \
+    __histogram_lines3(                                                        \
+        (counts) + 1, (size_t)LENGTH(counts), (lo), (hi),                      \
+        __STATS_ELEM(***(mat3)), (void*)(mat3),                                \
+        (const size_t[3]){MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),              \
+                          MATRIX3_EXT3(mat3)})
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Percentiles                                */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to compute exact percentiles of the elements of a vector.
+ * out[i] is the p[i]-quantile, interpolated linearly between order
+ * statistics; NaNs are ignored. Uses a scratch copy of the data.
+ *
+ * @param out 'vector(double)' of quantiles
+ * @param vec 'vector(T)' with T double, float, int or long
+ * @param p 'vector(double)' of probabilities in [0, 1], as long as 'out'
+ */
+#define percentiles_vector(out, vec, p)                                        \
+    do {                                                                       \
+        __STATS_CHECK_LENGTH(out, p, "percentiles_vector");                    \
+        __percentiles((out) + 1, (p) + 1, (size_t)LENGTH(p),                   \
+                      __STATS_ELEM(*(vec)), (vec), (size_t)LENGTH(vec));       \
+    } while (0)
+
+/**
+ * @brief Macro to compute exact percentiles of the elements of a matrix.
+ *
+ * @param out 'vector(double)' of quantiles
+ * @param mat 'matrix(T)' with T double, float, int or long
+ * @param p 'vector(double)' of probabilities in [0, 1], as long as 'out'
+ */
+#define percentiles_matrix(out, mat, p)                                        \
+    do {                                                                       \
+        __STATS_CHECK_LENGTH(out, p, "percentiles_matrix");                    \
+        __percentiles_lines2((out) + 1, (p) + 1, (size_t)LENGTH(p),            \
+                             __STATS_ELEM(**(mat)), (void*)(mat),              \
+                             MATRIX_NLINES(mat), MATRIX_LINELEN(mat));         \
+    } while (0)
+
+/**
+ * @brief Macro to compute exact percentiles of the elements of a matrix3.
+ *
+ * @param out 'vector(double)' of quantiles
+ * @param mat3 'matrix3(T)' with T double, float, int or long
+ * @param p 'vector(double)' of probabilities in [0, 1], as long as 'out'
+ */
+#define percentiles_matrix3(out, mat3, p)                                      \
+    do {                                                                       \
+        __STATS_CHECK_LENGTH(out, p, "percentiles_matrix3");                   \
+        __percentiles_lines3(                                                  \
+            (out) + 1, (p) + 1, (size_t)LENGTH(p), __STATS_ELEM(***(mat3)),    \
+            (void*)(mat3),                                                     \
+            (const size_t[3]){MATRIX3_EXT1(mat3), MATRIX3_EXT2(mat3),          \
+                              MATRIX3_EXT3(mat3)});                            \
+    } while (0)
+
+#endif
@@ -0,0 +1,260 @@
+#include "table.h"
+#include "error.h"
+#include <math.h>
+
+/* arguments evaluated together, so the coefficient loop vectorizes */
+#define BLOCK 256
+
+/* coefficients of a piece: degree 7, one cache line */
+#define PIECE_COEF 8
+
+/* largest number of pieces tried by TABLE_PIECEWISE */
+#define MAX_PIECES ((size_t)1 << 20)
+
+/* first and largest series length tried by TABLE_CHEBYSHEV */
+#define MIN_CHEB 16
+#define MAX_CHEB 1024
+
+struct func_table {
+    table_func_t f;
+    void* ctx;
+    double a;
+    double b;
+    double scale;
+    size_t npieces;
+    size_t ncoef;
+    double* coef;
+};
+
+static const char* const table_names[] = {"TABLE_CHEBYSHEV",
+                                          "TABLE_PIECEWISE"};
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Fitting                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/* sum of c[k] T_k(t) by Clenshaw's recurrence */
+static inline double clenshaw(const double* c, size_t n, double t) {
+    double b1 = 0.0, b2 = 0.0;
+    for (size_t k = n - 1; k > 0; k--) {
+        const double tmp = 2.0 * t * b1 - b2 + c[k];
+        b2 = b1;
+        b1 = tmp;
+    }
+    return t * b1 - b2 + c[0];
+}
+
+/*
+ * Chebyshev coefficients of the degree n - 1 interpolant of f on [lo, hi],
+ * from its values at the n Chebyshev nodes. 'fv' receives those values.
+ */
+static void fit(const func_table* tab, double lo, double hi, size_t n,
+                double* c, double* fv) {
+    const double mid = 0.5 * (lo + hi), half = 0.5 * (hi - lo);
+    for (size_t j = 0; j < n; j++)
+        fv[j] = tab->f(mid + half * cos(M_PI * (j + 0.5) / n), tab->ctx);
+    for (size_t k = 0; k < n; k++) {
+        double s = 0.0;
+        for (size_t j = 0; j < n; j++)
+            s += fv[j] * cos(M_PI * k * (j + 0.5) / n);
+        c[k] = (k ? 2.0 : 1.0) * s / n;
+    }
+}
+
+/*
+ * Largest error of the series c on [lo, hi] at the n + 1 extrema of T_n,
+ * which lie between the nodes, relative to max(1, |f|).
+ */
+static double check(const func_table* tab, double lo, double hi, size_t n,
+                    const double* c, size_t nc) {
+    const double mid = 0.5 * (lo + hi), half = 0.5 * (hi - lo);
+    double err = 0.0;
+    for (size_t j = 0; j <= n; j++) {
+        const double t = cos(M_PI * j / n);
+        const double fx = tab->f(mid + half * t, tab->ctx);
+        const double e = fabs(clenshaw(c, nc, t) - fx) / fmax(1.0, fabs(fx));
+        err = e > err || isnan(e) ? e : err;
+    }
+    return err;
+}
+
+static int build_chebyshev(func_table* tab, double tol) {
+    double* fv = malloc(MAX_CHEB * sizeof(double));
+    double* c = malloc(MAX_CHEB * sizeof(double));
+    int found = 0;
+    if (!fv || !c)
+        goto cleanup;
+    for (size_t n = MIN_CHEB; n <= MAX_CHEB && !found; n *= 2) {
+        fit(tab, tab->a, tab->b, n, c, fv);
+        if (!(check(tab, tab->a, tab->b, n, c, n) <= 0.5 * tol))
+            continue;
+        /* drop trailing terms worth less than a quarter of the bound */
+        double floor_f = INFINITY, dropped = 0.0;
+        for (size_t j = 0; j < n; j++)
+            floor_f = fmin(floor_f, fmax(1.0, fabs(fv[j])));
+        size_t nc = n;
+        while (nc > 1 && dropped + fabs(c[nc - 1]) <= 0.25 * tol * floor_f)
+            dropped += fabs(c[--nc]);
+        if (!(tab->coef = malloc(nc * sizeof(double))))
+            goto cleanup;
+        for (size_t k = 0; k < nc; k++)
+            tab->coef[k] = c[k];
+        tab->ncoef = nc;
+        tab->npieces = 1;
+        found = 1;
+    }
+
+cleanup:
+    free(fv);
+    free(c);
+    return found;
+}
+
+static int build_piecewise(func_table* tab, double tol) {
+    double fv[PIECE_COEF];
+    for (size_t np = 1; np <= MAX_PIECES; np *= 2) {
+        double* c = malloc(np * PIECE_COEF * sizeof(double));
+        if (!c)
+            return 0;
+        const double h = (tab->b - tab->a) / np;
+        int ok = 1;
+        for (size_t p = 0; p < np && ok; p++) {
+            const double lo = tab->a + p * h;
+            const double hi = p + 1 == np ? tab->b : lo + h;
+            fit(tab, lo, hi, PIECE_COEF, c + p * PIECE_COEF, fv);
+            ok = check(tab, lo, hi, PIECE_COEF, c + p * PIECE_COEF,
+                       PIECE_COEF) <= tol;
+        }
+        if (ok) {
+            tab->coef = c;
+            tab->ncoef = PIECE_COEF;
+            tab->npieces = np;
+            return 1;
+        }
+        free(c);
+    }
+    return 0;
+}
+
+func_table* new_func_table(table_method_t method, table_func_t f, void* ctx,
+                           double a, double b, double tol) {
+    if (method != TABLE_CHEBYSHEV && method != TABLE_PIECEWISE) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Unknown method @ new_func_table!\n");
+        return NULL;
+    }
+    if (!f || !(a < b) || !isfinite(b - a) || !(tol > 0.0)) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Invalid function, interval or tolerance @ "
+                    "new_func_table!\n");
+        return NULL;
+    }
+    func_table* tab = calloc(1, sizeof(func_table));
+    if (!tab) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate table @ new_func_table!\n");
+        return NULL;
+    }
+    tab->f = f;
+    tab->ctx = ctx;
+    tab->a = a;
+    tab->b = b;
+    const int found = method == TABLE_CHEBYSHEV ? build_chebyshev(tab, tol)
+                                                : build_piecewise(tab, tol);
+    if (!found) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Tolerance not reached with %s @ new_func_table!\n",
+                    table_names[method]);
+        free_func_table(tab);
+        return NULL;
+    }
+    tab->scale = tab->npieces / (b - a);
+    return tab;
+}
+
+void free_func_table(func_table* tab) {
+    if (!tab)
+        return;
+    free(tab->coef);
+    free(tab);
+}
+
+void func_table_shape(const func_table* tab, size_t* npieces, size_t* ncoef) {
+    if (npieces)
+        *npieces = tab->npieces;
+    if (ncoef)
+        *ncoef = tab->ncoef;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Evaluation                                */
+/*                                                                          */
+/****************************************************************************/
+
+/* piece of x and its coordinate in [-1, 1]; NaNs land in the first piece */
+static inline size_t locate(const func_table* tab, double x, double* t) {
+    double u = (x - tab->a) * tab->scale;
+    const double top = (double)tab->npieces;
+    u = u >= 0.0 ? u : 0.0;
+    u = u <= top ? u : top;
+    size_t p = (size_t)u;
+    p = p < tab->npieces ? p : tab->npieces - 1;
+    *t = 2.0 * (u - (double)p) - 1.0;
+    return p;
+}
+
+double func_table_eval(const func_table* tab, double x) {
+    if (!(x >= tab->a && x <= tab->b))
+        return tab->f(x, tab->ctx);
+    double t;
+    const size_t p = locate(tab, x, &t);
+    return clenshaw(tab->coef + p * tab->ncoef, tab->ncoef, t);
+}
+
+/*
+ * Evaluates up to BLOCK arguments, running the recurrence over the whole
+ * block one coefficient at a time so the inner loops vectorize; each
+ * argument reads its own piece's coefficients.
+ */
+static void eval_block(const func_table* tab, double* out, const double* in,
+                       size_t n) {
+    double t[BLOCK], b1[BLOCK], b2[BLOCK];
+    size_t off[BLOCK];
+    const size_t nc = tab->ncoef;
+    for (size_t e = 0; e < n; e++) {
+        off[e] = locate(tab, in[e], &t[e]) * nc;
+        b1[e] = 0.0;
+        b2[e] = 0.0;
+    }
+    for (size_t k = nc - 1; k > 0; k--)
+        for (size_t e = 0; e < n; e++) {
+            const double c = tab->coef[off[e] + k];
+            const double tmp = 2.0 * t[e] * b1[e] - b2[e] + c;
+            b2[e] = b1[e];
+            b1[e] = tmp;
+        }
+    for (size_t e = 0; e < n; e++) {
+        const double x = in[e];
+        out[e] = t[e] * b1[e] - b2[e] + tab->coef[off[e]];
+        if (!(x >= tab->a && x <= tab->b))
+            out[e] = tab->f(x, tab->ctx);
+    }
+}
+
+void __func_table_eval(const func_table* tab, double* out, const double* in,
+                       size_t n, size_t nout) {
+    if (n != nout) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "Unmatching vector lengths @ func_table_eval_vector!\n");
+        return;
+    }
+    const size_t nblock = (n + BLOCK - 1) / BLOCK;
+#pragma omp parallel for schedule(static) if (n >= SIMUTIL_PAR_MIN)
+    for (size_t blk = 0; blk < nblock; blk++) {
+        const size_t e0 = blk * BLOCK;
+        eval_block(tab, out + e0, in + e0, n - e0 < BLOCK ? n - e0 : BLOCK);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SIMUTIL_TABLE_H
+#define SIMUTIL_TABLE_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+
+typedef enum {
+    TABLE_CHEBYSHEV, /* one Chebyshev series over the whole range */
+    TABLE_PIECEWISE  /* equal intervals, each with a degree-7 Chebyshev fit */
+} table_method_t;
+
+/**
+ * @brief Scalar function to tabulate.
+ *
+ */
+typedef double (*table_func_t)(double x, void* ctx);
+
+/**
+ * @brief Opaque approximation of a scalar function over an interval. Holds
+ * the Chebyshev coefficients of every piece and the function itself, which
+ * is still called for arguments outside the interval.
+ *
+ */
+typedef struct func_table func_table;
+
+/**
+ * @brief Function to tabulate f over [a, b]. The approximation error, checked
+ * at points between the interpolation nodes, stays below
+ * tol * max(1, |f(x)|). TABLE_CHEBYSHEV suits functions smooth over the whole
+ * interval and uses up to 1024 terms; TABLE_PIECEWISE halves its intervals
+ * until the bound holds, up to 2^20 of them. Returns NULL if the bound
+ * cannot be met.
+ *
+ * @param method TABLE_CHEBYSHEV or TABLE_PIECEWISE
+ * @param f Function to tabulate, called serially while building
+ * @param ctx User data passed to 'f'
+ * @param a Lower end of the interval
+ * @param b Upper end of the interval
+ * @param tol Relative tolerance, absolute where |f| < 1
+ */
+SIMUTIL_API func_table* new_func_table(table_method_t method, table_func_t f,
+                                       void* ctx, double a, double b,
+                                       double tol);
+
+SIMUTIL_API void free_func_table(func_table* tab);
+
+/**
+ * @brief Function to evaluate a table at one point.
+ *
+ * @param tab Table
+ * @param x Argument; f is called directly outside [a, b]
+ */
+SIMUTIL_API double func_table_eval(const func_table* tab, double x);
+
+/**
+ * @brief Function to get the number of intervals and the number of
+ * Chebyshev coefficients per interval of a table.
+ *
+ * @param tab Table
+ * @param npieces Set to the number of intervals, or NULL
+ * @param ncoef Set to the coefficients per interval, or NULL
+ */
+SIMUTIL_API void func_table_shape(const func_table* tab, size_t* npieces,
+                                  size_t* ncoef);
+
+SIMUTIL_API void __func_table_eval(const func_table* tab, double* out,
+                                   const double* in, size_t n, size_t nout);
+
+/**
+ * @brief Macro to evaluate a table at every element of a vector, in
+ * vectorized blocks split across threads. 'out' may be 'in'.
+ *
+ * @param tab Table
+ * @param out 'vector(double)' as long as 'in'
+ * @param in 'vector(double)' of arguments
+ */
+#define func_table_eval_vector(tab, out, in)                                   \
+    __func_table_eval((tab), (double*)(out) + 1, (const double*)(in) + 1,      \
+                      (size_t)LENGTH(in), (size_t)LENGTH(out))
+
+#endif
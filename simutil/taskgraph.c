@@ -0,0 +1,318 @@
+#include "taskgraph.h"
+#include "error.h"
+#include "profile.h"
+#include <string.h>
+
+/* first capacity of the task and successor arrays */
+#define INIT_CAP 16
+
+typedef struct {
+    const char* name;
+    task_func_t fn;
+    void* ctx;
+    task_region* acc;
+    size_t nacc;
+    size_t* succ;
+    size_t nsucc;
+    size_t cap_succ;
+    size_t npred;
+    size_t pending;
+    unsigned long long start;
+    unsigned long long end;
+    size_t worker;
+} task;
+
+struct task_graph {
+    task* tasks;
+    size_t ntasks;
+    size_t cap;
+    unsigned long long start;
+    unsigned long long end;
+    size_t nworkers;
+};
+
+/* index of the calling thread among the workers of the current run */
+static _Thread_local size_t worker_id;
+
+task_graph* new_task_graph(void) {
+    task_graph* g = calloc(1, sizeof(task_graph));
+    if (!g)
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate graph @ new_task_graph!\n");
+    return g;
+}
+
+void free_task_graph(task_graph* g) {
+    if (!g)
+        return;
+    for (size_t t = 0; t < g->ntasks; t++) {
+        free(g->tasks[t].acc);
+        free(g->tasks[t].succ);
+    }
+    free(g->tasks);
+    free(g);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                               Dependencies                               */
+/*                                                                          */
+/****************************************************************************/
+
+static int overlap(const task_region* a, const task_region* b) {
+    if (a->base != b->base || !((a->mode | b->mode) & TASK_WRITE))
+        return 0;
+    for (int k = 0; k < 3; k++)
+        if (a->hi[k] < b->lo[k] || b->hi[k] < a->lo[k])
+            return 0;
+    return 1;
+}
+
+static int conflict(const task* a, const task* b) {
+    for (size_t i = 0; i < a->nacc; i++)
+        for (size_t j = 0; j < b->nacc; j++)
+            if (overlap(&a->acc[i], &b->acc[j]))
+                return 1;
+    return 0;
+}
+
+static int add_edge(task* from, size_t to) {
+    if (from->nsucc == from->cap_succ) {
+        const size_t cap = from->cap_succ ? 2 * from->cap_succ : INIT_CAP;
+        size_t* succ = realloc(from->succ, cap * sizeof(size_t));
+        if (!succ)
+            return 1;
+        from->succ = succ;
+        from->cap_succ = cap;
+    }
+    from->succ[from->nsucc++] = to;
+    return 0;
+}
+
+size_t __task_graph_add(task_graph* g, const char* name, task_func_t fn,
+                        void* ctx, const task_region* acc, size_t nacc) {
+    for (size_t i = 0; i < nacc; i++) {
+        const task_region* r = &acc[i];
+        if (r->mode < TASK_READ || r->mode > TASK_READWRITE ||
+            r->lo[0] > r->hi[0] || r->lo[1] > r->hi[1] ||
+            r->lo[2] > r->hi[2]) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Invalid region %zu of task '%s' @ task_add!\n", i,
+                        name ? name : "");
+            return SIZE_MAX;
+        }
+    }
+    if (g->ntasks == g->cap) {
+        const size_t cap = g->cap ? 2 * g->cap : INIT_CAP;
+        task* tasks = realloc(g->tasks, cap * sizeof(task));
+        if (!tasks)
+            goto fail;
+        g->tasks = tasks;
+        g->cap = cap;
+    }
+    task* t = &g->tasks[g->ntasks];
+    memset(t, 0, sizeof(task));
+    t->name = name ? name : "task";
+    t->fn = fn;
+    t->ctx = ctx;
+    if (!(t->acc = malloc(nacc * sizeof(task_region))))
+        goto fail;
+    memcpy(t->acc, acc, nacc * sizeof(task_region));
+    t->nacc = nacc;
+    const size_t id = g->ntasks;
+    for (size_t p = 0; p < id; p++)
+        if (conflict(&g->tasks[p], t)) {
+            if (add_edge(&g->tasks[p], id))
+                goto fail_edges;
+            t->npred++;
+        }
+    g->ntasks++;
+    return id;
+
+fail_edges:
+    /* edges to 'id' were appended last, so they can be taken back */
+    for (size_t p = 0; p < id; p++) {
+        task* q = &g->tasks[p];
+        if (q->nsucc && q->succ[q->nsucc - 1] == id)
+            q->nsucc--;
+    }
+    free(t->acc);
+fail:
+    raise_error(SIMUTIL_ALLOCATE_ERROR, "Failed to grow graph @ task_add!\n");
+    return SIZE_MAX;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                 Execution                                */
+/*                                                                          */
+/****************************************************************************/
+
+static void spawn(task_graph* g, size_t id);
+
+/* runs a task, then starts the successors it was the last to wait for */
+static void execute(task_graph* g, size_t id) {
+    task* t = &g->tasks[id];
+    t->worker = worker_id;
+    t->start = __simutil_prof_now();
+    t->fn(t->ctx);
+    t->end = __simutil_prof_now();
+    for (size_t i = 0; i < t->nsucc; i++) {
+        task* s = &g->tasks[t->succ[i]];
+        if (__atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL) == 0)
+            spawn(g, t->succ[i]);
+    }
+}
+
+static void spawn(task_graph* g, size_t id) {
+#pragma omp task
+    execute(g, id);
+}
+
+void task_graph_run(task_graph* g) {
+    for (size_t t = 0; t < g->ntasks; t++)
+        g->tasks[t].pending = g->tasks[t].npred;
+    g->nworkers = 0;
+    g->start = __simutil_prof_now();
+#pragma omp parallel
+    {
+        worker_id = __atomic_fetch_add(&g->nworkers, 1, __ATOMIC_RELAXED);
+#pragma omp barrier
+#pragma omp single
+        for (size_t t = 0; t < g->ntasks; t++)
+            if (g->tasks[t].npred == 0)
+                spawn(g, t);
+    }
+    g->end = __simutil_prof_now();
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Tracing                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Longest chain of dependent tasks by their durations in the last run.
+ * Tasks only depend on earlier ones, so one pass in order suffices. Sets
+ * 'prev' to the predecessor of every task on its longest chain and returns
+ * the last task of the critical path.
+ */
+static size_t critical_path(const task_graph* g, unsigned long long* len,
+                            size_t* prev) {
+    size_t last = SIZE_MAX;
+    unsigned long long best = 0;
+    for (size_t t = 0; t < g->ntasks; t++) {
+        len[t] = 0;
+        prev[t] = SIZE_MAX;
+    }
+    for (size_t t = 0; t < g->ntasks; t++) {
+        const task* k = &g->tasks[t];
+        const unsigned long long end = len[t] + (k->end - k->start);
+        for (size_t i = 0; i < k->nsucc; i++)
+            if (end > len[k->succ[i]] || prev[k->succ[i]] == SIZE_MAX) {
+                len[k->succ[i]] = end;
+                prev[k->succ[i]] = t;
+            }
+        len[t] = end;
+        if (last == SIZE_MAX || end > best) {
+            best = end;
+            last = t;
+        }
+    }
+    return last;
+}
+
+task_graph_stats task_graph_stats_of(const task_graph* g) {
+    task_graph_stats s = {0.0, 0.0, 0.0, g->nworkers};
+    if (g->ntasks == 0 || g->end == 0)
+        return s;
+    unsigned long long* len = malloc(g->ntasks * sizeof(unsigned long long));
+    size_t* prev = malloc(g->ntasks * sizeof(size_t));
+    if (!len || !prev) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "Failed to allocate path @ task_graph_stats_of!\n");
+        goto cleanup;
+    }
+    s.makespan = (g->end - g->start) * 1e-9;
+    for (size_t t = 0; t < g->ntasks; t++)
+        s.work += (g->tasks[t].end - g->tasks[t].start) * 1e-9;
+    s.critical_path = len[critical_path(g, len, prev)] * 1e-9;
+
+cleanup:
+    free(len);
+    free(prev);
+    return s;
+}
+
+/* writes a JSON string, escaping what JSON requires */
+static void put_string(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+/* events follow the metadata records, so each starts with a comma */
+static void put_event(FILE* fp, const task_graph* g, size_t id, int pid,
+                      size_t tid) {
+    const task* t = &g->tasks[id];
+    fprintf(fp, ",\n{\"name\":");
+    put_string(fp, t->name);
+    fprintf(fp,
+            ",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"task\":%zu,\"deps\":%zu}}",
+            pid, tid, (t->start - g->start) * 1e-3, (t->end - t->start) * 1e-3,
+            id, t->npred);
+}
+
+int task_graph_trace(const task_graph* g, const char* path) {
+    if (g->end == 0) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Graph has not been run @ task_graph_trace!\n");
+        return -1;
+    }
+    FILE* fp = fopen(path, "w");
+    unsigned long long* len = malloc((g->ntasks + 1) * sizeof(*len));
+    size_t* prev = malloc((g->ntasks + 1) * sizeof(size_t));
+    int status = -1;
+    if (!fp || !len || !prev) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Failed to open '%s' @ task_graph_trace!\n", path);
+        goto cleanup;
+    }
+    const task_graph_stats s = task_graph_stats_of(g);
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"otherData\":{"
+                "\"makespan_s\":%.9f,\"work_s\":%.9f,\"critical_path_s\":%.9f,"
+                "\"workers\":%zu,\"utilization\":%.4f,"
+                "\"critical_path_fraction\":%.4f},\n\"traceEvents\":[",
+            s.makespan, s.work, s.critical_path, s.nworkers,
+            s.makespan > 0.0 ? s.work / (s.makespan * s.nworkers) : 0.0,
+            s.makespan > 0.0 ? s.critical_path / s.makespan : 0.0);
+    fprintf(fp, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                "\"args\":{\"name\":\"workers\"}},"
+                "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"args\":{\"name\":\"critical path\"}}");
+    for (size_t t = 0; t < g->ntasks; t++)
+        put_event(fp, g, t, 0, g->tasks[t].worker);
+    if (g->ntasks)
+        for (size_t t = critical_path(g, len, prev); t != SIZE_MAX;
+             t = prev[t])
+            put_event(fp, g, t, 1, 0);
+    fprintf(fp, "\n]}\n");
+    status = ferror(fp) ? -1 : 0;
+
+cleanup:
+    if (fp && fclose(fp))
+        status = -1;
+    free(len);
+    free(prev);
+    return status;
+}
@@ -0,0 +1,173 @@
+#ifndef SIMUTIL_TASKGRAPH_H
+#define SIMUTIL_TASKGRAPH_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+#include <stdint.h>
+
+typedef enum {
+    TASK_READ = 1,
+    TASK_WRITE = 2,
+    TASK_READWRITE = 3
+} task_access_t;
+
+/**
+ * @brief Part of an object that a task reads or writes: an inclusive box of
+ * user indices (columns, rows, depth, from 1) in the object at 'base'.
+ * Build them with the task_* macros below.
+ *
+ */
+typedef struct {
+    const void* base;
+    size_t lo[3];
+    size_t hi[3];
+    task_access_t mode;
+} task_region;
+
+typedef void (*task_func_t)(void* ctx);
+
+/**
+ * @brief Opaque graph of tasks, kept between runs so that the same timestep
+ * can be executed again without rebuilding it.
+ *
+ */
+typedef struct task_graph task_graph;
+
+/**
+ * @brief Timing of the last run. 'work' is the sum of the task durations
+ * and 'critical_path' the longest chain of dependent tasks, both in seconds;
+ * work / (makespan * nworkers) is the utilization of the workers.
+ *
+ */
+typedef struct {
+    double makespan;
+    double work;
+    double critical_path;
+    size_t nworkers;
+} task_graph_stats;
+
+/**
+ * @brief Function to create an empty task graph.
+ *
+ */
+SIMUTIL_API task_graph* new_task_graph(void);
+
+SIMUTIL_API void free_task_graph(task_graph* g);
+
+SIMUTIL_API size_t __task_graph_add(task_graph* g, const char* name,
+                                    task_func_t fn, void* ctx,
+                                    const task_region* acc, size_t nacc);
+
+/**
+ * @brief Function to run every task of the graph once. Tasks start as soon
+ * as the tasks they depend on have finished and run concurrently on the
+ * OpenMP threads; simutil kernels called inside a task run on its thread.
+ * Returns when all tasks are done.
+ *
+ * @param g Task graph
+ */
+SIMUTIL_API void task_graph_run(task_graph* g);
+
+/**
+ * @brief Function to get the timing of the last run.
+ *
+ * @param g Task graph
+ */
+SIMUTIL_API task_graph_stats task_graph_stats_of(const task_graph* g);
+
+/**
+ * @brief Function to write the last run as a Chrome trace ('chrome://tracing'
+ * or Perfetto): one track per worker and a track of the critical path.
+ * Returns 0 on success.
+ *
+ * @param g Task graph
+ * @param path File to write
+ */
+SIMUTIL_API int task_graph_trace(const task_graph* g, const char* path);
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Access Sets                               */
+/*                                                                          */
+/****************************************************************************/
+
+#define __TASK_REGION(base, c0, c1, r0, r1, d0, d1, mode)                      \
+    ((task_region){(const void*)(base),                                        \
+                   {(size_t)(c0), (size_t)(r0), (size_t)(d0)},                 \
+                   {(size_t)(c1), (size_t)(r1), (size_t)(d1)},                 \
+                   (mode)})
+
+/**
+ * @brief Macro for a whole object of any kind, e.g. a container or a FILE*.
+ *
+ * @param obj Pointer identifying the object
+ * @param mode TASK_READ, TASK_WRITE or TASK_READWRITE
+ */
+#define task_object(obj, mode)                                                 \
+    __TASK_REGION((obj), 1, SIZE_MAX, 1, SIZE_MAX, 1, SIZE_MAX, (mode))
+
+#define task_vector(vec, mode) task_object((vec), (mode))
+#define task_matrix(mat, mode) task_object((mat), (mode))
+#define task_matrix3(mat3, mode) task_object((mat3), (mode))
+
+/**
+ * @brief Macro for the elements lo to hi of a vector.
+ *
+ * @param vec Vector
+ * @param lo First element, from 1
+ * @param hi Last element, included
+ * @param mode TASK_READ, TASK_WRITE or TASK_READWRITE
+ */
+#define task_vector_range(vec, lo, hi, mode)                                   \
+    __TASK_REGION((vec), (lo), (hi), 1, 1, 1, 1, (mode))
+
+/**
+ * @brief Macro for a slice of a matrix, with the bounds of ELEM_OPER_SLICE.
+ *
+ * @param mat Matrix
+ * @param left First column
+ * @param right Last column, included
+ * @param up First row
+ * @param down Last row, included
+ * @param mode TASK_READ, TASK_WRITE or TASK_READWRITE
+ */
+#define task_matrix_slice(mat, left, right, up, down, mode)                    \
+    __TASK_REGION((mat), (left), (right), (up), (down), 1, 1, (mode))
+
+/**
+ * @brief Macro for a box of a matrix3.
+ *
+ * @param mat3 Matrix3
+ * @param c0, c1 First and last column
+ * @param r0, r1 First and last row
+ * @param d0, d1 First and last depth
+ * @param mode TASK_READ, TASK_WRITE or TASK_READWRITE
+ */
+#define task_matrix3_box(mat3, c0, c1, r0, r1, d0, d1, mode)                   \
+    __TASK_REGION((mat3), (c0), (c1), (r0), (r1), (d0), (d1), (mode))
+
+/**
+ * @brief Macro to append a task to a graph. It depends on every earlier task
+ * with an overlapping region when either of the two writes it, so tasks run
+ * as if in the order they were added. Returns the task's index as a size_t.
+ *
+ * @param g Task graph
+ * @param name Name shown in traces, kept by reference
+ * @param fn Function run by the task
+ * @param ctx Argument passed to 'fn'
+ * @param ... One or more regions from the task_* macros
+ */
+#define task_add(g, name, fn, ctx, ...)                                        \
+    __task_graph_add((g), (name), (fn), (ctx),                                 \
+                     (const task_region[]){__VA_ARGS__},                       \
+                     sizeof((const task_region[]){__VA_ARGS__}) /              \
+                         sizeof(task_region))
+
+#endif
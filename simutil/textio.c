@@ -0,0 +1,664 @@
+#include "textio.h"
+#include "error.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* bytes of input per parsing chunk, so small files stay on one thread */
+#define CHUNK_BYTES ((size_t)1 << 20)
+
+/* largest number of chunks, whatever the size of the file */
+#define MAX_CHUNKS 4096
+
+/* longest token handed to strtod when the fast path does not apply */
+#define MAX_TOKEN 128
+
+/*
+ * 'runs' holds pairs (first row, its line): rows of a run sit on
+ * consecutive lines, so errors found after parsing can name the line.
+ */
+struct text_table {
+    double* values;
+    size_t ncols;
+    size_t nrows;
+    size_t ndeps;
+    size_t* runs;
+    size_t nruns;
+    size_t cap_runs;
+};
+
+/* kinds of lines recorded while parsing */
+enum { LINE_ROW, LINE_BLANK, LINE_OTHER };
+
+typedef struct {
+    size_t nv;
+    unsigned char kind;
+    unsigned char closes;
+} line_rec;
+
+/* output of one chunk: its values and one record per line */
+typedef struct {
+    const char* begin;
+    const char* end;
+    double* values;
+    size_t nvalues;
+    size_t cap_values;
+    size_t offset;
+    line_rec* lines;
+    size_t nlines;
+    size_t cap_lines;
+    size_t bad_line;
+    int status;
+} chunk;
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Numbers                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/* characters that end a token: separators, brackets and line ends */
+static const unsigned char is_delim[256] = {
+    [' '] = 1, ['\t'] = 1, [','] = 1, [';'] = 1, ['\r'] = 1,
+    ['\n'] = 1, ['['] = 1, [']'] = 1, ['\v'] = 1, ['\f'] = 1};
+
+/* powers of ten that doubles hold exactly */
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static int parse_slow(const char* p, size_t len, double* out) {
+    char buf[MAX_TOKEN];
+    char* stop;
+    if (len >= MAX_TOKEN)
+        return 1;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    *out = strtod(buf, &stop);
+    return stop != buf + len;
+}
+
+/*
+ * Parses the token [p, q). Decimal numbers with at most 19 significant
+ * digits whose mantissa and power of ten are exact in a double take one
+ * correctly rounded multiply or divide; the rest go to strtod.
+ */
+static int parse_number(const char* p, const char* q, double* out) {
+    const char* s = p;
+    int neg = 0, ndig = 0, exp10 = 0, any = 0;
+    uint64_t m = 0;
+    if (s < q && (*s == '-' || *s == '+'))
+        neg = *s++ == '-';
+    for (; s < q && (unsigned)(*s - '0') < 10; s++, any = 1) {
+        if (ndig < 19) {
+            m = 10 * m + (uint64_t)(*s - '0');
+            ndig += m != 0;
+        } else
+            exp10++;
+    }
+    if (s < q && *s == '.')
+        for (s++; s < q && (unsigned)(*s - '0') < 10; s++, any = 1)
+            if (ndig < 19) {
+                m = 10 * m + (uint64_t)(*s - '0');
+                ndig += m != 0;
+                exp10--;
+            }
+    if (any && s < q && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        int eneg = 0, ev = 0;
+        if (e < q && (*e == '-' || *e == '+'))
+            eneg = *e++ == '-';
+        if (e < q && (unsigned)(*e - '0') < 10) {
+            for (; e < q && (unsigned)(*e - '0') < 10; e++)
+                ev = ev < 10000 ? 10 * ev + (*e - '0') : ev;
+            exp10 += eneg ? -ev : ev;
+            s = e;
+        }
+    }
+    if (!any || s != q)
+        return parse_slow(p, (size_t)(q - p), out);
+    if (m == 0) {
+        *out = neg ? -0.0 : 0.0;
+        return 0;
+    }
+    if (m > ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22)
+        return parse_slow(p, (size_t)(q - p), out);
+    const double v = exp10 < 0 ? (double)m / pow10_exact[-exp10]
+                               : (double)m * pow10_exact[exp10];
+    *out = neg ? -v : v;
+    return 0;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Parsing                                 */
+/*                                                                          */
+/****************************************************************************/
+
+static int push_value(chunk* c, double v) {
+    if (c->nvalues == c->cap_values) {
+        const size_t cap = c->cap_values ? 2 * c->cap_values : 1024;
+        double* values = realloc(c->values, cap * sizeof(double));
+        if (!values)
+            return 1;
+        c->values = values;
+        c->cap_values = cap;
+    }
+    c->values[c->nvalues++] = v;
+    return 0;
+}
+
+static int push_line(chunk* c, size_t nv, int kind, size_t closes) {
+    if (c->nlines == c->cap_lines) {
+        const size_t cap = c->cap_lines ? 2 * c->cap_lines : 256;
+        line_rec* lines = realloc(c->lines, cap * sizeof(line_rec));
+        if (!lines)
+            return 1;
+        c->lines = lines;
+        c->cap_lines = cap;
+    }
+    c->lines[c->nlines].nv = nv;
+    c->lines[c->nlines].kind = (unsigned char)kind;
+    c->lines[c->nlines].closes = (unsigned char)(closes < 255 ? closes : 255);
+    c->nlines++;
+    return 0;
+}
+
+/*
+ * Parses whole lines from c->begin to c->end, recording the values of
+ * every line and how many brackets it closes. Sets c->status to 1 on a
+ * malformed number, with c->bad_line the line within the chunk, or to 2
+ * when out of memory.
+ */
+static void parse_chunk(chunk* c) {
+    const char* p = c->begin;
+    const char* const end = c->end;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        eol = eol ? eol : end;
+        size_t nv = 0, closes = 0;
+        int other = 0;
+        while (p < eol) {
+            const unsigned char ch = (unsigned char)*p;
+            if (is_delim[ch]) {
+                closes += ch == ']';
+                other |= ch == '[' || ch == ']';
+                p++;
+                continue;
+            }
+            if (ch == '#' && nv == 0) {
+                other = 1;
+                p = eol;
+                break;
+            }
+            const char* q = p + 1;
+            while (q < eol && !is_delim[(unsigned char)*q])
+                q++;
+            double v;
+            if (parse_number(p, q, &v)) {
+                c->status = 1;
+                c->bad_line = c->nlines;
+                return;
+            }
+            if (push_value(c, v)) {
+                c->status = 2;
+                return;
+            }
+            nv++;
+            p = q;
+        }
+        const int kind = nv ? LINE_ROW : other ? LINE_OTHER : LINE_BLANK;
+        if (push_line(c, nv, kind, closes)) {
+            c->status = 2;
+            return;
+        }
+        p = eol + 1;
+    }
+}
+
+/* parses the single line at p, returning 1 if it is not all numbers */
+static int is_header(const char* p, const char* end) {
+    const char* eol = memchr(p, '\n', (size_t)(end - p));
+    chunk c;
+    memset(&c, 0, sizeof(chunk));
+    c.begin = p;
+    c.end = eol ? eol : end;
+    parse_chunk(&c);
+    free(c.values);
+    free(c.lines);
+    return c.status == 1;
+}
+
+static int push_run(text_table* t, size_t row, size_t line) {
+    if (t->nruns == t->cap_runs) {
+        const size_t cap = t->cap_runs ? 2 * t->cap_runs : 16;
+        size_t* runs = realloc(t->runs, 2 * cap * sizeof(size_t));
+        if (!runs)
+            return 1;
+        t->runs = runs;
+        t->cap_runs = cap;
+    }
+    t->runs[2 * t->nruns] = row;
+    t->runs[2 * t->nruns + 1] = line;
+    t->nruns++;
+    return 0;
+}
+
+/* line of the 0-based row, from the last run starting at or before it */
+static size_t line_of(const text_table* t, size_t row) {
+    size_t lo = 0, hi = t->nruns;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (t->runs[2 * mid] <= row)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return t->runs[2 * lo + 1] + (row - t->runs[2 * lo]);
+}
+
+/*
+ * Shapes the line records into rows of equal length grouped in depth
+ * slices of equal height. CSV slices are separated by blank lines; in the
+ * bracketed format, which nests 'rank' levels deep, a row closing two
+ * brackets ends a slice of a matrix3.
+ */
+static int shape(text_table* t, const chunk* chunks, size_t nchunks,
+                 int rank, size_t first_line) {
+    size_t line = first_line, rows = 0, slice = 0, last = 0;
+    t->ncols = t->nrows = t->ndeps = 0;
+    for (size_t c = 0; c < nchunks; c++)
+        for (size_t l = 0; l < chunks[c].nlines; l++) {
+            const line_rec* r = &chunks[c].lines[l];
+            line++;
+            int ends = 0;
+            if (r->kind == LINE_ROW) {
+                if (t->ncols == 0)
+                    t->ncols = r->nv;
+                if (r->nv != t->ncols) {
+                    raise_error(SIMUTIL_DIMENSION_ERROR,
+                                "Line %zu has %zu values instead of %zu @ "
+                                "read_text!\n",
+                                line, r->nv, t->ncols);
+                    return 1;
+                }
+                if ((rows == 0 || line != last + 1) &&
+                    push_run(t, rows, line)) {
+                    raise_error(SIMUTIL_ALLOCATE_ERROR,
+                                "Failed to allocate while shaping @ "
+                                "read_text!\n");
+                    return 1;
+                }
+                last = line;
+                rows++;
+                slice++;
+                ends = rank == 3 && r->closes >= 2;
+            } else
+                ends = rank == 0 && r->kind == LINE_BLANK;
+            if (ends && slice) {
+                if (t->ndeps && slice != t->nrows) {
+                    raise_error(SIMUTIL_DIMENSION_ERROR,
+                                "Slice ending on line %zu has %zu rows "
+                                "instead of %zu @ read_text!\n",
+                                line, slice, t->nrows);
+                    return 1;
+                }
+                t->nrows = slice;
+                t->ndeps++;
+                slice = 0;
+            }
+        }
+    if (slice) {
+        if (t->ndeps && slice != t->nrows) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "Last slice has %zu rows instead of %zu @ "
+                        "read_text!\n",
+                        slice, t->nrows);
+            return 1;
+        }
+        t->nrows = slice;
+        t->ndeps++;
+    }
+    if (rows == 0) {
+        raise_error(SIMUTIL_DIMENSION_ERROR, "No values @ read_text!\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* reads the file into memory, mapped when possible */
+static char* map_file(const char* path, size_t* size, int* mapped) {
+    struct stat st;
+    char* data = NULL;
+    const int fd = open(path, O_RDONLY);
+    *mapped = 0;
+    if (fd < 0 || fstat(fd, &st) || st.st_size <= 0)
+        goto cleanup;
+    *size = (size_t)st.st_size;
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        madvise(data, *size, MADV_SEQUENTIAL | MADV_WILLNEED);
+        *mapped = 1;
+        goto cleanup;
+    }
+    if ((data = malloc(*size))) {
+        size_t got = 0;
+        ssize_t n = 1;
+        while (got < *size && (n = read(fd, data + got, *size - got)) > 0)
+            got += (size_t)n;
+        if (got != *size) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+cleanup:
+    if (fd >= 0)
+        close(fd);
+    return data;
+}
+
+text_table* read_text(const char* path) {
+    size_t size = 0;
+    int mapped;
+    char* data = map_file(path, &size, &mapped);
+    if (!data) {
+        raise_error(SIMUTIL_DEFAULT_ERROR,
+                    "Failed to read '%s' or file empty @ read_text!\n", path);
+        return NULL;
+    }
+    const char* const end = data + size;
+    text_table* t = calloc(1, sizeof(text_table));
+    chunk* chunks = NULL;
+    size_t nchunks = 0;
+    int failed = 1;
+    if (!t)
+        goto fail_alloc;
+
+    /* the format and nesting depth come from the leading brackets */
+    const char* p = data;
+    int rank = 0;
+    size_t first_line = 0;
+    while (p < end && (is_delim[(unsigned char)*p] || *p == '['))
+        if (*p++ == '[')
+            rank++;
+    if (rank > 3) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "'%s' is nested %d levels deep @ read_text!\n", path,
+                    rank);
+        goto cleanup;
+    }
+    p = data;
+    if (rank == 0) {
+        /* skip a header line, after any comments */
+        const char* line = p;
+        while (line < end) {
+            const char* s = line;
+            while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+                s++;
+            if (s < end && *s != '#' && *s != '\n')
+                break;
+            const char* eol = memchr(line, '\n', (size_t)(end - line));
+            line = eol ? eol + 1 : end;
+            first_line++;
+        }
+        if (line < end && is_header(line, end)) {
+            const char* eol = memchr(line, '\n', (size_t)(end - line));
+            p = eol ? eol + 1 : end;
+            first_line++;
+        } else
+            first_line = 0;
+    }
+
+    /* chunks of whole lines */
+    nchunks = (size_t)(end - p) / CHUNK_BYTES + 1;
+    nchunks = nchunks < MAX_CHUNKS ? nchunks : MAX_CHUNKS;
+    if (!(chunks = calloc(nchunks, sizeof(chunk))))
+        goto fail_alloc;
+    const char* start = p;
+    for (size_t c = 0; c < nchunks; c++) {
+        const char* stop = c + 1 == nchunks
+                               ? end
+                               : p + (size_t)(end - p) / nchunks * (c + 1);
+        if (stop < start)
+            stop = start;
+        else if (stop < end) {
+            const char* eol = memchr(stop, '\n', (size_t)(end - stop));
+            stop = eol ? eol + 1 : end;
+        }
+        chunks[c].begin = start;
+        chunks[c].end = stop;
+        start = stop;
+    }
+#pragma omp parallel for schedule(dynamic, 1) if (nchunks > 1)
+    for (size_t c = 0; c < nchunks; c++)
+        parse_chunk(&chunks[c]);
+
+    size_t line = first_line, nvalues = 0;
+    for (size_t c = 0; c < nchunks; c++) {
+        if (chunks[c].status == 1) {
+            raise_error(SIMUTIL_TYPE_ERROR,
+                        "Invalid number on line %zu of '%s' @ read_text!\n",
+                        line + chunks[c].bad_line + 1, path);
+            goto cleanup;
+        }
+        if (chunks[c].status == 2)
+            goto fail_alloc;
+        line += chunks[c].nlines;
+        chunks[c].offset = nvalues;
+        nvalues += chunks[c].nvalues;
+    }
+    if (shape(t, chunks, nchunks, rank, first_line))
+        goto cleanup;
+    if (!(t->values = malloc(nvalues * sizeof(double))))
+        goto fail_alloc;
+#pragma omp parallel for schedule(dynamic, 1) if (nchunks > 1)
+    for (size_t c = 0; c < nchunks; c++)
+        if (chunks[c].nvalues)
+            memcpy(t->values + chunks[c].offset, chunks[c].values,
+                   chunks[c].nvalues * sizeof(double));
+    failed = 0;
+    goto cleanup;
+
+fail_alloc:
+    raise_error(SIMUTIL_ALLOCATE_ERROR,
+                "Failed to allocate while parsing '%s' @ read_text!\n", path);
+cleanup:
+    for (size_t c = 0; c < nchunks; c++) {
+        free(chunks[c].values);
+        free(chunks[c].lines);
+    }
+    free(chunks);
+    if (mapped)
+        munmap(data, size);
+    else
+        free(data);
+    if (failed) {
+        free_text_table(t);
+        return NULL;
+    }
+    return t;
+}
+
+void free_text_table(text_table* t) {
+    if (!t)
+        return;
+    free(t->values);
+    free(t->runs);
+    free(t);
+}
+
+void text_table_shape(const text_table* t, size_t* ncols, size_t* nrows,
+                      size_t* ndeps) {
+    if (ncols)
+        *ncols = t->ncols;
+    if (nrows)
+        *nrows = t->nrows;
+    if (ndeps)
+        *ndeps = t->ndeps;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                                Containers                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Values an integer element type holds: [lo, hi), with hi one past its
+ * largest value, which doubles represent exactly. Returns 0 for floating
+ * point types, which take any value.
+ */
+static int int_range(text_elem_t elem, double* lo, double* hi) {
+    switch (elem) {
+    case TEXT_INT:
+        *lo = (double)INT_MIN;
+        *hi = (double)INT_MAX + 1.0;
+        return 1;
+    case TEXT_UINT:
+        *lo = 0.0;
+        *hi = (double)UINT_MAX + 1.0;
+        return 1;
+    case TEXT_LONG:
+        *lo = (double)LONG_MIN;
+        *hi = -(double)LONG_MIN;
+        return 1;
+    case TEXT_ULONG:
+        *lo = 0.0;
+        *hi = 2.0 * ((double)(ULONG_MAX / 2) + 1.0);
+        return 1;
+    case TEXT_SHORT:
+        *lo = (double)SHRT_MIN;
+        *hi = (double)SHRT_MAX + 1.0;
+        return 1;
+    case TEXT_USHORT:
+        *lo = 0.0;
+        *hi = (double)USHRT_MAX + 1.0;
+        return 1;
+    case TEXT_UCHAR:
+        *lo = 0.0;
+        *hi = (double)UCHAR_MAX + 1.0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Reports the first value that an integer element type cannot hold exactly,
+ * as converting it would be undefined or lose its fraction.
+ */
+static int check_values(const text_table* t, text_elem_t elem,
+                        const char* name) {
+    double lo, hi;
+    if (!int_range(elem, &lo, &hi))
+        return 0;
+    const double* v = t->values;
+    const size_t n = t->ncols * t->nrows * t->ndeps;
+    size_t bad = n;
+#pragma omp parallel for schedule(static) reduction(min : bad)                 \
+    if (n >= SIMUTIL_PAR_MIN)
+    for (size_t i = 0; i < n; i++)
+        if (!(v[i] >= lo && v[i] < hi && v[i] == floor(v[i])) && i < bad)
+            bad = i;
+    if (bad == n)
+        return 0;
+    raise_error(SIMUTIL_TYPE_ERROR,
+                "Value %.17g on line %zu, column %zu does not fit the element "
+                "type @ %s!\n",
+                v[bad], line_of(t, bad / t->ncols), bad % t->ncols + 1, name);
+    return 1;
+}
+
+int __text_table_dims(const text_table* t, int rank, text_elem_t elem,
+                      size_t* dims, const char* name) {
+    if ((unsigned)elem >= TEXT_UNKNOWN) {
+        raise_error(SIMUTIL_TYPE_ERROR, "Unsupported element type @ %s!\n",
+                    name);
+        return 1;
+    }
+    if (rank == 1) {
+        if (t->ndeps != 1 || (t->ncols != 1 && t->nrows != 1)) {
+            raise_error(SIMUTIL_DIMENSION_ERROR,
+                        "File holds %zux%zux%zu values, not a single row or "
+                        "column @ %s!\n",
+                        t->ncols, t->nrows, t->ndeps, name);
+            return 1;
+        }
+        dims[0] = t->ncols * t->nrows;
+        dims[1] = dims[2] = 1;
+        return check_values(t, elem, name);
+    }
+    if (rank == 2 && t->ndeps != 1) {
+        raise_error(SIMUTIL_DIMENSION_ERROR,
+                    "File holds %zu slices, not a matrix @ %s!\n", t->ndeps,
+                    name);
+        return 1;
+    }
+    dims[0] = t->ncols;
+    dims[1] = t->nrows;
+    dims[2] = t->ndeps;
+    return check_values(t, elem, name);
+}
+
+/*
+ * Value (i, j, k) of the file, zero-based column, row and slice, is
+ * src[(k * nrows + j) * ncols + i]. Destination lines are filled one after
+ * another from the strided source. __text_table_dims has checked that every
+ * value converts to T.
+ */
+#define COPY_CASE(E, T)                                                        \
+    case E: {                                                                  \
+        if (rank == 1) {                                                       \
+            T* out = dst;                                                      \
+            for (size_t i = 0; i < ext[0]; i++)                                \
+                out[i] = (T)src[i];                                            \
+        } else if (rank == 2) {                                                \
+            T** out = dst;                                                     \
+            _Pragma("omp parallel for schedule(static) if (par)")              \
+            for (size_t a = 1; a <= ext[0]; a++)                               \
+                for (size_t b = 1; b <= ext[1]; b++)                           \
+                    out[a][b] = (T)src[lines_are_cols                          \
+                                          ? (b - 1) * ncols + (a - 1)          \
+                                          : (a - 1) * ncols + (b - 1)];        \
+        } else {                                                               \
+            T*** out = dst;                                                    \
+            _Pragma("omp parallel for schedule(static) if (par)")              \
+            for (size_t a = 1; a <= ext[0]; a++)                               \
+                for (size_t b = 1; b <= ext[1]; b++) {                         \
+                    const size_t i = lines_are_cols ? a - 1 : b - 1;           \
+                    const size_t j = lines_are_cols ? b - 1 : a - 1;           \
+                    for (size_t k = 0; k < ext[2]; k++)                        \
+                        out[a][b][k + 1] =                                     \
+                            (T)src[(k * nrows + j) * ncols + i];               \
+                }                                                              \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+void __text_table_copy(const text_table* t, void* dst, const size_t* ext,
+                       int rank, int lines_are_cols, text_elem_t elem) {
+    const double* src = t->values;
+    const size_t ncols = t->ncols, nrows = t->nrows;
+    const int par = t->ncols * t->nrows * t->ndeps >= SIMUTIL_PAR_MIN;
+    switch (elem) {
+        COPY_CASE(TEXT_DOUBLE, double)
+        COPY_CASE(TEXT_FLOAT, float)
+        COPY_CASE(TEXT_LONG_DOUBLE, long double)
+        COPY_CASE(TEXT_INT, int)
+        COPY_CASE(TEXT_UINT, unsigned int)
+        COPY_CASE(TEXT_LONG, long)
+        COPY_CASE(TEXT_ULONG, unsigned long)
+        COPY_CASE(TEXT_SHORT, short)
+        COPY_CASE(TEXT_USHORT, unsigned short)
+        COPY_CASE(TEXT_UCHAR, unsigned char)
+    default:
+        raise_error(SIMUTIL_TYPE_ERROR,
+                    "Unsupported element type @ __text_table_copy!\n");
+    }
+}
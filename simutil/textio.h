@@ -0,0 +1,170 @@
+#ifndef SIMUTIL_TEXTIO_H
+#define SIMUTIL_TEXTIO_H
+
+#ifndef SIMUTIL_VECTOR_BASE_H
+#include "vector_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/*
+ * Element types the loaders can fill. Values are parsed as double and
+ * converted, so integers are exact up to 2^53. Integer types only take
+ * whole numbers within their range.
+ */
+typedef enum {
+    TEXT_DOUBLE,
+    TEXT_FLOAT,
+    TEXT_LONG_DOUBLE,
+    TEXT_INT,
+    TEXT_UINT,
+    TEXT_LONG,
+    TEXT_ULONG,
+    TEXT_SHORT,
+    TEXT_USHORT,
+    TEXT_UCHAR,
+    TEXT_UNKNOWN
+} text_elem_t;
+
+/**
+ * @brief Opaque parsed text file: its values, as doubles, and its shape.
+ *
+ */
+typedef struct text_table text_table;
+
+/**
+ * @brief Function to parse a text file of numbers. Files starting with '['
+ * are read in the format of the fprint_* functions, nested one to three
+ * levels deep. Any other file is read as CSV or whitespace-separated
+ * columns, one row per line, where blank lines separate the depth slices of
+ * a matrix3, lines starting with '#' are skipped and a first line that is
+ * not numeric is taken as a header. Large files are parsed in chunks across
+ * threads. Returns NULL on error, with the offending line reported.
+ *
+ * @param path File to read
+ */
+SIMUTIL_API text_table* read_text(const char* path);
+
+SIMUTIL_API void free_text_table(text_table* t);
+
+/**
+ * @brief Function to get the shape of a parsed file.
+ *
+ * @param t Parsed file
+ * @param ncols Set to the values per row, or NULL
+ * @param nrows Set to the rows per depth slice, or NULL
+ * @param ndeps Set to the number of depth slices, or NULL
+ */
+SIMUTIL_API void text_table_shape(const text_table* t, size_t* ncols,
+                                  size_t* nrows, size_t* ndeps);
+
+SIMUTIL_API int __text_table_dims(const text_table* t, int rank,
+                                  text_elem_t elem, size_t* dims,
+                                  const char* name);
+
+SIMUTIL_API void __text_table_copy(const text_table* t, void* dst,
+                                   const size_t* ext, int rank,
+                                   int lines_are_cols, text_elem_t elem);
+
+#define __TEXT_ELEM(x)                                                         \
+    _Generic((x),                                                              \
+        double: TEXT_DOUBLE,                                                   \
+        float: TEXT_FLOAT,                                                     \
+        long double: TEXT_LONG_DOUBLE,                                         \
+        int: TEXT_INT,                                                         \
+        unsigned int: TEXT_UINT,                                               \
+        long: TEXT_LONG,                                                       \
+        unsigned long: TEXT_ULONG,                                             \
+        short: TEXT_SHORT,                                                     \
+        unsigned short: TEXT_USHORT,                                           \
+        unsigned char: TEXT_UCHAR,                                             \
+        default: TEXT_UNKNOWN)
+
+/****************************************************************************/
+/*                                                                          */
+/*                                  Loading                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to load a vector from a file holding a single row or a
+ * single column, e.g. written by fprint_vector. 'vec' is assigned a new
+ * vector, or NULL on error.
+ *
+ * @param vec 'vector(T)' variable to assign, T one of text_elem_t
+ * @param path File to read
+ */
+#define load_vector(vec, path)                                                 \
+    do {                                                                       \
+        size_t load_dims[3];                                                   \
+        text_table* load_t = read_text(path);                                  \
+        (vec) = NULL;                                                          \
+        if (load_t &&                                                          \
+            !__text_table_dims(load_t, 1, __TEXT_ELEM(*(vec)), load_dims,      \
+                               "load_vector")) {                               \
+            (vec) = new_vector(__typeof__(*(vec)), load_dims[0]);              \
+            __text_table_copy(load_t, (void*)((vec) + 1), load_dims, 1, 0,     \
+                              __TEXT_ELEM(*(vec)));                            \
+        }                                                                      \
+        free_text_table(load_t);                                               \
+    } while (0)
+
+/**
+ * @brief Macro to load a matrix, one row per line, e.g. written by
+ * fprint_matrix. 'mat' is assigned a new matrix, or NULL on error.
+ *
+ * @param mat 'matrix(T)' variable to assign, T one of text_elem_t
+ * @param path File to read
+ */
+#define load_matrix(mat, path)                                                 \
+    do {                                                                       \
+        size_t load_dims[3];                                                   \
+        text_table* load_t = read_text(path);                                  \
+        (mat) = NULL;                                                          \
+        if (load_t &&                                                          \
+            !__text_table_dims(load_t, 2, __TEXT_ELEM(**(mat)), load_dims,     \
+                               "load_matrix")) {                               \
+            (mat) = new_matrix(__typeof__(**(mat)), load_dims[0],              \
+                               load_dims[1]);                                  \
+            const size_t load_ext[3] = {(size_t)MATRIX_NLINES(mat),            \
+                                        (size_t)MATRIX_LINELEN(mat), 1};       \
+            __text_table_copy(load_t, (void*)(mat), load_ext, 2,               \
+                              __SIMUTIL_LINES_ARE_COLS,                        \
+                              __TEXT_ELEM(**(mat)));                           \
+        }                                                                      \
+        free_text_table(load_t);                                               \
+    } while (0)
+
+/**
+ * @brief Macro to load a matrix3, e.g. written by fprint_matrix3. In CSV
+ * files, blank lines separate the depth slices. 'mat3' is assigned a new
+ * matrix3, or NULL on error.
+ *
+ * @param mat3 'matrix3(T)' variable to assign, T one of text_elem_t
+ * @param path File to read
+ */
+#define load_matrix3(mat3, path)                                               \
+    do {                                                                       \
+        size_t load_dims[3];                                                   \
+        text_table* load_t = read_text(path);                                  \
+        (mat3) = NULL;                                                         \
+        if (load_t &&                                                          \
+            !__text_table_dims(load_t, 3, __TEXT_ELEM(***(mat3)), load_dims,   \
+                               "load_matrix3")) {                              \
+            (mat3) = new_matrix3(__typeof__(***(mat3)), load_dims[0],          \
+                                 load_dims[1], load_dims[2]);                  \
+            const size_t load_ext[3] = {(size_t)MATRIX3_EXT1(mat3),            \
+                                        (size_t)MATRIX3_EXT2(mat3),            \
+                                        (size_t)MATRIX3_EXT3(mat3)};           \
+            __text_table_copy(load_t, (void*)(mat3), load_ext, 3,              \
+                              __SIMUTIL_LINES_ARE_COLS,                        \
+                              __TEXT_ELEM(***(mat3)));                         \
+        }                                                                      \
+        free_text_table(load_t);                                               \
+    } while (0)
+
+#endif
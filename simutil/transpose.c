@@ -0,0 +1,353 @@
+#include "transpose.h"
+#include "error.h"
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE__
+#include <immintrin.h>
+#endif
+
+/* tile edge used for cache blocking, in elements */
+#define TILE 32
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Micro Kernels                               */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * The kernels below work on tile-relative line tables: 's[i]' points to the
+ * first element of row i of the source tile and 'd[j]' to the first element
+ * of row j of the target tile, so that 'd[j][i] = s[i][j]'.
+ */
+
+#ifdef __AVX__
+/* 4x4 block of 8-byte elements */
+static inline void kernel4x4_8(char* const* d, char* const* s, size_t i,
+                               size_t j) {
+    __m256d r0 = _mm256_loadu_pd((const double*)(s[i + 0] + j * 8));
+    __m256d r1 = _mm256_loadu_pd((const double*)(s[i + 1] + j * 8));
+    __m256d r2 = _mm256_loadu_pd((const double*)(s[i + 2] + j * 8));
+    __m256d r3 = _mm256_loadu_pd((const double*)(s[i + 3] + j * 8));
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+    _mm256_storeu_pd((double*)(d[j + 0] + i * 8),
+                     _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd((double*)(d[j + 1] + i * 8),
+                     _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd((double*)(d[j + 2] + i * 8),
+                     _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd((double*)(d[j + 3] + i * 8),
+                     _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+#endif
+
+#ifdef __SSE__
+/* 4x4 block of 4-byte elements */
+static inline void kernel4x4_4(char* const* d, char* const* s, size_t i,
+                               size_t j) {
+    __m128 r0 = _mm_loadu_ps((const float*)(s[i + 0] + j * 4));
+    __m128 r1 = _mm_loadu_ps((const float*)(s[i + 1] + j * 4));
+    __m128 r2 = _mm_loadu_ps((const float*)(s[i + 2] + j * 4));
+    __m128 r3 = _mm_loadu_ps((const float*)(s[i + 3] + j * 4));
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps((float*)(d[j + 0] + i * 4), r0);
+    _mm_storeu_ps((float*)(d[j + 1] + i * 4), r1);
+    _mm_storeu_ps((float*)(d[j + 2] + i * 4), r2);
+    _mm_storeu_ps((float*)(d[j + 3] + i * 4), r3);
+}
+#endif
+
+/* 16-byte elements, e.g. 'double _Complex' */
+typedef struct {
+    uint64_t lo, hi;
+} pair64;
+
+#define SCALAR_TILE(type)                                                      \
+    do {                                                                       \
+        for (size_t i = ib; i < ie; i++) {                                     \
+            const type* row = (const type*)s[i];                               \
+            for (size_t j = jb; j < je; j++)                                   \
+                ((type*)d[j])[i] = row[j];                                     \
+        }                                                                      \
+    } while (0)
+
+/* element by element transpose of [ib, ie) x [jb, je) */
+static void tile_scalar(char* const* d, char* const* s, size_t ib, size_t ie,
+                        size_t jb, size_t je, size_t es) {
+    switch (es) {
+    case 1:
+        SCALAR_TILE(uint8_t);
+        break;
+    case 2:
+        SCALAR_TILE(uint16_t);
+        break;
+    case 4:
+        SCALAR_TILE(uint32_t);
+        break;
+    case 8:
+        SCALAR_TILE(uint64_t);
+        break;
+    case 16:
+        SCALAR_TILE(pair64);
+        break;
+    default:
+        for (size_t i = ib; i < ie; i++)
+            for (size_t j = jb; j < je; j++)
+                memcpy(d[j] + i * es, s[i] + j * es, es);
+        break;
+    }
+}
+
+/* transposes an ni x nj tile, using 4x4 SIMD shuffles where possible */
+static void transpose_tile(char* const* d, char* const* s, size_t ni,
+                           size_t nj, size_t es) {
+    const size_t ni4 = ni & ~(size_t)3;
+    const size_t nj4 = nj & ~(size_t)3;
+#ifdef __AVX__
+    if (es == 8) {
+        for (size_t i = 0; i < ni4; i += 4)
+            for (size_t j = 0; j < nj4; j += 4)
+                kernel4x4_8(d, s, i, j);
+        tile_scalar(d, s, 0, ni4, nj4, nj, es);
+        tile_scalar(d, s, ni4, ni, 0, nj, es);
+        return;
+    }
+#endif
+#ifdef __SSE__
+    if (es == 4) {
+        for (size_t i = 0; i < ni4; i += 4)
+            for (size_t j = 0; j < nj4; j += 4)
+                kernel4x4_4(d, s, i, j);
+        tile_scalar(d, s, 0, ni4, nj4, nj, es);
+        tile_scalar(d, s, ni4, ni, 0, nj, es);
+        return;
+    }
+#endif
+    (void)ni4;
+    (void)nj4;
+    tile_scalar(d, s, 0, ni, 0, nj, es);
+}
+
+/* out-of-place blocked transpose: dst[j][i] = src[i][j], i < n1, j < n2 */
+void __transpose_tables(char* const* dst, char* const* src, size_t n1,
+                        size_t n2, size_t es) {
+    char* s[TILE];
+    char* d[TILE];
+    for (size_t i0 = 0; i0 < n1; i0 += TILE) {
+        const size_t ni = (i0 + TILE < n1) ? TILE : n1 - i0;
+        for (size_t j0 = 0; j0 < n2; j0 += TILE) {
+            const size_t nj = (j0 + TILE < n2) ? TILE : n2 - j0;
+            for (size_t i = 0; i < ni; i++)
+                s[i] = src[i0 + i] + j0 * es;
+            for (size_t j = 0; j < nj; j++)
+                d[j] = dst[j0 + j] + i0 * es;
+            transpose_tile(d, s, ni, nj, es);
+        }
+    }
+}
+
+/* swaps the element at 'a' with the element at 'b' */
+static inline void swap_elem(char* a, char* b, size_t es) {
+    char t[64];
+    for (size_t off = 0; off < es; off += sizeof(t)) {
+        size_t n = (es - off < sizeof(t)) ? es - off : sizeof(t);
+        memcpy(t, a + off, n);
+        memcpy(a + off, b + off, n);
+        memcpy(b + off, t, n);
+    }
+}
+
+/*
+ * Exchanges tile A = [i0, i0 + ni) x [j0, j0 + nj) with the mirrored tile
+ * B = [j0, j0 + nj) x [i0, i0 + ni), transposing both on the way.
+ */
+static void swap_tiles(char* const* lines, size_t i0, size_t ni, size_t j0,
+                       size_t nj, size_t es) {
+    if (es > 16) {
+        for (size_t i = i0; i < i0 + ni; i++)
+            for (size_t j = j0; j < j0 + nj; j++)
+                swap_elem(lines[i] + j * es, lines[j] + i * es, es);
+        return;
+    }
+    /* holds one TILE x TILE tile of up to 16-byte elements */
+    _Alignas(32) char buf[TILE * TILE * 16];
+    char* a[TILE];
+    char* b[TILE];
+    char* t[TILE];
+    for (size_t i = 0; i < ni; i++)
+        a[i] = lines[i0 + i] + j0 * es;
+    for (size_t j = 0; j < nj; j++) {
+        b[j] = lines[j0 + j] + i0 * es;
+        t[j] = buf + j * TILE * es;
+    }
+    transpose_tile(t, a, ni, nj, es); /* t = A^T */
+    transpose_tile(a, b, nj, ni, es); /* A = B^T */
+    for (size_t j = 0; j < nj; j++)   /* B = t */
+        memcpy(b[j], t[j], ni * es);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                              Line Tables                                 */
+/*                                                                          */
+/****************************************************************************/
+
+/* 0-indexed table pointing at element [1] of every line of a matrix */
+static char** matrix_lines(void** mat, size_t nlines, size_t es) {
+    char** lines = malloc((nlines ? nlines : 1) * sizeof(char*));
+    if (!lines) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for transpose line table!\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < nlines; i++)
+        lines[i] = (char*)mat[i + 1] + es;
+    return lines;
+}
+
+/* 0-indexed table pointing at every line of a dense buffer */
+static char** dense_lines(const void* buf, size_t nlines, size_t linelen,
+                          size_t es) {
+    char** lines = malloc((nlines ? nlines : 1) * sizeof(char*));
+    if (!lines) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for transpose line table!\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < nlines; i++)
+        lines[i] = (char*)buf + i * linelen * es;
+    return lines;
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                            Public Functions                              */
+/*                                                                          */
+/****************************************************************************/
+
+void __transpose_lines(void** dst, void** src, size_t nlines, size_t linelen,
+                       size_t elem_size) {
+    char** s = matrix_lines(src, nlines, elem_size);
+    char** d = matrix_lines(dst, linelen, elem_size);
+    if (s && d)
+        __transpose_tables(d, s, nlines, linelen, elem_size);
+    free(s);
+    free(d);
+}
+
+void __transpose_lines_inplace(void** mat, size_t n, size_t elem_size) {
+    char** lines = matrix_lines(mat, n, elem_size);
+    if (!lines)
+        return;
+    for (size_t i0 = 0; i0 < n; i0 += TILE) {
+        const size_t ni = (i0 + TILE < n) ? TILE : n - i0;
+        /* diagonal tile: swap across the diagonal element by element */
+        for (size_t i = i0; i < i0 + ni; i++)
+            for (size_t j = i + 1; j < i0 + ni; j++)
+                swap_elem(lines[i] + j * elem_size, lines[j] + i * elem_size,
+                          elem_size);
+        for (size_t j0 = i0 + ni; j0 < n; j0 += TILE) {
+            const size_t nj = (j0 + TILE < n) ? TILE : n - j0;
+            swap_tiles(lines, i0, ni, j0, nj, elem_size);
+        }
+    }
+    free(lines);
+}
+
+void __lines_to_dense(void* buf, void** mat, size_t nlines, size_t linelen,
+                      size_t elem_size, int transpose) {
+    char** s = matrix_lines(mat, nlines, elem_size);
+    if (!s)
+        return;
+    if (!transpose) {
+        for (size_t i = 0; i < nlines; i++)
+            memcpy((char*)buf + i * linelen * elem_size, s[i],
+                   linelen * elem_size);
+    } else {
+        char** d = dense_lines(buf, linelen, nlines, elem_size);
+        if (d)
+            __transpose_tables(d, s, nlines, linelen, elem_size);
+        free(d);
+    }
+    free(s);
+}
+
+void __lines_from_dense(void** mat, const void* buf, size_t nlines,
+                        size_t linelen, size_t elem_size, int transpose) {
+    char** d = matrix_lines(mat, nlines, elem_size);
+    if (!d)
+        return;
+    if (!transpose) {
+        for (size_t i = 0; i < nlines; i++)
+            memcpy(d[i], (const char*)buf + i * linelen * elem_size,
+                   linelen * elem_size);
+    } else {
+        char** s = dense_lines(buf, linelen, nlines, elem_size);
+        if (s)
+            __transpose_tables(d, s, linelen, nlines, elem_size);
+        free(s);
+    }
+    free(d);
+}
+
+/* pointer to element [1] of the storage line (i0, i1), 0-indexed */
+static inline char* line3(void*** mat, size_t i0, size_t i1, size_t es) {
+    return (char*)mat[i0 + 1][i1 + 1] + es;
+}
+
+void __permute_matrix3(void*** dst, void*** src, const size_t* src_ext,
+                       const int* perm, size_t elem_size) {
+    size_t idx[3];
+    if (perm[2] == 2) {
+        /* contiguous axis is kept: plain line copies */
+        const size_t n0 = src_ext[perm[0]];
+        const size_t n1 = src_ext[perm[1]];
+        for (size_t x0 = 0; x0 < n0; x0++)
+            for (size_t x1 = 0; x1 < n1; x1++) {
+                idx[perm[0]] = x0;
+                idx[perm[1]] = x1;
+                memcpy(line3(dst, x0, x1, elem_size),
+                       line3(src, idx[0], idx[1], elem_size),
+                       src_ext[2] * elem_size);
+            }
+        return;
+    }
+    /*
+     * src axis 's' becomes the contiguous axis of dst, src axis 2 lands on
+     * dst axis 't', and the remaining src axis 'r' maps to dst axis 'u'.
+     * Every slice along 'r' is then a plain 2-D transpose.
+     */
+    const int s = perm[2];
+    const int r = 1 - s;
+    const int t = (perm[0] == 2) ? 0 : 1;
+    const size_t ns = src_ext[s];
+    const size_t n2 = src_ext[2];
+    char** sl = malloc((ns ? ns : 1) * sizeof(char*));
+    char** dl = malloc((n2 ? n2 : 1) * sizeof(char*));
+    if (!sl || !dl) {
+        raise_error(SIMUTIL_ALLOCATE_ERROR,
+                    "NULL allocation for transpose line table!\n");
+        free(sl);
+        free(dl);
+        return;
+    }
+    for (size_t xr = 0; xr < src_ext[r]; xr++) {
+        for (size_t xs = 0; xs < ns; xs++) {
+            idx[r] = xr;
+            idx[s] = xs;
+            sl[xs] = line3(src, idx[0], idx[1], elem_size);
+        }
+        for (size_t y = 0; y < n2; y++) {
+            size_t d[2];
+            d[t] = y;
+            d[1 - t] = xr;
+            dl[y] = line3(dst, d[0], d[1], elem_size);
+        }
+        __transpose_tables(dl, sl, ns, n2, elem_size);
+    }
+    free(sl);
+    free(dl);
+}
@@ -0,0 +1,166 @@
+#ifndef SIMUTIL_TRANSPOSE_H
+#define SIMUTIL_TRANSPOSE_H
+
+#ifndef SIMUTIL_MATRIX_BASE_H
+#include "matrix_base.h"
+#endif
+#ifndef SIMUTIL_MATRIX3_BASE_H
+#include "matrix3_base.h"
+#endif
+
+/* 0-indexed line tables: dst[j][i] = src[i][j] for i < n1, j < n2 */
+SIMUTIL_API void __transpose_tables(char* const* dst, char* const* src,
+                                    size_t n1, size_t n2, size_t elem_size);
+
+SIMUTIL_API void __transpose_lines(void** dst, void** src, size_t nlines,
+                                   size_t linelen, size_t elem_size);
+
+SIMUTIL_API void __transpose_lines_inplace(void** mat, size_t n,
+                                           size_t elem_size);
+
+SIMUTIL_API void __lines_to_dense(void* buf, void** mat, size_t nlines,
+                                  size_t linelen, size_t elem_size,
+                                  int transpose);
+
+SIMUTIL_API void __lines_from_dense(void** mat, const void* buf, size_t nlines,
+                                    size_t linelen, size_t elem_size,
+                                    int transpose);
+
+SIMUTIL_API void __permute_matrix3(void*** dst, void*** src,
+                                   const size_t* src_ext, const int* perm,
+                                   size_t elem_size);
+
+/****************************************************************************/
+/*                                                                          */
+/*                             Matrix Transpose                             */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to set 'dst' to the transpose of 'src' using cache-blocked,
+ * SIMD-shuffled tiles. 'dst' must have as many columns as 'src' has rows and
+ * vice versa.
+ *
+ * @param dst Target matrix
+ * @param src Source matrix
+ */
+#define transpose_matrix(_dst, _src)                                           \
+    do {                                                                       \
+        __typeof__(_dst) dst = (_dst);                                         \
+        __typeof__(_src) src = (_src);                                         \
+        if (COLS(dst) != ROWS(src) || ROWS(dst) != COLS(src) ||                \
+            sizeof(**dst) != sizeof(**src)) {                                  \
+            raise_error(                                                       \
+                SIMUTIL_DIMENSION_ERROR,                                       \
+                "Unmatching matrix dimensions @ transpose_matrix!\n");         \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __transpose_lines((void**)dst, (void**)src, MATRIX_NLINES(src),        \
+                          MATRIX_LINELEN(src), sizeof(**src));                 \
+    } while (0)
+
+/**
+ * @brief Macro to transpose a square matrix in place.
+ *
+ * @param mat Square matrix to transpose
+ */
+#define transpose_matrix_inplace(_mat)                                         \
+    do {                                                                       \
+        __typeof__(_mat) mat = (_mat);                                         \
+        if (ROWS(mat) != COLS(mat)) {                                          \
+            raise_error(SIMUTIL_DIMENSION_ERROR,                               \
+                        "Non-square matrix @ transpose_matrix_inplace!\n");    \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __transpose_lines_inplace((void**)mat, ROWS(mat), sizeof(**mat));      \
+    } while (0)
+
+/****************************************************************************/
+/*                                                                          */
+/*                            Layout Conversion                             */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macros to copy a matrix into a dense, 0-indexed C array of
+ * ROWS(mat) * COLS(mat) elements in column-major or row-major order,
+ * regardless of the layout the matrix itself was built with.
+ *
+ * @param buf Pointer to the first element of the dense array
+ * @param mat Source matrix
+ */
+#define matrix_to_col_major(buf, mat)                                          \
+    __lines_to_dense((void*)(buf), (void**)(mat), MATRIX_NLINES(mat),          \
+                     MATRIX_LINELEN(mat), sizeof(**(mat)),                     \
+                     !__SIMUTIL_LINES_ARE_COLS)
+
+#define matrix_to_row_major(buf, mat)                                          \
+    __lines_to_dense((void*)(buf), (void**)(mat), MATRIX_NLINES(mat),          \
+                     MATRIX_LINELEN(mat), sizeof(**(mat)),                     \
+                     __SIMUTIL_LINES_ARE_COLS)
+
+/**
+ * @brief Macros to fill a matrix from a dense, 0-indexed C array of
+ * ROWS(mat) * COLS(mat) elements in column-major or row-major order.
+ *
+ * @param mat Target matrix
+ * @param buf Pointer to the first element of the dense array
+ */
+#define matrix_from_col_major(mat, buf)                                        \
+    __lines_from_dense((void**)(mat), (const void*)(buf), MATRIX_NLINES(mat),  \
+                       MATRIX_LINELEN(mat), sizeof(**(mat)),                   \
+                       !__SIMUTIL_LINES_ARE_COLS)
+
+#define matrix_from_row_major(mat, buf)                                        \
+    __lines_from_dense((void**)(mat), (const void*)(buf), MATRIX_NLINES(mat),  \
+                       MATRIX_LINELEN(mat), sizeof(**(mat)),                   \
+                       __SIMUTIL_LINES_ARE_COLS)
+
+/****************************************************************************/
+/*                                                                          */
+/*                           matrix3 Permutation                            */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to permute the axes of a matrix3. Axes are numbered 0, 1, 2 in
+ * indexing order, and 'dst[x0][x1][x2]' is set to the element of 'src' whose
+ * index along axis 'a0' is x0, along 'a1' is x1 and along 'a2' is x2. The
+ * storage extents of 'dst' must be the permuted extents of 'src'.
+ *
+ * @param dst Target matrix3
+ * @param src Source matrix3
+ * @param a0 Source axis that becomes the first index of 'dst'
+ * @param a1 Source axis that becomes the second index of 'dst'
+ * @param a2 Source axis that becomes the third index of 'dst'
+ */
+#define permute_matrix3(_dst, _src, a0, a1, a2)                                \
+    do {                                                                       \
+        __typeof__(_dst) dst = (_dst);                                         \
+        __typeof__(_src) src = (_src);                                         \
+        const int perm[3] = {(a0), (a1), (a2)};                                \
+        const size_t src_ext[3] = {MATRIX3_EXT1(src), MATRIX3_EXT2(src),       \
+                                   MATRIX3_EXT3(src)};                         \
+        const size_t dst_ext[3] = {MATRIX3_EXT1(dst), MATRIX3_EXT2(dst),       \
+                                   MATRIX3_EXT3(dst)};                         \
+        if (perm[0] < 0 || perm[0] > 2 || perm[1] < 0 || perm[1] > 2 ||        \
+            perm[2] < 0 || perm[2] > 2 || perm[0] == perm[1] ||                \
+            perm[0] == perm[2] || perm[1] == perm[2]) {                        \
+            raise_error(SIMUTIL_DEFAULT_ERROR,                                 \
+                        "Invalid axis permutation @ permute_matrix3!\n");      \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        if (dst_ext[0] != src_ext[perm[0]] ||                                  \
+            dst_ext[1] != src_ext[perm[1]] ||                                  \
+            dst_ext[2] != src_ext[perm[2]] ||                                  \
+            sizeof(***dst) != sizeof(***src)) {                                \
+            raise_error(                                                       \
+                SIMUTIL_DIMENSION_ERROR,                                       \
+                "Unmatching matrix3 dimensions @ permute_matrix3!\n");         \
+            exit(EXIT_FAILURE);                                                \
+        }                                                                      \
+        __permute_matrix3((void***)dst, (void***)src, src_ext, perm,           \
+                          sizeof(***src));                                     \
+    } while (0)
+
+#endif
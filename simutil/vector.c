@@ -1,5 +1,6 @@
 #include "vector.h"
 #include "error.h"
+#include "profile.h"
 #include <string.h>
 
 #define __VECTOR_NULLCHECK(p)                                                  \
@@ -12,14 +13,47 @@
         }                                                                      \
     } while (0)
 
+/*
+ * realloc for the memory of a vector holding 'old_size' bytes. Memory shared
+ * with other owners is left to them: the caller gets a private copy and gives
+ * up its share.
+ */
+static void* realloc_vector(void* vec_start, size_t old_size,
+                            size_t new_size) {
+    size_t* refs = (size_t*)vec_start + 1;
+    if (__atomic_load_n(refs, __ATOMIC_ACQUIRE) == 1) {
+        SIMUTIL_PROF_ADDR(old_addr, vec_start);
+        void* out = realloc(vec_start, new_size);
+        if (out)
+            SIMUTIL_PROF_FREE(old_addr);
+        return out;
+    }
+    void* out = malloc(new_size);
+    if (!out)
+        return NULL;
+    memcpy(out, vec_start, old_size < new_size ? old_size : new_size);
+    *((size_t*)out + 1) = 1;
+    if (__atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        SIMUTIL_PROF_FREE(vec_start);
+        free(vec_start);
+    }
+    return out;
+}
+
 int __append_element(void** vec_mem, void* elem, size_t elem_size) {
     __VECTOR_NULLCHECK(*vec_mem);
     __VECTOR_NULLCHECK(vec_mem);
     const int new_length = LENGTH(*vec_mem) + 1;
     void* vec_start = (void*)((char*)*vec_mem - VECTOR_SIZE_BYTE);
-    void* vec_start_new = realloc(vec_start, new_length * elem_size +
-                                                 VECTOR_SIZE_BYTE + elem_size);
+    const size_t new_size =
+        new_length * elem_size + VECTOR_SIZE_BYTE + elem_size;
+    const size_t old_size =
+        (size_t)LENGTH(*vec_mem) * elem_size + VECTOR_SIZE_BYTE + elem_size;
+    SIMUTIL_PROF_START(prof_start);
+    void* vec_start_new = realloc_vector(vec_start, old_size, new_size);
     __VECTOR_NULLCHECK(vec_start_new);
+    SIMUTIL_PROF_ALLOC(SIMUTIL_PROF_APPEND_ELEMENT, vec_start_new, new_size,
+                       prof_start);
     *(((size_t*)vec_start_new) + 0) = new_length;
     memcpy((void*)((char*)vec_start_new + new_length * elem_size +
                    VECTOR_SIZE_BYTE),
@@ -33,9 +67,15 @@ int __resize_vector(void** vec_mem, size_t new_length, size_t elem_size) {
     __VECTOR_NULLCHECK(*vec_mem);
     __VECTOR_NULLCHECK(vec_mem);
     void* vec_start = (void*)((char*)*vec_mem - VECTOR_SIZE_BYTE);
-    void* vec_start_new = realloc(vec_start, new_length * elem_size +
-                                                 VECTOR_SIZE_BYTE + elem_size);
+    const size_t new_size =
+        new_length * elem_size + VECTOR_SIZE_BYTE + elem_size;
+    const size_t old_size =
+        (size_t)LENGTH(*vec_mem) * elem_size + VECTOR_SIZE_BYTE + elem_size;
+    SIMUTIL_PROF_START(prof_start);
+    void* vec_start_new = realloc_vector(vec_start, old_size, new_size);
     __VECTOR_NULLCHECK(vec_start_new);
+    SIMUTIL_PROF_ALLOC(SIMUTIL_PROF_RESIZE_VECTOR, vec_start_new, new_size,
+                       prof_start);
     *(((size_t*)vec_start_new) + 0) = new_length;
     char* out = (char*)vec_start_new;
     *(vec_mem) = (void*)(out + VECTOR_SIZE_BYTE);
@@ -13,6 +13,7 @@
  */
 #define FROM_VECTOR(from, _targ, _size)                                        \
     do {                                                                       \
+        SIMUTIL_PROF_START(prof_start);                                        \
         int size = (int)(_size);                                               \
         __typeof__(_targ) targ = (_targ);                                      \
         if (LENGTH(targ) != size)                                              \
@@ -21,11 +22,13 @@
         for (int i = 0; i < (int)size; i++) {                                  \
             targ[i + 1] = (from)[i];                                           \
         }                                                                      \
+        SIMUTIL_PROF_OPS(SIMUTIL_PROF_FROM_VECTOR, size, prof_start);          \
     } while (0)
 
-int __resize_vector(void** vec_mem, size_t new_length, size_t elem_size);
+SIMUTIL_API int __resize_vector(void** vec_mem, size_t new_length,
+                                size_t elem_size);
 
-int __append_element(void** vec_mem, void* elem, size_t elem_size);
+SIMUTIL_API int __append_element(void** vec_mem, void* elem, size_t elem_size);
 
 #define grow_vector(vec, elem)                                                 \
     do {                                                                       \
@@ -43,40 +46,32 @@ int __append_element(void** vec_mem, void* elem, size_t elem_size);
     } while (0)
 
 // macro to generate printing functions
-#define PRINT_FUNC(name, type, fmt)                                            \
-    static inline void __print##name##_v(FILE* fp, type vec) {                 \
+#if __SIMUTIL_KERNEL_BODY
+#define PRINT_FUNC(name, T, fmt, arg)                                          \
+    __SIMUTIL_KERNEL void __print##name##_v(FILE* fp, vector(T) vec) {         \
         const int length = LENGTH(vec);                                        \
         if (fp == stdout || fp == stderr)                                      \
             fprintf(fp, "[");                                                  \
         for (int i = 1; i <= length; i++) {                                    \
             if (i != length) {                                                 \
-                fprintf(fp, fmt, vec[i]);                                      \
+                fprintf(fp, fmt, arg(vec[i]));                                 \
                 fprintf(fp, ", ");                                             \
             } else                                                             \
-                fprintf(fp, fmt, vec[i]);                                      \
+                fprintf(fp, fmt, arg(vec[i]));                                 \
         }                                                                      \
         if (fp == stdout || fp == stderr)                                      \
             fprintf(fp, "]\n");                                                \
         else                                                                   \
             fprintf(fp, "\n");                                                 \
     }
+#else
+#define PRINT_FUNC(name, T, fmt, arg)                                          \
+    SIMUTIL_API void __print##name##_v(FILE* fp, vector(T) vec);
+#endif
 
-// printing floating-point numbers
-PRINT_FUNC(_float, vector(float), "%6.3f")
-PRINT_FUNC(_double, vector(double), "%6.3f")
-PRINT_FUNC(_long_double, vector(long double), "%6.3Lf")
-
-// printing integers / char
-PRINT_FUNC(_char, vector(char), "%c")
-PRINT_FUNC(_uchar, vector(unsigned char), "%3d")
-PRINT_FUNC(_short, vector(short), "%3hd")
-PRINT_FUNC(_ushort, vector(unsigned short), "%3hd")
-PRINT_FUNC(_int, vector(int), "%3d")
-PRINT_FUNC(_uint, vector(unsigned int), "%3u")
-PRINT_FUNC(_long, vector(long), "%3ld")
-PRINT_FUNC(_ulong, vector(unsigned long), "%3lu")
+SIMUTIL_ELEM_TYPES(PRINT_FUNC)
 
-#define print_vector(vec)                                                      \
+#define __PRINT_VECTOR_FUNC(vec)                                               \
     _Generic((vec),                                                            \
         vector(char): __print_char_v,                                          \
         vector(unsigned char): __print_uchar_v,                                \
@@ -88,21 +83,14 @@ PRINT_FUNC(_ulong, vector(unsigned long), "%3lu")
         vector(unsigned long): __print_ulong_v,                                \
         vector(float): __print_float_v,                                        \
         vector(double): __print_double_v,                                      \
-        vector(long double): __print_long_double_v)(stdout, vec)
+        vector(float _Complex): __print_cfloat_v,                              \
+        vector(double _Complex): __print_cdouble_v,                            \
+        vector(long double): __print_long_double_v,                            \
+        vector(dual): __print_dual_v)
 
-#define fprint_vector(fp, vec)                                                 \
-    _Generic((vec),                                                            \
-        vector(char): __print_char_v,                                          \
-        vector(unsigned char): __print_uchar_v,                                \
-        vector(short): __print_short_v,                                        \
-        vector(unsigned short): __print_ushort_v,                              \
-        vector(int): __print_int_v,                                            \
-        vector(unsigned int): __print_uint_v,                                  \
-        vector(long): __print_long_v,                                          \
-        vector(unsigned long): __print_ulong_v,                                \
-        vector(float): __print_float_v,                                        \
-        vector(double): __print_double_v,                                      \
-        vector(long double): __print_long_double_v)(fp, vec)
+#define print_vector(vec) __PRINT_VECTOR_FUNC(vec)(stdout, vec)
+
+#define fprint_vector(fp, vec) __PRINT_VECTOR_FUNC(vec)(fp, vec)
 
 #undef PRINT_FUNC
 #endif
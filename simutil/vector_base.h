@@ -2,11 +2,15 @@
 #define SIMUTIL_VECTOR_BASE_H
 
 #include "error.h"
+#include "kernels.h"
+#include "profile.h"
 #include "simutil_includes.h"
+#include <string.h>
 
 #define vector(T) T*
 
-#define VECTOR_SIZE_BYTE (size_t)(sizeof(size_t) * 1)
+/* Metadata memory size: the length, then the reference count */
+#define VECTOR_SIZE_BYTE (size_t)(sizeof(size_t) * 2)
 
 /****************************************************************************/
 /*                                                                          */
@@ -20,24 +24,95 @@
  */
 #define LENGTH(vec) ((int)(*((size_t*)(((char*)(vec) - VECTOR_SIZE_BYTE)) + 0)))
 
-static inline void* __init_vector(size_t size, size_t n_elem) {
+/**
+ * @brief Macro to access the number of owners sharing the vector's memory
+ *
+ */
+#define VECTOR_REFS(vec) (*((size_t*)(((char*)(vec) - VECTOR_SIZE_BYTE)) + 1))
+
+#if __SIMUTIL_KERNEL_BODY
+__SIMUTIL_KERNEL void* __init_vector(size_t size, size_t n_elem) {
+    SIMUTIL_PROF_START(prof_start);
     void* vec_start = calloc(1, size);
     SIMUTIL_NULLPTR_CHECK(vec_start);
+    SIMUTIL_PROF_ALLOC(SIMUTIL_PROF_INIT_VECTOR, vec_start, size, prof_start);
     *(((size_t*)vec_start) + 0) = n_elem;
+    *(((size_t*)vec_start) + 1) = 1;
     char* out = (char*)vec_start + VECTOR_SIZE_BYTE;
     SIMUTIL_NULLPTR_CHECK(out);
     return (void*)out;
 }
+#else
+SIMUTIL_API void* __init_vector(size_t size, size_t n_elem);
+#endif
 
 #define new_vector(T, length)                                                  \
     ((vector(T))__init_vector(                                                 \
         sizeof(T) * ((size_t)(length) + 1) + VECTOR_SIZE_BYTE, (length)))
 
+/**
+ * @brief Macro to release a vector. The memory is freed when the last owner
+ * (see 'share_vector') releases it.
+ *
+ * @param vec Vector to free
+ */
 #define free_vector(vec)                                                       \
     do {                                                                       \
         void* vec_mem = (void*)((char*)(vec) - VECTOR_SIZE_BYTE);              \
-        free(vec_mem);                                                         \
+        if (__atomic_sub_fetch(&VECTOR_REFS(vec), 1, __ATOMIC_ACQ_REL) == 0) { \
+            SIMUTIL_PROF_FREE(vec_mem);                                        \
+            free(vec_mem);                                                     \
+        }                                                                      \
         vec_mem = NULL;                                                        \
     } while (0)
 
+/****************************************************************************/
+/*                                                                          */
+/*                              Shared Vectors                              */
+/*                                                                          */
+/****************************************************************************/
+
+/**
+ * @brief Macro to add an owner to a vector in O(1). Returns the same pointer,
+ * which must be released with 'free_vector' like any other vector. Owners
+ * only read the shared memory; call 'cow_vector' before writing to it.
+ *
+ * @param vec Vector to share
+ */
+#define share_vector(vec)                                                      \
+    (__atomic_add_fetch(&VECTOR_REFS(vec), 1, __ATOMIC_RELAXED), (vec))
+
+/**
+ * @brief Function to give a shared vector memory of its own, releasing the
+ * caller's share of the old memory. Returns 'vec' itself when the caller is
+ * the only owner.
+ *
+ * @param vec Vector to detach
+ * @param elem_size The size of a single element in the vector
+ */
+#if __SIMUTIL_KERNEL_BODY
+__SIMUTIL_KERNEL void* __cow_vector(void* vec, size_t elem_size) {
+    if (__atomic_load_n(&VECTOR_REFS(vec), __ATOMIC_ACQUIRE) == 1)
+        return vec;
+    const size_t n_elem = (size_t)LENGTH(vec);
+    char* out = (char*)__init_vector(
+        elem_size * (n_elem + 1) + VECTOR_SIZE_BYTE, n_elem);
+    memcpy(out + elem_size, (char*)vec + elem_size, n_elem * elem_size);
+    free_vector(vec);
+    return (void*)out;
+}
+#else
+SIMUTIL_API void* __cow_vector(void* vec, size_t elem_size);
+#endif
+
+/**
+ * @brief Macro to make a vector safe to write to. A vector with other owners
+ * is replaced by a private copy, so that the other owners keep seeing the
+ * values from before the write.
+ *
+ * @param vec Vector to detach, assigned the copy if one is made
+ */
+#define cow_vector(vec)                                                        \
+    ((vec) = (__typeof__(vec))__cow_vector((vec), sizeof(*(vec))))
+
 #endif